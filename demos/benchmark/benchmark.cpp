@@ -0,0 +1,1350 @@
+/*
+ Performance benchmarks of OpenGLSE internals.
+
+ usage: run the program, it measures the engine functions and writes
+        the results to stdout
+
+ Miloslav Číž, 2014
+ */
+
+#include "../../openglse.hpp"
+#include <chrono>
+#include <stdlib.h>
+#include <dirent.h>
+#include <unistd.h>
+
+using namespace gl_se;
+
+#define REPEAT 5                // how many times each measurement is repeated (the best time is taken)
+#define PLANE_RESOLUTION 500
+#define MATRIX_ITERATIONS 1000000  // number of matrix operations per measurement
+#define SCENE_NODES 10000          // number of nodes in the transform hierarchy benchmark
+#define SCENE_CHILDREN 4           // children of each inner node
+#define ROTATING_OBJECTS 10000     // number of meshes in the rotation benchmark
+#define FUR_LAYERS 30              // shells of the fur-like mesh in the vertex format benchmark
+#define OVERDRAW_VIEWPOINTS 32     // directions the overdraw is measured from
+#define CULLING_FRAMES 36          // camera positions the meshlet culling is measured from
+#define CULLING_TERRAIN_RESOLUTION 1000
+#define BATCHED_MESHES 1000        // small meshes in the static batching benchmark
+#define ARENA_TEXTS 2000           // texts made in the buffer arena benchmark
+#define FULL_SCREEN_LAYERS 200     // full-screen Phong shaded quads drawn in the shader variant benchmark
+#define MORPH_FRAMES 100           // frames of the morph animation benchmark
+#define MORPH_RESOLUTION 100       // plane resolution of each morph animation frame
+#define SKIN_BONES 32              // bones of the skinned plane, same keys as the morph animation frames
+#define SKIN_POSES 1000            // poses computed in the skinning benchmark
+#define CROWD_INSTANCES 1000       // animated instances in the crowd benchmark
+#define CROWD_FRAMES 8             // frames of the crowd's animation
+#define RAIL_KEYS 5000             // keyframes of each camera rail interpolator
+#define RAIL_SAMPLES 100000        // points the camera rail is evaluated in
+#define ATLAS_PROPS 100            // props with a texture each in the texture atlas benchmark
+#define COMPRESSED_TEXTURE_SIZE 2048  // width and height of the texture in the texture compression benchmark
+#define RESIDENT_MESHES 200        // static meshes in the residency benchmark
+#define TRACKED_MESHES 500         // meshes in the memory tracker benchmark
+
+static void render_scene()
+  {
+  }
+
+double measure_ms(function<void()> what)   // runs the function REPEAT times and returns the best time in ms
+
+  {
+    unsigned int i;
+    double best = numeric_limits<double>::max();
+
+    for (i = 0; i < REPEAT; i++)
+      {
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        what();
+        chrono::duration<double,milli> duration = chrono::high_resolution_clock::now() - start;
+
+        if (duration.count() < best)
+          best = duration.count();
+      }
+
+    return best;
+  }
+
+string make_temporary_directory()         // makes a new empty directory for the cache benchmarks, so that their first pass is really cold
+
+  {
+    char name[] = "/tmp/openglse_benchmark_XXXXXX";
+
+    if (mkdtemp(name) == NULL)
+      {
+        cerr << "ERROR: couldn't make a temporary directory, the cache is off." << endl;
+        return "";
+      }
+
+    return name;
+  }
+
+void remove_temporary_directory(string directory)   // deletes the directory made by make_temporary_directory with the cache files in it
+
+  {
+    DIR *handle;
+    struct dirent *entry;
+
+    if (directory.length() == 0 || (handle = opendir(directory.c_str())) == NULL)
+      return;
+
+    while ((entry = readdir(handle)) != NULL)
+      if (strcmp(entry->d_name,".") != 0 && strcmp(entry->d_name,"..") != 0)
+        remove((directory + "/" + entry->d_name).c_str());
+
+    closedir(handle);
+    rmdir(directory.c_str());
+  }
+
+void benchmark_job_system()                // engine bulk loops with the job system on 1 to 32 threads
+
+  {
+    unsigned int thread_counts[] = {1,2,4,8,16,32};
+    unsigned int i,j;
+    float matrix[4][4];
+    float x0,y0,z0,x1,y1,z1;
+    texture_2d heightmap;
+    mesh_3d_static *mesh;
+
+    heightmap.initialise(512,512);
+
+    for (j = 0; j < 512; j++)
+      for (i = 0; i < 512; i++)
+        heightmap.set_pixel(i,j,(i * j) % 256,0,0);
+
+    mesh = make_plane(10,10,PLANE_RESOLUTION,PLANE_RESOLUTION);
+    make_rotation_matrix(1,2,3,ROTATION_ZXY,matrix);
+
+    cout << "job system scaling (" << mesh->vertex_count() << " vertices, " << mesh->triangle_count() << " triangles, best of " << REPEAT << ", ms):" << endl;
+    cout << "threads  apply_matrix  smooth_normals  texture_map_plane  bounding_box  make_terrain" << endl;
+
+    for (i = 0; i < sizeof(thread_counts) / sizeof(unsigned int); i++)
+      {
+        init_job_system(thread_counts[i]);
+
+        cout << setw(7) << thread_counts[i];
+        cout << setw(14) << measure_ms([&]{ mesh->apply_matrix(matrix); });
+        cout << setw(16) << measure_ms([&]{ mesh->smooth_normals(); });
+        cout << setw(19) << measure_ms([&]{ mesh->texture_map_plane(DIRECTION_FORWARD,1,1); });
+        cout << setw(14) << measure_ms([&]{ mesh->get_bounding_box(&x0,&y0,&z0,&x1,&y1,&z1); });
+        cout << setw(14) << measure_ms([&]{ delete make_terrain(10,10,1,PLANE_RESOLUTION,PLANE_RESOLUTION,&heightmap); });
+        cout << endl;
+      }
+
+    cout << endl;
+
+    init_job_system();
+    delete mesh;
+  }
+
+void reference_multiply_matrices(float matrix_a[4][4], float matrix_b[4][4], float matrix_result[4][4])   // the original scalar version
+
+  {
+    unsigned int i,j;
+
+    for (j = 0; j < 4; j++)
+      for (i = 0; i < 4; i++)
+        matrix_result[i][j] =
+          matrix_b[0][j] * matrix_a[i][0] +
+          matrix_b[1][j] * matrix_a[i][1] +
+          matrix_b[2][j] * matrix_a[i][2] +
+          matrix_b[3][j] * matrix_a[i][3];
+  }
+
+void reference_multiply_vector_matrix(float vector[4], float matrix[4][4], float vector_result[4])     // the original scalar version
+
+  {
+    unsigned int i;
+
+    for (i = 0; i < 4; i++)
+      vector_result[i] = vector[0] * matrix[i][0] + vector[1] * matrix[i][1] +
+                         vector[2] * matrix[i][2] + vector[3] * matrix[i][3];
+  }
+
+void benchmark_matrix_math()               // SIMD matrix functions against the original scalar ones
+
+  {
+    unsigned int i;
+    float rotation[4][4],translation[4][4],scale[4][4],helper[4][4],result[4][4];
+    float test_vector[4],vector_result[4];
+    matrix_4x4 rotation_4x4,result_4x4;
+    vector_4d vector_4x4,vector_result_4x4;
+    vector<vertex_3d> points(MATRIX_ITERATIONS);
+    mesh_3d_static *mesh,*plane;
+    double time;
+    volatile float sink;
+
+    make_rotation_matrix(10,20,30,ROTATION_ZXY,rotation);
+    make_translation_matrix(1,2,3,translation);
+    make_scale_matrix(2,2,2,scale);
+    memcpy(rotation_4x4.m,rotation,sizeof(rotation));
+    make_identity_matrix(result);
+
+    for (i = 0; i < 4; i++)
+      test_vector[i] = i + 1;
+
+    memcpy(vector_4x4.v,test_vector,sizeof(test_vector));
+
+    for (i = 0; i < points.size(); i++)
+      {
+        points[i].position.x = i % 100;
+        points[i].position.y = i % 37;
+        points[i].position.z = i % 11;
+      }
+
+    mesh = make_cuboid(1,1,1);
+
+    cout << "matrix math (" << MATRIX_ITERATIONS << " operations, best of " << REPEAT << ", ms):" << endl;
+
+    #if defined(OPENGLSE_AVX)
+      cout << "(AVX kernels)" << endl;
+    #elif defined(OPENGLSE_SSE)
+      cout << "(SSE kernels)" << endl;
+    #elif defined(OPENGLSE_NEON)
+      cout << "(NEON kernels)" << endl;
+    #else
+      cout << "(scalar kernels)" << endl;
+    #endif
+
+    cout << "matrix * matrix, original:          " << measure_ms([&]{ for (i = 0; i < MATRIX_ITERATIONS; i++) { reference_multiply_matrices(result,rotation,helper); memcpy(result,helper,sizeof(helper)); } }) << endl;
+    cout << "matrix * matrix, multiply_matrices: " << measure_ms([&]{ for (i = 0; i < MATRIX_ITERATIONS; i++) multiply_matrices(result,rotation,result); }) << endl;
+    cout << "matrix * matrix, 4x4:               " << measure_ms([&]{ for (i = 0; i < MATRIX_ITERATIONS; i++) multiply_matrices_4x4(&result_4x4,&rotation_4x4,&result_4x4); }) << endl;
+    cout << "matrix * matrix, affine:            " << measure_ms([&]{ for (i = 0; i < MATRIX_ITERATIONS; i++) multiply_matrices_affine(&result_4x4,&rotation_4x4,&result_4x4); }) << endl;
+    cout << "affine inverse:                     " << measure_ms([&]{ for (i = 0; i < MATRIX_ITERATIONS; i++) invert_matrix_affine(&result_4x4,&result_4x4); }) << endl;
+    cout << "matrix * vector, original:          " << measure_ms([&]{ for (i = 0; i < MATRIX_ITERATIONS; i++) { reference_multiply_vector_matrix(test_vector,rotation,vector_result); memcpy(test_vector,vector_result,sizeof(test_vector)); } }) << endl;
+    cout << "matrix * vector, 4x4:               " << measure_ms([&]{ for (i = 0; i < MATRIX_ITERATIONS; i++) { multiply_vector_matrix_4x4(&vector_4x4,&rotation_4x4,&vector_result_4x4); vector_4x4 = vector_result_4x4; } }) << endl;
+    cout << "T * R * S, original (2 multiplies): " << measure_ms([&]{ for (i = 0; i < MATRIX_ITERATIONS; i++) { reference_multiply_matrices(translation,rotation,helper); reference_multiply_matrices(helper,scale,result); } }) << endl;
+    cout << "mesh set_position (composed):       " << measure_ms([&]{ for (i = 0; i < MATRIX_ITERATIONS; i++) mesh->set_position(i,0,0); }) << endl;
+    cout << "points loop, original:              " << measure_ms([&]{
+        for (i = 0; i < points.size(); i++)
+          {
+            float helper_vector[4] = {points[i].position.x,points[i].position.y,points[i].position.z,1};
+            reference_multiply_vector_matrix(helper_vector,rotation,vector_result);
+            points[i].position.x = vector_result[0];
+            points[i].position.y = vector_result[1];
+            points[i].position.z = vector_result[2];
+          }
+      }) << endl;
+    cout << "points batch, transform_points:     " << measure_ms([&]{ transform_points(&rotation_4x4,&points[0].position.x,points.size(),sizeof(vertex_3d),1.0); }) << endl;
+
+    plane = make_plane(10,10,PLANE_RESOLUTION,PLANE_RESOLUTION);
+    time = measure_ms([&]{ plane->apply_matrix(rotation); });
+    cout << "apply_matrix (" << plane->vertex_count() << " vertices):    " << time << " (" << (plane->vertex_count() * sizeof(vertex_3d) * 2) / (time * 1000000.0) << " GB/s read + written)" << endl;
+    cout << endl;
+
+    delete plane;
+
+    sink = result[0][0] + result_4x4.m[0][0] + test_vector[0] + vector_4x4.v[0] + points[0].position.x;
+    (void) sink;
+
+    delete mesh;
+  }
+
+void benchmark_scene_nodes()               // transform hierarchy updates
+
+  {
+    unsigned int i,frame;
+    vector<scene_node *> nodes;
+    float matrix[4][4];
+    point_3d position;
+
+    nodes.push_back(new scene_node());
+
+    for (i = 1; i < SCENE_NODES; i++)     // a tree where node i is a child of node (i - 1) / SCENE_CHILDREN
+      {
+        nodes.push_back(new scene_node());
+        nodes[i]->set_position(1,0,0);
+        nodes[i]->set_parent(nodes[(i - 1) / SCENE_CHILDREN]);
+      }
+
+    update_scene_nodes();
+    frame = 0;
+
+    cout << "scene nodes (" << SCENE_NODES << " nodes, best of " << REPEAT << ", ms):" << endl;
+    cout << "all nodes animated:        " << measure_ms([&]{
+        frame++;
+
+        for (i = 0; i < nodes.size(); i++)
+          nodes[i]->set_rotation(0,frame,0);
+
+        update_scene_nodes();
+      }) << endl;
+    cout << "only the root animated:    " << measure_ms([&]{ frame++; nodes[0]->set_rotation(0,frame,0); update_scene_nodes(); }) << endl;
+    cout << "one leaf animated:         " << measure_ms([&]{ frame++; nodes.back()->set_rotation(0,frame,0); update_scene_nodes(); }) << endl;
+    cout << "by hand (walk to the root): " << measure_ms([&]{
+        for (i = 0; i < nodes.size(); i++)       // what the scenes did before: multiply the chain for every object
+          {
+            scene_node *node = nodes[i];
+
+            make_identity_matrix(matrix);
+
+            while (node != NULL)
+              {
+                float local[4][4],helper[4][4];
+
+                node->get_position(&position);
+                make_translation_matrix(position.x,position.y,position.z,local);
+                multiply_matrices(local,matrix,helper);
+                memcpy(matrix,helper,sizeof(helper));
+                node = node->get_parent();
+              }
+          }
+      }) << endl;
+    cout << endl;
+
+    for (i = 0; i < nodes.size(); i++)
+      delete nodes[i];
+  }
+
+void benchmark_rotations()                 // many rotating objects, Euler angles against quaternions
+
+  {
+    unsigned int i,frame;
+    vector<mesh_3d_static *> meshes;
+    float translation[4][4],rotation[4][4],scale[4][4],helper[4][4],matrix[4][4];
+    quaternion step;
+    volatile float sink = 0;
+
+    for (i = 0; i < ROTATING_OBJECTS; i++)
+      {
+        meshes.push_back(new mesh_3d_static());
+        meshes[i]->set_position(i,0,0);
+      }
+
+    make_quaternion(0,1,0.5,ROTATION_ZXY,&step);   // made once, used every frame
+    make_translation_matrix(1,2,3,translation);
+    make_scale_matrix(1,1,1,scale);
+    frame = 0;
+
+    cout << "rotations (" << ROTATING_OBJECTS << " objects, best of " << REPEAT << ", ms):" << endl;
+    cout << "original (angles, matrix, 2 multiplies): " << measure_ms([&]{
+        frame++;
+
+        for (i = 0; i < ROTATING_OBJECTS; i++)
+          {
+            make_rotation_matrix(0,frame + i,0.5 * frame,ROTATION_ZXY,rotation);
+            reference_multiply_matrices(translation,rotation,helper);
+            reference_multiply_matrices(helper,scale,matrix);
+            sink = sink + matrix[0][0];
+          }
+      }) << endl;
+    cout << "set_rotation + matrix:                   " << measure_ms([&]{
+        frame++;
+
+        for (i = 0; i < ROTATING_OBJECTS; i++)
+          {
+            meshes[i]->set_rotation(0,frame + i,0.5 * frame);
+            meshes[i]->get_transformation_matrix(matrix);
+            sink = sink + matrix[0][0];
+          }
+      }) << endl;
+    cout << "rotate (quaternion) + matrix:            " << measure_ms([&]{
+        for (i = 0; i < ROTATING_OBJECTS; i++)
+          {
+            meshes[i]->rotate(step);
+            meshes[i]->get_transformation_matrix(matrix);
+            sink = sink + matrix[0][0];
+          }
+      }) << endl;
+    cout << "rotate (quaternion), matrix not needed:  " << measure_ms([&]{
+        for (i = 0; i < ROTATING_OBJECTS; i++)
+          meshes[i]->rotate(step);
+      }) << endl;
+    cout << "camera.rotate x " << ROTATING_OBJECTS << ":                  " << measure_ms([&]{
+        for (i = 0; i < ROTATING_OBJECTS; i++)
+          camera.rotate(0,0.01,0);
+      }) << endl;
+    cout << endl;
+
+    camera.set_rotation(0,0,0);
+
+    for (i = 0; i < meshes.size(); i++)
+      delete meshes[i];
+  }
+
+GLint vbo_size(mesh_3d_static *mesh)     // size of the mesh's VBO as reported by the driver
+
+  {
+    GLuint vbo,ibo,vao;
+    GLint size;
+
+    mesh->get_vbo_ibo_vao(&vbo,&ibo,&vao);
+    glBindBuffer(GL_ARRAY_BUFFER,vbo);
+    glGetBufferParameteriv(GL_ARRAY_BUFFER,GL_BUFFER_SIZE,&size);
+    glBindBuffer(GL_ARRAY_BUFFER,0);
+    return size;
+  }
+
+void benchmark_vertex_formats()            // VBO memory of the float and compact vertex formats
+
+  {
+    unsigned int i;
+    mesh_3d_static *meshes[2];
+    const char *names[2] = {"terrain","fur"};
+    mesh_3d_static *sphere;
+    float scale_matrix[4][4];
+    point_3d offset,scale;
+
+    meshes[0] = make_terrain(50,50,10,PLANE_RESOLUTION,PLANE_RESOLUTION,NULL);
+    meshes[0]->texture_map_plane(DIRECTION_DOWN,10,10);
+
+    meshes[1] = new mesh_3d_static();
+    sphere = make_sphere(2,30,30);
+    make_scale_matrix(1.01,1.01,1.01,scale_matrix);
+
+    for (i = 0; i < FUR_LAYERS; i++)
+      {
+        meshes[1]->merge(sphere);
+        sphere->apply_matrix(scale_matrix);
+      }
+
+    delete sphere;
+
+    cout << "vertex formats (VBO size in kB, update time in ms, position step):" << endl;
+    cout << "mesh      vertices   float    compact  ratio  update float  update compact  step" << endl;
+
+    for (i = 0; i < 2; i++)
+      {
+        GLint size_float,size_compact;
+        double time_float,time_compact;
+
+        meshes[i]->set_vertex_format(VERTEX_FORMAT_FLOAT);
+        time_float = measure_ms([&]{ meshes[i]->update(); });
+        size_float = vbo_size(meshes[i]);
+
+        meshes[i]->set_vertex_format(VERTEX_FORMAT_COMPACT);
+        time_compact = measure_ms([&]{ meshes[i]->update(); });
+        size_compact = vbo_size(meshes[i]);
+        meshes[i]->get_position_dequantization(&offset,&scale);
+
+        cout << setw(8) << names[i] << setw(10) << meshes[i]->vertex_count() << setw(9) << size_float / 1024 <<
+          setw(10) << size_compact / 1024 << setw(7) << setprecision(3) << (size_compact > 0 ? size_float / ((double) size_compact) : 0.0) <<
+          setw(14) << time_float << setw(16) << time_compact << setw(10) << max(scale.x,max(scale.y,scale.z)) / 65535.0 << endl;
+
+        delete meshes[i];
+      }
+
+    cout << endl;
+  }
+
+void benchmark_vertex_cache()              // triangle order before and after the vertex cache optimisation
+
+  {
+    unsigned int i,j;
+    mesh_3d_static *meshes[3];
+    const char *names[3] = {"sphere","terrain","shuffled"};
+    float acmr[2][2],atvr[2][2];
+    unsigned int cache_sizes[2] = {16,32};
+    double time;
+
+    meshes[0] = make_sphere(2,60,60);
+    meshes[1] = make_terrain(50,50,10,PLANE_RESOLUTION,PLANE_RESOLUTION,NULL);
+    meshes[2] = make_sphere(2,60,60);
+
+    srand(1);
+
+    for (i = meshes[2]->triangles.size() - 1; i > 0; i--)   // worst case, random triangle order
+      swap(meshes[2]->triangles[i],meshes[2]->triangles[rand() % (i + 1)]);
+
+    cout << "vertex cache (FIFO 16 / FIFO 32, before -> after optimisation):" << endl;
+    cout << "mesh      triangles  ACMR 16       ACMR 32       ATVR 16       ATVR 32       time (ms)" << endl;
+
+    for (i = 0; i < 3; i++)
+      {
+        for (j = 0; j < 2; j++)
+          meshes[i]->get_vertex_cache_statistics(cache_sizes[j],&acmr[0][j],&atvr[0][j]);
+
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        meshes[i]->optimize_vertex_cache();
+        time = chrono::duration<double,milli>(chrono::high_resolution_clock::now() - start).count();
+
+        for (j = 0; j < 2; j++)
+          meshes[i]->get_vertex_cache_statistics(cache_sizes[j],&acmr[1][j],&atvr[1][j]);
+
+        cout << setw(8) << names[i] << setw(11) << meshes[i]->triangle_count() << setprecision(3) << fixed;
+
+        for (j = 0; j < 2; j++)
+          cout << setw(7) << acmr[0][j] << " " << setw(5) << acmr[1][j] << " ";
+
+        for (j = 0; j < 2; j++)
+          cout << setw(7) << atvr[0][j] << " " << setw(5) << atvr[1][j] << " ";
+
+        cout << setw(10) << setprecision(1) << time << endl;
+        cout.unsetf(ios_base::floatfield);
+
+        delete meshes[i];
+      }
+
+    cout << endl;
+  }
+
+void benchmark_overdraw()                  // overdraw and ACMR before and after the overdraw optimisation
+
+  {
+    unsigned int i;
+    mesh_3d_static *meshes[3];
+    const char *names[3] = {"sphere","shells","blobs"};
+    mesh_3d_static *helper;
+    float matrix[4][4];
+    float acmr_before,acmr_after,overdraw_before,overdraw_after,atvr;
+    double time;
+
+    meshes[0] = make_sphere(2,60,60);
+
+    meshes[1] = new mesh_3d_static();       // nested shells, the worst case when drawn from inside out
+    helper = make_sphere(2,30,30);
+    make_scale_matrix(1.05,1.05,1.05,matrix);
+
+    for (i = 0; i < 8; i++)
+      {
+        meshes[1]->merge(helper);
+        helper->apply_matrix(matrix);
+      }
+
+    delete helper;
+
+    meshes[2] = new mesh_3d_static();       // overlapping blobs, like a dense prop
+
+    for (i = 0; i < 20; i++)
+      {
+        helper = make_sphere(1,20,20);
+        make_translation_matrix((i % 5) * 0.8,(i / 5) * 0.8,(i % 3) * 0.5,matrix);
+        helper->apply_matrix(matrix);
+        meshes[2]->merge(helper);
+        delete helper;
+      }
+
+    cout << "overdraw (" << OVERDRAW_VIEWPOINTS << " viewpoints, threshold 1.05, ACMR for FIFO 16):" << endl;
+    cout << "mesh      triangles  overdraw before  after  ACMR before  after  time (ms)" << endl;
+
+    for (i = 0; i < 3; i++)
+      {
+        meshes[i]->optimize_vertex_cache();
+        meshes[i]->get_vertex_cache_statistics(16,&acmr_before,&atvr);
+        meshes[i]->get_overdraw_statistics(OVERDRAW_VIEWPOINTS,&overdraw_before);
+
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        meshes[i]->optimize_overdraw(1.05);
+        time = chrono::duration<double,milli>(chrono::high_resolution_clock::now() - start).count();
+
+        meshes[i]->get_vertex_cache_statistics(16,&acmr_after,&atvr);
+        meshes[i]->get_overdraw_statistics(OVERDRAW_VIEWPOINTS,&overdraw_after);
+
+        cout << setw(8) << names[i] << setw(11) << meshes[i]->triangle_count() << setprecision(3) << fixed <<
+          setw(17) << overdraw_before << setw(7) << overdraw_after << setw(13) << acmr_before << setw(7) << acmr_after <<
+          setw(11) << setprecision(1) << time << endl;
+        cout.unsetf(ios_base::floatfield);
+
+        delete meshes[i];
+      }
+
+    cout << endl;
+  }
+
+void benchmark_meshlets()                  // triangles removed by meshlet culling with the camera going around
+
+  {
+    unsigned int i,frame;
+    mesh_3d_static *meshes[2];
+    const char *names[2] = {"cow","terrain"};
+    unsigned long long culled;
+    float width,height,depth,distance,angle;
+    double time;
+
+    meshes[0] = new mesh_3d_static();
+
+    if (!meshes[0]->load_obj("../sandbox/cow.obj"))
+      {
+        delete meshes[0];
+        meshes[0] = make_sphere(2,100,100);
+        names[0] = "sphere";
+      }
+
+    meshes[1] = make_terrain(500,500,30,CULLING_TERRAIN_RESOLUTION,CULLING_TERRAIN_RESOLUTION,NULL);
+    meshes[1]->optimize_vertex_cache();
+
+    cout << "meshlets (average of " << CULLING_FRAMES << " camera positions):" << endl;
+    cout << "mesh      triangles  meshlets  culled triangles  culled %  culling time (ms)" << endl;
+
+    for (i = 0; i < 2; i++)
+      {
+        meshes[i]->build_meshlets();
+        meshes[i]->get_size(&width,&height,&depth);
+        distance = max(width,max(height,depth));
+        culled = 0;
+
+        time = measure_ms([&]{
+            for (frame = 0; frame < CULLING_FRAMES; frame++)
+              {
+                angle = frame * 360.0 / CULLING_FRAMES;
+
+                if (i == 0)      // around the object, looking at it
+                  {
+                    camera.set_position(-1 * sin(angle * PI_DIVIDED_180) * distance,height / 2.0,-1 * cos(angle * PI_DIVIDED_180) * distance);
+                    camera.set_rotation(0,angle,0);
+                  }
+                else             // standing on the terrain, looking around
+                  {
+                    camera.set_position(0,20,0);
+                    camera.set_rotation(15,angle,0);
+                  }
+
+                culled += meshes[i]->cull_meshlets();
+              }
+          });
+
+        culled /= REPEAT;
+
+        cout << setw(8) << names[i] << setw(11) << meshes[i]->triangle_count() << setw(10) << meshes[i]->get_meshlet_count() <<
+          setw(18) << culled / CULLING_FRAMES << setw(10) << setprecision(3) << 100.0 * culled / CULLING_FRAMES / meshes[i]->triangle_count() <<
+          setw(19) << time / CULLING_FRAMES << endl;
+
+        delete meshes[i];
+      }
+
+    camera.set_position(0,0,0);
+    camera.set_rotation(0,0,0);
+    cout << endl;
+  }
+
+void benchmark_batching()                  // static batches against merging the meshes one by one
+
+  {
+    unsigned int i;
+    vector<mesh_3d_static *> meshes;
+    vector<mesh_3d_batch *> batches;
+    mesh_3d_static *merged;
+    texture_2d texture;
+    float matrix[4][4];
+    double time_batches,time_merge;
+
+    for (i = 0; i < BATCHED_MESHES; i++)    // two materials
+      {
+        meshes.push_back(make_sphere(1,8,8));
+        meshes[i]->set_position((i % 32) * 3,0,(i / 32) * 3);
+        meshes[i]->set_rotation(0,i,0);
+
+        if (i % 2)
+          meshes[i]->set_texture(&texture);
+      }
+
+    time_batches = measure_ms([&]{
+        for (i = 0; i < batches.size(); i++)
+          delete batches[i];
+
+        batches.clear();
+        make_static_batches(meshes,batches);
+      });
+
+    time_merge = measure_ms([&]{
+        merged = new mesh_3d_static();
+
+        for (i = 0; i < BATCHED_MESHES; i++)
+          {
+            mesh_3d_static copy(meshes[i]);
+            meshes[i]->get_transformation_matrix(matrix);
+            copy.apply_matrix(matrix);
+            merged->merge(&copy);
+          }
+
+        delete merged;
+      });
+
+    cout << "static batching (" << BATCHED_MESHES << " meshes, 2 materials):" << endl;
+    cout << "draw calls: " << BATCHED_MESHES << " -> " << batches.size() << endl;
+    cout << "make_static_batches: " << time_batches << " ms" << endl;
+    cout << "merge one by one:    " << time_merge << " ms" << endl;
+
+    for (i = 0; i < batches.size(); i++)
+      delete batches[i];
+
+    for (i = 0; i < meshes.size(); i++)
+      delete meshes[i];
+
+    cout << endl;
+  }
+
+void benchmark_buffer_arena()              // texts drawn from the shared buffer arena against their own buffers
+
+  {
+    unsigned int i;
+    vector<picture_2d *> texts;
+    double time_arena,time_own;
+
+    for (i = 0; i < ARENA_TEXTS; i++)
+      texts.push_back(make_text("text number " + to_string(i)));
+
+    cout << "buffer arena (" << ARENA_TEXTS << " texts):" << endl;
+    get_default_buffer_arena()->print_report();
+
+    time_arena = measure_ms([&]{
+        for (i = 0; i < texts.size(); i++)
+          texts[i]->draw();
+
+        glFinish();
+      });
+
+    for (i = 0; i < texts.size(); i += 2)   // free every other text, which leaves holes
+      {
+        delete texts[i];
+        texts[i] = NULL;
+      }
+
+    cout << "after deleting every other text:" << endl;
+    get_default_buffer_arena()->print_report();
+
+    get_default_buffer_arena()->defragment();
+    cout << "after defragmentation:" << endl;
+    get_default_buffer_arena()->print_report();
+
+    for (i = 0; i < texts.size(); i++)
+      if (texts[i] == NULL)
+        texts[i] = make_text("text number " + to_string(i));
+
+    for (i = 0; i < texts.size(); i++)    // move the texts to their own buffers
+      {
+        texts[i]->get_picture_mesh()->set_buffer_arena(NULL);
+        texts[i]->update();
+      }
+
+    time_own = measure_ms([&]{
+        for (i = 0; i < texts.size(); i++)
+          texts[i]->draw();
+
+        glFinish();
+      });
+
+    cout << "draw arena:       " << time_arena << " ms (3 GL objects)" << endl;
+    cout << "draw own buffers: " << time_own << " ms (" << texts.size() * 3 << " GL objects)" << endl;
+
+    for (i = 0; i < texts.size(); i++)
+      delete texts[i];
+
+    cout << endl;
+  }
+
+void benchmark_shader_variants()           // fragment cost of Phong shaded full-screen quads with different shader features, against one shader with all of them
+
+  {
+    unsigned int i,j,k;
+    picture_2d quad;
+    texture_2d texture;
+    mesh_3d_static *mesh;
+    const char *names[4] = {"Phong","Phong + fog","Phong + 4 shadows","Phong + transparency"};
+    double times[2][4];
+    unsigned int variants_before;
+
+    texture.initialise(256,256);
+    texture.update();
+
+    quad.set_picture(&texture);
+    quad.set_position(0,0);
+    quad.set_size(1,1);
+
+    mesh = quad.get_picture_mesh();
+    mesh->set_render_mode(RENDER_MODE_SHADED_PHONG);
+
+    glDisable(GL_DEPTH_TEST);             // every layer is shaded
+
+    variants_before = get_shader_variant_count();
+
+    for (k = 0; k < 2; k++)               // k = 1: the uber-shader baseline, all features are always compiled in and the unused ones do nothing
+      for (i = 0; i < 4; i++)
+        {
+          mesh->set_use_fog(i == 1 || k == 1);
+          mesh->shadows.clear();
+          texture.set_transparency(i == 3 || k == 1);
+
+          if (i == 2)
+            for (j = 0; j < 4; j++)
+              mesh->add_shadow(0.2 + j * 0.2,0.5,0.1,0.5);
+          else if (k == 1)
+            mesh->add_shadow(0,0,0,0);    // invisible, only runs the shadow loop
+
+          quad.draw();                    // compiles the variant
+          glFinish();
+
+          times[k][i] = measure_ms([&]{
+              for (j = 0; j < FULL_SCREEN_LAYERS; j++)
+                quad.draw();
+
+              glFinish();
+            });
+        }
+
+    glEnable(GL_DEPTH_TEST);
+
+    cout << "shader variants (" << FULL_SCREEN_LAYERS << " full-screen quads, " << get_shader_variant_count() - variants_before << " variants compiled):" << endl;
+
+    for (i = 0; i < 4; i++)
+      cout << setw(22) << names[i] << ": " << times[0][i] << " ms, " << times[0][i] * 1000000.0 / (FULL_SCREEN_LAYERS * 320.0 * 240.0) <<
+        " ns per fragment (uber-shader " << times[1][i] << " ms)" << endl;
+
+    cout << endl;
+  }
+
+void benchmark_program_cache()             // making the common shader variants without and with the program binary cache
+
+  {
+    unsigned int i,hits,misses,previous_hits,previous_misses;
+    double milliseconds,previous_milliseconds;
+    const char *names[3] = {"no cache","cache, first pass","cache, second pass"};
+    string directory = make_temporary_directory();
+
+    cout << "program binary cache (common shader variants, cache in " << directory << "):" << endl;
+
+    for (i = 0; i < 3; i++)
+      {
+        set_cache_directory(i == 0 ? "" : directory);
+        clear_shader_variants();
+
+        get_program_cache_statistics(&previous_hits,&previous_misses,&previous_milliseconds);
+        precompile_shader_variants();
+        get_program_cache_statistics(&hits,&misses,&milliseconds);
+
+        cout << setw(20) << names[i] << ": " << milliseconds - previous_milliseconds << " ms (" <<
+          hits - previous_hits << " loaded, " << misses - previous_misses << " compiled)" << endl;
+      }
+
+    set_cache_directory("");
+    remove_temporary_directory(directory);
+    cout << endl;
+  }
+
+void benchmark_morph_animation()          // GPU memory and upload time of a long morph animation
+
+  {
+    unsigned int i,j,old_size;
+    double time_upload;
+    mesh_3d_static *plane;
+    mesh_3d_animated animation;
+
+    plane = make_plane(10,10,MORPH_RESOLUTION,MORPH_RESOLUTION);
+
+    for (i = 0; i < MORPH_FRAMES; i++)
+      {
+        for (j = 0; j < plane->vertex_count(); j++)
+          plane->vertices[j].position.y = sin(i * 0.1 + j * 0.01);
+
+        animation.add_frame(plane,50);
+      }
+
+    time_upload = measure_ms([&]{
+        animation.mark_frames_changed();
+        animation.update();
+        glFinish();
+      });
+
+    // the previous layout stored each frame interleaved with the next one and had one IBO per frame:
+
+    old_size = MORPH_FRAMES * (2 * plane->vertex_count() * sizeof(vertex_3d) + plane->triangle_count() * 3 * sizeof(GLushort));
+
+    cout << "morph animation (" << MORPH_FRAMES << " frames, " << plane->vertex_count() << " vertices each):" << endl;
+    cout << "GPU memory, frame pairs:   " << old_size / 1024 << " KB" << endl;
+    cout << "GPU memory, shared buffer: " << animation.get_gpu_memory_size() / 1024 << " KB" << endl;
+    cout << "upload: " << time_upload << " ms" << endl;
+
+    delete plane;
+    cout << endl;
+  }
+
+void benchmark_skinning()                  // memory of a skeletal clip against the same animation as morph frames, pose sampling time
+
+  {
+    unsigned int i,j,bones[4] = {0,0,0,0};
+    float weights[4] = {1,0,0,0};
+    double time_poses;
+    point_3d position = {0,0,0}, scale = {1,1,1};
+    quaternion rotation;
+    mesh_3d_static *plane;
+    mesh_3d_skinned skinned;
+    skeletal_clip clip;
+
+    plane = make_plane(10,10,MORPH_RESOLUTION,MORPH_RESOLUTION);
+
+    skinned.vertices = plane->vertices;
+    skinned.triangles = plane->triangles;
+
+    for (i = 0; i < SKIN_BONES; i++)    // a chain of bones going along the x axis
+      {
+        position.x = i == 0 ? -5 : 10.0 / SKIN_BONES;
+        make_quaternion(0,0,0,ROTATION_ZXY,&rotation);
+        skinned.add_bone("bone" + to_string(i),((int) i) - 1,position,rotation,scale);
+      }
+
+    for (i = 0; i < skinned.vertices.size(); i++)
+      {
+        bones[0] = min((unsigned int) ((skinned.vertices[i].position.x + 5) / 10.0 * SKIN_BONES),(unsigned int) SKIN_BONES - 1);
+        skinned.set_vertex_bones(i,bones,weights);
+      }
+
+    for (i = 0; i < SKIN_BONES; i++)
+      for (j = 0; j < MORPH_FRAMES; j++)
+        {
+          position.x = i == 0 ? -5 : 10.0 / SKIN_BONES;
+          make_quaternion(0,0,sin(j * 0.1 + i * 0.2) * 10,ROTATION_ZXY,&rotation);
+          clip.add_key(i,j * 50,position,rotation,scale);
+        }
+
+    skinned.set_clip(&clip);
+    skinned.update();
+
+    time_poses = measure_ms([&]{
+        for (i = 0; i < SKIN_POSES; i++)
+          {
+            skinned.set_clip_time((i * 37) % ((unsigned int) clip.get_length()));
+            skinned.update_pose();
+          }
+      });
+
+    cout << "skinning (" << SKIN_BONES << " bones, " << MORPH_FRAMES << " keys, " << skinned.vertices.size() << " vertices):" << endl;
+    cout << "animation memory, morph frames:  " << MORPH_FRAMES * skinned.vertices.size() * sizeof(vertex_3d) / 1024 << " KB" << endl;
+    cout << "animation memory, skeletal clip: " << clip.get_memory_size() / 1024 << " KB" << endl;
+    cout << SKIN_POSES << " poses: " << time_poses << " ms" << endl;
+
+    delete plane;
+    cout << endl;
+  }
+
+void benchmark_crowd()                     // animated instances drawn one by one against one instanced call with a vertex animation texture
+
+  {
+    unsigned int i,j;
+    double time_separate,time_crowd;
+    mesh_3d_static *frame;
+    mesh_3d_animated animation;
+    mesh_3d_crowd crowd;
+    vector<mesh_3d_animated *> instances;
+
+    frame = make_sphere(1,8,12);
+
+    for (i = 0; i < CROWD_FRAMES; i++)
+      {
+        for (j = 0; j < frame->vertex_count(); j++)
+          frame->vertices[j].position.y *= 1.0 + 0.05 * sin(i * 2 * PI / CROWD_FRAMES);
+
+        animation.add_frame(frame,100);
+      }
+
+    animation.update();
+    animation.set_playing(true);
+
+    crowd.build(&animation);
+    crowd.update();
+
+    for (i = 0; i < CROWD_INSTANCES; i++)
+      {
+        mesh_3d_animated *instance = new mesh_3d_animated();
+        instance->make_instance_of(&animation);
+        instance->set_position((i % 40) * 3.0,0,(i / 40) * 3.0);
+        instance->set_playing(true);
+        instances.push_back(instance);
+        crowd.add_member(instance,i * 37 % (CROWD_FRAMES * 100));
+      }
+
+    time_separate = measure_ms([&]{
+        for (i = 0; i < instances.size(); i++)
+          instances[i]->draw();
+
+        glFinish();
+      });
+
+    time_crowd = measure_ms([&]{
+        crowd.draw();
+        glFinish();
+      });
+
+    cout << "crowd (" << CROWD_INSTANCES << " animated instances, " << frame->vertex_count() << " vertices, " << CROWD_FRAMES << " frames):" << endl;
+    cout << "draw one by one:       " << time_separate << " ms (" << CROWD_INSTANCES << " draw calls)" << endl;
+    cout << "draw instanced crowd:  " << time_crowd << " ms (1 draw call, " << crowd.get_texture_memory_size() / 1024 << " KB vertex animation texture)" << endl;
+
+    for (i = 0; i < instances.size(); i++)
+      delete instances[i];
+
+    delete frame;
+    cout << endl;
+  }
+
+float reference_get_value(const vector<keyframe> &keyframes, float x)   // the original linear search
+
+  {
+    unsigned int i;
+
+    if (keyframes.size() <= 1)
+      return 0.0;
+
+    for (i = 0; i < keyframes.size(); i++)
+      if (keyframes[i].x > x)
+        break;
+
+    if (i == 0 || i >= keyframes.size())
+      return 0;
+
+    return interpolate((x - keyframes[i - 1].x) / (keyframes[i].x - keyframes[i - 1].x),
+      keyframes[i - 1].y,keyframes[i].y,keyframes[i - 1].interpolation);
+  }
+
+void benchmark_interpolators()             // camera rail keyframe lookup: linear search, cursor, random access and the batch API
+
+  {
+    unsigned int i,j;
+    double time_reference,time_cursor,time_random,time_batch,time_insert,time_multichannel;
+    keyframe_interpolator rails[5];
+    multichannel_interpolator rail(5);
+    keyframe_interpolator *rail_pointers[5];
+    vector<keyframe> keys(RAIL_KEYS);
+    float values[5];
+    volatile float sink;
+
+    for (i = 0; i < RAIL_KEYS; i++)
+      {
+        keys[i].x = i * 100;
+        keys[i].y = sin(i * 0.1) * 50;
+        keys[i].interpolation = INTERPOLATION_LINEAR;   // interpolate() only gives the same function as the segments for linear keys
+        keys[i].tangent = 0.0;
+        keys[i].control_in = keys[i].y;
+        keys[i].control_out = keys[i].y;
+      }
+
+    time_insert = measure_ms([&]{
+        for (j = 0; j < 5; j++)
+          {
+            rails[j].clear();
+            rails[j].add_keyframes(keys);
+            rail_pointers[j] = &rails[j];
+          }
+      });
+
+    float length = (RAIL_KEYS - 1) * 100.0;
+
+    time_reference = measure_ms([&]{
+        for (i = 0; i < RAIL_SAMPLES / 100; i++)    // too slow for all the samples
+          for (j = 0; j < 5; j++)
+            sink = reference_get_value(keys,i * 100 * length / RAIL_SAMPLES);
+      }) * 100;
+
+    time_cursor = measure_ms([&]{
+        for (i = 0; i < RAIL_SAMPLES; i++)
+          for (j = 0; j < 5; j++)
+            sink = rails[j].get_value(i * length / RAIL_SAMPLES);
+      });
+
+    time_random = measure_ms([&]{
+        for (i = 0; i < RAIL_SAMPLES; i++)
+          for (j = 0; j < 5; j++)
+            sink = rails[j].get_value((i * 7919 % RAIL_SAMPLES) * length / RAIL_SAMPLES);
+      });
+
+    time_batch = measure_ms([&]{
+        for (i = 0; i < RAIL_SAMPLES; i++)
+          {
+            get_interpolated_values(rail_pointers,5,i * length / RAIL_SAMPLES,values);
+            sink = values[0];
+          }
+      });
+
+    for (i = 0; i < RAIL_KEYS; i++)
+      {
+        for (j = 0; j < 5; j++)
+          values[j] = keys[i].y;
+
+        rail.add_keyframe(keys[i].x,values,INTERPOLATION_LINEAR);
+      }
+
+    time_multichannel = measure_ms([&]{
+        for (i = 0; i < RAIL_SAMPLES; i++)
+          {
+            rail.get_values(i * length / RAIL_SAMPLES,values);
+            sink = values[0];
+          }
+      });
+
+    (void) sink;
+
+    cout << "camera rail (5 linear interpolators, " << RAIL_KEYS << " keys, " << RAIL_SAMPLES << " samples):" << endl;
+    cout << "bulk insert:          " << time_insert << " ms" << endl;
+    cout << "linear search:        " << time_reference << " ms (estimated from 1 % of the samples)" << endl;
+    cout << "cursor (playback):    " << time_cursor << " ms" << endl;
+    cout << "binary search:        " << time_random << " ms (random order)" << endl;
+    cout << "batch (playback):     " << time_batch << " ms" << endl;
+    cout << "multichannel:         " << time_multichannel << " ms" << endl;
+    cout << endl;
+  }
+
+void benchmark_texture_atlas()             // texture binds and draw time of props with their own textures against the props sharing an atlas
+
+  {
+    unsigned int i,j,k,binds_separate,binds_atlas,remapped;
+    double time_separate,time_atlas,time_build;
+    texture_atlas atlas(1024,4);
+    vector<texture_2d *> textures;
+    vector<mesh_3d_static *> props;
+
+    for (i = 0; i < ATLAS_PROPS; i++)
+      {
+        texture_2d *texture = new texture_2d();
+        unsigned int size = 32 << (i % 3);   // 32, 64 and 128 pixels
+
+        texture->initialise(size,size);
+
+        for (j = 0; j < size; j++)
+          for (k = 0; k < size; k++)
+            texture->set_pixel(k,j,(i * 37) % 256,((j / 8 + k / 8) % 2) * 255,(i * 91) % 256);
+
+        texture->update();
+        textures.push_back(texture);
+
+        mesh_3d_static *prop = make_sharp_cuboid(1,1,1);
+        prop->set_texture(texture);
+        prop->set_position((i % 10) * 2.0,0,(i / 10) * 2.0);
+        prop->update();
+        props.push_back(prop);
+      }
+
+    auto draw_props = [&]{
+        for (i = 0; i < props.size(); i++)
+          props[i]->draw();
+
+        glFinish();
+      };
+
+    time_separate = measure_ms(draw_props);
+
+    binds_separate = get_texture_bind_count();
+    draw_props();
+    binds_separate = get_texture_bind_count() - binds_separate;
+
+    time_build = measure_ms([&]{
+        atlas.clear();
+
+        for (i = 0; i < textures.size(); i++)
+          atlas.add_texture(textures[i]);
+
+        atlas.build();
+      });
+
+    remapped = 0;
+
+    for (i = 0; i < props.size(); i++)
+      if (atlas.remap_mesh(props[i]))
+        {
+          props[i]->update();
+          remapped++;
+        }
+
+    time_atlas = measure_ms(draw_props);
+
+    binds_atlas = get_texture_bind_count();
+    draw_props();
+    binds_atlas = get_texture_bind_count() - binds_atlas;
+
+    cout << "texture atlas (" << ATLAS_PROPS << " props with their own textures, " << remapped << " remapped):" << endl;
+    cout << "own textures:         " << time_separate << " ms (" << binds_separate << " texture binds per frame)" << endl;
+    cout << "atlas:                " << time_atlas << " ms (" << binds_atlas << " texture binds per frame, " << atlas.get_page_count() << " pages)" << endl;
+    cout << "atlas build:          " << time_build << " ms" << endl;
+
+    for (i = 0; i < props.size(); i++)
+      delete props[i];
+
+    for (i = 0; i < textures.size(); i++)
+      delete textures[i];
+
+    cout << endl;
+  }
+
+void benchmark_texture_compression()       // upload time and GPU memory of a big texture, uncompressed and block compressed
+
+  {
+    unsigned int i,j,hits,misses,previous_hits,previous_misses;
+    double time;
+    texture_2d texture;
+    const char *names[5] = {"uncompressed","BC1","BC3","BC1, cache first pass","BC1, cache second pass"};
+    texture_compression formats[5] = {TEXTURE_COMPRESSION_NONE,TEXTURE_COMPRESSION_BC1,TEXTURE_COMPRESSION_BC3,TEXTURE_COMPRESSION_BC1,TEXTURE_COMPRESSION_BC1};
+    string directory = make_temporary_directory();
+
+    texture.initialise(COMPRESSED_TEXTURE_SIZE,COMPRESSED_TEXTURE_SIZE);
+
+    for (i = 0; i < COMPRESSED_TEXTURE_SIZE; i++)    // terrain-like colors with noise
+      for (j = 0; j < COMPRESSED_TEXTURE_SIZE; j++)
+        texture.set_pixel(j,i,
+          60 + 40 * sin(i * 0.01) + rand() % 20,
+          120 + 50 * cos(j * 0.013) + rand() % 20,
+          40 + 30 * sin((i + j) * 0.007) + rand() % 20);
+
+    cout << "texture compression (" << COMPRESSED_TEXTURE_SIZE << " x " << COMPRESSED_TEXTURE_SIZE << " texture, " <<
+      (texture_compression_is_supported() ? "S3TC supported" : "S3TC not supported") << ", cache in " << directory << "):" << endl;
+
+    for (i = 0; i < 5; i++)
+      {
+        set_cache_directory(i >= 3 ? directory : "");
+        texture.set_compression(formats[i]);
+
+        get_texture_cache_statistics(&previous_hits,&previous_misses);
+
+        chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+        texture.update();
+        glFinish();
+        time = chrono::duration<double,milli>(chrono::high_resolution_clock::now() - start).count();
+
+        get_texture_cache_statistics(&hits,&misses);
+
+        cout << setw(24) << names[i] << ": " << time << " ms, " << texture.get_gpu_memory_size() / 1024 << " KB on GPU (" <<
+          hits - previous_hits << " loaded, " << misses - previous_misses << " encoded)" << endl;
+      }
+
+    set_cache_directory("");
+    remove_temporary_directory(directory);
+    cout << endl;
+  }
+
+void benchmark_residency()                 // CPU memory of static meshes and textures with the data kept, discarded and reloaded after upload
+
+  {
+    unsigned int i,j;
+    double time_reload;
+    memory_usage before,after;
+    const char *names[3] = {"keep","discard","reload"};
+    residency_policy policies[3] = {RESIDENCY_KEEP,RESIDENCY_DISCARD,RESIDENCY_RELOAD};
+
+    cout << "residency (" << RESIDENT_MESHES << " spheres and textures, cache in the current directory):" << endl;
+    set_cache_directory(".");
+
+    for (i = 0; i < 3; i++)
+      {
+        vector<mesh_3d_static *> meshes;
+        vector<texture_2d *> textures;
+
+        before = get_memory_usage(MEMORY_MESHES);
+        before.cpu_bytes += get_memory_usage(MEMORY_TEXTURES).cpu_bytes;
+        before.gpu_bytes += get_memory_usage(MEMORY_TEXTURES).gpu_bytes;
+
+        for (j = 0; j < RESIDENT_MESHES; j++)
+          {
+            mesh_3d_static *mesh = make_sphere(1,30,30 + j % 10);
+            texture_2d *texture = new texture_2d();
+
+            mesh->set_residency(policies[i]);
+            mesh->update();
+            meshes.push_back(mesh);
+
+            texture->set_residency(policies[i]);
+            texture->initialise(128,128);
+            textures.push_back(texture);
+          }
+
+        after = get_memory_usage(MEMORY_MESHES);
+        after.cpu_bytes += get_memory_usage(MEMORY_TEXTURES).cpu_bytes;
+        after.gpu_bytes += get_memory_usage(MEMORY_TEXTURES).gpu_bytes;
+
+        time_reload = 0;
+
+        if (policies[i] == RESIDENCY_RELOAD)
+          {
+            chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+            for (j = 0; j < meshes.size(); j++)
+              meshes[j]->make_resident();
+
+            time_reload = chrono::duration<double,milli>(chrono::high_resolution_clock::now() - start).count();
+          }
+
+        cout << setw(8) << names[i] << ": " << (after.cpu_bytes - before.cpu_bytes) / 1024 << " KB CPU, " <<
+          (after.gpu_bytes - before.gpu_bytes) / 1024 << " KB GPU";
+
+        if (policies[i] == RESIDENCY_RELOAD)
+          cout << ", reloading the meshes " << time_reload << " ms";
+
+        cout << endl;
+
+        for (j = 0; j < meshes.size(); j++)
+          {
+            delete meshes[j];
+            delete textures[j];
+          }
+      }
+
+    print_memory_report();
+    set_cache_directory("");
+    cout << endl;
+  }
+
+void benchmark_memory_tracker()           // cost of one memory report (done on each allocation) against making the meshes, budget warnings and the high-water marks
+
+  {
+    unsigned int i;
+    double time_upload,time_reports;
+    memory_usage usage;
+    vector<memory_record> records;
+    vector<mesh_3d_static *> meshes;
+
+    cout << "memory tracker (" << TRACKED_MESHES << " meshes):" << endl;
+
+    set_memory_budget(MEMORY_MESHES,0,TRACKED_MESHES * 8 * 1024);   // smaller than what the meshes need, warns once
+
+    chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+
+    for (i = 0; i < TRACKED_MESHES; i++)
+      {
+        meshes.push_back(make_sphere(1,20,20));
+        meshes.back()->update();
+      }
+
+    time_upload = chrono::duration<double,milli>(chrono::high_resolution_clock::now() - start).count();
+
+    records.resize(meshes.size());
+
+    for (i = 0; i < meshes.size(); i++)
+      get_object_memory_usage(meshes[i],&records[i]);
+
+    time_reports = measure_ms([&]{       // each mesh grows and shrinks back, so both reports change the sums, peaks and budget state like update() does
+        for (i = 0; i < meshes.size(); i++)
+          {
+            set_memory_usage(meshes[i],records[i].category,records[i].cpu_bytes,records[i].gpu_bytes + 1024);
+            set_memory_usage(meshes[i],records[i].category,records[i].cpu_bytes,records[i].gpu_bytes);
+          }
+      });
+
+    print_memory_report(5);
+
+    for (i = 0; i < meshes.size(); i++)
+      delete meshes[i];
+
+    set_memory_budget(MEMORY_MESHES,0,0);
+    usage = get_memory_usage(MEMORY_CATEGORIES);
+
+    cout << "  making and uploading the meshes: " << time_upload << " ms" << endl;
+    cout << "  reporting their memory: " << time_reports << " ms, " << time_reports * 1000000.0 / (2 * TRACKED_MESHES) << " ns per report" << endl;
+    cout << "  after deleting: " << usage.gpu_bytes / 1024 << " KB GPU, high-water mark " << usage.gpu_peak_bytes / 1024 << " KB GPU" << endl;
+    cout << "  " << get_memory_report_line(MEMORY_CATEGORIES) << endl;
+    cout << endl;
+  }
+
+int main(int argc, char **argv)
+
+{
+  init_opengl(&argc,argv,320,240,render_scene,"benchmark");   // the benchmarks need the GL context
+
+  cout << "hardware threads: " << thread::hardware_concurrency() << endl << endl;
+
+  benchmark_job_system();
+  benchmark_matrix_math();
+  benchmark_scene_nodes();
+  benchmark_rotations();
+  benchmark_vertex_formats();
+  benchmark_vertex_cache();
+  benchmark_overdraw();
+  benchmark_meshlets();
+  benchmark_batching();
+  benchmark_buffer_arena();
+  benchmark_shader_variants();
+  benchmark_program_cache();
+  benchmark_morph_animation();
+  benchmark_skinning();
+  benchmark_crowd();
+  benchmark_interpolators();
+  benchmark_texture_atlas();
+  benchmark_texture_compression();
+  benchmark_residency();
+  benchmark_memory_tracker();
+
+  return 0;
+}
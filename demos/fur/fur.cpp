@@ -95,6 +95,7 @@ int main(int argc, char **argv)
   model->set_texture(&fur_texture);
   model->set_render_mode(RENDER_MODE_SHADED_PHONG);
   model->set_lighting_properties(0.2,0.6,0.6,2);
+  model->set_vertex_format(VERTEX_FORMAT_COMPACT);  // the layers take a lot of vertices
 
   for (i = 0; i < LAYERS; i++)
     {
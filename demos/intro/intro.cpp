@@ -17,6 +17,7 @@ mesh_3d_static *terrain, *water_frame_0, *water_frame_1, *skybox,
 
 mesh_3d_static *rock1_instances[3];
 mesh_3d_static *rock2_instances[5];
+mesh_3d_group *rocks;             // all rock instances, drawn with one call
 
 mesh_3d_animated *water;
 texture_2d terrain_heightmap, terrain_texturemap, water_texture,
@@ -66,21 +67,21 @@ void setup_camera_keyframes()
     i_r_x.add_keyframe(14700,       11,      INTERPOLATION_SINE);
     i_r_y.add_keyframe(15200,       375,     INTERPOLATION_SINE);
 
-    i_x.add_keyframe(  17700,       -25,     INTERPOLATION_LINEAR);
-    i_y.add_keyframe(  18500,       3,       INTERPOLATION_LINEAR);
-    i_z.add_keyframe(  18100,       -1,      INTERPOLATION_LINEAR);
+    i_x.add_keyframe(  17700,       -25,     INTERPOLATION_CATMULL_ROM);
+    i_y.add_keyframe(  18500,       3,       INTERPOLATION_CATMULL_ROM);
+    i_z.add_keyframe(  18100,       -1,      INTERPOLATION_CATMULL_ROM);
     i_r_x.add_keyframe(18005,       -10,     INTERPOLATION_SINE);
     i_r_y.add_keyframe(17800,       440,     INTERPOLATION_SINE);
 
-    i_x.add_keyframe(  20500,       -23,     INTERPOLATION_LINEAR);
-    i_y.add_keyframe(  20100,       5,       INTERPOLATION_LINEAR);
-    i_z.add_keyframe(  19700,       14,      INTERPOLATION_LINEAR);
+    i_x.add_keyframe(  20500,       -23,     INTERPOLATION_CATMULL_ROM);
+    i_y.add_keyframe(  20100,       5,       INTERPOLATION_CATMULL_ROM);
+    i_z.add_keyframe(  19700,       14,      INTERPOLATION_CATMULL_ROM);
     i_r_x.add_keyframe(20100,       2,       INTERPOLATION_SINE);
     i_r_y.add_keyframe(20200,       460,     INTERPOLATION_SINE);
 
-    i_x.add_keyframe(  22100,       -18,     INTERPOLATION_LINEAR);
-    i_y.add_keyframe(  21500,       11,      INTERPOLATION_LINEAR);
-    i_z.add_keyframe(  22100,       38,      INTERPOLATION_LINEAR);
+    i_x.add_keyframe(  22100,       -18,     INTERPOLATION_CATMULL_ROM);
+    i_y.add_keyframe(  21500,       11,      INTERPOLATION_CATMULL_ROM);
+    i_z.add_keyframe(  22100,       38,      INTERPOLATION_CATMULL_ROM);
     i_r_x.add_keyframe(22000,       11,      INTERPOLATION_SINE);
     i_r_y.add_keyframe(22000,       500,     INTERPOLATION_SINE);
 
@@ -102,27 +103,27 @@ void setup_camera_keyframes()
     i_r_x.add_keyframe(33000,       7,       INTERPOLATION_CONSTANT);
     i_r_y.add_keyframe(33000,       270,     INTERPOLATION_CONSTANT);
 
-    i_x.add_keyframe(  34000,       10,      INTERPOLATION_LINEAR);
-    i_y.add_keyframe(  34000,       7,       INTERPOLATION_LINEAR);
-    i_z.add_keyframe(  34000,       12,      INTERPOLATION_LINEAR);
+    i_x.add_keyframe(  34000,       10,      INTERPOLATION_CATMULL_ROM);
+    i_y.add_keyframe(  34000,       7,       INTERPOLATION_CATMULL_ROM);
+    i_z.add_keyframe(  34000,       12,      INTERPOLATION_CATMULL_ROM);
     i_r_x.add_keyframe(34000,       15,      INTERPOLATION_SINE);
     i_r_y.add_keyframe(34000,       196,     INTERPOLATION_SINE);
 
-    i_x.add_keyframe(  38000,       8,       INTERPOLATION_LINEAR);
-    i_y.add_keyframe(  38000,       9,       INTERPOLATION_LINEAR);
-    i_z.add_keyframe(  38000,       2.4,     INTERPOLATION_LINEAR);
+    i_x.add_keyframe(  38000,       8,       INTERPOLATION_CATMULL_ROM);
+    i_y.add_keyframe(  38000,       9,       INTERPOLATION_CATMULL_ROM);
+    i_z.add_keyframe(  38000,       2.4,     INTERPOLATION_CATMULL_ROM);
     i_r_x.add_keyframe(38000,       -5,      INTERPOLATION_SINE);
     i_r_y.add_keyframe(38000,       259,     INTERPOLATION_SINE);
 
-    i_x.add_keyframe(  42000,       0,       INTERPOLATION_LINEAR);
-    i_y.add_keyframe(  42000,       11,      INTERPOLATION_LINEAR);
-    i_z.add_keyframe(  42000,       4.1,     INTERPOLATION_LINEAR);
+    i_x.add_keyframe(  42000,       0,       INTERPOLATION_CATMULL_ROM);
+    i_y.add_keyframe(  42000,       11,      INTERPOLATION_CATMULL_ROM);
+    i_z.add_keyframe(  42000,       4.1,     INTERPOLATION_CATMULL_ROM);
     i_r_x.add_keyframe(42000,       0,       INTERPOLATION_SINE);
     i_r_y.add_keyframe(42000,       280,     INTERPOLATION_SINE);
 
-    i_x.add_keyframe(  46000,       -11,     INTERPOLATION_LINEAR);
-    i_y.add_keyframe(  46000,       15,      INTERPOLATION_LINEAR);
-    i_z.add_keyframe(  46000,       8,       INTERPOLATION_LINEAR);
+    i_x.add_keyframe(  46000,       -11,     INTERPOLATION_CATMULL_ROM);
+    i_y.add_keyframe(  46000,       15,      INTERPOLATION_CATMULL_ROM);
+    i_z.add_keyframe(  46000,       8,       INTERPOLATION_CATMULL_ROM);
     i_r_x.add_keyframe(46000,       46,      INTERPOLATION_SINE);
     i_r_y.add_keyframe(46000,       168,     INTERPOLATION_SINE);
 
@@ -138,9 +139,9 @@ void setup_camera_keyframes()
     i_r_x.add_keyframe(52000,       0,       INTERPOLATION_SINE);
     i_r_y.add_keyframe(52000,       218,     INTERPOLATION_SINE);
 
-    i_x.add_keyframe(  62000,       -130,    INTERPOLATION_LINEAR);
-    i_y.add_keyframe(  62000,       8,       INTERPOLATION_LINEAR);
-    i_z.add_keyframe(  62000,       -127,    INTERPOLATION_LINEAR);
+    i_x.add_keyframe(  62000,       -130,    INTERPOLATION_CATMULL_ROM);
+    i_y.add_keyframe(  62000,       8,       INTERPOLATION_CATMULL_ROM);
+    i_z.add_keyframe(  62000,       -127,    INTERPOLATION_CATMULL_ROM);
     i_r_x.add_keyframe(62000,       0,       INTERPOLATION_SINE);
     i_r_y.add_keyframe(62000,       218,     INTERPOLATION_SINE);
   }
@@ -154,8 +155,13 @@ static void render_scene()
       stop_rendering();
 
     // get the camera position and rotation from interpolators:
-    camera.set_position(i_x.get_value(parameter),i_y.get_value(parameter),i_z.get_value(parameter));
-    camera.set_rotation(i_r_x.get_value(parameter),i_r_y.get_value(parameter),0);
+    keyframe_interpolator *camera_interpolators[5] = {&i_x,&i_y,&i_z,&i_r_x,&i_r_y};
+    float camera_values[5];
+
+    get_interpolated_values(camera_interpolators,5,parameter,camera_values);
+
+    camera.set_position(camera_values[0],camera_values[1],camera_values[2]);
+    camera.set_rotation(camera_values[3],camera_values[4],0);
 
     unsigned int i;
 
@@ -164,15 +170,7 @@ static void render_scene()
         trees[i]->draw();
       }
 
-    rock1_instances[0]->draw();
-    rock1_instances[1]->draw();
-    rock1_instances[2]->draw();
-
-    rock2_instances[0]->draw();
-    rock2_instances[1]->draw();
-    rock2_instances[2]->draw();
-    rock2_instances[3]->draw();
-    rock2_instances[4]->draw();
+    rocks->draw();
 
     sun->draw();
 
@@ -202,6 +200,7 @@ void destroy_scene()
     delete rock2_instances[2];
     delete rock2_instances[3];
     delete rock2_instances[4];
+    delete rocks;
     delete water;
   }
 
@@ -242,6 +241,8 @@ void init_scene()
     terrain->set_lighting_properties(0.3,0.7,0.3,1.5);
     terrain->set_texture(&grass_texture);
     terrain->set_texture2(&sand_texture);
+    terrain->set_vertex_format(VERTEX_FORMAT_COMPACT);
+    terrain->optimize_vertex_cache();   // also uploads the mesh
 
     // make the water animation of two frames:
     water_frame_0 = make_terrain(300,300,1,18,18,NULL);
@@ -345,6 +346,17 @@ void init_scene()
     rock2_instances[4]->set_rotation(0,5,0);
     rock2_instances[4]->set_scale(0.12);
 
+    vector<mesh_3d_static *> rock_list;
+
+    for (i = 0; i < 3; i++)
+      rock_list.push_back(rock1_instances[i]);
+
+    for (i = 0; i < 5; i++)
+      rock_list.push_back(rock2_instances[i]);
+
+    rocks = new mesh_3d_group();
+    rocks->build(rock_list);
+
     // make trees:
     tree_low = new mesh_3d_static();
     tree_low->load_obj("tree_low.obj");
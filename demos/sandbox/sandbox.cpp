@@ -43,6 +43,10 @@ static void render_scene()
       {
         counter = WRITE_FPS_EACH_FRAMES;
         cout << "FPS: " << get_fps() << endl;
+
+        delete text_lines[2];                   // memory overlay
+        text_lines[2] = make_memory_text(MEMORY_CATEGORIES);
+        text_lines[2]->set_position(0.02,2 * 0.2);
       }
 
     counter--;
@@ -84,7 +88,7 @@ int main(int argc, char **argv)
 
   text_lines[0] = make_text("q to quit");
   text_lines[1] = make_text("s to move the sphere");
-  text_lines[2] = make_text("");
+  text_lines[2] = make_memory_text(MEMORY_CATEGORIES);
 
   for (i = 0; i < NUMBER_OF_TEXT_LINES; i++)                // set the text line positions
     text_lines[i]->set_position(0.02,i * 0.2);
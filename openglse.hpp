@@ -11,8 +11,23 @@
 #define PI_DIVIDED_180 0.01745329251
 #define PI_DIVIDED_2 1.57079632679
 #define RECOMPUTE_FRAMES 128            // after how many frames things like FPS or LOD are recomputed
-#define MAX_ANIMATION_FRAMES 32
+#define MAX_ANIMATION_FRAMES 32         // maximum number of frames of a crowd's vertex animation texture
 #define MAX_SHADOWS 64                  // maximum number of shadows on the mesh surface
+#define MAX_WORKER_THREADS 32           // maximum number of threads used by the job system (including the main thread)
+#define JOB_MIN_BATCH 2048              // minimum number of items processed by one parallel_for job
+#define SOA_BLOCK_SIZE 256              // how many vertices batch operations convert to structure of arrays at once
+#define VERTEX_CACHE_SIZE 32            // post-transform vertex cache size the triangle order is optimised for
+#define OVERDRAW_RESOLUTION 256         // resolution of the offscreen buffer overdraw is measured in
+#define MESHLET_MAX_VERTICES 64         // maximum number of vertices in one meshlet
+#define MESHLET_MAX_TRIANGLES 124       // maximum number of triangles in one meshlet
+#define FRAME_UNIFORMS_BINDING 0        // uniform buffer binding point of the per-frame block
+#define MATERIAL_UNIFORMS_BINDING 1     // uniform buffer binding point of the per-material block
+#define BONE_UNIFORMS_BINDING 2         // uniform buffer binding point of the bone matrix palette
+#define SHADER_VARIANTS 4096            // size of the shader variant table (2 bits render mode, 2 bits textures, 8 feature bits)
+#define MAX_BONES 64                    // maximum number of bones of a skinned mesh (size of the shader's bone matrix palette)
+#define VERTEX_TEXTURE_WIDTH 1024       // width of the vertex animation textures of crowds
+#define VERTEX_TEXTURE_UNIT 2           // texture unit the vertex animation texture is bound to
+#define TEXTURE_UNITS 3                 // texture units used by the engine (two texture layers and the vertex animation texture)
 #define OPENGLSE_VERSION 1
 
 #include <stdio.h>
@@ -24,6 +39,28 @@
 #include <fstream>
 #include <limits>
 #include <math.h>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <map>
+#include <unordered_map>
+
+#if !defined(OPENGLSE_NO_SIMD) && (defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1))
+  #define OPENGLSE_SSE                  // SSE matrix kernels
+  #include <xmmintrin.h>
+  #ifdef __AVX__
+    #define OPENGLSE_AVX                // AVX matrix kernels
+    #include <immintrin.h>
+  #endif
+#elif !defined(OPENGLSE_NO_SIMD) && (defined(__ARM_NEON) || defined(__ARM_NEON__))
+  #define OPENGLSE_NEON                 // NEON matrix kernels
+  #include <arm_neon.h>
+#endif
 
 #include <GL/glew.h>
 #include <GL/freeglut.h>
@@ -134,32 +171,69 @@ unsigned char default_font_data[] =       {   // default font pixel data
 
 char shader_vertex[] =
 "#version 330                                                 \n"
+"// features are set by #defines inserted by make_shader_source: RENDER_MODE, TEXTURES, ANIMATED, DRAW_2D, FOG, INSTANCED, SKINNED, VERTEX_TEXTURE \n"
 "layout (location = 0) in vec3 position;                      \n"
-"layout (location = 1) in vec2 texture_coordinate;          \n"
+"layout (location = 1) in vec2 texture_coordinate;            \n"
 "layout (location = 2) in vec3 normal;                        \n"
 "layout (location = 3) in float texture_blend_ratio;          \n"
 "layout (location = 4) in vec3 position2;                     \n"
-"layout (location = 5) in vec2 texture_coordinate2;         \n"
+"layout (location = 5) in vec2 texture_coordinate2;           \n"
 "layout (location = 6) in vec3 normal2;                       \n"
 "layout (location = 7) in float texture_blend_ratio2;         \n"
+"layout (location = 8) in mat4 instance_matrix;  // world matrix of the instance, locations 8 to 11 \n"
+"                                                             \n"
+"#if ANIMATED                                                 \n"
+"uniform float frame_percentage;   // for animation           \n"
+"#endif                                                       \n"
+"#if SKINNED                                                  \n"
+"layout (location = 12) in uvec4 bone_indices;                \n"
+"layout (location = 13) in vec4 bone_weights;  // normalized, sum to 1\n"
+"layout (std140, row_major) uniform bone_data  // bone world matrices * inverse bind matrices, in a buffer so that they don't use the vertex uniform components \n"
+"{                                                            \n"
+"  mat4 bone_matrices[MAX_BONES];                             \n"
+"};                                                           \n"
+"#endif                                                       \n"
+"#if VERTEX_TEXTURE                                           \n"
+"layout (location = 14) in float instance_time_offset;  // milliseconds\n"
+"uniform sampler2D vertex_texture_unit;  // position and normal of each vertex in each frame\n"
+"uniform float animation_time;     // milliseconds            \n"
+"uniform int vertex_texture_vertices;  // vertices of one frame\n"
+"uniform int vertex_texture_frames;                           \n"
+"uniform float frame_starts[MAX_ANIMATION_FRAMES + 1];  // the last one is the length\n"
+"                                                             \n"
+"vec3 fetch_vertex(int frame, int component)  // component 0 = position, 1 = normal\n"
+"{                                                            \n"
+"  int index = (frame * vertex_texture_vertices + gl_VertexID) * 2 + component;\n"
+"  return texelFetch(vertex_texture_unit,ivec2(index % VERTEX_TEXTURE_WIDTH,index / VERTEX_TEXTURE_WIDTH),0).xyz;\n"
+"}                                                            \n"
+"#endif                                                       \n"
+"layout (std140, row_major) uniform frame_data  // per-frame uniform block (frame_uniforms) \n"
+"{                                                            \n"
+"  mat4 perspective_matrix;                                   \n"
+"  mat4 view_matrix;                                          \n"
+"  vec3 light_direction;                                      \n"
+"  float fog_distance;                                        \n"
+"  vec3 light_color;                                          \n"
+"  float far_plane;          // far plane distance            \n"
+"  vec3 camera_position;                                      \n"
+"  vec3 background_color;    // viewport background color     \n"
+"};                                                           \n"
+"                                                             \n"
+"layout (std140) uniform material_data  // per-material uniform block (material_uniforms) \n"
+"{                                                            \n"
+"  vec3 mesh_color;                                           \n"
+"  float ambient_factor;                                      \n"
+"  vec3 transparent_color;                                    \n"
+"  float diffuse_factor;                                      \n"
+"  float specular_factor;                                     \n"
+"  float specular_exponent;                                   \n"
+"};                                                           \n"
 "                                                             \n"
-"uniform float frame_percentage;        // for animation, if < 0, no animation is used \n"
-"uniform mat4 perspective_matrix;                             \n"
 "uniform mat4 world_matrix;                                   \n"
-"uniform mat4 view_matrix;                                    \n"
-"uniform vec3 light_direction;                                \n"
-"uniform uint textures;                                       \n"
-"uniform vec3 camera_position;                                \n"
-"uniform float ambient_factor;     // material variable       \n"
-"uniform float diffuse_factor;     // material variable       \n"
-"uniform float specular_factor;    // material variable       \n"
-"uniform float specular_exponent;  // material variable       \n"
-"uniform uint render_mode;                                    \n"
-"uniform float fog_distance;                                  \n"
-"uniform float far_plane;          // far plane distance      \n"
-"uniform bool draw_2d;             // of true, the view and perspective transforms won't be performed \n"
+"uniform vec3 position_offset;     // dequantisation of compact vertex positions \n"
+"uniform vec3 position_scale;                                 \n"
 "                                                             \n"
-"out vec2 uv_coordinate;                                    \n"
+"out vec2 uv_coordinate;                                      \n"
 "out float texture_ratio;                                     \n"
 "out float final_intensity;      // computed from lighting    \n"
 "out vec3 transformed_normal;    // normal after object transformation \n"
@@ -173,52 +247,80 @@ char shader_vertex[] =
 "                                                             \n"
 "void main()                                                  \n"
 "{                                                            \n"
-
-"  if (frame_percentage >= 0) {                               \n"
-"    transformed_position = mix(position,position2,frame_percentage);    \n"
-"    transformed_normal = mix(normal,normal2,frame_percentage);          \n"
-"    uv_coordinate = mix(texture_coordinate,texture_coordinate2,frame_percentage);  \n"
-"    texture_ratio = mix(texture_blend_ratio,texture_blend_ratio2,frame_percentage); }    \n"
-"  else {"
-"    transformed_position = position;                         \n"
-"    uv_coordinate = texture_coordinate;                  \n"
-"    transformed_normal = normal; }                           \n"
+"#if ANIMATED                                                 \n"
+"  transformed_position = mix(position,position2,frame_percentage); \n"
+"  transformed_normal = mix(normal,normal2,frame_percentage); \n"
+"  uv_coordinate = mix(texture_coordinate,texture_coordinate2,frame_percentage); \n"
+"  texture_ratio = mix(texture_blend_ratio,texture_blend_ratio2,frame_percentage); \n"
+"#elif VERTEX_TEXTURE                                         \n"
+"  float time = mod(animation_time + instance_time_offset,frame_starts[vertex_texture_frames]);\n"
+"  int frame = 0;                                             \n"
+"                                                             \n"
+"  while (frame < vertex_texture_frames - 1 && time >= frame_starts[frame + 1])\n"
+"    frame++;                                                 \n"
+"                                                             \n"
+"  float ratio = (time - frame_starts[frame]) / max(frame_starts[frame + 1] - frame_starts[frame],0.001);\n"
+"  int next_frame = (frame + 1) % vertex_texture_frames;      \n"
+"  transformed_position = mix(fetch_vertex(frame,0),fetch_vertex(next_frame,0),ratio);\n"
+"  transformed_normal = mix(fetch_vertex(frame,1),fetch_vertex(next_frame,1),ratio);\n"
+"  uv_coordinate = texture_coordinate;                        \n"
+"#else                                                        \n"
+"  transformed_position = position_offset + position * position_scale; \n"
+"  uv_coordinate = texture_coordinate;                        \n"
+"  transformed_normal = normal;                               \n"
+"#endif                                                       \n"
+"                                                             \n"
+"#if SKINNED                                                  \n"
+"  mat4 skin_matrix =                                         \n"
+"    bone_matrices[bone_indices.x] * bone_weights.x +         \n"
+"    bone_matrices[bone_indices.y] * bone_weights.y +         \n"
+"    bone_matrices[bone_indices.z] * bone_weights.z +         \n"
+"    bone_matrices[bone_indices.w] * bone_weights.w;          \n"
+"  transformed_position = (skin_matrix * vec4(transformed_position,1.0)).xyz;\n"
+"  transformed_normal = (skin_matrix * vec4(transformed_normal,0.0)).xyz;\n"
+"#endif                                                       \n"
+"                                                             \n"
+"#if INSTANCED                                                \n"
+"  mat4 model_matrix = instance_matrix;                       \n"
+"#else                                                        \n"
+"  mat4 model_matrix = world_matrix;                          \n"
+"#endif                                                       \n"
+"  transformed_position = (model_matrix * vec4(transformed_position,1.0)).xyz; \n"
+"  transformed_normal = normalize((model_matrix * vec4(transformed_normal,0.0)).xyz); \n"
+"                                                             \n"
+"#if DRAW_2D                                                  \n"
+"  gl_Position = vec4(transformed_position,1.0);              \n"
+"#else                                                        \n"
+"  gl_Position = perspective_matrix * view_matrix * vec4(transformed_position,1.0); \n"
+"#endif                                                       \n"
+"                                                             \n"
+"#if TEXTURES == 2                                            \n"
+"  texture_ratio = texture_blend_ratio;                       \n"
+"#endif                                                       \n"
+"                                                             \n"
+"#if FOG                                                      \n"
+"  if (fog_distance > 0) // fog enabled                       \n"
+"    fog_intensity = clamp(pow((1.0 - gl_Position.z / far_plane) / (1.0 - fog_distance),2),0.0,1.0); \n"
+"  else                                                       \n"
+"    fog_intensity = 1.0;                                     \n"
+"#endif                                                       \n"
 "                                                             \n"
-"  transformed_position = (world_matrix * vec4(transformed_position,1.0)).xyz;                         \n"
-"  transformed_normal = normalize((world_matrix * vec4(transformed_normal,0.0)).xyz);                  \n"
-"                                                                                                      \n"
-"                                                                                                      \n"
-"  if (!draw_2d)                                                                                       \n"
-"    gl_Position = perspective_matrix * view_matrix * vec4(transformed_position,1.0);                  \n"
-"  else                                                                                                \n"
-"    gl_Position = vec4(transformed_position,1.0);                                                     \n"
-"                                                                                                      \n"
-"   if (textures == uint(2))                                                                           \n"
-"    texture_ratio = texture_blend_ratio;                                                              \n"
-"                                                                                                      \n"
-"  if (fog_distance > 0) // fog enabled                                                                \n"
-"    fog_intensity = clamp(pow((1.0 - gl_Position.z / far_plane) / (1.0 - fog_distance),2),0.0,1.0);   \n"
-"  else                                                                                                \n"
-"    fog_intensity = 1.0;                                                                              \n"
-"                                                                                                      \n"
-"  if (render_mode == uint(0)) {    // no light                                                        \n"
-"    diffuse_intensity = 1.0;                                                                          \n"
-"    specular_intensity = 1.0;                                                                         \n"
-"    final_intensity = 1.0; }                                                                          \n"
-"  else if (render_mode == uint(1)) {   // Goraud shading                                              \n"
-"    diffuse_intensity = clamp(dot(normalize(transformed_normal),-1 * light_direction),0.0,1.0);       \n"
-"    reflection_vector = normalize(reflect(light_direction,transformed_normal));                       \n"
-"    direction_to_camera = normalize(camera_position - transformed_position);                          \n"
-"    specular_intensity = clamp(dot(direction_to_camera,reflection_vector),0.0,1.0);                   \n"
-"    specular_intensity = clamp(pow(specular_intensity,specular_exponent),0.0,1.0);                    \n"
-"    final_intensity = ambient_factor + diffuse_factor * diffuse_intensity + specular_factor * specular_intensity; } \n"
-"  else                                                                                                \n"
-"    final_intensity = 1.0;                                                                            \n"
+"#if RENDER_MODE == 1  // Goraud shading                      \n"
+"  diffuse_intensity = clamp(dot(normalize(transformed_normal),-1 * light_direction),0.0,1.0); \n"
+"  reflection_vector = normalize(reflect(light_direction,transformed_normal)); \n"
+"  direction_to_camera = normalize(camera_position - transformed_position); \n"
+"  specular_intensity = clamp(dot(direction_to_camera,reflection_vector),0.0,1.0); \n"
+"  specular_intensity = clamp(pow(specular_intensity,specular_exponent),0.0,1.0); \n"
+"  final_intensity = ambient_factor + diffuse_factor * diffuse_intensity + specular_factor * specular_intensity; \n"
+"#else                                                        \n"
+"  final_intensity = 1.0;                                     \n"
+"#endif                                                       \n"
 "}                                                            \n";
 
 char shader_fragment[] =
 "#version 330                                                 \n"
-"in vec2 uv_coordinate;                                     \n"
+"// features are set by #defines inserted by make_shader_source: RENDER_MODE, TEXTURES, DRAW_2D, FOG, SHADOWS, TRANSPARENCY \n"
+"in vec2 uv_coordinate;                                       \n"
 "in float final_intensity;                                    \n"
 "in vec3 transformed_normal;                                  \n"
 "in vec3 transformed_position;                                \n"
@@ -228,24 +330,32 @@ char shader_fragment[] =
 "                                                             \n"
 "uniform sampler2D texture_unit;                              \n"
 "uniform sampler2D texture_unit2;  // second texture layer    \n"
-"uniform uint textures;            // number of textures (0,1 or 2) \n"
-"uniform vec3 mesh_color;                                     \n"
-"uniform vec3 light_direction;                                \n"
-"uniform vec3 light_color;                                    \n"
-"uniform vec3 camera_position;                                \n"
-"uniform float ambient_factor;     // material variable       \n"
-"uniform float diffuse_factor;     // material variable       \n"
-"uniform float specular_factor;    // material variable       \n"
-"uniform float specular_exponent;  // material variable       \n"
-"uniform vec3 transparent_color;                              \n"
-"uniform bool transparency_enabled;                           \n"
-"uniform uint render_mode;                                    \n"
-"uniform float fog_distance;                                  \n"
-"uniform vec3 background_color;  // viewport background color \n"
-"uniform bool use_fog;                                        \n"
+"layout (std140, row_major) uniform frame_data  // per-frame uniform block (frame_uniforms) \n"
+"{                                                            \n"
+"  mat4 perspective_matrix;                                   \n"
+"  mat4 view_matrix;                                          \n"
+"  vec3 light_direction;                                      \n"
+"  float fog_distance;                                        \n"
+"  vec3 light_color;                                          \n"
+"  float far_plane;          // far plane distance            \n"
+"  vec3 camera_position;                                      \n"
+"  vec3 background_color;    // viewport background color     \n"
+"};                                                           \n"
+"                                                             \n"
+"layout (std140) uniform material_data  // per-material uniform block (material_uniforms) \n"
+"{                                                            \n"
+"  vec3 mesh_color;                                           \n"
+"  float ambient_factor;                                      \n"
+"  vec3 transparent_color;                                    \n"
+"  float diffuse_factor;                                      \n"
+"  float specular_factor;                                     \n"
+"  float specular_exponent;                                   \n"
+"};                                                           \n"
+"                                                             \n"
+"#if SHADOWS                                                  \n"
 "uniform uint number_of_shadows;                              \n"
 "uniform float shadows[256];                                  \n"
-"uniform bool draw_2d;             // of true, the view and perspective transforms won't be performed \n"
+"#endif                                                       \n"
 "                                                             \n"
 "vec3 transparent_color_difference;   // helper variable      \n"
 "vec3 reflection_vector;                                      \n"
@@ -262,49 +372,54 @@ char shader_fragment[] =
 "                                                             \n"
 "void main()                                                  \n"
 "{                                                            \n"
-"  if (textures == uint(0))                                   \n"
-"    FragColor = vec4(mesh_color,1.0);                        \n"
-"  else {                                                     \n"
-"    FragColor = texture2D(texture_unit,uv_coordinate.xy);  \n"
-"    if (textures == uint(2))                                 \n"
-"       FragColor = mix(texture2D(texture_unit2,uv_coordinate.xy),FragColor,texture_ratio);  \n"
-"    }                                                        \n"
+"#if TEXTURES == 0                                            \n"
+"  FragColor = vec4(mesh_color,1.0);                          \n"
+"#else                                                        \n"
+"  FragColor = texture2D(texture_unit,uv_coordinate.xy);      \n"
+"#if TEXTURES == 2                                            \n"
+"  FragColor = mix(texture2D(texture_unit2,uv_coordinate.xy),FragColor,texture_ratio); \n"
+"#endif                                                       \n"
+"#endif                                                       \n"
 "                                                             \n"
-"  if (render_mode == uint(2)) { // Phong                                                                      \n"
-"    diffuse_intensity = clamp(dot(normalize(transformed_normal),-1 * light_direction),0.0,1.0);               \n"
-"    reflection_vector = normalize(reflect(light_direction,transformed_normal));                               \n"
-"    direction_to_camera = normalize(camera_position - transformed_position);                                  \n"
-"    specular_intensity = clamp(dot(direction_to_camera,reflection_vector),0.0,1.0);                           \n"
-"    specular_intensity = clamp(pow(specular_intensity,specular_exponent),0.0,1.0);                            \n"
-"    helper_intensity = ambient_factor + diffuse_factor * diffuse_intensity + specular_factor * specular_intensity; } \n"
-"  else                                                       \n"
-"    helper_intensity = final_intensity;                      \n"
+"#if RENDER_MODE == 2  // Phong                               \n"
+"  diffuse_intensity = clamp(dot(normalize(transformed_normal),-1 * light_direction),0.0,1.0); \n"
+"  reflection_vector = normalize(reflect(light_direction,transformed_normal)); \n"
+"  direction_to_camera = normalize(camera_position - transformed_position); \n"
+"  specular_intensity = clamp(dot(direction_to_camera,reflection_vector),0.0,1.0); \n"
+"  specular_intensity = clamp(pow(specular_intensity,specular_exponent),0.0,1.0); \n"
+"  helper_intensity = ambient_factor + diffuse_factor * diffuse_intensity + specular_factor * specular_intensity; \n"
+"#else                                                        \n"
+"  helper_intensity = final_intensity;                        \n"
+"#endif                                                       \n"
 "                                                             \n"
+"#if TRANSPARENCY   // gl_FragDepth is only written here, so that other variants keep early depth test \n"
 "  gl_FragDepth = gl_FragCoord.z;                             \n"
+"  transparent_color_difference = FragColor.xyz - transparent_color; \n"
 "                                                             \n"
-"  if (transparency_enabled) {                                \n"
-"    transparent_color_difference = FragColor.xyz - transparent_color; \n"
-"                                                                      \n"
-"  if (draw_2d)                                               \n"
-"    gl_FragDepth = 0.0;                                      \n"
+"#if DRAW_2D                                                  \n"
+"  gl_FragDepth = 0.0;                                        \n"
+"#endif                                                       \n"
 "                                                             \n"
-"  if (abs(transparent_color_difference[0]) < 0.1 && abs(transparent_color_difference[1]) < 0.1 && abs(transparent_color_difference[2]) < 0.1)  // set the z coordinate \n"
-"      gl_FragDepth = 1.1;     // transparent color           \n"
-"    }                                                        \n"
+"  if (FragColor.a < 0.5 || (abs(transparent_color_difference[0]) < 0.1 && abs(transparent_color_difference[1]) < 0.1 && abs(transparent_color_difference[2]) < 0.1))  // compressed textures have alpha \n"
+"    gl_FragDepth = 1.1;     // transparent color             \n"
+"#endif                                                       \n"
 "                                                             \n"
 "  FragColor = FragColor * vec4(helper_intensity,helper_intensity,helper_intensity,1.0) * vec4(light_color,1.0); \n"
 "                                                             \n"
+"#if SHADOWS                                                  \n"
 "  for (i = uint(0); i < number_of_shadows; i++) {            \n"
 "    shadow_index = i * uint(4);  // sizeof shadow struct     \n"
-"    dx = uv_coordinate.x - shadows[shadow_index];          \n"
-"    dy = uv_coordinate.y - shadows[shadow_index + uint(1)];\n"
+"    dx = uv_coordinate.x - shadows[shadow_index];            \n"
+"    dy = uv_coordinate.y - shadows[shadow_index + uint(1)];  \n"
 "    shadow_center_distance = sqrt(dx * dx + dy * dy);        \n"
 "    shadow_color = sign(shadows[shadow_index + uint(3)]);    \n"
 "    shadow_intensity = clamp(-20.0 * shadow_center_distance + 20.0 * shadows[shadow_index + uint(2)],0.0,1.0); \n"
 "    FragColor = mix(FragColor,vec4(shadow_color,shadow_color,shadow_color,1.0),shadow_intensity * abs(shadows[shadow_index + uint(3)])); } \n"
+"#endif                                                       \n"
 "                                                             \n"
-"  if (use_fog)                                               \n"
-"    FragColor = mix(vec4(background_color,1.0),FragColor,fog_intensity); // apply fog \n"
+"#if FOG                                                      \n"
+"  FragColor = mix(vec4(background_color,1.0),FragColor,fog_intensity); // apply fog \n"
+"#endif                                                       \n"
 "}                                                            \n";
 
 typedef enum                       /// special key codes
@@ -323,6 +438,18 @@ typedef enum
     RENDER_MODE_WIREFRAME          /// Goraud shaded, drawn in wireframe
   } render_mode;
 
+typedef enum                       /// shader features that are compiled into a shader variant (as #defines), combined with the render mode and number of textures
+  {
+    SHADER_ANIMATED = 16,          /// interpolation between two animation frames
+    SHADER_2D = 32,                /// no view and perspective transformation
+    SHADER_FOG = 64,
+    SHADER_SHADOWS = 128,          /// simple shadows on the mesh surface
+    SHADER_TRANSPARENCY = 256,     /// transparent color of the texture (writes gl_FragDepth)
+    SHADER_INSTANCED = 512,        /// world matrix taken from the instance_matrix attribute
+    SHADER_SKINNED = 1024,         /// vertices transformed by a weighted sum of bone matrices
+    SHADER_VERTEX_TEXTURE = 2048   /// animation frames read from a vertex animation texture at the instance's time
+  } shader_feature;
+
 typedef enum
   {
     DIRECTION_UP,
@@ -333,6 +460,53 @@ typedef enum
     DIRECTION_BACKWARD
   } axis_direction;
 
+typedef enum                        /// formats a texture_2d can be stored in on GPU
+  {
+    TEXTURE_COMPRESSION_NONE = 0,   /// 4 bytes per pixel (RGBA)
+    TEXTURE_COMPRESSION_BC1,        /// 0.5 bytes per pixel (S3TC DXT1), the transparent color is encoded as 1 bit alpha
+    TEXTURE_COMPRESSION_BC3         /// 1 byte per pixel (S3TC DXT5), better colors than BC1 next to the transparent color
+  } texture_compression;
+
+typedef enum                        /// what happens to the CPU copy of an object's data (texture pixels, mesh vertices and triangles) after it's uploaded to GPU
+  {
+    RESIDENCY_KEEP = 0,             /// the data stay in memory
+    RESIDENCY_DISCARD,              /// the data are freed, they can't be changed or uploaded again
+    RESIDENCY_RELOAD                /// the data are freed and written to the cache directory, they're loaded back when needed
+  } residency_policy;
+
+typedef enum                        /// kinds of objects the memory usage is reported for
+  {
+    MEMORY_TEXTURES = 0,
+    MEMORY_MESHES,                  /// static, skinned and batched meshes and mesh groups
+    MEMORY_ANIMATED_MESHES,
+    MEMORY_CROWDS,
+    MEMORY_BUFFER_ARENAS,           /// the whole buffers of the arenas, the meshes in them don't count their GPU data
+    MEMORY_UNIFORM_BUFFERS,         /// the shared frame, material and bone uniform buffers
+    MEMORY_CATEGORIES               /// number of categories, used as a category it means all of them
+  } memory_category;
+
+typedef struct                      /// memory used by one category of objects
+  {
+    unsigned int objects;           /// number of objects with data on CPU or GPU
+    unsigned long long cpu_bytes;
+    unsigned long long gpu_bytes;
+    unsigned long long cpu_peak_bytes;   /// high-water marks since the start
+    unsigned long long gpu_peak_bytes;
+  } memory_usage;
+
+typedef struct                      /// memory used by one object
+  {
+    memory_category category;
+    unsigned long long cpu_bytes;
+    unsigned long long gpu_bytes;
+  } memory_record;
+
+typedef enum                        /// layouts of the vertex data on GPU
+  {
+    VERTEX_FORMAT_FLOAT = 0,        /// 36 bytes per vertex, all attributes are 32 bit floats
+    VERTEX_FORMAT_COMPACT           /// 16 bytes per vertex, see vertex_3d_compact
+  } vertex_format;
+
 typedef enum
   {
     ROTATION_XYZ,                   /// rotation around x first, then y and then z
@@ -348,6 +522,24 @@ typedef struct                      /// point in 3D space
     float z;
   } point_3d;
 
+typedef struct                      /// quaternion representing a rotation, x, y and z is the vector part, w the scalar part
+  {
+    float x;
+    float y;
+    float z;
+    float w;
+  } quaternion;
+
+typedef struct                      /// 4x4 matrix aligned for SIMD, m[row][column], used with column vectors
+  {
+    alignas(16) float m[4][4];
+  } matrix_4x4;
+
+typedef struct                      /// 4D vector aligned for SIMD
+  {
+    alignas(16) float v[4];
+  } vector_4d;
+
 typedef struct                      /// vertex in 3D space
   {
     point_3d position;
@@ -356,6 +548,15 @@ typedef struct                      /// vertex in 3D space
     float texture_blend_ratio;      /// for texture blending
   } vertex_3d;
 
+typedef struct                      /// compact vertex (16 bytes) uploaded to GPU with VERTEX_FORMAT_COMPACT
+  {
+    unsigned short position[3];     /// position quantised within the mesh bounding box
+    unsigned char texture_blend_ratio;
+    unsigned char padding;
+    unsigned short texture_coordinate[2];  /// half floats or unsigned normalized values
+    unsigned int normal;            /// signed normalized 10-10-10-2 (GL_INT_2_10_10_10_REV)
+  } vertex_3d_compact;
+
 typedef struct                      /// triangle represented as three vertex indices
   {
     unsigned int index1;
@@ -363,15 +564,98 @@ typedef struct                      /// triangle represented as three vertex ind
     unsigned int index3;
   } triangle_3d;
 
-typedef struct                      /// an animation frame
+typedef struct                      /// cluster of neighbouring triangles that is culled as a whole
+  {
+    unsigned int first_triangle;    /// the meshlet's triangles are a continuous range in the mesh
+    unsigned int triangle_count;
+    point_3d center;                /// bounding sphere in model space
+    float radius;
+    point_3d cone_axis;             /// average direction the triangles face
+    float cone_cutoff;              /// sine of the normal cone angle, > 1 if the meshlet can't be back face culled
+  } meshlet;
+
+typedef struct                      /// an animation frame, all frames of a mesh share one VBO and IBO
   {
-    GLuint vbo;
-    GLuint ibo;
     vector<vertex_3d> vertices;
     vector<triangle_3d> triangles;
     unsigned int length_ms;         /// frame length in milliseconds
   } animation_frame;
 
+typedef struct                      /// bone influences of one vertex of a skinned mesh
+  {
+    unsigned char bone_indices[4];
+    unsigned char bone_weights[4];  /// the weights are normalized so that they sum to 255
+  } vertex_skin;
+
+typedef struct                      /// bone of a skeleton, its transformation is relative to the parent bone
+  {
+    string name;
+    int parent;                     /// index of the parent bone, -1 for a root bone, parents always go before their children
+    point_3d position;              /// bind pose (the pose the mesh was modelled in)
+    quaternion rotation;
+    point_3d scale;
+    matrix_4x4 inverse_bind_matrix; /// transforms the mesh from the bind pose to the bone's space
+  } skeleton_bone;
+
+typedef struct                      /// pose of one bone at given time of an animation clip
+  {
+    float time_ms;
+    point_3d position;
+    quaternion rotation;
+    point_3d scale;
+  } bone_key;
+
+typedef struct                      /// keys of one bone in an animation clip
+  {
+    unsigned int bone;
+    vector<bone_key> keys;          /// sorted by time
+  } bone_track;
+
+typedef struct                      /// per-frame shader data, std140 layout of the frame_data uniform block
+  {
+    float perspective_matrix[4][4]; /// row-major like all the matrices (the block is declared row_major)
+    float view_matrix[4][4];
+    float light_direction[3];
+    float fog_distance;             /// normalised, -1 if the fog is disabled
+    float light_color[3];
+    float far_plane;
+    float camera_position[3];
+    float padding;
+    float background_color[3];
+    float padding2;
+  } frame_uniforms;
+
+typedef struct                      /// per-material shader data, std140 layout of the material_data uniform block
+  {
+    float mesh_color[3];
+    float ambient_factor;
+    float transparent_color[3];
+    float diffuse_factor;
+    float specular_factor;
+    float specular_exponent;
+    GLuint textures;                /// this and the following members aren't in the block (they select the shader variant), they make the materials differ
+    GLuint render_mode;
+    GLuint use_fog;
+    GLuint transparency_enabled;
+    GLuint padding[2];              /// to 64 bytes
+  } material_uniforms;
+
+typedef struct                      /// compiled shader program for one combination of shader features
+  {
+    GLuint program;                 /// 0 if the variant hasn't been compiled yet
+    bool failed;                    /// the variant couldn't be made, it isn't tried again until clear_shader_variants
+    GLuint world_matrix_location;
+    GLuint frame_percentage_location;
+    GLuint number_of_shadows_location;
+    GLuint shadows_location;
+    GLuint position_offset_location;
+    GLuint position_scale_location;
+    GLuint animation_time_location;
+    GLuint vertex_texture_vertices_location;
+    GLuint vertex_texture_frames_location;
+    GLuint frame_starts_location;
+  } shader_variant;
+
 typedef struct                      /// simple shadow properties
   {                                 // don't change this struct, it would probably mess things up
     float position[2];              /// texture (uv) coordinate of the shadow at the surface
@@ -383,9 +667,20 @@ typedef enum                        /// possible interpolation methods
   {
     INTERPOLATION_LINEAR,
     INTERPOLATION_SINE,
-    INTERPOLATION_CONSTANT
+    INTERPOLATION_CONSTANT,
+    INTERPOLATION_CATMULL_ROM,      /// cubic spline through the keyframes, tangents given by the neighbouring keyframes (no velocity jumps)
+    INTERPOLATION_HERMITE,          /// cubic spline with tangents given at the keyframes
+    INTERPOLATION_BEZIER            /// cubic Bezier curve with control values given at the keyframes
   } interpolation_method;
 
+typedef struct                      /// cubic polynomial of one keyframe segment, value = ((a * t + b) * t + c) * t + d, t in <0,1>
+  {
+    float coefficients[4];          /// a, b, c, d
+    float start;                    /// x of the first keyframe
+    float inverse_width;            /// 1 / segment width, makes t out of x
+    bool sine;                      /// t is eased with a cosine first (INTERPOLATION_SINE)
+  } spline_segment;
+
 //------------------------------------
 
 class gpu_object                       /// something that can be put on GPU
@@ -425,6 +720,11 @@ class texture_2d: public gpu_object    /// represents a texture, it's x and y si
       bool transparency_enabled;
       unsigned char transparent_color[3];
       float transparent_color_float[3];
+      texture_compression compression;      /// format requested with set_compression
+      texture_compression gpu_compression;  /// format the texture has been uploaded in
+      residency_policy residency;
+      bool data_discarded;                  /// true if the data have been freed after upload
+      unsigned long long residency_hash;    /// hash of the data in the cache directory released with RESIDENCY_RELOAD, 0 if none
 
       GLuint to;            /// texture object handle
 
@@ -433,6 +733,35 @@ class texture_2d: public gpu_object    /// represents a texture, it's x and y si
          Uploads the texture data to GPU.
          */
 
+      void encode_blocks(vector<unsigned char> &blocks);
+        /**<
+         Encodes the texture data to compressed blocks of the format set
+         with set_compression, the rows of blocks are encoded in
+         parallel by the job system.
+
+         @param blocks vector the blocks will be written to
+         */
+
+      unsigned long long get_data_hash();
+        /**<
+         Computes the hash of the pixel data and everything else the
+         compressed blocks depend on, which keys the texture cache.
+
+         @return hash
+         */
+
+      void release_data();
+        /**<
+         Frees the pixel data after upload according to the residency
+         policy.
+         */
+
+      void update_memory_usage();
+        /**<
+         Reports the texture's current CPU and GPU memory to the memory
+         statistics.
+         */
+
       unsigned int xy_to_linear(int x, int y);
         /**<
          Converts x,y coordinates to linear data offset.
@@ -447,7 +776,7 @@ class texture_2d: public gpu_object    /// represents a texture, it's x and y si
          Class constructor, initialises a new texture.
          */
 
-      ~texture_2d();
+      virtual ~texture_2d();
         /**<
          Class destructor, frees all the memory.
          */
@@ -571,4983 +900,14762 @@ class texture_2d: public gpu_object    /// represents a texture, it's x and y si
          @param texture hright in pixels
          */
 
-      virtual void update();
-      virtual void unload();
-  };
-
-//------------------------------------
-
-class mesh_3d: public gpu_drawable    /// an abstract class of 3D mesh made of triangles
-  {
-    protected:
-      point_3d position;
-      point_3d rotation;   /// the object's rotation in angles, x, y and z are roll, pitch and yaw
-      point_3d scale;
-      bool use_fog;
-      texture_2d *texture;     /// the texture associated with the mesh
-      texture_2d *texture2;    /// second texture layer for texture blending (e.g. for terrain)
-      unsigned int color[3];   /// RGB mesh color that's used when the mesh doesn't have any texture
-      float color_float[3];    /// mesh RGB color in range <0,1>
-      render_mode mesh_render_mode;         /// determines how the model will be rendered
-      bool visible;
-
-      float material_ambient_intensity;     /// in range <0,1>, affects how much ambient light is reflected
-      float material_diffuse_intensity;     /// in range <0,1>, affects how much diffuse light is reflected
-      float material_specular_intensity;    /// in range <0,1>, affects how much specular light is reflected
-      float material_specular_exponent;
-
-      float translation_matrix[4][4];
-      float rotation_matrix[4][4];
-      float scale_matrix[4][4];
-      float transformation_matrix[4][4];  /// translation + rotation + scale
-
-      void update_transformation_matrix();
+      void set_compression(texture_compression compression);
         /**<
-          Computes and updates the object's transformation matrix out of
-          translation, rotation and scale matrices.
-        */
-
-      void init_rendering();
-        /**<
-          Sets the uniform variables, textures and other things for the
-          shaed before rendering is done.
+         Sets the format the texture is stored in on GPU, it takes
+         effect at the next update. Compressed textures take 4 (BC3) or
+         8 (BC1) times less memory and bandwidth. The blocks are encoded
+         on the CPU on all threads and if a cache directory is set (see
+         set_cache_directory), they are saved there and loaded at the
+         next run instead of encoding again. If the GPU doesn't support
+         S3TC, the texture is uploaded uncompressed.
+
+         @param compression texture format
          */
 
-    public:
-      vector<shadow> shadows;             /// simple shadows on the object surface
-
-      mesh_3d();
+      texture_compression get_compression();
         /**<
-         Class constructor.
-        */
+         Gets the format set with set_compression.
 
-      virtual ~mesh_3d() = 0;
-        /**<
-         Class destructor, frees all the object's memory.
+         @return requested texture format
          */
 
-      void set_visibility(bool visible);
+      texture_compression get_gpu_compression();
         /**<
-         Sets the mesh visibility.
+         Gets the format the texture has actually been uploaded in
+         (differs from get_compression when compression isn't
+         supported).
 
-         @param visible if true, the mesh will be visible, otherwise not
+         @return texture format on GPU
          */
 
-      bool get_visibility();
-
+      unsigned int get_gpu_memory_size();
         /**<
-         Checks whether the mesh is visible.
+         Gets the size of the texture on GPU.
 
-         @return true if the mesh is visible, false otherwise
+         @return size in bytes
          */
 
-      texture_2d *get_texture(unsigned int texture_no = 0);
+      unsigned int get_cpu_memory_size();
         /**<
-         Gets the texture of this mesh.
+         Gets the size of the texture's pixel data in memory.
 
-         @param texture_no number of texture (1 or 2)
-         @return texture
+         @return size in bytes, 0 if the data have been released
          */
 
-      void set_render_mode(render_mode mode);
+      void set_residency(residency_policy policy);
         /**<
-         Sets the render mode for the mesh (determines how the mesh will
-         be rendered).
-
-         @param mode mode to be set
+         Sets what happens to the pixel data after the texture is
+         uploaded (by update, initialise or load_ppm). Released data are
+         loaded back automatically (RESIDENCY_RELOAD) by the methods that
+         need them (set_pixel, get_pixel, flip_vertical, save_ppm,
+         update), and freed again by the next upload. With
+         RESIDENCY_DISCARD these methods fail with an error (get_pixel
+         returns black) and the texture stays on GPU as it is. The lazy
+         reload isn't thread safe, code that reads the pixels from
+         several threads has to call make_resident before.
+         RESIDENCY_RELOAD needs a cache directory (see
+         set_cache_directory), without it the data are kept.
+
+         @param policy residency policy, RESIDENCY_KEEP by default
          */
 
-      void add_shadow(float x, float y, float radius, float brightness);
+      residency_policy get_residency();
         /**<
-         Adds a new simple shadow blob that will be displayed on the
-         surface of the mesh.
+         Gets the residency policy.
 
-         @param x texture u coordinate of the shadow center
-         @param y texture v coordinate of the shadow center
-         @param radius shadow radius
-         @param brightness brightness in range <-1,1>, -1 means
-                completely black, 1 means completely white
+         @return residency policy
          */
 
-      void set_use_fog(bool enable);
+      bool make_resident();
         /**<
-         Sets whether the mesh should be affected by fog (if it's turned
-         on) when being rendered;
+         Makes sure the pixel data are in memory, loading them from the
+         cache directory if they have been released with
+         RESIDENCY_RELOAD.
 
-         @param enable if true, the mesh will be affected by fog,
-                otherwise not
+         @return true if the data are in memory, false if they have been
+                 discarded
          */
 
-      render_mode get_render_mode();
+      virtual void update();
+      virtual void unload();
+  };
+
+//------------------------------------
+
+class scene_node                      /// node of the transform hierarchy (scene graph), its transformation is relative to its parent node
+  {
+    protected:
+      point_3d position;
+      point_3d rotation;               /// rotation in degrees, same as with mesh_3d, computed from the orientation when needed
+      quaternion orientation;
+      bool rotation_up_to_date;        /// false if the orientation changed and the rotation angles haven't been computed yet
+      point_3d scale;
+      scene_node *parent;
+      vector<scene_node *> children;
+      float local_matrix[4][4];        /// translation + rotation + scale relative to the parent
+      float world_matrix[4][4];        /// parent world matrix * local matrix
+      bool dirty;                      /// local transformation or parent changed since the last update
+      bool world_changed;              /// the world matrix was recomputed in the last update pass
+
+    public:
+      scene_node();
         /**<
-         Returns the render mode set for the mesh.
+         Class constructor, makes a new root node with identity
+         transformation.
+         */
 
-         @return current render mode
+      ~scene_node();
+        /**<
+         Class destructor, the children of the node become root nodes.
+         Meshes attached to the node have to be detached (or deleted)
+         before.
          */
 
-      virtual void clear() = 0;
+      scene_node(const scene_node &node) = delete;
+      scene_node &operator=(const scene_node &node) = delete;
         /**<
-         Restores the mesh to the state as if it was just initialised.
+         Nodes can't be copied, a copy would share the children and
+         unlink them when destroyed.
          */
 
-      void set_color(unsigned char red, unsigned char green, unsigned char blue);
+      bool set_parent(scene_node *parent);
         /**<
-         Sets the mesh's color (which will be used if no texture is specified
-         for the mesh).
+         Attaches the node to a parent node, its transformation will
+         then be relative to the parent.
 
-         @param red amount of red
-         @param green amount of green
-         @param blue amount of blue
+         @param parent new parent node, NULL makes the node a root node
+         @return true if the parent was set, false if it would make a
+                 cycle in the hierarchy
          */
 
-      void set_lighting_properties(float ambient, float diffuse, float specular, float specular_exponent);
+      scene_node *get_parent();
         /**<
-         Sets the lighting properties that affect how the light is
-         reflected by the mesh surface.
+         Gets the parent node.
 
-         @param ambient factor in range <0,1>, says how much ambient light is reflected
-         @param diffuse factor in range <0,1>, says how much diffuse light is reflected
-         @param specular factor in range <0,1>, says how much specular light is reflected
-         @param specular_exponent defines a size of specular reflections
+         @return parent node or NULL if the node is a root
          */
 
-      void set_texture(texture_2d *texture);
+      unsigned int get_number_of_children();
         /**<
-         Sets given texture to be used with this mesh.
+         Gets the number of the node's children.
 
-         @param texture texture to be set for the mesh
-        */
+         @return number of children
+         */
 
-      void set_texture2(texture_2d *texture);
+      scene_node *get_child(unsigned int index);
         /**<
-         Sets given texture to be used as a second texture layer with
-         this mesh.
+         Gets the node's child.
 
-         @param texture texture to be set for the mesh as a second
-                texture layer
-        */
+         @param index index of the child, must be lower than
+                get_number_of_children()
+         @return child node
+         */
 
       void set_position(float x, float y, float z);
         /**<
-         Sets the mesh position in the world space.
+         Sets the node position relative to its parent.
 
          @param x new x position
          @param y new y position
          @param z new z position
-        */
+         */
 
       void set_rotation(float x, float y, float z);
         /**<
-         Sets the mesh rotation in the world space. The parameter
+         Sets the node rotation relative to its parent. The parameter
          values are in degrees.
 
          @param x new x rotation along x axis (roll)
          @param y new y rotation along y axis (pitch)
          @param z new z rotation along z axis (yaw)
-        */
+         */
+
+      void set_orientation(quaternion orientation);
+        /**<
+         Sets the node rotation relative to its parent as a quaternion.
+
+         @param orientation new rotation, it should be normalized
+         */
+
+      void get_orientation(quaternion *orientation);
+        /**<
+         Gets the node rotation relative to its parent as a quaternion.
+
+         @param orientation in this variable the rotation will be returned
+         */
+
+      void rotate(quaternion rotation);
+        /**<
+         Rotates the node by given rotation (applied after the current
+         one). No trigonometric functions are computed, so for constant
+         rotation speed make the quaternion once and call this each
+         frame.
+
+         @param rotation rotation to be applied
+         */
 
       void set_scale(float x, float y, float z);
         /**<
-         Sets the mesh scale.
+         Sets the node scale relative to its parent.
 
          @param x new scale in x direction
          @param y new scale in y direction
          @param z new scale in z direction
-        */
+         */
 
-      void set_scale(float scale);
+      void get_position(point_3d *point);
         /**<
-         Sets the mesh scale.
+         Gets the node position relative to its parent.
 
-         @param scale new scale
-        */
+         @param point in this variable the position will be returned
+         */
 
-      void get_position(point_3d *point);
+      void get_rotation(point_3d *point);
         /**<
-         Gets the object position.
+         Gets the node rotation relative to its parent.
 
-         @param point in this variable the object position will be returned
-        */
+         @param point in this variable the rotation will be returned
+         */
 
       void get_scale(point_3d *scale);
         /**<
-         Gets the object scale.
+         Gets the node scale relative to its parent.
 
-         @param scale in this variable the object scale (in x, y and z) will be returned
-        */
+         @param scale in this variable the scale will be returned
+         */
 
-      void get_rotation(point_3d *point);
+      void get_world_matrix(float matrix[4][4]);
         /**<
-         Gets the object rotation.
+         Gets the node's world matrix (all the transformations from
+         the root node down to this one). If any node has changed
+         since, update_scene_nodes is called first.
 
-         @param point in this variable the object rotation will be returned
-        */
+         @param matrix in this variable the matrix will be returned
+         */
 
-      virtual void update() = 0;
-      virtual void unload() = 0;
-      virtual void draw() = 0;
+      void get_world_position(point_3d *point);
+        /**<
+         Gets the node's position in the world space.
+
+         @param point in this variable the position will be returned
+         */
+
+      const float *get_world_matrix_pointer();
+        /**<
+         Gets a pointer to the node's world matrix as computed by the
+         last update_scene_nodes call (no update is done).
+
+         @return pointer to the row-major 4x4 world matrix
+         */
+
+      void update_world_matrix();
+        /**<
+         Recomputes the world matrix if the node or its parent has
+         changed. The parent has to be updated before, this is called
+         for all the nodes in the right order by update_scene_nodes.
+         */
   };
 
 //------------------------------------
 
-class mesh_3d_static: public mesh_3d         /// static (non-animated) 3D mesh
+typedef struct                      /// range of a buffer_arena buffer
   {
-    protected:
-      GLuint vbo;          /// the mesh's virtual buffer object handle
-      GLuint ibo;          /// the mesh's index buffer object handle
-      GLuint vao;          /// the mesh's vertex array object handle
-      mesh_3d_static *instance_parent;    /// if this object is an instance of another mesh, this points to it
+    unsigned int offset;            /// in vertices or indices
+    unsigned int size;
+  } arena_range;
 
-    public:
-      vector<vertex_3d> vertices;
-      vector<triangle_3d> triangles;
+typedef struct                      /// part of a buffer_arena given to one mesh
+  {
+    arena_range vertices;
+    arena_range indices;            /// the indices are relative to the first vertex of the allocation
+    bool used;
+  } arena_allocation;
 
-      mesh_3d_static();
+typedef struct                      /// part of a texture_atlas page taken by one texture
+  {
+    unsigned int page;              /// index of the page
+    unsigned int x;                 /// position of the texture in the page in pixels (without the padding)
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+    float u0;                       /// texture coordinates of the texture's corners in the page
+    float v0;
+    float u1;
+    float v1;
+  } atlas_region;
+
+typedef struct                      /// segment of the skyline (top edge of the packed rectangles) of an atlas page
+  {
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+  } skyline_segment;
+
+class buffer_arena                  /// big VBO and IBO shared by many small meshes, which are drawn with base vertex offsets from one VAO
+  {
+    protected:
+      GLuint vbo;
+      GLuint ibo;                   /// 16 bit indices
+      GLuint vao;
+      unsigned int vertex_capacity;
+      unsigned int index_capacity;
+      vector<arena_allocation> allocations;   /// indexed by allocation handles
+      vector<unsigned int> free_handles;
+      vector<arena_range> free_vertices;      /// free ranges sorted by offset, adjacent ranges are always merged
+      vector<arena_range> free_indices;
+
+      void grow(unsigned int minimum_vertices, unsigned int minimum_indices);
         /**<
-         Class constructor.
+         Makes the buffers bigger (at least twice) so that the given
+         number of vertices and indices can be allocated, the existing
+         data are copied on GPU.
         */
 
-      mesh_3d_static(mesh_3d_static *copy_from);
+      void make_vao();
         /**<
-         Copy constructor, makes a copy of an existing mesh. The mesh
-         must be updated with update method afterwards. This does NOT
-         make the new mesh an instance of the existing mesh.
+         Sets up the VAO for the current buffers.
+        */
 
-         @param copy_from static mesh to be copied
+    public:
+      buffer_arena(unsigned int vertex_capacity = 16384, unsigned int index_capacity = 49152);
+        /**<
+         Class constructor. The buffers are made with the first
+         allocation and grow as needed.
+
+         @param vertex_capacity initial number of vertices
+         @param index_capacity initial number of indices
         */
 
-      virtual ~mesh_3d_static();
+      ~buffer_arena();
+
+      int allocate(unsigned int number_of_vertices, unsigned int number_of_indices);
         /**<
-         Class destructor, frees all the object's memory.
-         */
+         Allocates ranges of the vertex and index buffer with first fit
+         strategy, the buffers are made bigger if there is no free range
+         big enough.
+
+         @param number_of_vertices number of vertices, at most 65536 as
+                the indices are 16 bit
+         @param number_of_indices number of indices
+         @return handle of the allocation, which stays valid until it's
+                 freed (defragmentation doesn't change it)
+        */
 
-      void make_instance_of(mesh_3d_static *what);
+      void free(int allocation);
         /**<
-         Makes this mesh an instance of another mesh (that means that
-         this mesh will use the other meshe's vertex data stored in GPU
-         memory.) The vertex data of this mesh will be deleted by
-         calling this method.
+         Frees an allocation, its ranges are merged with the adjacent
+         free ones.
 
-         @param what mesh of which this mesh will become an instance
-         */
+         @param allocation handle of the allocation
+        */
 
-      virtual void update();
-      virtual void unload();
-      virtual void draw();
-      virtual void clear();
+      void upload(int allocation, vector<vertex_3d> &vertices, vector<triangle_3d> &triangles);
+        /**<
+         Uploads mesh data to an allocation, it has to be big enough.
 
-      unsigned int vertex_count();
+         @param allocation handle of the allocation
+         @param vertices vertices to be uploaded
+         @param triangles triangles to be uploaded, the indices are
+                relative to the first vertex
+        */
+
+      arena_allocation get_allocation(int allocation);
         /**<
-         Gets the mesh vertex count.
+         Gets the ranges of given allocation, the offsets can change
+         with each defragmentation.
 
-         @return number of vertices of the mesh, if the mesh is
-                 instanced, then the number of vertices of the instance
-                 parent is returned
-         */
+         @param allocation handle of the allocation
+         @return allocation ranges
+        */
 
-      unsigned int triangle_count();
+      GLuint get_vao();
         /**<
-         Gets the mesh triangle count.
+         Gets the VAO shared by all the meshes in the arena, its element
+         array buffer is the arena's IBO.
 
-         @return number of triangles of the mesh, if the mesh is
-                 instanced, then the number of triangles of the instance
-                 parent is returned
-         */
+         @return VAO handle
+        */
 
-      void add_triangle(unsigned int index1, unsigned int index2, unsigned int index3);
+      void defragment();
         /**<
-         Adds a new triangle indices to the mesh.
+         Moves all the allocations to the beginning of the buffers (the
+         data are copied on GPU) so that all the free space becomes one
+         range at the end. The allocation handles stay valid.
+        */
 
-         @param index1 first index of the triangle
-         @param index2 second index of the triangle
-         @param index3 third index of the triangle
+      unsigned int get_allocation_count();
+        /**<
+         Gets the number of allocations currently in use.
+
+         @return number of allocations
         */
 
-      void print_data();
-       /**<
-         Debugging purposes method, prints the model's vertices and
-         triangles to stdout.
-         */
+      void get_occupancy(float *vertex_occupancy, float *index_occupancy);
+        /**<
+         Gets the used fraction of the buffers.
 
-      void remove_useless_triangles();
+         @param vertex_occupancy in this variable the used fraction of
+                the VBO (0 to 1) will be returned
+         @param index_occupancy in this variable the used fraction of
+                the IBO (0 to 1) will be returned
+        */
+
+      void get_fragmentation(float *vertex_fragmentation, float *index_fragmentation);
         /**<
-         Removes all mesh triangles that have two or three same vertices
-         and thus serve no purpose.
-         */
+         Gets the fragmentation of the free space of the buffers,
+         computed as 1 - largest free range / all free space, so 0
+         means all the free space can be allocated at once.
+
+         @param vertex_fragmentation in this variable the VBO
+                fragmentation will be returned
+         @param index_fragmentation in this variable the IBO
+                fragmentation will be returned
+        */
 
-      void merge_vertices(unsigned int index1, unsigned int index2, bool average_position);
+      void print_report();
         /**<
-         Merges two vertices into one while preserving the mesh
-         triangles (their indices will be recomputed).
+         Prints the arena capacity, occupancy and fragmentation to the
+         standard output.
+        */
+  };
 
-         @param index1 index of the first vertex to be merged
-         @param index2 index of the second vertex to be merged
-         @param average_position if true, the new vertex will be placed
-                at average position of both vertices, otherwise the
-                second vertex (index2) will be merged into the first one
-         */
+//------------------------------------
 
-      void merge(mesh_3d_static *mesh);
+class mesh_3d: public gpu_drawable    /// an abstract class of 3D mesh made of triangles
+  {
+    protected:
+      point_3d position;
+      point_3d rotation;   /// the object's rotation in angles, x, y and z are roll, pitch and yaw
+      point_3d scale;
+      bool use_fog;
+      texture_2d *texture;     /// the texture associated with the mesh
+      texture_2d *texture2;    /// second texture layer for texture blending (e.g. for terrain)
+      unsigned int color[3];   /// RGB mesh color that's used when the mesh doesn't have any texture
+      float color_float[3];    /// mesh RGB color in range <0,1>
+      render_mode mesh_render_mode;         /// determines how the model will be rendered
+      bool visible;
+
+      float material_ambient_intensity;     /// in range <0,1>, affects how much ambient light is reflected
+      float material_diffuse_intensity;     /// in range <0,1>, affects how much diffuse light is reflected
+      float material_specular_intensity;    /// in range <0,1>, affects how much specular light is reflected
+      float material_specular_exponent;
+      material_uniforms material;         /// the material data the mesh was last drawn with
+      int material_index;                 /// index of the material in the material uniform buffer, -1 if not known yet
+
+      quaternion orientation;             /// the object's rotation, the rotation angles are computed from it when needed
+      bool rotation_up_to_date;           /// false if the orientation changed and the rotation angles haven't been computed yet
+      bool transformation_up_to_date;     /// false if the transformation matrix has to be recomputed before it's used
+      float transformation_matrix[4][4];  /// translation + rotation + scale
+      scene_node *parent_node;            /// node the mesh is attached to, NULL if none
+
+      void update_transformation_matrix();
         /**<
-         Merges another mesh to this one.
+          Computes and updates the object's transformation matrix out of
+          the position, orientation and scale.
+        */
 
-         @param mesh mesh to merge to this one, it will stay unmodified
+      void init_rendering(unsigned int features = 0);
+        /**<
+          Sets the uniform variables, textures and other things for the
+          shaed before rendering is done. The shader variant is chosen
+          by the mesh's material and given features.
+
+          @param features shader_feature values the drawing needs in
+                 addition to the material (SHADER_ANIMATED,
+                 SHADER_INSTANCED)
          */
 
-      void flip_triangles();
+    public:
+      vector<shadow> shadows;             /// simple shadows on the object surface
+
+      mesh_3d();
         /**<
-         Flips the vertex triangles and normals (so that they're facing
-         the other way).
+         Class constructor.
+        */
+
+      virtual ~mesh_3d() = 0;
+        /**<
+         Class destructor, frees all the object's memory.
          */
 
-      bool load_obj(string filename);
+      void set_visibility(bool visible);
         /**<
-         Loads the mesh from obj file format.
+         Sets the mesh visibility.
 
-         @param filename file to be loaded
-         @return true if everything went OK, false otherwise
+         @param visible if true, the mesh will be visible, otherwise not
          */
 
-      bool save_obj(string filename);
+      bool get_visibility();
+
         /**<
-         Saves the mesh as obj file format.
+         Checks whether the mesh is visible.
 
-         @param filename file to be saved
-         @return true if everything went OK, false otherwise
+         @return true if the mesh is visible, false otherwise
          */
 
-      void simplify(float ratio);
+      texture_2d *get_texture(unsigned int texture_no = 0);
         /**<
-         lowers the number of polygons, for more see
-         simplify(unsigned int).
+         Gets the texture of this mesh.
 
-         @param ratio value in range <0,1> which says how much the mesh
-                should be simplified (e.g. 0.75 means that the new mesh
-                will be 75 % of the original)
+         @param texture_no number of texture (1 or 2)
+         @return texture
          */
 
-      void simplify(unsigned int iterations);
+      void set_render_mode(render_mode mode);
         /**<
-         lowers the number of polygons by successively merging vertices
-         with the shortest distance together. This is useful for example
-         for making simplified versions of the mesh for LOD. This method
-         is very simple and may take a lot of time for models with a lot
-         of triangles (a few thousand).
+         Sets the render mode for the mesh (determines how the mesh will
+         be rendered).
 
-         @param iterations how many times the vertices will be merged
+         @param mode mode to be set
          */
 
-      void get_bounding_box(float *x0, float *y0, float *z0, float *x1, float *y1, float *z1);
+      void add_shadow(float x, float y, float radius, float brightness);
         /**<
-         Gets the model bounding box (in model space).
+         Adds a new simple shadow blob that will be displayed on the
+         surface of the mesh.
 
-         @param x0 x coordinate of the first point
-         @param y0 y coordinate of the first point
-         @param z0 z coordinate of the first point
-         @param x1 x coordinate of the second point
-         @param y1 y coordinate of the second point
-         @param z1 z coordinate of the second point
+         @param x texture u coordinate of the shadow center
+         @param y texture v coordinate of the shadow center
+         @param radius shadow radius
+         @param brightness brightness in range <-1,1>, -1 means
+                completely black, 1 means completely white
          */
 
-      void get_bounding_box(point_3d *first_point, point_3d *second_point);
+      void set_use_fog(bool enable);
         /**<
-         Gets the model bounding box (in model space).
+         Sets whether the mesh should be affected by fog (if it's turned
+         on) when being rendered;
 
-         @param first_point in this variable the first point defining
-                the bounding box will be returned
-         @param second_point in this variable the second point defining
-                the bounding box will be returned
+         @param enable if true, the mesh will be affected by fog,
+                otherwise not
          */
 
-      void get_size(float *width, float *height, float *depth);
+      render_mode get_render_mode();
         /**<
-         Gets the size of the model's bounding box (in model space).
+         Returns the render mode set for the mesh.
 
-         @param width in this variable the model width (x size) will be
-                returned
-         @param height in this variable the model height (y) will be
-                returned
-         @param depth in this variable the model depth (z) will be
-                returned
+         @return current render mode
          */
 
-      void get_vbo_ibo_vao(GLuint *vbo, GLuint *ibo, GLuint *vao);
+      bool has_same_material(mesh_3d *mesh);
         /**<
-         Gets the VBO (vertex buffer object), IBO (index buffer object)
-         and VAO (vertex array object) handles.
+         Checks whether another mesh is rendered with the same material,
+         i.e. the same textures, render mode, color, lighting properties
+         and fog setting, so that both can be drawn with one draw call.
 
-         @param vbo in this vriable VBO handle will be returned
-         @param ibo in this vriable IBO handle will be returned
-         @param vao in this vriable VAO handle will be returned
+         @param mesh mesh to be compared with this one
+         @return true if the materials are the same, false otherwise
          */
 
-      void texture_map_plane(axis_direction direction, float plane_width, float plane_height);
+      void copy_material(mesh_3d *mesh);
         /**<
-         Maps the texture coordinates of the vertices using planar mapping.
+         Sets the textures, render mode, color, lighting properties and
+         fog setting of this mesh to those of another mesh.
 
-         @param direction direction of the plane normal
-         @param plane_width width of the plane, 1.0 is the width of the mesh
-         @param plena_height height of the plane, 1.0 is the height of the mesh
+         @param mesh mesh whose material will be copied
          */
 
-      void texture_map_layer_mask(texture_2d *mask);
+      virtual void clear() = 0;
         /**<
-         Maps a mask defining texture layers blend. This information is
-         encoded into mesh vertices. The mapping is done depending on
-         vertices x and z position.
+         Restores the mesh to the state as if it was just initialised.
+         */
 
-         @param mask gryscale blend mask (only red component is taken
-                into account)
+      void set_color(unsigned char red, unsigned char green, unsigned char blue);
+        /**<
+         Sets the mesh's color (which will be used if no texture is specified
+         for the mesh).
+
+         @param red amount of red
+         @param green amount of green
+         @param blue amount of blue
          */
 
-      void smooth_normals();
+      void set_lighting_properties(float ambient, float diffuse, float specular, float specular_exponent);
         /**<
-         Makes the mesh normals by computing a normal for each triangle
-         and averaging them so the mesh will appear smooth.
+         Sets the lighting properties that affect how the light is
+         reflected by the mesh surface.
+
+         @param ambient factor in range <0,1>, says how much ambient light is reflected
+         @param diffuse factor in range <0,1>, says how much diffuse light is reflected
+         @param specular factor in range <0,1>, says how much specular light is reflected
+         @param specular_exponent defines a size of specular reflections
          */
 
-      void add_vertex(float x, float y, float z);
+      void set_texture(texture_2d *texture);
         /**<
-         Adds a new vertex to the mesh.
+         Sets given texture to be used with this mesh.
 
-         @param x x position of the vertice
-         @param y y position of the vertice
-         @param z z position of the vertice
+         @param texture texture to be set for the mesh
         */
 
-      void add_vertex(float x, float y, float z, float texture_u, float texture_v, float normal_x, float normal_y, float normal_z);
+      void set_texture2(texture_2d *texture);
         /**<
-         Adds a new vertex to the mesh.
+         Sets given texture to be used as a second texture layer with
+         this mesh.
 
-         @param x x position of the vertice
-         @param y y position of the vertice
-         @param z z position of the vertice
-         @param texture_u texture u coordinate
-         @param texture_v texture v coordinate
-         @param normal_x normal vector x, the normal will be automatically normalized
-         @param normal_y normal vector y
-         @param normal_z normal vector z
+         @param texture texture to be set for the mesh as a second
+                texture layer
         */
 
-      void apply_matrix(float matrix[4][4]);
+      void set_position(float x, float y, float z);
         /**<
-         Applies a transformation matrix to all the vertices of the
-         mesh. The multiplication is done in order point * matrix (so
-         the point is a row vector, not column). Normals are also
-         transformed.
+         Sets the mesh position in the world space.
 
-         @param matrix transformation matrix to be applies
+         @param x new x position
+         @param y new y position
+         @param z new z position
         */
 
-      void scale_to_size(float size, bool apply_matrix = false);
+      void set_rotation(float x, float y, float z);
         /**<
-         Scales the model so that it's largest size (i.e. width,
-         height or depth) is given amount while keeping it's
-         proportions. The size is calculated from the model's bounding
-         box.
-
-         @param size to what size the model should be scaled
-         @param apply_matrix if true, the model will be scaled by
-                applying scale matrix which means it will be scaled in
-                model space, otherwise the model will be scaled by
-                setting it's scale property (it will be scaled in world
-                space)
-         */
-  };
-
-//------------------------------------
-
-class mesh_3d_animated: public mesh_3d
-  {
-    protected:
-      bool playing;
-      bool loop;                   /// whether the animation should loop
-      bool interpolating;          /// whether frame interpolation or just switching is used
-      float play_speed;
-      int current_frame;           /// current frame number
-      float frame_percentage;      /// percentage played of the current frame
-      mesh_3d_animated *instance_parent;    /// if this object is an instance of another mesh, this points to it
+         Sets the mesh rotation in the world space. The parameter
+         values are in degrees.
 
-    public:
-      vector<animation_frame> frames;
+         @param x new x rotation along x axis (roll)
+         @param y new y rotation along y axis (pitch)
+         @param z new z rotation along z axis (yaw)
+        */
 
-      mesh_3d_animated();
+      void set_scale(float x, float y, float z);
         /**<
-         Class constructor.
-         */
+         Sets the mesh scale.
 
-      virtual ~mesh_3d_animated();
-        /**<
-         Class destructor, frees all the object's memory.
-         */
+         @param x new scale in x direction
+         @param y new scale in y direction
+         @param z new scale in z direction
+        */
 
-      void set_speed(float speed);
+      void set_scale(float scale);
         /**<
-         Sets the play speed of the animation.
+         Sets the mesh scale.
 
-         @param speed speed at which the animation should be played (1.0
-                is normal)
-         */
+         @param scale new scale
+        */
 
-      void make_instance_of(mesh_3d_animated *what);
+      void get_position(point_3d *point);
         /**<
-         Makes this mesh an instance of another mesh (that means that
-         this mesh will use the other meshe's vertex data stored in GPU
-         memory.) The vertex data of this mesh will be deleted by
-         calling this method.
+         Gets the object position.
 
-         @param what mesh of which this mesh will become an instance
-         */
+         @param point in this variable the object position will be returned
+        */
 
-      void use_interpolation(bool interpolate);
+      void get_scale(point_3d *scale);
         /**<
-         Sets the frame interpolation on or off.
+         Gets the object scale.
 
-         @param interpolate if true, interpolation between frames will be
-                used, otherwise the frames will just be switched
-         */
+         @param scale in this variable the object scale (in x, y and z) will be returned
+        */
 
-      unsigned int get_number_of_frames();
+      void get_rotation(point_3d *point);
         /**<
-         Returns number of animation frames.
+         Gets the object rotation.
 
-         @return number of frames
-         */
+         @param point in this variable the object rotation will be returned
+        */
 
-      void add_frame(mesh_3d_static *mesh, unsigned int length);
+      void set_orientation(quaternion orientation);
         /**<
-         Makes a new frame out of 3D mesh and appends it to the frame
-         list.
+         Sets the mesh rotation as a quaternion.
 
-         @param mesh mesh whose vertex and triangle data will be used to
-                make the frame
-         @param length length of the frame in milliseconds
-         */
+         @param orientation new rotation, it should be normalized
+        */
 
-      void set_playing(bool play);
+      void get_orientation(quaternion *orientation);
         /**<
-         Makes the animation play or stop.
-
-         @param play if true, the animation will start to play, otherwise
-                it will stop
-         */
-
-      virtual void update();
-      virtual void unload();
-      virtual void clear();
-      virtual void draw();
-  };
+         Gets the mesh rotation as a quaternion.
 
-//------------------------------------
-
-class picture_2d: public gpu_drawable /// 2D picture that can be drawn (for example for GUI)
-  {
-    protected:
-      mesh_3d_static picture_mesh;    /// 2 triangles that will be textured with the image
-
-    public:
-      picture_2d();
-      virtual ~picture_2d();
+         @param orientation in this variable the rotation will be returned
+        */
 
-      void set_picture(texture_2d *picture);
+      void rotate(quaternion rotation);
         /**<
-         Sets the picture to be displayed.
+         Rotates the mesh by given rotation (applied after the current
+         one). No trigonometric functions are computed, so for constant
+         rotation speed make the quaternion once and call this each
+         frame.
 
-         @param picture picture to be displayed
-         */
+         @param rotation rotation to be applied
+        */
 
-      void set_position(float x, float y);
+      void get_transformation_matrix(float matrix[4][4]);
         /**<
-         Sets the picture position on the screen.
+         Gets the mesh transformation matrix (translation * rotation *
+         scale), it is only computed when it's needed and something has
+         changed. Parent scene node transformation isn't included.
 
-         @param x x position in range <0,1>
-         @param y y position in range <0,1>
-         */
+         @param matrix in this variable the matrix will be returned
+        */
 
-      mesh_3d_static* get_picture_mesh();
+      void get_world_matrix(float matrix[4][4]);
         /**<
-         Gets the internal mesh that is used to display the image.
+         Gets the matrix the mesh is rendered with, i.e. the
+         transformation matrix combined with the parent node's world
+         matrix if the mesh is attached to a node.
 
-         @return pointer to picture mesh
-         */
+         @param matrix in this variable the matrix will be returned
+        */
 
-      void set_size(float width, float height);
+      void set_parent_node(scene_node *node);
         /**<
-         Sets the picture size.
+         Attaches the mesh to a scene node so that it moves with it, the
+         mesh position, rotation and scale are then relative to the
+         node.
 
-         @param width width in range <0,1>
-         @param height height in range <0,1>
-         */
+         @param node node to attach the mesh to, NULL detaches the mesh
+        */
 
-      void set_rotation(float degrees);
+      scene_node *get_parent_node();
         /**<
-         Sets the picture rotation
+         Gets the scene node the mesh is attached to.
 
-         @param angles rotation angle in degrees
-         */
+         @return the node or NULL if the mesh isn't attached to any
+        */
 
-      virtual void draw();
-      virtual void update();
-      virtual void unload();
+      virtual void update() = 0;
+      virtual void unload() = 0;
+      virtual void draw() = 0;
   };
 
 //------------------------------------
 
-typedef struct                        /// for LOD
-  {
-    float distance_to;                /// to which distance this mesh should be used
-    mesh_3d_static *mesh;
-  } detail_level;
-
-class mesh_3d_lod: public mesh_3d        /// set of multiple static meshes that are being switched between depending on their distance, the LOD is being recomputed every RECOMPUTE_FRAMES frames
+class mesh_3d_static: public mesh_3d         /// static (non-animated) 3D mesh
   {
     protected:
-      bool keep_everything_on_gpu;
-      bool use_this_mesh_properties;  /// if true, then all the meshes will only provide geometry, other things (textures etc.) will be provided by this mesh_3d_lod
-      int active_level;               // -1 if lod_meshes vector is empty
-
-    public:
-      vector<detail_level> lod_meshes;
+      GLuint vbo;          /// the mesh's virtual buffer object handle
+      GLuint ibo;          /// the mesh's index buffer object handle
+      GLuint vao;          /// the mesh's vertex array object handle
+      mesh_3d_static *instance_parent;    /// if this object is an instance of another mesh, this points to it
+      GLenum index_type;                  /// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, type of the indices in the IBO
+      vertex_format format;               /// layout of the vertex data on GPU
+      bool compact_uv_half;               /// with compact format, true if texture coordinates are half floats (they don't fit <0,1>)
+      point_3d position_offset;           /// dequantised position = position_offset + quantised position * position_scale
+      point_3d position_scale;
+      vector<meshlet> meshlets;           /// triangle clusters for culling, empty if they haven't been built
+      unsigned int meshlet_triangle_count;   /// number of triangles the meshlets were built for
+      unsigned int culled_triangles;      /// triangles removed by meshlet culling in the last draw
+      vector<GLsizei> visible_counts;     /// index counts of the ranges that passed meshlet culling
+      vector<const GLvoid *> visible_offsets;  /// byte offsets of those ranges in the IBO
+      buffer_arena *arena;                /// if not NULL, the mesh is stored in this arena instead of its own buffers
+      int arena_handle;                   /// handle of the mesh's allocation in the arena, -1 if it has none
+      residency_policy residency;
+      bool data_discarded;                /// true if the vertices and triangles have been freed after upload
+      unsigned int discarded_vertex_count;   /// vertex_count and triangle_count of the uploaded data
+      unsigned int discarded_triangle_count;
+      unsigned long long residency_hash;  /// hash of the data in the cache directory released with RESIDENCY_RELOAD, 0 if none
+
+      void make_compact_vertices(vector<vertex_3d_compact> &compact_vertices);
+        /**<
+         Converts the vertices to the compact format and computes the
+         position dequantisation values.
+         */
 
-      mesh_3d_lod(bool use_this_mesh_properties, bool keep_everything_on_gpu);
+      void transform_vertices(float matrix[4][4], unsigned int first, unsigned int number_of_vertices);
         /**<
-         Class constructor, initialises new object.
+         Applies a matrix to a range of vertices, see apply_matrix.
 
-         @param use_this_mesh_properties if true, then all the detail
-                meshes will only provide geometry, other things (such as
-                textures, lighting etc.) will be provided by this
-                mesh_3d_lod so that all the mesh details will share them,
-                if false, then all meshes can specify their own
-                properties
-         @param keep_everything_on_gpu if true, then all the detail
-                meshes will be kept loaded on GPU (faster mesh switching
-                but less memory efficient), otherwise only current
-                detail level mesh will be loaded on GPU (slower but
-                better for memory)
+         @param matrix matrix to be applied
+         @param first index of the first vertex
+         @param number_of_vertices number of vertices to be transformed
          */
 
-      int get_current_detail_level();
+      void upload_position_dequantization();
         /**<
-         Gets the current detail level.
-
-         @return current detail level where 0 is the best quality mesh,
-                 -1 means there is active level because either there are
-                 no meshes set or the mesh_3d_lod object is too far away
-                 beyond all meshes set distances
+         Sets the shader's position dequantisation uniforms for the
+         mesh's vertex format, init_rendering has to be called before.
          */
 
-      void add_detail_mesh(mesh_3d_static *mesh, float distance);
+      void draw_index_ranges(vector<GLsizei> &counts, vector<const GLvoid *> &offsets);
         /**<
-         Adds a detail level mesh,
+         Draws given ranges of the mesh's IBO with one
+         glMultiDrawElements call. init_rendering has to be called
+         before.
 
-         @param mesh mesh to be added
-         @param distance distance from the camera to which the mesh
-                should be used, the next mesh will be used after the
-                distance is crossed (or the mesh will stop being
-                displayed if there is no next level of detail)
+         @param counts number of indices in each range
+         @param offsets offset of each range in the IBO in bytes
          */
 
-      virtual void update();
+      void release_arena_allocation();
         /**<
-         This should be called every time a change is made to this
-         object's lod_meshes vector manually.
+         Frees the mesh's allocation in the buffer arena, if it has
+         one.
          */
 
-      virtual void unload();
+      void upload_buffers();
         /**<
-         Does nothing for this class.
+         Uploads the vertices and triangles to the mesh's buffers or its
+         buffer arena allocation.
          */
 
-      virtual void draw();
+      void release_data();
         /**<
-         Draws the current level of detail mesh.
+         Frees the vertices and triangles after upload according to the
+         residency policy.
          */
 
-      virtual void clear();
-  };
-
-//------------------------------------
-
-typedef struct
-  {
-    float x;                            /// indipendent variable value
-    float y;                            /// dependant variable value
-    interpolation_method interpolation; /// method of interpolation from this point to the next one
-  } keyframe;
-
-class keyframe_interpolator           /// represents a general function of one argument composed of points that are interpolated between (good for animation etc.)
-  {
-    protected:
-      void sort();
+      virtual void update_memory_usage();
         /**<
-         Sorts the keyframes by x value (lowest first).
+         Reports the mesh's current CPU and GPU memory to the memory
+         statistics.
          */
 
     public:
-      vector<keyframe> keyframes;
+      vector<vertex_3d> vertices;
+      vector<triangle_3d> triangles;
 
-      void add_keyframe(float x, float y, interpolation_method interpolation);
+      mesh_3d_static();
         /**<
-         Adds a new keyframe. It will be automatically put in the right
-         place so that the keyframes are sorted.
-
-         @param x indipendent variable value
-         @param y dependant variable value
-         @param interpolation method of interpolation from this point to the next one
-         */
+         Class constructor.
+        */
 
-      float get_value(float x);
+      mesh_3d_static(mesh_3d_static *copy_from);
         /**<
-         Gets the function value in given point.
+         Copy constructor, makes a copy of an existing mesh. The mesh
+         must be updated with update method afterwards. This does NOT
+         make the new mesh an instance of the existing mesh.
 
-         @param x value in which the function should be computed (interpolated)
-         @return function value
-         */
-  };
+         @param copy_from static mesh to be copied
+        */
+
+      virtual ~mesh_3d_static();
+        /**<
+         Class destructor, frees all the object's memory.
+         */
+
+      void make_instance_of(mesh_3d_static *what);
+        /**<
+         Makes this mesh an instance of another mesh (that means that
+         this mesh will use the other meshe's vertex data stored in GPU
+         memory.) The vertex data of this mesh will be deleted by
+         calling this method.
+
+         @param what mesh of which this mesh will become an instance
+         */
+
+      virtual void update();
+      virtual void unload();
+      virtual void draw();
+      virtual void clear();
+
+      unsigned int vertex_count();
+        /**<
+         Gets the mesh vertex count.
+
+         @return number of vertices of the mesh, if the mesh is
+                 instanced, then the number of vertices of the instance
+                 parent is returned
+         */
+
+      unsigned int triangle_count();
+        /**<
+         Gets the mesh triangle count.
+
+         @return number of triangles of the mesh, if the mesh is
+                 instanced, then the number of triangles of the instance
+                 parent is returned
+         */
+
+      void add_triangle(unsigned int index1, unsigned int index2, unsigned int index3);
+        /**<
+         Adds a new triangle indices to the mesh.
+
+         @param index1 first index of the triangle
+         @param index2 second index of the triangle
+         @param index3 third index of the triangle
+        */
+
+      void print_data();
+       /**<
+         Debugging purposes method, prints the model's vertices and
+         triangles to stdout.
+         */
+
+      void remove_useless_triangles();
+        /**<
+         Removes all mesh triangles that have two or three same vertices
+         and thus serve no purpose.
+         */
+
+      void merge_vertices(unsigned int index1, unsigned int index2, bool average_position);
+        /**<
+         Merges two vertices into one while preserving the mesh
+         triangles (their indices will be recomputed).
+
+         @param index1 index of the first vertex to be merged
+         @param index2 index of the second vertex to be merged
+         @param average_position if true, the new vertex will be placed
+                at average position of both vertices, otherwise the
+                second vertex (index2) will be merged into the first one
+         */
+
+      void merge(mesh_3d_static *mesh);
+        /**<
+         Merges another mesh to this one.
+
+         @param mesh mesh to merge to this one, it will stay unmodified
+         */
+
+      void flip_triangles();
+        /**<
+         Flips the vertex triangles and normals (so that they're facing
+         the other way).
+         */
+
+      void optimize_vertex_cache();
+        /**<
+         Reorders the triangles so that the GPU post-transform vertex
+         cache is used well (Tom Forsyth's linear-speed algorithm for
+         a VERTEX_CACHE_SIZE LRU cache) and then renumbers the vertices
+         in the order they're first used so that vertex fetch is
+         sequential. The mesh looks the same, only the indices change.
+         load_obj does this automatically.
+         */
+
+      void get_vertex_cache_statistics(unsigned int cache_size, float *acmr, float *atvr);
+        /**<
+         Simulates a FIFO post-transform vertex cache drawing the mesh
+         and computes how well the triangle order uses it.
+
+         @param cache_size number of vertices in the simulated cache
+         @param acmr in this variable the average cache miss ratio
+                (transformed vertices per triangle, 0.5 to 3, the lower
+                the better) will be returned
+         @param atvr in this variable the average transform to vertex
+                ratio (transformed vertices per used vertex, 1 is
+                optimal) will be returned
+         */
+
+      void optimize_overdraw(float threshold);
+        /**<
+         Reorders the triangles so that less pixels are shaded more than
+         once (Sander et al.: Fast Triangle Reordering for Vertex
+         Locality and Reduced Overdraw). The triangles are split into
+         clusters at the points where the vertex cache is flushed
+         anyway and where the cache efficiency stays within the
+         threshold, then the clusters facing outwards (those likely to
+         occlude the others) are put first. Call it after
+         optimize_vertex_cache.
+
+         @param threshold how much the ACMR is allowed to get worse in
+                exchange for less overdraw, e.g. 1.05 means 5 %, 1.0
+                means only the hard cluster boundaries are used
+         */
+
+      void build_meshlets();
+        /**<
+         Splits the triangles into meshlets (at most
+         MESHLET_MAX_VERTICES vertices and MESHLET_MAX_TRIANGLES
+         triangles) with bounding spheres and normal cones. When the
+         mesh is drawn, the meshlets outside the view frustum or facing
+         away from the camera are skipped, which pays off for meshes
+         with many triangles. The meshlets follow the triangle order, so
+         optimize_vertex_cache should be called before (load_obj does
+         it). The meshlets have to be built again if the triangles
+         change.
+         */
+
+      unsigned int get_meshlet_count();
+        /**<
+         Gets the number of meshlets.
+
+         @return number of meshlets, 0 if they haven't been built
+         */
+
+      unsigned int cull_meshlets();
+        /**<
+         Finds the meshlets visible with the current camera and mesh
+         transformation and prepares the index ranges for drawing them.
+         This is done by draw(), it's public so that culling can be
+         measured without drawing.
+
+         @return number of triangles removed
+         */
+
+      unsigned int get_culled_triangles();
+        /**<
+         Gets the number of triangles removed by meshlet culling the
+         last time the mesh was drawn.
+
+         @return number of culled triangles
+         */
+
+      void set_buffer_arena(buffer_arena *arena);
+        /**<
+         Makes the mesh be stored in given buffer arena instead of its
+         own VBO, IBO and VAO, which saves GL objects and VAO switches
+         for many small meshes. This takes effect with the next update.
+         Only meshes with VERTEX_FORMAT_FLOAT and at most 65536
+         vertices are put in the arena, other meshes keep using their
+         own buffers. Instances draw from the arena if their parent is
+         in one.
+
+         @param arena arena to be used, NULL means the mesh will have
+                its own buffers
+         */
+
+      buffer_arena *get_buffer_arena();
+        /**<
+         Gets the buffer arena the mesh has been set to use.
+
+         @return the arena or NULL
+         */
+
+      void set_residency(residency_policy policy);
+        /**<
+         Sets what happens to the vertices and triangles after the mesh
+         is uploaded by update. Released data are loaded back
+         automatically (RESIDENCY_RELOAD) by the methods that use them
+         (update, merge, apply_matrix, get_bounding_box etc.), by
+         mesh_3d_animated::add_frame, mesh_3d_batch and mesh_3d_group.
+         Only code that accesses the vertices and triangles vectors
+         directly has to call make_resident before. vertex_count and triangle_count
+         return the uploaded counts and the mesh can still be drawn and
+         instanced. With RESIDENCY_DISCARD the data can't be loaded
+         back, update then fails with an error and keeps the GPU
+         buffers. RESIDENCY_RELOAD needs a cache directory (see
+         set_cache_directory), without it the data are kept.
+
+         @param policy residency policy, RESIDENCY_KEEP by default
+         */
+
+      residency_policy get_residency();
+        /**<
+         Gets the residency policy.
+
+         @return residency policy
+         */
+
+      bool make_resident();
+        /**<
+         Makes sure the vertices and triangles are in memory, loading
+         them from the cache directory if they have been released with
+         RESIDENCY_RELOAD. They're released again by the next update.
+
+         @return true if the data are in memory, false if they have been
+                 discarded
+         */
+
+      unsigned int get_cpu_memory_size();
+        /**<
+         Gets the size of the vertices and triangles in memory.
+
+         @return size in bytes
+         */
+
+      unsigned int get_gpu_memory_size();
+        /**<
+         Gets the size of the mesh's vertex and index data on GPU (its
+         part of the buffer arena if it's in one, 0 for instances).
+
+         @return size in bytes
+         */
+
+      void draw_geometry();
+        /**<
+         Draws the mesh's triangles with the uniforms that are currently
+         set (init_rendering isn't called), this is used by objects that
+         draw the mesh's geometry with their own properties.
+         */
+
+      void get_overdraw_statistics(unsigned int viewpoints, float *overdraw);
+        /**<
+         Measures overdraw of the mesh by rendering it offscreen (on
+         CPU, with depth test and back face culling, in the triangle
+         order) from viewpoints evenly distributed around it and counting
+         the fragments that pass the depth test.
+
+         @param viewpoints number of directions the mesh is rendered from
+         @param overdraw in this variable the average number of shaded
+                fragments per covered pixel will be returned (1 means no
+                overdraw)
+         */
+
+      bool load_obj(string filename);
+        /**<
+         Loads the mesh from obj file format.
+
+         @param filename file to be loaded
+         @return true if everything went OK, false otherwise
+         */
+
+      bool save_obj(string filename);
+        /**<
+         Saves the mesh as obj file format.
+
+         @param filename file to be saved
+         @return true if everything went OK, false otherwise
+         */
+
+      void simplify(float ratio);
+        /**<
+         lowers the number of polygons, for more see
+         simplify(unsigned int).
+
+         @param ratio value in range <0,1> which says how much the mesh
+                should be simplified (e.g. 0.75 means that the new mesh
+                will be 75 % of the original)
+         */
+
+      void simplify(unsigned int iterations);
+        /**<
+         lowers the number of polygons by successively merging vertices
+         with the shortest distance together. This is useful for example
+         for making simplified versions of the mesh for LOD. This method
+         is very simple and may take a lot of time for models with a lot
+         of triangles (a few thousand).
+
+         @param iterations how many times the vertices will be merged
+         */
+
+      void get_bounding_box(float *x0, float *y0, float *z0, float *x1, float *y1, float *z1);
+        /**<
+         Gets the model bounding box (in model space).
+
+         @param x0 x coordinate of the first point
+         @param y0 y coordinate of the first point
+         @param z0 z coordinate of the first point
+         @param x1 x coordinate of the second point
+         @param y1 y coordinate of the second point
+         @param z1 z coordinate of the second point
+         */
+
+      void get_bounding_box(point_3d *first_point, point_3d *second_point);
+        /**<
+         Gets the model bounding box (in model space).
+
+         @param first_point in this variable the first point defining
+                the bounding box will be returned
+         @param second_point in this variable the second point defining
+                the bounding box will be returned
+         */
+
+      void get_size(float *width, float *height, float *depth);
+        /**<
+         Gets the size of the model's bounding box (in model space).
+
+         @param width in this variable the model width (x size) will be
+                returned
+         @param height in this variable the model height (y) will be
+                returned
+         @param depth in this variable the model depth (z) will be
+                returned
+         */
+
+      void set_vertex_format(vertex_format format);
+        /**<
+         Sets the layout of the vertex data on GPU, it takes effect
+         with the next update(). VERTEX_FORMAT_COMPACT takes less than
+         half of the memory and vertex fetch bandwidth: positions are
+         quantised to 16 bits within the mesh bounding box, texture
+         coordinates are 16 bit unsigned normalized (or half floats if
+         they're outside <0,1>), normals are 10-10-10-2 and the texture
+         blend ratio has 8 bits. The vertices member keeps full
+         precision.
+
+         @param format vertex format to be used
+         */
+
+      vertex_format get_vertex_format();
+        /**<
+         Gets the layout of the vertex data on GPU.
+
+         @return vertex format
+         */
+
+      GLenum get_index_type();
+        /**<
+         Gets the type of the indices in the mesh's IBO. It is chosen
+         by update(): GL_UNSIGNED_SHORT for meshes with at most 65536
+         vertices (half the memory and index fetch bandwidth),
+         GL_UNSIGNED_INT otherwise.
+
+         @return GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+         */
+
+      void get_position_dequantization(point_3d *offset, point_3d *scale);
+        /**<
+         Gets the values the shader uses to get positions out of the
+         vertex data on GPU (offset + position * scale), which is
+         offset 0 and scale 1 for VERTEX_FORMAT_FLOAT.
+
+         @param offset in this variable the offset will be returned
+         @param scale in this variable the scale will be returned
+         */
+
+      mesh_3d_static *get_instance_parent();
+        /**<
+         Gets the mesh this mesh is an instance of.
+
+         @return instance parent, NULL if the mesh isn't an instance
+         */
+
+      void get_vbo_ibo_vao(GLuint *vbo, GLuint *ibo, GLuint *vao);
+        /**<
+         Gets the VBO (vertex buffer object), IBO (index buffer object)
+         and VAO (vertex array object) handles.
+
+         @param vbo in this vriable VBO handle will be returned
+         @param ibo in this vriable IBO handle will be returned
+         @param vao in this vriable VAO handle will be returned
+         */
+
+      void texture_map_plane(axis_direction direction, float plane_width, float plane_height);
+        /**<
+         Maps the texture coordinates of the vertices using planar mapping.
+
+         @param direction direction of the plane normal
+         @param plane_width width of the plane, 1.0 is the width of the mesh
+         @param plena_height height of the plane, 1.0 is the height of the mesh
+         */
+
+      void texture_map_layer_mask(texture_2d *mask);
+        /**<
+         Maps a mask defining texture layers blend. This information is
+         encoded into mesh vertices. The mapping is done depending on
+         vertices x and z position.
+
+         @param mask gryscale blend mask (only red component is taken
+                into account)
+         */
+
+      void smooth_normals();
+        /**<
+         Makes the mesh normals by computing a normal for each triangle
+         and averaging them so the mesh will appear smooth.
+         */
+
+      void add_vertex(float x, float y, float z);
+        /**<
+         Adds a new vertex to the mesh.
+
+         @param x x position of the vertice
+         @param y y position of the vertice
+         @param z z position of the vertice
+        */
+
+      void add_vertex(float x, float y, float z, float texture_u, float texture_v, float normal_x, float normal_y, float normal_z);
+        /**<
+         Adds a new vertex to the mesh.
+
+         @param x x position of the vertice
+         @param y y position of the vertice
+         @param z z position of the vertice
+         @param texture_u texture u coordinate
+         @param texture_v texture v coordinate
+         @param normal_x normal vector x, the normal will be automatically normalized
+         @param normal_y normal vector y
+         @param normal_z normal vector z
+        */
+
+      void apply_matrix(float matrix[4][4]);
+        /**<
+         Applies a transformation matrix to all the vertices of the
+         mesh. The multiplication is done in order matrix * point (so
+         the point is a column vector). Normals are transformed by the
+         inverse transpose of the matrix (so they stay perpendicular to
+         the surface even with non-uniform scale) and normalized.
+
+         @param matrix transformation matrix to be applies
+        */
+
+      void scale_to_size(float size, bool apply_matrix = false);
+        /**<
+         Scales the model so that it's largest size (i.e. width,
+         height or depth) is given amount while keeping it's
+         proportions. The size is calculated from the model's bounding
+         box.
+
+         @param size to what size the model should be scaled
+         @param apply_matrix if true, the model will be scaled by
+                applying scale matrix which means it will be scaled in
+                model space, otherwise the model will be scaled by
+                setting it's scale property (it will be scaled in world
+                space)
+         */
+  };
+
+//------------------------------------
+
+class mesh_3d_animated: public mesh_3d
+  {
+    protected:
+      bool playing;
+      bool loop;                   /// whether the animation should loop
+      bool interpolating;          /// whether frame interpolation or just switching is used
+      float play_speed;
+      int current_frame;           /// current frame number
+      float frame_percentage;      /// percentage played of the current frame
+      mesh_3d_animated *instance_parent;    /// if this object is an instance of another mesh, this points to it
+      GLuint vbo;                  /// vertices of all frames stored one after another
+      GLuint ibo;                  /// indices shared by all frames
+      GLenum index_type;           /// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, type of the indices in the IBO
+      unsigned int frame_vertex_count;     /// number of vertices in each uploaded frame
+      unsigned int uploaded_frame_count;   /// number of frames in the VBO, frames may have been added since
+      unsigned int frame_triangle_count;   /// number of triangles in the uploaded IBO
+      bool frames_changed;         /// if true, the frames have to be uploaded again by update()
+
+      void update_memory_usage();
+        /**<
+         Reports the mesh's current CPU and GPU memory to the memory
+         statistics.
+         */
+
+    public:
+      vector<animation_frame> frames;
+
+      mesh_3d_animated();
+        /**<
+         Class constructor.
+         */
+
+      virtual ~mesh_3d_animated();
+        /**<
+         Class destructor, frees all the object's memory.
+         */
+
+      void set_speed(float speed);
+        /**<
+         Sets the play speed of the animation.
+
+         @param speed speed at which the animation should be played (1.0
+                is normal)
+         */
+
+      void make_instance_of(mesh_3d_animated *what);
+        /**<
+         Makes this mesh an instance of another mesh (that means that
+         this mesh will use the other meshe's vertex data stored in GPU
+         memory.) The vertex data of this mesh will be deleted by
+         calling this method.
+
+         @param what mesh of which this mesh will become an instance
+         */
+
+      void use_interpolation(bool interpolate);
+        /**<
+         Sets the frame interpolation on or off.
+
+         @param interpolate if true, interpolation between frames will be
+                used, otherwise the frames will just be switched
+         */
+
+      unsigned int get_number_of_frames();
+        /**<
+         Returns number of animation frames.
+
+         @return number of frames
+         */
+
+      void add_frame(mesh_3d_static *mesh, unsigned int length);
+        /**<
+         Makes a new frame out of 3D mesh and appends it to the frame
+         list.
+
+         @param mesh mesh whose vertex and triangle data will be used to
+                make the frame
+         @param length length of the frame in milliseconds
+         */
+
+      void mark_frames_changed();
+        /**<
+         Makes the next update() upload the frames again, should be
+         called after the frames vector has been modified directly
+         (add_frame and clear do this automatically). All frames must
+         have the same number of vertices and share the triangles of the
+         first frame.
+         */
+
+      unsigned int get_gpu_memory_size();
+        /**<
+         Returns the size of the vertex and index data the mesh keeps in
+         GPU memory.
+
+         @return size in bytes, 0 for instances and not uploaded meshes
+         */
+
+      void set_playing(bool play);
+        /**<
+         Makes the animation play or stop.
+
+         @param play if true, the animation will start to play, otherwise
+                it will stop
+         */
+
+      virtual void update();
+      virtual void unload();
+      virtual void clear();
+      virtual void draw();
+  };
+
+//------------------------------------
+
+class skeletal_clip                 /// skeletal animation clip, it only stores keys of the animated bones, so its memory is given by bones * keys
+  {
+    protected:
+      vector<bone_track> tracks;
+      vector<int> bone_tracks;      /// index of the track of each bone, -1 if the bone has no track
+      float length_ms;
+
+    public:
+      skeletal_clip();
+        /**<
+         Class constructor.
+         */
+
+      void add_key(unsigned int bone, float time_ms, point_3d position, quaternion rotation, point_3d scale);
+        /**<
+         Adds a key to the track of given bone, the keys can be added in
+         any order.
+
+         @param bone index of the bone in the skeleton
+         @param time_ms time of the key in milliseconds
+         @param position position of the bone relative to its parent
+         @param rotation rotation of the bone relative to its parent
+         @param scale scale of the bone
+         */
+
+      bool sample(unsigned int bone, float time_ms, bone_key *result);
+        /**<
+         Samples the bone's track at given time, the keys around the time
+         are found by binary search and interpolated (rotations with
+         slerp). Times outside the track give the first or the last key.
+
+         @param bone index of the bone in the skeleton
+         @param time_ms time in milliseconds
+         @param result in this variable the bone's pose will be returned
+         @return true if the bone has a track in this clip, false
+                 otherwise (the result is then unchanged)
+         */
+
+      float get_length();
+        /**<
+         Returns the length of the clip.
+
+         @return time of the last key in milliseconds
+         */
+
+      unsigned int get_key_count();
+        /**<
+         Returns the number of keys of all the tracks.
+
+         @return number of keys
+         */
+
+      unsigned int get_memory_size();
+        /**<
+         Returns the size of the clip's keys in memory.
+
+         @return size in bytes
+         */
+
+      void clear();
+        /**<
+         Removes all the keys.
+         */
+  };
+
+//------------------------------------
+
+class mesh_3d_skinned: public mesh_3d_static  /// mesh deformed by a skeleton with matrix palette skinning in the vertex shader
+  {
+    protected:
+      vector<skeleton_bone> bones;
+      vector<matrix_4x4> bone_matrices;   /// palette uploaded to the shader, bone world matrix * inverse bind matrix
+      vector<matrix_4x4> world_matrices;  /// bone world matrices, kept between update_pose calls to not allocate each frame
+      GLuint skin_vbo;                    /// vertex_skin of each vertex (attributes 12 and 13)
+      skeletal_clip *clip;
+      float clip_time;                    /// current time of the clip in milliseconds
+      float play_speed;
+      bool playing;
+      bool loop;
+
+      virtual void update_memory_usage();
+        /**<
+         Reports the mesh's memory including the skin data.
+         */
+
+    public:
+      vector<vertex_skin> skin;           /// bone influences of each vertex, vertices without them follow the first bone
+
+      mesh_3d_skinned();
+        /**<
+         Class constructor.
+         */
+
+      virtual ~mesh_3d_skinned();
+        /**<
+         Class destructor, frees all the object's memory.
+         */
+
+      void make_instance_of(mesh_3d_skinned *what);
+        /**<
+         Makes this mesh an instance of another skinned mesh. The
+         vertex and skin data on GPU are shared, the skeleton is copied,
+         so each instance can play its own clip.
+
+         @param what mesh of which this mesh will become an instance
+         */
+
+      int add_bone(string name, int parent, point_3d position, quaternion rotation, point_3d scale);
+        /**<
+         Adds a bone to the skeleton. The given transformation is the
+         bind pose, its inverse is used to bring the mesh vertices to the
+         bone's space.
+
+         @param name name of the bone
+         @param parent index of the parent bone (it must already exist),
+                -1 for a root bone
+         @param position position relative to the parent bone
+         @param rotation rotation relative to the parent bone
+         @param scale scale of the bone
+         @return index of the new bone, -1 if it couldn't be added (too
+                 many bones or invalid parent)
+         */
+
+      int find_bone(string name);
+        /**<
+         Finds a bone by its name.
+
+         @param name name of the bone
+         @return index of the bone, -1 if there is no such bone
+         */
+
+      unsigned int get_bone_count();
+        /**<
+         Returns the number of bones of the skeleton.
+
+         @return number of bones
+         */
+
+      void set_vertex_bones(unsigned int vertex, const unsigned int bones[4], const float weights[4]);
+        /**<
+         Sets the bones that influence given vertex. The weights are
+         normalized and quantized to 8 bits. The bones have to be added
+         before, the vertex is left as it is if a used bone doesn't
+         exist.
+
+         @param vertex index of the vertex
+         @param bones indices of up to four bones
+         @param weights weights of the bones, unused ones should be 0
+         */
+
+      void set_clip(skeletal_clip *clip);
+        /**<
+         Sets the animation clip the mesh plays, the clip isn't copied
+         and can be shared by many meshes.
+
+         @param clip clip to be played, NULL shows the bind pose
+         */
+
+      void set_clip_time(float time_ms);
+        /**<
+         Sets the current time of the clip.
+
+         @param time_ms time in milliseconds
+         */
+
+      float get_clip_time();
+        /**<
+         Returns the current time of the clip.
+
+         @return time in milliseconds
+         */
+
+      void set_playing(bool play);
+        /**<
+         Makes the clip play or stop, the time advances in draw().
+
+         @param play if true, the clip will play
+         */
+
+      void set_loop(bool loop);
+        /**<
+         Sets whether the clip starts again after it ends.
+
+         @param loop if true, the clip will loop
+         */
+
+      void set_speed(float speed);
+        /**<
+         Sets the play speed of the clip.
+
+         @param speed speed at which the clip should be played (1.0 is
+                normal)
+         */
+
+      void update_pose();
+        /**<
+         Samples the clip at the current time and computes the bone
+         matrix palette. This is done automatically in draw().
+         */
+
+      virtual void update();
+      virtual void unload();
+      virtual void draw();
+      virtual void clear();
+  };
+
+//------------------------------------
+
+class picture_2d: public gpu_drawable /// 2D picture that can be drawn (for example for GUI)
+  {
+    protected:
+      mesh_3d_static picture_mesh;    /// 2 triangles that will be textured with the image
+
+    public:
+      picture_2d();
+      virtual ~picture_2d();
+
+      void set_picture(texture_2d *picture);
+        /**<
+         Sets the picture to be displayed.
+
+         @param picture picture to be displayed
+         */
+
+      void set_position(float x, float y);
+        /**<
+         Sets the picture position on the screen.
+
+         @param x x position in range <0,1>
+         @param y y position in range <0,1>
+         */
+
+      mesh_3d_static* get_picture_mesh();
+        /**<
+         Gets the internal mesh that is used to display the image.
+
+         @return pointer to picture mesh
+         */
+
+      void set_size(float width, float height);
+        /**<
+         Sets the picture size.
+
+         @param width width in range <0,1>
+         @param height height in range <0,1>
+         */
+
+      void set_rotation(float degrees);
+        /**<
+         Sets the picture rotation
+
+         @param angles rotation angle in degrees
+         */
+
+      virtual void draw();
+      virtual void update();
+      virtual void unload();
+  };
+
+//------------------------------------
+
+typedef struct                        /// for LOD
+  {
+    float distance_to;                /// to which distance this mesh should be used
+    mesh_3d_static *mesh;
+  } detail_level;
+
+class mesh_3d_lod: public mesh_3d        /// set of multiple static meshes that are being switched between depending on their distance, the LOD is being recomputed every RECOMPUTE_FRAMES frames
+  {
+    protected:
+      bool keep_everything_on_gpu;
+      bool use_this_mesh_properties;  /// if true, then all the meshes will only provide geometry, other things (textures etc.) will be provided by this mesh_3d_lod
+      int active_level;               // -1 if lod_meshes vector is empty
+
+    public:
+      vector<detail_level> lod_meshes;
+
+      mesh_3d_lod(bool use_this_mesh_properties, bool keep_everything_on_gpu);
+        /**<
+         Class constructor, initialises new object.
+
+         @param use_this_mesh_properties if true, then all the detail
+                meshes will only provide geometry, other things (such as
+                textures, lighting etc.) will be provided by this
+                mesh_3d_lod so that all the mesh details will share them,
+                if false, then all meshes can specify their own
+                properties
+         @param keep_everything_on_gpu if true, then all the detail
+                meshes will be kept loaded on GPU (faster mesh switching
+                but less memory efficient), otherwise only current
+                detail level mesh will be loaded on GPU (slower but
+                better for memory)
+         */
+
+      int get_current_detail_level();
+        /**<
+         Gets the current detail level.
+
+         @return current detail level where 0 is the best quality mesh,
+                 -1 means there is active level because either there are
+                 no meshes set or the mesh_3d_lod object is too far away
+                 beyond all meshes set distances
+         */
+
+      void add_detail_mesh(mesh_3d_static *mesh, float distance);
+        /**<
+         Adds a detail level mesh,
+
+         @param mesh mesh to be added
+         @param distance distance from the camera to which the mesh
+                should be used, the next mesh will be used after the
+                distance is crossed (or the mesh will stop being
+                displayed if there is no next level of detail)
+         */
+
+      virtual void update();
+        /**<
+         This should be called every time a change is made to this
+         object's lod_meshes vector manually.
+         */
+
+      virtual void unload();
+        /**<
+         Does nothing for this class.
+         */
+
+      virtual void draw();
+        /**<
+         Draws the current level of detail mesh.
+         */
+
+      virtual void clear();
+  };
+
+//------------------------------------
+
+typedef struct                      /// mesh merged into a batch
+  {
+    mesh_3d_static *source;         /// the original mesh
+    unsigned int first_triangle;    /// the mesh's triangles are a continuous range in the batch
+    unsigned int triangle_count;
+    bool visible;
+  } batch_member;
+
+typedef struct                      /// draw command of glMultiDrawElementsIndirect, the layout is given by OpenGL
+  {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+  } draw_elements_indirect_command;
+
+typedef struct                      /// geometry shared by meshes in a mesh_3d_group
+  {
+    mesh_3d_static *geometry;       /// mesh whose vertices and triangles are used
+    unsigned int first_index;       /// where the geometry starts in the group's IBO
+    unsigned int index_count;
+    unsigned int base_vertex;       /// where the geometry starts in the group's VBO
+    vector<mesh_3d_static *> members;   /// meshes drawn with the geometry
+  } group_geometry;
+
+class mesh_3d_batch: public mesh_3d_static   /// static meshes with the same material merged together so that they're drawn with one draw call
+  {
+    protected:
+      vector<batch_member> members;
+      unsigned int hidden_members;        /// number of members that aren't visible
+
+    public:
+      mesh_3d_batch();
+        /**<
+         Class constructor.
+        */
+
+      void build(vector<mesh_3d_static *> &meshes);
+        /**<
+         Merges the meshes into this batch and uploads it to GPU. The
+         vertices are transformed by each mesh's current transformation
+         (including its scene node), so the meshes are expected not to
+         move afterwards. The material is taken from the first mesh,
+         all of them should have the same one (see make_static_batches).
+         The source meshes aren't modified and shouldn't be drawn
+         anymore. Their shadows aren't merged.
+
+         @param meshes meshes to be merged
+         */
+
+      unsigned int get_member_count();
+        /**<
+         Gets the number of meshes merged into the batch.
+
+         @return number of merged meshes
+         */
+
+      mesh_3d_static *get_member(unsigned int index);
+        /**<
+         Gets the original mesh merged into the batch.
+
+         @param index index of the mesh, in the order they were passed
+                to build
+         @return the original mesh, NULL if the index is out of range
+         */
+
+      void set_member_visibility(unsigned int index, bool visible);
+        /**<
+         Hides or shows one of the merged meshes. As long as some are
+         hidden, the batch is drawn as a list of index ranges with
+         glMultiDrawElements (and meshlets aren't used).
+
+         @param index index of the mesh
+         @param visible visibility to be set
+         */
+
+      bool get_member_visibility(unsigned int index);
+        /**<
+         Gets the visibility of one of the merged meshes.
+
+         @param index index of the mesh
+         @return true if the mesh is visible, false otherwise
+         */
+
+      virtual void draw();
+      virtual void clear();
+  };
+
+//------------------------------------
+
+class mesh_3d_group: public mesh_3d   /// static meshes with the same material that can move independently, drawn with one glMultiDrawElementsIndirect call if the GPU supports it
+  {
+    protected:
+      vector<group_geometry> geometries;
+      GLuint vbo;                         /// vertices of all the geometries
+      GLuint ibo;                         /// indices of all the geometries, relative to their base vertex
+      GLuint vao;
+      GLuint matrix_buffer;               /// world matrix of each drawn mesh (instanced attribute)
+      GLuint indirect_buffer;             /// draw commands
+      GLenum index_type;
+      unsigned int geometry_buffer_size;  /// bytes of the vertex and index buffers
+      unsigned int stream_buffer_size;    /// bytes allocated for the matrix and indirect buffers by the last draw
+      vector<draw_elements_indirect_command> commands;
+      vector<float> matrices;             /// column-major world matrices for the current draw
+
+      void update_memory_usage();
+        /**<
+         Reports the group's current CPU and GPU memory to the memory
+         statistics.
+         */
+
+    public:
+      mesh_3d_group();
+        /**<
+         Class constructor.
+        */
+
+      virtual ~mesh_3d_group();
+
+      void build(vector<mesh_3d_static *> &meshes);
+        /**<
+         Makes the group of given meshes and uploads it to GPU. The
+         geometry of all the meshes is put into shared vertex and index
+         buffers (instances of the same mesh share it), so that the
+         whole group can be drawn by one glMultiDrawElementsIndirect
+         call, the world matrix of each mesh is passed as an instanced
+         vertex attribute. The meshes keep their transformations and
+         visibility, which are read every time the group is drawn. The
+         material is taken from the first mesh, all of them should have
+         the same one. If multi draw indirect isn't supported, each mesh
+         is drawn with its own call from the shared buffers. The meshes
+         must use VERTEX_FORMAT_FLOAT and shouldn't be drawn
+         themselves.
+
+         @param meshes meshes to be put in the group
+         */
+
+      unsigned int get_member_count();
+        /**<
+         Gets the number of meshes in the group.
+
+         @return number of meshes
+         */
+
+      unsigned int get_draw_command_count();
+        /**<
+         Gets the number of draw commands submitted the last time the
+         group was drawn (one per geometry with visible meshes).
+
+         @return number of commands
+         */
+
+      virtual void update();
+      virtual void unload();
+      virtual void draw();
+      virtual void clear();
+  };
+
+//------------------------------------
+
+class mesh_3d_crowd: public mesh_3d   /// many instances of an animated mesh drawn with one instanced call, the frames are read from a vertex animation texture
+  {
+    protected:
+      vector<mesh_3d *> members;          /// meshes whose transformation and visibility the instances take
+      vector<float> time_offsets;         /// animation time offset of each member in milliseconds
+      vector<vertex_3d> base_vertices;    /// first frame, only its texture coordinates are used
+      vector<triangle_3d> triangles;
+      vector<float> texture_data;         /// position and normal of each vertex in each frame, RGBA
+      vector<float> frame_starts;         /// start time of each frame, the last item is the animation length
+      vector<float> instance_data;        /// column-major world matrix and time offset of each visible member
+      GLuint vbo;
+      GLuint ibo;
+      GLuint vao;
+      GLuint instance_buffer;             /// instance_data (instanced attributes 8 to 11 and 14)
+      unsigned int instance_buffer_size;  /// bytes allocated for the instance buffer by the last draw
+      GLuint vertex_texture;
+      GLenum index_type;
+      unsigned int texture_height;
+      float animation_time;               /// milliseconds
+      float play_speed;
+      bool playing;
+
+      void update_memory_usage();
+        /**<
+         Reports the crowd's current CPU and GPU memory to the memory
+         statistics.
+         */
+
+    public:
+      mesh_3d_crowd();
+        /**<
+         Class constructor.
+        */
+
+      virtual ~mesh_3d_crowd();
+
+      void build(mesh_3d_animated *animation);
+        /**<
+         Bakes the frames of an animated mesh to a vertex animation
+         texture (float RGBA, two texels per vertex and frame). All
+         frames must have the same vertices and at most
+         MAX_ANIMATION_FRAMES frames are used, the animation loops
+         like mesh_3d_animated does. The material is taken from the
+         animated mesh. update must be called afterwards, it refuses to
+         upload a texture higher than GL_MAX_TEXTURE_SIZE (too many
+         frames times vertices). If the frames can't be baked, the crowd
+         stays as it was.
+
+         @param animation mesh whose frames will be baked, it isn't
+                needed after this call
+         */
+
+      unsigned int add_member(mesh_3d *member, float time_offset);
+        /**<
+         Adds an instance to the crowd. Its world matrix and visibility
+         are taken from given mesh every time the crowd is drawn (the
+         mesh shouldn't be drawn itself, it can be e.g. an instance of
+         the animated mesh).
+
+         @param member mesh that gives the instance's transformation
+         @param time_offset animation time offset in milliseconds, so
+                that the instances don't move all the same
+         @return index of the member
+         */
+
+      void set_time_offset(unsigned int member, float time_offset);
+        /**<
+         Sets the animation time offset of a member.
+
+         @param member index of the member
+         @param time_offset offset in milliseconds
+         */
+
+      unsigned int get_member_count();
+        /**<
+         Gets the number of instances of the crowd.
+
+         @return number of members
+         */
+
+      unsigned int get_texture_memory_size();
+        /**<
+         Gets the size of the vertex animation texture.
+
+         @return size in bytes
+         */
+
+      void set_playing(bool play);
+        /**<
+         Makes the animation play or stop.
+
+         @param play if true, the animation will play
+         */
+
+      void set_speed(float speed);
+        /**<
+         Sets the play speed of the animation.
+
+         @param speed speed at which the animation should be played (1.0
+                is normal)
+         */
+
+      virtual void update();
+      virtual void unload();
+      virtual void draw();
+      virtual void clear();
+  };
+
+//------------------------------------
+
+class texture_atlas                   /// packs many small textures into a few big pages, so that meshes with different textures can share one texture, it owns the pages
+  {
+    protected:
+      unsigned int page_size;
+      unsigned int padding;             /// pixels around each texture filled with its edge pixels, so that filtering doesn't bleed the neighbours in
+      vector<texture_2d *> sources;     /// textures added to the atlas
+      vector<atlas_region> regions;     /// region of each source
+      vector<texture_2d *> pages;
+      vector<int> page_colors;          /// transparent color of each page as 0xRRGGBB, -1 for none
+      vector<vector<skyline_segment> > skylines;   /// skyline of each page
+
+      bool find_position(unsigned int page, unsigned int width, unsigned int height, unsigned int *x, unsigned int *y, unsigned int *segment);
+        /**<
+         Finds the lowest position where a rectangle fits in a page
+         (skyline bottom-left packing).
+
+         @param page index of the page
+         @param width width of the rectangle including the padding
+         @param height height of the rectangle including the padding
+         @param x in this variable the x position will be returned
+         @param y in this variable the y position will be returned
+         @param segment in this variable the index of the skyline
+                segment the rectangle starts at will be returned
+         @return true if the rectangle fits, false otherwise
+         */
+
+      void place(unsigned int page, unsigned int segment, unsigned int x, unsigned int y, unsigned int width, unsigned int height);
+        /**<
+         Updates the page's skyline after a rectangle has been put to
+         the position returned by find_position.
+         */
+
+    public:
+      texture_atlas(unsigned int page_size = 1024, unsigned int padding = 4);
+        /**<
+         Class constructor.
+
+         @param page_size width and height of the pages in pixels (power
+                of 2)
+         @param padding number of pixels around each texture
+         */
+
+      ~texture_atlas();
+        /**<
+         Class destructor, deletes the pages. The meshes remapped to
+         them mustn't be drawn afterwards.
+         */
+
+      int add_texture(texture_2d *texture);
+        /**<
+         Adds a texture to the atlas, it's packed in build(). Textures
+         with transparency are put in pages of their own (one for each
+         transparent color).
+
+         @param texture texture to be added, its pixel data are read in
+                build()
+         @return handle of the texture's region, the same handle is
+                returned if the texture has already been added
+         */
+
+      void build();
+        /**<
+         Packs the textures added since the last build (the biggest
+         first) into the free space of the pages or into new pages,
+         copies their pixels and uploads the changed pages. The regions
+         are valid after this call. Textures packed before keep their
+         regions (and pixels), so the meshes already remapped to the
+         pages stay valid. The textures that don't fit in a page are
+         left out (their region has page -1 cast to unsigned).
+         */
+
+      int find_texture(texture_2d *texture);
+        /**<
+         Finds the handle of an added texture.
+
+         @param texture texture to be found
+         @return handle of the texture, -1 if it hasn't been added
+         */
+
+      atlas_region get_region(int handle);
+        /**<
+         Gets the region of a texture in the atlas.
+
+         @param handle handle returned by add_texture
+         @return region of the texture
+         */
+
+      texture_2d *get_page(unsigned int index);
+        /**<
+         Gets a page of the atlas.
+
+         @param index index of the page
+         @return page texture
+         */
+
+      unsigned int get_page_count();
+        /**<
+         Gets the number of pages.
+
+         @return number of pages
+         */
+
+      bool remap_mesh(mesh_3d_static *mesh);
+        /**<
+         Moves a mesh to the atlas: its texture coordinates are remapped
+         to the region of its texture and the page is set as its
+         texture. The mesh has to be updated afterwards. Meshes whose
+         texture coordinates are outside <0,1> (repeated textures) and
+         meshes with a second texture layer (it would be sampled with
+         the remapped coordinates) can't be remapped.
+
+         @param mesh mesh whose texture has been added to the atlas
+         @return true if the mesh has been remapped, false if its
+                 texture isn't in the atlas, its texture coordinates
+                 are out of range or it has a second texture
+         */
+
+      void clear();
+        /**<
+         Removes all the textures and deletes the pages, the meshes
+         remapped to them have to be given other textures (or deleted)
+         before.
+         */
+  };
+
+//------------------------------------
+
+typedef struct
+  {
+    float x;                            /// indipendent variable value
+    float y;                            /// dependant variable value
+    interpolation_method interpolation; /// method of interpolation from this point to the next one
+    float tangent;                      /// slope (dy/dx) at this point, for INTERPOLATION_HERMITE
+    float control_in;                   /// y of the Bezier control point before this point, for INTERPOLATION_BEZIER
+    float control_out;                  /// y of the Bezier control point after this point
+  } keyframe;
+
+class keyframe_interpolator           /// represents a general function of one argument composed of points that are interpolated between (good for animation etc.)
+  {
+    protected:
+      vector<keyframe> keyframes;       /// sorted by x, only changed by the methods so that the segments are kept up to date
+      unsigned int cursor;              /// result of the last find_segment, the next search starts there
+      vector<spline_segment> segments;  /// polynomial of each pair of neighbouring keyframes
+      bool segments_changed;            /// if true, the segments have to be computed again
+
+      void sort();
+        /**<
+         Sorts the keyframes by x value (lowest first), keyframes with
+         the same x keep their order.
+         */
+
+    public:
+      keyframe_interpolator();
+        /**<
+         Class constructor.
+         */
+
+      void add_keyframe(float x, float y, interpolation_method interpolation);
+        /**<
+         Adds a new keyframe. It will be automatically put in the right
+         place so that the keyframes are sorted (adding the keyframes in
+         order of x is the fastest).
+
+         @param x indipendent variable value
+         @param y dependant variable value
+         @param interpolation method of interpolation from this point to the next one
+         */
+
+      void add_keyframes(const vector<keyframe> &new_keyframes);
+        /**<
+         Adds many keyframes at once, they are sorted only once after
+         all of them have been added.
+
+         @param new_keyframes keyframes to be added, in any order
+         */
+
+      void add_hermite_keyframe(float x, float y, float tangent);
+        /**<
+         Adds a keyframe with INTERPOLATION_HERMITE.
+
+         @param x indipendent variable value
+         @param y dependant variable value
+         @param tangent slope (dy/dx) of the function at this point
+         */
+
+      void add_bezier_keyframe(float x, float y, float control_in, float control_out);
+        /**<
+         Adds a keyframe with INTERPOLATION_BEZIER. The curve goes
+         through the keyframes and is pulled towards the control values
+         (x always moves uniformly).
+
+         @param x indipendent variable value
+         @param y dependant variable value
+         @param control_in value of the control point before this point
+                (used if the previous keyframe is a Bezier one)
+         @param control_out value of the control point after this point
+         */
+
+      void update_segments();
+        /**<
+         Computes the polynomial coefficients of all the segments. This
+         is done automatically after the keyframes have changed.
+         */
+
+      unsigned int get_keyframe_count();
+        /**<
+         Gets the number of keyframes.
+
+         @return number of keyframes
+         */
+
+      keyframe get_keyframe(unsigned int index);
+        /**<
+         Gets a keyframe.
+
+         @param index index of the keyframe (the keyframes are sorted
+                by x)
+         @return the keyframe, a zeroed keyframe if the index is out of
+                 range
+         */
+
+      void set_keyframe(unsigned int index, keyframe new_keyframe);
+        /**<
+         Replaces a keyframe, e.g. to move it or change its value. The
+         keyframes are sorted again if x has changed.
+
+         @param index index of the keyframe
+         @param new_keyframe new keyframe data
+         */
+
+      void remove_keyframe(unsigned int index);
+        /**<
+         Removes a keyframe.
+
+         @param index index of the keyframe
+         */
+
+      void clear();
+        /**<
+         Removes all the keyframes.
+         */
+
+      spline_segment *get_segment(float x);
+        /**<
+         Gets the polynomial of the segment given point lies in, the
+         segments are computed first if the keyframes have been added.
+
+         @param x value of the independent variable
+         @return segment, NULL if x is outside the keyframes
+         */
+
+      unsigned int find_segment(float x);
+        /**<
+         Finds the keyframes given point lies between. The search starts
+         at the result of the previous call, so it takes constant time
+         when x only grows a little between calls (playback), otherwise
+         binary search is used.
+
+         @param x value of the independent variable
+         @return index of the first keyframe with greater x than given
+                 value (so the point lies between this keyframe and the
+                 previous one), 0 if x is before the first keyframe,
+                 number of keyframes if it's after the last one
+         */
+
+      float get_value(float x);
+        /**<
+         Gets the function value in given point.
+
+         @param x value in which the function should be computed (interpolated)
+         @return function value
+         */
+  };
+
+//------------------------------------
+
+class multichannel_interpolator       /// several functions with common keyframe positions (e.g. camera position and rotation), evaluated with one keyframe search
+  {
+    protected:
+      unsigned int channels;
+      unsigned int cursor;              /// result of the last search, the next one starts there
+      vector<float> positions;          /// x of each keyframe, sorted
+      vector<interpolation_method> methods;  /// method of each keyframe
+      vector<keyframe> values;          /// y, tangent and controls of each keyframe and channel (keyframe * channels + channel), x is unused
+      vector<spline_segment> segments;  /// segment * channels + channel
+      bool segments_changed;
+
+      void update_segments();
+        /**<
+         Computes the polynomial coefficients of all the segments.
+         */
+
+    public:
+      multichannel_interpolator(unsigned int channels);
+        /**<
+         Class constructor.
+
+         @param channels number of functions
+         */
+
+      void add_keyframe(float x, const float *values, interpolation_method interpolation, const float *tangents = NULL);
+        /**<
+         Adds a keyframe to all the channels. It will be automatically
+         put in the right place so that the keyframes are sorted.
+
+         @param x indipendent variable value
+         @param values value of each channel
+         @param interpolation method of interpolation from this point to
+                the next one
+         @param tangents slope of each channel at this point for
+                INTERPOLATION_HERMITE, NULL means 0
+         */
+
+      void add_bezier_keyframe(float x, const float *values, const float *controls_in, const float *controls_out);
+        /**<
+         Adds a keyframe with INTERPOLATION_BEZIER, see
+         keyframe_interpolator::add_bezier_keyframe.
+
+         @param x indipendent variable value
+         @param values value of each channel
+         @param controls_in value of the control point before this point
+                for each channel
+         @param controls_out value of the control point after this point
+                for each channel
+         */
+
+      void get_values(float x, float *result);
+        /**<
+         Gets the values of all the channels in given point. Outside the
+         keyframes the values of the first or the last keyframe are
+         returned.
+
+         @param x value in which the functions should be computed
+         @param result array where the value of each channel will be
+                stored
+         */
+
+      unsigned int get_channel_count();
+        /**<
+         Gets the number of channels.
+
+         @return number of channels
+         */
+
+      unsigned int get_keyframe_count();
+        /**<
+         Gets the number of keyframes.
+
+         @return number of keyframes
+         */
+
+      void clear();
+        /**<
+         Removes all the keyframes.
+         */
+  };
+
+//------------------------------------
+
+class job                             /// unit of work that is run by the job system on any of its threads
+  {
+    public:
+      function<void()> work;                 /// the work to be done
+      atomic<int> unfinished_dependencies;   /// number of jobs that must finish before this one can run (+1 until the job is submitted)
+      atomic<bool> finished;                 /// set after the job has been run and its continuations have been released
+      bool completed;                        /// like finished, but protected by continuations_mutex
+      mutex continuations_mutex;
+      vector<job *> continuations;           /// jobs that depend on this one
+
+      job();
+        /**<
+         Class constructor, initialises a job with no work.
+         */
+
+      job(function<void()> work);
+        /**<
+         Class constructor, initialises a job.
+
+         @param work function that will be run by the job
+         */
+  };
+
+//------------------------------------
+
+void render_loop();
+  /**<
+   Starts the rendering loop that will continue rendering the scene
+   using function specified with init_opengl function. The loop can
+   be stopped by calling stop_rendering function. The loop also ends
+   when the window is closed by the user.
+   */
+
+void stop_rendering();
+  /**<
+   Stops the main rendering loop.
+   */
+
+void draw_pixel(unsigned int x, unsigned int y, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
+  /**<
+   Draws a pixel at given position in frame buffer.
+
+   @param x x position in pixels
+   @param y y position in pixels
+   @param r amount of red
+   @param g amount of green
+   @param b amount of blue
+   @param a amount of alpha
+  */
+
+void init_opengl(int *argc_pointer, char** argv, unsigned int window_width, unsigned int window_height, void (*draw_function)(void), const char *window_title);
+  /**<
+   Initialises OpenGL, should be before any other function call from
+   this library.
+
+   @param argc_pointer pointer to program argc
+   @param argv program argv
+   @param window_width rendering window width in pixels
+   @param window_height rendering window height in pixels
+   @param draw_function pointer to a function that will be called
+          to render each frame, this function shouldn't call
+          glutSwapBuffers or glClear, they will be called
+          automatically
+   @param window_title window title
+  */
+
+void get_interpolated_values(keyframe_interpolator **interpolators, unsigned int count, float x, float *result);
+  /**<
+   Evaluates many interpolators at the same point, e.g. all the
+   coordinates of a camera path. Each value is computed right after its
+   keyframe is looked up, nothing is allocated.
+
+   @param interpolators array of interpolators
+   @param count number of interpolators
+   @param x value in which the functions should be computed
+   @param result array of count values where the results will be
+          stored, the same as keyframe_interpolator::get_value would
+          return
+   */
+
+float interpolate(float ratio, float value1, float value2, interpolation_method method);
+  /**<
+   Interpolates between two values using specified method.
+
+   @param ratio value in range <0,1> where 0 will return the first
+          point value, 1 the second one and the values between will be
+          interpolated
+   @param value1 first value to be interpolated between
+   @param value2 second value to be interpolated between
+   @param method method to use, the spline methods need the
+          neighbouring keyframes, so here they give a smooth step (zero
+          tangents)
+   @return value interpolated between value1 and value2 in given ratio
+   */
+
+void set_perspective(float fov_degrees, float near, float far);
+  /**<
+   Sets the perspective for the rendering.
+
+   @param fov field of view in degrees
+   @param near near distance
+   @param far far distance
+  */
+
+void register_keyboard_function(void (*function)(int key, int x, int y));
+  /**<
+   Registers given function to be called when key press (character or special)
+   one occurs.
+
+   @param function function to be registered (key is either the ASCII key code
+          or a special_keys code, x and y are the mouse coordinates at the
+          time when the key press occured)
+  */
+
+void register_advanced_keyboard_function(void (*function)(bool key_up, int key, int x, int y));
+  /**<
+   Registers given function to be called when key down or key up event
+   occurs.
+
+   @param function function to be registered (key is either the ASCII key code
+          or a special_keys code, x and y are the mouse coordinates at the
+          time when the key press occured, key_up indicates if the event was
+          key press or key release)
+   */
+
+void register_mouse_function(void (*function)(int button, int state));
+  /**<
+   Registers given function to be called when mouse button press occurs.
+   To regularly check mouse coordinates get_mouse_position function
+   can be used in the main rendering loop.
+
+   @param function function to be registered
+  */
+
+int get_time();
+  /**<
+   Gets the current time count.
+
+   @return number of millisecends since the init function has been called
+   */
+
+void normalize_vector(point_3d *vector);
+  /**<
+   Normalizes given vector (so that it's size is equal to 1).
+
+   @param vector vector to be normalized
+   */
+
+int get_frame_time_difference();
+  /**<
+   Gets the time difference of this frame and the previous one.
+
+   @return time difference in milliseconds since the last frame
+   */
+
+float vector_length(point_3d vector);
+  /**<
+   Calculates a vector length.
+
+   @param vector vector whose length will be returned
+   @return vector length
+   */
+
+mesh_3d_static *make_cuboid(float side_x, float side_y, float side_z);
+  /**<
+   Makes a cuboid (box) mesh.
+
+   @param side_x length of the x side
+   @param side_y length of the y side
+   @param side_z length of the z side
+   @return instance of the cuboid mesh
+   */
+
+mesh_3d_static *make_sharp_cuboid(float side_x, float side_y, float side_z);
+  /**<
+   Makes sharp-edged cuboid (box) mesh. It consists of 6 faces that don't
+   share vertices, so that the edges can be sharp and can have independent
+   texture mapping, which is especially good for skyboxes etc.
+
+   @param side_x length of the x side
+   @param side_y length of the y side
+   @param side_z length of the z side
+   @return instance of the cuboid mesh
+   */
+
+mesh_3d_static *make_plane(float width, float height, unsigned int resolution_x, unsigned int resolution_y);
+  /**<
+   Makes a plane mesh.
+
+   @param width plane width
+   @param height plane height
+   @param resolution_x number of squares in x direction
+   @param resolution_y number of squares in y direction
+   @return instance of the plane mesh
+   */
+
+mesh_3d_static *make_cone(float radius, float height, unsigned int sides);
+  /**<
+   Makes a cone mesh.
+
+   @param radius cone base radius
+   @param height cone height
+   @param sides number of sides
+   @return instance of the cone mesh
+   */
+
+mesh_3d_static *make_cylinder(float radius, float height, unsigned int sides);
+  /**<
+   Makes a cylinder mesh.
+
+   @param radius cylinder base radius
+   @param height cylinder height
+   @param sides number of sides
+   @return instance of the cylinder mesh
+   */
+
+mesh_3d_static *make_sphere(float radius, unsigned int height_segments, unsigned int sides);
+  /**<
+   Makes a sphere mesh.
+
+   @param radius sphere radius
+   @param height_segments vertical resolution
+   @param sides number of sides of the sphere
+   @return instance of the sphere mesh
+   */
+
+unsigned int get_shader_variant_count();
+  /**<
+   Gets the number of shader variants compiled so far. A variant is
+   compiled for each combination of render mode, number of textures and
+   shader features (fog, shadows, transparency, animation, ...) the
+   first time a mesh needs it.
+
+   @return number of compiled shader variants
+   */
+
+void precompile_shader_variants();
+  /**<
+   Makes the shader variants of the common static materials (all render
+   modes and numbers of textures, with and without fog) so that they
+   aren't compiled during rendering. This can be called after
+   init_opengl, with a cache directory set the programs are loaded from
+   the program binary cache if possible.
+   */
+
+void clear_shader_variants();
+  /**<
+   Deletes all the shader variants, they are made again when they are
+   needed. This can be used to measure the startup time or after the
+   cache directory has changed.
+   */
+
+void get_program_cache_statistics(unsigned int *hits, unsigned int *misses, double *milliseconds);
+  /**<
+   Gets the statistics of making shader programs since the start.
+
+   @param hits in this variable the number of programs loaded from the
+          program binary cache will be returned
+   @param misses in this variable the number of programs compiled from
+          source will be returned
+   @param milliseconds in this variable the total time spent making the
+          programs will be returned
+   */
+
+memory_usage get_memory_usage(memory_category category);
+  /**<
+   Gets the CPU and GPU memory used by the objects of given category, as
+   of their last update (the objects report their memory when they
+   allocate or free their buffers and textures, when their data are
+   released or loaded back and when they're destroyed).
+
+   @param category category of the objects, MEMORY_CATEGORIES gives the
+          total of all the categories
+   @return memory used by the category, with the high-water marks
+   */
+
+bool get_object_memory_usage(const void *object, memory_record *record);
+  /**<
+   Gets the memory used by one object (texture, mesh, arena etc.).
+
+   @param object the object
+   @param record in this variable the object's memory will be returned
+   @return true if the object holds some memory, false otherwise
+   */
+
+void get_largest_memory_users(unsigned int count, vector<const void *> &objects, vector<memory_record> &records);
+  /**<
+   Gets the objects that use the most memory (CPU and GPU together).
+
+   @param count maximum number of objects to get
+   @param objects in this vector the objects will be returned, the
+          biggest first
+   @param records in this vector the memory of each object will be
+          returned
+   */
+
+void set_memory_budget(memory_category category, unsigned long long cpu_bytes, unsigned long long gpu_bytes);
+  /**<
+   Sets the memory budget of a category. A warning is printed to stderr
+   each time the category's memory gets over the budget.
+
+   @param category category of objects, MEMORY_CATEGORIES sets the budget
+          of all of them together
+   @param cpu_bytes CPU memory budget, 0 means no budget
+   @param gpu_bytes GPU memory budget, 0 means no budget
+   */
+
+void print_memory_report(unsigned int largest_objects = 0);
+  /**<
+   Prints the memory used by each category of objects, the totals and
+   the high-water marks to stdout.
+
+   @param largest_objects number of the biggest objects to be listed too
+   */
+
+string get_memory_report_line(memory_category category);
+  /**<
+   Makes a short one line summary of the memory used by a category,
+   e.g. for a text overlay.
+
+   @param category category of objects, MEMORY_CATEGORIES for the total
+   @return summary text
+   */
+
+picture_2d *make_memory_text(memory_category category, texture_2d *font = NULL, float size = 0.05, float spacing = 0.03);
+  /**<
+   Makes a picture of the memory summary of a category (see
+   get_memory_report_line and make_text) to be drawn as an overlay. The
+   picture doesn't change, make a new one to show the current state.
+
+   @param category category of objects, MEMORY_CATEGORIES for the total
+   @param font font to be used, NULL means the default font
+   @param size font size
+   @param spacing spacing of the characters
+   @return picture of the summary
+   */
+
+bool texture_compression_is_supported();
+  /**<
+   Checks whether the GPU can decode the compressed texture formats
+   (S3TC). This can be called after init_opengl.
+
+   @return true if compressed textures are supported, false otherwise
+   */
+
+void get_texture_cache_statistics(unsigned int *hits, unsigned int *misses);
+  /**<
+   Gets the statistics of compressing textures since the start.
+
+   @param hits in this variable the number of textures whose compressed
+          blocks have been loaded from the cache will be returned
+   @param misses in this variable the number of textures that have been
+          encoded will be returned
+   */
+
+void set_cache_directory(string directory);
+  /**<
+   Sets the directory in which data are cached between runs of the
+   program (e.g. shader program binaries keyed by a hash of the shader
+   source and the GL driver, so that shaders aren't compiled at every
+   startup, and compressed textures). Caching is disabled by default. Call this before
+   init_opengl to have the first shaders cached too.
+
+   @param directory path of an existing directory, empty string disables
+          caching
+   */
+
+string get_cache_directory();
+  /**<
+   Gets the directory set with set_cache_directory.
+
+   @return cache directory, empty if caching is disabled
+   */
+
+buffer_arena *get_default_buffer_arena();
+  /**<
+   Gets the buffer arena that make_text puts its meshes in, it can be
+   used for other small meshes too (see
+   mesh_3d_static::set_buffer_arena).
+
+   @return default buffer arena
+   */
+
+unsigned int get_texture_bind_count();
+  /**<
+   Gets the number of textures bound since the start. Binding a texture
+   that is already bound to the unit is skipped and not counted, so the
+   difference between two frames shows how well the meshes share
+   textures (e.g. through a texture_atlas).
+
+   @return number of glBindTexture calls
+   */
+
+bool multi_draw_indirect_is_supported();
+  /**<
+   Checks whether the GPU supports glMultiDrawElementsIndirect with base
+   instance (OpenGL 4.3 or the ARB extensions), which mesh_3d_group
+   uses. This can be called after init_opengl.
+
+   @return true if multi draw indirect is supported, false otherwise
+   */
+
+void set_multi_draw_indirect(bool enable);
+  /**<
+   Sets whether mesh_3d_group objects are drawn with
+   glMultiDrawElementsIndirect or with one draw call per mesh. It's
+   enabled by init_opengl if supported and can't be enabled if it isn't
+   supported.
+
+   @param enable if true, multi draw indirect will be used if supported
+   */
+
+void make_static_batches(vector<mesh_3d_static *> &meshes, vector<mesh_3d_batch *> &batches);
+  /**<
+   Groups static meshes by their material and makes one batch for each
+   group, so that many small objects that don't move can be drawn with
+   a few draw calls. Invisible meshes are left out.
+
+   @param meshes meshes to be batched, they aren't modified
+   @param batches the new batches will be added to this vector, they're
+          allocated with new and have to be deleted by the caller
+   */
+
+mesh_3d_static *make_terrain(float size_x, float size_y, float height, unsigned int resolution_x, unsigned int resolution_y, texture_2d *heightmap, float crop_x = 0.0, float crop_y = 0.0, float crop_width = 1.0, float crop_height = 1.0);
+  /**<
+   Makes a terrain mesh based on heightmap stored as image in texture.
+
+   @param size_x x size of the mesh
+   @param size_y y size of the mesh
+   @param height terrain amplitude
+   @param resolution_x x resolution of the terrain
+   @param resolution_y y resolution of the terrain
+   @param heightmap heightmap image where lighter means higher, only red component
+          is taken into account, if NULL, the terrain will be flat
+   @param crop_x x coordinate in the range <0,1> of the starting cropping point
+   @param crop_y y coordinate in the range <0,1> of the starting cropping point
+   @param crop_width width of the cropping rectangle (in the range <0,1>)
+   @param crop_height height of the cropping rectangle (in the range <0,1>)
+   @return generated terrain mesh
+   */
+
+picture_2d *make_text(string text, texture_2d *font = NULL, float size = 0.05, float spacing = 0.03);
+  /**<
+   Makes a picture of given ASCII text.
+
+   @param text text to be displayed
+   @param font font to be used, if NULL, the default font will be used,
+          the texture should contain exactly 256 characters one next to
+          another from left to right in ASCII order, the size doesn't
+          matter
+   @param size font size
+   @param spacing spacing of the characters
+   @return picture representing given text
+   */
+
+void go_fullscreen();
+  /**<
+   Makes the window fullscreen.
+   */
+
+string get_gpu_info_string();
+  /**<
+   Gets the string with GPU info.
+
+   @return string in format "vendor version"
+   */
+
+float get_fps();
+  /**<
+   Returns current FPS. FPS is being recomputed after every RECOMPUTE_FRAMES
+   frames.
+
+   @return current number of frames per second
+   */
+
+float get_spf();
+  /**<
+   Returns current SPF (seconds per frame). SPF is being recomputed after
+   every RECOMPUTE_FRAMES frames.
+
+   @return current number of seconds per frame
+   */
+
+void set_global_light(point_3d direction, unsigned char red, unsigned char green, unsigned char blue);
+  /**<
+   Sets the global directional light parameters that will be used in
+   shading process.
+
+   @param direction light direction
+   @param red amount of red in the light intensity
+   @param green amount of green in the light intensity
+   @param blue amount of blue in the light intensity
+   */
+
+void set_background_color(unsigned char red, unsigned char green, unsigned char blue);
+  /**<
+   Sets the background (and fog) color for the viewport.
+
+   @param red amount of red
+   @param green amount of green
+   @param blue amount of blue
+   */
+
+void set_mouse_position(unsigned int x, unsigned int y);
+  /**<
+   Sets the mouse position relatively to the window top left corner.
+
+   @param x x position of the mouse cursor
+   @param y y position of the mouse cursor
+   */
+
+void set_mouse_visibility(bool visible);
+  /**<
+   Makes the mouse cursor visible or invisible.
+
+   @param visible if true, the cursor will be visible, invisible
+          otherwise
+   */
+
+void get_mouse_position(int *x, int *y);
+  /**<
+   Gets the current mouse position relative to upper left corner of the
+   window.
+
+   @param x in this variable the x coordinate in pixels will be returned
+   @param y in this variable the y coordinate in pixels will be returned
+   */
+
+void set_fog(float distance);
+  /**<
+   Sets the fog distance. The fog color is determined by the background
+   color.
+
+   @param distance distance of the fog measured from the far plane,
+          negative value or zero turns the fog off
+   */
+
+void init_job_system(unsigned int threads = 0);
+  /**<
+   Starts the job system worker threads. Each thread has its own job
+   queue and idle threads steal jobs from the others. This is called
+   automatically by init_opengl, calling it again restarts the job
+   system with a new number of threads.
+
+   @param threads total number of threads including the calling one
+          (at most MAX_WORKER_THREADS), 0 means the number of hardware
+          threads, 1 means everything is run on the calling thread
+   */
+
+void shutdown_job_system();
+  /**<
+   Finishes all the queued jobs and stops the worker threads. This is
+   called automatically at program exit.
+   */
+
+unsigned int get_number_of_threads();
+  /**<
+   Gets the number of threads used by the job system.
+
+   @return number of threads including the main one
+   */
+
+void add_job_dependency(job *what, job *depends_on);
+  /**<
+   Makes a job wait for another job to finish before it can be run.
+   This must be called before the job is submitted.
+
+   @param what job that will wait
+   @param depends_on job that has to be finished first
+   */
+
+void submit_job(job *what);
+  /**<
+   Submits a job to be run by the job system as soon as all of its
+   dependencies are finished. The job must stay allocated until it is
+   finished.
+
+   @param what job to be submitted
+   */
+
+void wait_for_job(job *what);
+  /**<
+   Waits until given job is finished, the calling thread runs other
+   queued jobs in the meantime.
+
+   @param what job to wait for
+   */
+
+void parallel_for(unsigned int count, function<void(unsigned int from, unsigned int to)> body, unsigned int min_batch = JOB_MIN_BATCH);
+  /**<
+   Splits the range <0,count) to batches that are processed in parallel
+   by the job system and waits for all of them to finish.
+
+   @param count number of items to be processed
+   @param body function that processes items in range <from,to), it
+          will be called from multiple threads at once
+   @param min_batch minimum number of items in one batch, small ranges
+          are processed directly on the calling thread
+   */
+
+void multiply_matrices_4x4(const matrix_4x4 *matrix_a, const matrix_4x4 *matrix_b, matrix_4x4 *matrix_result);
+  /**<
+   Multiplies two matrices using SIMD instructions (SSE, AVX or NEON,
+   whatever the compiler targets, or plain C++ when none is available
+   or OPENGLSE_NO_SIMD is defined).
+
+   @param matrix_a first matrix
+   @param matrix_b second matrix
+   @param matrix_result matrix where the result matrix_a * matrix_b will
+          be stored, it can be the same as one of the input matrices
+   */
+
+void multiply_matrices_affine(const matrix_4x4 *matrix_a, const matrix_4x4 *matrix_b, matrix_4x4 *matrix_result);
+  /**<
+   Faster version of multiply_matrices_4x4 for affine matrices (the
+   last row being 0 0 0 1), which are all the translation, rotation and
+   scale matrices and their products, but not the perspective matrix.
+
+   @param matrix_a first affine matrix
+   @param matrix_b second affine matrix
+   @param matrix_result matrix where the result matrix_a * matrix_b will
+          be stored, it can be the same as one of the input matrices
+   */
+
+bool invert_matrix_affine(const matrix_4x4 *matrix, matrix_4x4 *matrix_result);
+  /**<
+   Inverts an affine matrix (the last row being 0 0 0 1).
+
+   @param matrix matrix to be inverted
+   @param matrix_result matrix where the result will be stored, it can
+          be the same as the input matrix, it isn't changed if the
+          matrix can't be inverted
+   @return true if the matrix could be inverted, false if it is
+           singular
+   */
+
+void multiply_vector_matrix_4x4(const vector_4d *vector, const matrix_4x4 *matrix, vector_4d *vector_result);
+  /**<
+   Multiplies a column vector by a matrix (matrix * vector) using SIMD
+   instructions.
+
+   @param vector vector to be multiplied
+   @param matrix matrix to multiply the vector with
+   @param vector_result vector where the result will be stored, it can
+          be the same as the input vector
+   */
+
+void transform_points(const matrix_4x4 *matrix, float *points, unsigned int count, unsigned int stride, float w);
+  /**<
+   Transforms an array of 3D points (or directions) by a matrix in
+   place. The matrix is loaded only once for the whole array.
+
+   @param matrix transformation matrix
+   @param points pointer to the x coordinate of the first point, each
+          point consists of three consecutive floats (x, y and z)
+   @param count number of points
+   @param stride distance between two points in bytes, e.g.
+          sizeof(vertex_3d) to transform vertex positions in place
+   @param w fourth coordinate of the points, 1 for points (translation
+          is applied), 0 for directions such as normals
+   */
+
+void transform_points_soa(const matrix_4x4 *matrix, float *x, float *y, float *z, unsigned int count, float w);
+  /**<
+   Transforms 3D points (or directions) stored as structure of arrays
+   in place by a matrix. This is faster than transform_points as whole
+   SIMD registers of x, y and z coordinates are processed at once.
+
+   @param matrix transformation matrix
+   @param x array of x coordinates
+   @param y array of y coordinates
+   @param z array of z coordinates
+   @param count number of points
+   @param w fourth coordinate of the points, 1 for points (translation
+          is applied), 0 for directions
+   */
+
+void make_quaternion(float degrees_x, float degrees_y, float degrees_z, rotation_matrix_type type, quaternion *result);
+  /**<
+   Makes a quaternion out of rotation angles, the result is the same
+   rotation as the matrix made by make_rotation_matrix.
+
+   @param degrees_x rotation around x in degrees
+   @param degrees_y rotation around y in degrees
+   @param degrees_z rotation around z in degrees
+   @param type order of the rotations
+   @param result in this variable the quaternion will be returned
+   */
+
+void make_quaternion_axis_angle(point_3d axis, float degrees, quaternion *result);
+  /**<
+   Makes a quaternion representing a rotation around given axis (in the
+   same direction as rotations around the coordinate axes).
+
+   @param axis rotation axis, doesn't have to be normalized
+   @param degrees rotation angle in degrees
+   @param result in this variable the quaternion will be returned
+   */
+
+void multiply_quaternions(quaternion quaternion1, quaternion quaternion2, quaternion *result);
+  /**<
+   Multiplies two quaternions, which combines the rotations.
+
+   @param quaternion1 rotation applied second
+   @param quaternion2 rotation applied first
+   @param result in this variable the quaternion1 * quaternion2 will be
+          returned
+   */
+
+void normalize_quaternion(quaternion *what);
+  /**<
+   Normalizes a quaternion (so that its length is 1), which removes
+   rounding errors accumulated by repeated multiplication.
+
+   @param what quaternion to be normalized
+   */
+
+void interpolate_quaternions(float ratio, quaternion quaternion1, quaternion quaternion2, quaternion *result);
+  /**<
+   Interpolates between two rotations using spherical linear
+   interpolation (slerp), i.e. with constant angular speed the shorter
+   way around.
+
+   @param ratio value in range <0,1>, 0 gives the first rotation, 1 the
+          second one
+   @param quaternion1 first rotation
+   @param quaternion2 second rotation
+   @param result in this variable the interpolated rotation will be
+          returned
+   */
+
+void make_quaternion_matrix(quaternion rotation, float matrix[4][4]);
+  /**<
+   Makes a rotation matrix out of a quaternion (without any
+   trigonometric functions).
+
+   @param rotation normalized quaternion
+   @param matrix in this variable the matrix will be returned
+   */
+
+void quaternion_to_euler(quaternion rotation, rotation_matrix_type type, point_3d *degrees);
+  /**<
+   Converts a quaternion to rotation angles, so that make_rotation_matrix
+   with given order makes the same rotation.
+
+   @param rotation normalized quaternion
+   @param type order of the rotations
+   @param degrees in this variable the angles in degrees in range
+          <0,360) will be returned
+   */
+
+void update_scene_nodes();
+  /**<
+   Recomputes the world matrices of all the scene nodes that have
+   changed (and of their descendants) in one pass over all the nodes
+   sorted so that parents go before their children. This is done
+   automatically when a world matrix is needed (e.g. for drawing an
+   attached mesh), calling it manually is only useful to control when
+   the work is done.
+   */
+
+// global variables:
+
+unsigned int global_window_width, global_window_height;
+unsigned int global_window_center[2];
+void (*user_render_function)(void) = NULL;                         /// pointer to user specified loop render function
+void (*user_keyboard_function)(int key, int x, int y) = NULL;      /// pointer to user specified keypress function
+void (*user_advanced_keyboard_function)(bool key_up, int key, int x, int y) = NULL;
+void (*user_mouse_function)(int button, int state) = NULL;
+float global_fov, global_near, global_far;                         /// perspective parameters
+float global_fog_distance;                                         /// at what distance from the far plane in view space the fog begins
+bool global_recompute_lod = false;                                 /// flag that tells the mesh_3d_lod objects to recompute their LODs
+int global_mouse_position[2];
+bool global_ignore_mouse_position = true;                          /// this is used by camera.handle_fps() to prevent mouse rotation in first call
+
+int global_frame_counter = 0;                                      /// for FPS
+int global_last_time = 0;                                          /// for FPS
+float global_fps = 0;
+float global_spf = 0;
+
+unsigned char global_background_color[3];                          /// background color of the viewport
+bool global_keyboard_state[512];                                   /// keeps the keyboard state (each ASCII character + special keys) for the advanced keyboard function
+int global_previous_frame_time = 0;                                /// keep the time of the previous frame
+int global_frame_time_difference = 0;
+
+point_3d global_light_direction;                                   /// global directional light direction vector
+unsigned char global_light_color[3];                               /// global directional light RGB intensity
+
+map<const void *,memory_record> global_memory_records;            /// memory reported by each object, declared before the global objects that report to it
+memory_usage global_memory_usage[MEMORY_CATEGORIES + 1];           /// sums of global_memory_records per category, the last item is the total
+unsigned long long global_cpu_memory_budgets[MEMORY_CATEGORIES + 1];   /// 0 means no budget
+unsigned long long global_gpu_memory_budgets[MEMORY_CATEGORIES + 1];
+bool global_memory_budget_exceeded[MEMORY_CATEGORIES + 1];         /// to warn only once each time a budget gets exceeded
+const char *global_memory_category_names[MEMORY_CATEGORIES + 1] = {"textures","meshes","animated","crowds","arenas","uniforms","total"};
+map<string,unsigned int> global_residency_files;                   /// cache files with released data -> number of objects using them
+
+texture_2d global_default_font;                                    /// default font texture
+buffer_arena global_buffer_arena;                                  /// arena for the meshes of make_text and other small meshes
+GLuint global_bound_vao = 0;                                       /// currently bound VAO, to skip redundant glBindVertexArray calls
+GLuint global_bound_textures[TEXTURE_UNITS];                       /// texture bound to each texture unit, to skip redundant glBindTexture calls
+unsigned int global_active_texture_unit = 0;                       /// texture unit set by the last glActiveTexture
+unsigned int global_texture_binds = 0;                             /// number of glBindTexture calls made
+
+typedef struct                                                     /// job queue of one job system thread
+  {
+    mutex lock;
+    deque<job *> jobs;
+  } job_queue;
+
+job_queue global_job_queues[MAX_WORKER_THREADS];                   /// index 0 is the main thread's queue
+vector<thread> global_worker_threads;
+unsigned int global_number_of_threads = 1;                         /// job system threads including the main one
+atomic<bool> global_job_system_running(false);
+atomic<int> global_queued_jobs(0);
+mutex global_job_sleep_mutex;                                      /// idle workers sleep on global_job_wakeup with this mutex
+condition_variable global_job_wakeup;
+bool global_job_system_exit_registered = false;
+thread_local unsigned int global_thread_index = 0;                 /// job queue index of the current thread
+vector<scene_node *> global_scene_nodes;                           /// all scene nodes, parents always before their children (when sorted)
+bool global_scene_nodes_sorted = true;                             /// false if the hierarchy changed and global_scene_nodes has to be resorted
+bool global_scene_nodes_changed = false;                           /// true if any node changed since the last update_scene_nodes
+
+GLuint world_matrix_location;                                      /// world matrix location
+GLuint frame_percentage_location;
+GLuint number_of_shadows_location;
+GLuint shadows_location;
+GLuint position_offset_location;
+GLuint position_scale_location;
+GLuint animation_time_location;
+GLuint vertex_texture_vertices_location;
+GLuint vertex_texture_frames_location;
+GLuint frame_starts_location;
+shader_variant global_shader_variants[SHADER_VARIANTS];           /// compiled shader variants, indexed by shader_variant_key
+int global_current_shader_variant = -1;                            /// variant in use, its locations are copied to the *_location variables
+unsigned int global_shader_features = 0;                           /// features added to every mesh drawn (SHADER_2D while drawing pictures)
+string global_cache_directory = "";                                /// where data are cached between runs, empty if caching is disabled
+unsigned int global_program_cache_hits = 0;                        /// shader programs loaded from the program binary cache
+unsigned int global_program_cache_misses = 0;                      /// shader programs compiled from source
+unsigned int global_texture_cache_hits = 0;                        /// compressed textures loaded from the cache
+unsigned int global_texture_cache_misses = 0;                      /// compressed textures encoded
+double global_program_time = 0;                                    /// milliseconds spent making shader programs
+frame_uniforms global_frame_uniforms;                              /// CPU copy of the per-frame uniform block
+bool global_frame_uniforms_changed = true;                         /// true if global_frame_uniforms has to be uploaded
+GLuint global_frame_ubo = 0;                                       /// per-frame uniform buffer
+GLuint global_bone_ubo = 0;                                        /// bone matrix palette uniform buffer, MAX_BONES matrices
+vector<material_uniforms> global_materials;                        /// materials in the order they are in the material uniform buffer
+vector<unsigned int> global_material_references;                   /// number of meshes using each material, free slots have 0
+vector<unsigned int> global_free_materials;                        /// slots of global_materials that can be reused
+unordered_map<string,int> global_material_indices;                 /// material bytes -> index of the used material
+GLuint global_material_ubo = 0;                                    /// per-material uniform buffer, each material at a multiple of global_material_stride
+unsigned int global_material_ubo_capacity = 0;                     /// number of materials the buffer has space for
+unsigned int global_material_stride = 0;                           /// material size aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+int global_bound_material = -1;                                    /// index of the material bound to MATERIAL_UNIFORMS_BINDING
+bool global_multi_draw_indirect = false;                            /// whether mesh_3d_group uses glMultiDrawElementsIndirect
+
+struct camera_struct                   /// represents a camera
+{
+  point_3d position;                   /// camera position
+  point_3d rotation;                   /// camera rotation (around x, y and z axis in degrees)
+  point_3d direction_forward_vector;   /// camera direction (forward) vector
+  point_3d direction_left_vector;
+  point_3d direction_up_vector;
+  mesh_3d *skybox = NULL;              /// skybox, follows the camera movement (but not its rotation)
+
+  quaternion orientation;              /// camera rotation as a quaternion, kept in sync with the rotation angles
+  float translation_matrix[4][4];
+  float rotation_matrix[4][4];
+  float transformation_matrix[4][4];   /// translation + rotation
+
+  float movement_speed = 0.01;         /// camera movement speed (distance per millisecond) used by camera handling function
+  float rotation_speed = 0.1;          /// camera rotation speed (angles per millisecond)
+  bool limit_x_rotation = true;        /// this disallows camera handling function to rotate around x more than allowed (classic FPS behaviour)
+  bool use_mouse_for_rotation = true;  /// if true, the mouse movement rotates the camera, otherwise keys are used and mouse can be moved freely
+
+  int key_go_forward = SPECIAL_KEY_UP;
+  int key_go_backward = SPECIAL_KEY_DOWN;
+  int key_go_left = SPECIAL_KEY_LEFT;
+  int key_go_right = SPECIAL_KEY_RIGHT;
+  int key_go_up = 'q';
+  int key_go_down = 'e';
+  int key_rotate_y_cw = 'd';
+  int key_rotate_y_ccw = 'a';
+  int key_rotate_x_cw = 'w';
+  int key_rotate_x_ccw = 's';
+  int key_rotate_z_cw = 'y';
+  int key_rotate_z_ccw = 'x';
+
+  void set_position(float x, float y, float z);
+    /**<
+     Sets the camera position to given point.
+
+     @param x new camera x
+     @param y new camera y
+     @param z new camera z
+    */
+
+  void get_direction(point_3d *direction);
+    /**<
+     Gets the camera direction vector;
+
+     @param direction in this variable the unit camera direction vector
+            will be returned
+     */
+
+  void set_skybox(mesh_3d *what);
+    /**<
+     Sets a skybox, which will follow the camera movement (but not its
+     rotation).
+
+     @param what skybox to be set
+     */
+
+  void handle_fps();
+    /**<
+     Handles the camera depending on the current keyboard state and camera
+     settings (speed, key mapping etc.). This is intended to be called inside
+     the render function and only if advanced keyboard function is registered.
+     The camera behaves the same way as in FPS.
+     */
+
+  void move(float dx, float dy, float dz);
+    /**<
+     Moves the camera relatively to its current position.
+
+     @param dx by how much to move the camera in x
+     @param dy by how much to move the camera in y
+     @param dz by how much to move the camera in z
+     */
+
+  void rotate(float dx_angles, float dy_angles, float dz_angles);
+    /**<
+     Rotates the camera relatively to its current rotation.
+
+     @param dx_angles by how many angles to rotate the camera around x
+     @param dy_angles by how many angles to rotate the camera around y
+     @param dz_angles by how many angles to rotate the camera around z
+     */
+
+  void set_rotation(float x, float y, float z);
+    /**<
+     Sets the camera rotation to given point.
+
+     @param x new camera rotation around x
+     @param y new camera rotation around y
+     @param z new camera rotation around z
+    */
+
+  void set_orientation(quaternion orientation);
+    /**<
+     Sets the camera rotation as a quaternion.
+
+     @param orientation new camera rotation, it should be normalized
+    */
+
+  void update_rotation();
+    /**<
+     Updates the view matrix and direction vectors after the
+     orientation has changed.
+    */
+
+  void get_position(point_3d *position);
+    /**<
+     Gets the current camera position.
+
+     @param position in this variable the camera position will be returned
+    */
+
+  void get_rotation(point_3d *rotation);
+    /**<
+     Gets the current camera rotation.
+
+     @param rotation in this variable the camera rotation in degrees will
+          be returned
+    */
+
+  void go(axis_direction direction, float distance);
+    /**<
+     Moves the camera in direction depending on its rotation.
+
+     @param direction direction in which the camera will move from its
+            perspective
+     @param distance how far the camera should go
+     */
+
+} camera;
+
+//======================================================================
+// private function definitions:
+//======================================================================
+
+float get_distance(point_3d point1, point_3d point2)
+
+{
+  float dx,dy,dz;
+
+  dx = point1.x - point2.x;
+  dy = point1.y - point2.y;
+  dz = point1.z - point2.z;
+
+  return sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+//----------------------------------------------------------------------
+
+void load_default_font()
+  /**<
+   Loads the default global font texture (global_default_font).
+   */
+
+{
+  unsigned int i,j,index,x_position;
+
+  global_default_font.initialise(1280 + 256,8);  // 1280 = 256 (number of characters) * 5 (character width), + 256 = space perofe each character
+  global_default_font.set_transparent_color(255,255,255);
+  global_default_font.set_transparency(true);
+
+  index = 0;
+
+  for (j = 0; j < 7; j++)
+    {
+      x_position = 198;
+
+      for (i = 0; i < 470; i++)              // 470 = width of default font pixel data
+        {
+          if (i % 5 == 0)
+            x_position++;
+
+          if (default_font_data[index] != 0)
+            global_default_font.set_pixel(x_position,j,0,0,0); // 166 = offset
+
+          x_position++;
+          index++;
+        }
+    }
+
+  global_default_font.update();
+}
+
+//----------------------------------------------------------------------
+
+float clamp(float what, float minimum, float maximum)
+
+{
+  if (what > maximum)
+    return maximum;
+  else if (what < minimum)
+    return minimum;
+  else
+    return what;
+}
+
+//----------------------------------------------------------------------
+
+unsigned short quantize_unorm16(float value)
+  /**<
+   Converts a value in range <0,1> to 16 bit unsigned normalized
+   integer.
+   */
+
+{
+  return (unsigned short) (clamp(value,0.0,1.0) * 65535.0 + 0.5);
+}
+
+//----------------------------------------------------------------------
+
+unsigned short float_to_half(float value)
+  /**<
+   Converts a float to 16 bit half float, rounding to the nearest
+   value. Values too big are clamped to the maximum half float.
+   */
+
+{
+  unsigned int bits,sign,mantissa,result;
+  int exponent;
+
+  memcpy(&bits,&value,sizeof(bits));
+
+  sign = (bits >> 16) & 0x8000;
+  exponent = ((int) ((bits >> 23) & 0xff)) - 127 + 15;
+  mantissa = bits & 0x7fffff;
+
+  if (((bits >> 23) & 0xff) == 0xff)          // infinity or NaN
+    return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+
+  if (exponent <= 0)                          // half float denormal or zero
+    {
+      if (exponent < -10)
+        return sign;
+
+      mantissa |= 0x800000;
+      result = mantissa >> (14 - exponent);
+
+      if ((mantissa >> (13 - exponent)) & 1)  // round
+        result++;
+
+      return sign | result;
+    }
+
+  if (exponent >= 31)
+    return sign | 0x7bff;
+
+  result = (exponent << 10) | (mantissa >> 13);
+
+  if (mantissa & 0x1000)                      // round, a carry correctly increases the exponent
+    result++;
+
+  if (result >= 0x7c00)
+    result = 0x7bff;
+
+  return sign | result;
+}
+
+//----------------------------------------------------------------------
+
+GLenum upload_indices(vector<triangle_3d> &triangles, unsigned int number_of_vertices)
+  /**<
+   Uploads triangle indices to the currently bound element array buffer.
+   If the number of vertices allows it, the indices are converted to 16
+   bits, which halves the IBO memory and index fetch bandwidth (8 bit
+   indices aren't used, many drivers convert them on the CPU).
+
+   @param triangles triangles to be uploaded
+   @param number_of_vertices number of vertices the indices point to
+   @return type of the uploaded indices (GL_UNSIGNED_SHORT or
+           GL_UNSIGNED_INT), to be passed to glDrawElements
+   */
+
+{
+  unsigned int i;
+
+  if (number_of_vertices > 65536 || triangles.size() == 0)
+    {
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER,triangles.size() * sizeof(triangle_3d),triangles.size() == 0 ? NULL : &triangles[0],GL_STATIC_DRAW);
+      return GL_UNSIGNED_INT;
+    }
+
+  vector<unsigned short> indices(triangles.size() * 3);
+
+  for (i = 0; i < triangles.size(); i++)
+    {
+      indices[i * 3] = (unsigned short) triangles[i].index1;
+      indices[i * 3 + 1] = (unsigned short) triangles[i].index2;
+      indices[i * 3 + 2] = (unsigned short) triangles[i].index3;
+    }
+
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,indices.size() * sizeof(unsigned short),&indices[0],GL_STATIC_DRAW);
+  return GL_UNSIGNED_SHORT;
+}
+
+//----------------------------------------------------------------------
+
+void bind_vertex_array(GLuint vao)
+  /**<
+   Binds given VAO unless it's already bound. All VAO binding has to go
+   through this function so that the cached binding stays right.
+
+   @param vao VAO handle, 0 unbinds the current VAO
+   */
+
+{
+  if (vao == global_bound_vao)
+    return;
+
+  glBindVertexArray(vao);
+  global_bound_vao = vao;
+}
+
+//----------------------------------------------------------------------
+
+void bind_texture(unsigned int unit, GLuint texture_object)
+  /**<
+   Binds a 2D texture to given texture unit unless it's already bound
+   there. All texture binding has to go through this function so that
+   the cached bindings stay right. The unit is always left active, so
+   the texture can be modified (glTexImage2D etc.) right after this.
+
+   @param unit texture unit, less than TEXTURE_UNITS
+   @param texture_object texture object handle
+   */
+
+{
+  if (global_active_texture_unit != unit)    // even if the texture is bound, calls that follow may modify it
+    {
+      glActiveTexture(GL_TEXTURE0 + unit);
+      global_active_texture_unit = unit;
+    }
+
+  if (global_bound_textures[unit] == texture_object)
+    return;
+
+  glBindTexture(GL_TEXTURE_2D,texture_object);
+  global_bound_textures[unit] = texture_object;
+  global_texture_binds++;
+}
+
+//----------------------------------------------------------------------
+
+void delete_texture(GLuint texture_object)
+  /**<
+   Deletes given texture object and updates the cached bindings.
+
+   @param texture_object texture object handle
+   */
+
+{
+  unsigned int i;
+
+  glDeleteTextures(1,&texture_object);
+
+  for (i = 0; i < TEXTURE_UNITS; i++)
+    if (global_bound_textures[i] == texture_object)
+      global_bound_textures[i] = 0;
+}
+
+//----------------------------------------------------------------------
+
+void delete_vertex_array(GLuint vao)
+  /**<
+   Deletes given VAO and updates the cached binding (a deleted VAO gets
+   unbound and its handle can be reused).
+
+   @param vao VAO handle
+   */
+
+{
+  glDeleteVertexArrays(1,&vao);
+
+  if (vao == global_bound_vao)
+    global_bound_vao = 0;
+}
+
+//----------------------------------------------------------------------
+
+bool allocate_arena_range(vector<arena_range> &free_ranges, unsigned int size, unsigned int *offset)
+  /**<
+   Takes a range of given size from the first free range that is big
+   enough.
+
+   @param free_ranges free ranges sorted by offset
+   @param size size of the range to be allocated
+   @param offset in this variable the offset of the allocated range will
+          be returned
+   @return true if the range has been allocated, false if there is no
+           free range big enough
+   */
+
+{
+  unsigned int i;
+
+  if (size == 0)
+    {
+      *offset = 0;
+      return true;
+    }
+
+  for (i = 0; i < free_ranges.size(); i++)
+    if (free_ranges[i].size >= size)
+      {
+        *offset = free_ranges[i].offset;
+        free_ranges[i].offset += size;
+        free_ranges[i].size -= size;
+
+        if (free_ranges[i].size == 0)
+          free_ranges.erase(free_ranges.begin() + i);
+
+        return true;
+      }
+
+  return false;
+}
+
+//----------------------------------------------------------------------
+
+void free_arena_range(vector<arena_range> &free_ranges, arena_range range)
+  /**<
+   Returns a range to the free ranges and merges it with the adjacent
+   ones.
+
+   @param free_ranges free ranges sorted by offset
+   @param range range to be freed
+   */
+
+{
+  unsigned int i;
+
+  if (range.size == 0)
+    return;
+
+  for (i = 0; i < free_ranges.size(); i++)
+    if (free_ranges[i].offset > range.offset)
+      break;
+
+  free_ranges.insert(free_ranges.begin() + i,range);
+
+  if (i + 1 < free_ranges.size() && free_ranges[i].offset + free_ranges[i].size == free_ranges[i + 1].offset)
+    {
+      free_ranges[i].size += free_ranges[i + 1].size;
+      free_ranges.erase(free_ranges.begin() + i + 1);
+    }
+
+  if (i > 0 && free_ranges[i - 1].offset + free_ranges[i - 1].size == free_ranges[i].offset)
+    {
+      free_ranges[i - 1].size += free_ranges[i].size;
+      free_ranges.erase(free_ranges.begin() + i);
+    }
+}
+
+//----------------------------------------------------------------------
+
+float arena_fragmentation(vector<arena_range> &free_ranges)
+  /**<
+   Computes the fragmentation of free ranges as 1 - largest free range
+   / all free space.
+
+   @param free_ranges free ranges
+   @return fragmentation in range <0,1>
+   */
+
+{
+  unsigned int i,largest,total;
+
+  largest = 0;
+  total = 0;
+
+  for (i = 0; i < free_ranges.size(); i++)
+    {
+      largest = max(largest,free_ranges[i].size);
+      total += free_ranges[i].size;
+    }
+
+  return total == 0 ? 0.0 : 1.0 - largest / ((float) total);
+}
+
+//----------------------------------------------------------------------
+
+GLuint resize_gpu_buffer(GLuint buffer, unsigned int old_size, unsigned int new_size)
+  /**<
+   Makes a new buffer of given size and copies the old buffer's data to
+   it on GPU, the old buffer is deleted.
+
+   @param buffer buffer to be resized, can be 0
+   @param old_size size of the old buffer in bytes
+   @param new_size size of the new buffer in bytes
+   @return handle of the new buffer
+   */
+
+{
+  GLuint result;
+
+  glGenBuffers(1,&result);
+
+  if (result == 0)
+    cerr << "ERROR: buffer couldn't be allocated.";
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER,result);   // copy targets don't change VAO state
+  glBufferData(GL_COPY_WRITE_BUFFER,new_size,NULL,GL_STATIC_DRAW);
+
+  if (buffer != 0)
+    {
+      glBindBuffer(GL_COPY_READ_BUFFER,buffer);
+      glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,0,0,min(old_size,new_size));
+      glDeleteBuffers(1,&buffer);
+    }
+
+  return result;
+}
+
+//----------------------------------------------------------------------
+
+void rasterize_triangle_overdraw(float points[3][3], float *depth_buffer, unsigned int *fragment_counts)
+  /**<
+   Rasterizes a triangle to OVERDRAW_RESOLUTION x OVERDRAW_RESOLUTION
+   depth buffer, counts the fragments passing the depth test (less). The
+   top-left fill rule is used so that pixels on shared edges are only
+   counted once.
+
+   @param points triangle points, x and y in pixels, z is the depth
+   @param depth_buffer depth buffer
+   @param fragment_counts per pixel counters of fragments
+   */
+
+{
+  long long x[3],y[3];
+  long long area,w0,w1,w2;
+  int min_x,min_y,max_x,max_y,px,py,i,j;
+  int bias[3];
+  float depth;
+
+  for (i = 0; i < 3; i++)        // snap to 1/16 of a pixel
+    {
+      x[i] = (long long) floor(points[i][0] * 16.0 + 0.5);
+      y[i] = (long long) floor(points[i][1] * 16.0 + 0.5);
+    }
+
+  area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+
+  if (area == 0)
+    return;
+
+  if (area < 0)                  // make the triangle counter clockwise
+    {
+      swap(x[1],x[2]);
+      swap(y[1],y[2]);
+      swap(points[1],points[2]);
+      area = -area;
+    }
+
+  for (i = 0; i < 3; i++)       // edge i goes from point i + 1 to point i + 2
+    {
+      long long dx = x[(i + 2) % 3] - x[(i + 1) % 3];
+      long long dy = y[(i + 2) % 3] - y[(i + 1) % 3];
+      bias[i] = (dy > 0 || (dy == 0 && dx < 0)) ? 0 : -1;   // top-left rule
+    }
+
+  min_x = max(0,(int) (min(x[0],min(x[1],x[2])) >> 4));
+  min_y = max(0,(int) (min(y[0],min(y[1],y[2])) >> 4));
+  max_x = min(OVERDRAW_RESOLUTION - 1,(int) (max(x[0],max(x[1],x[2])) >> 4) + 1);
+  max_y = min(OVERDRAW_RESOLUTION - 1,(int) (max(y[0],max(y[1],y[2])) >> 4) + 1);
+
+  for (j = min_y; j <= max_y; j++)
+    for (i = min_x; i <= max_x; i++)
+      {
+        px = i * 16 + 8;         // pixel center
+        py = j * 16 + 8;
+
+        w0 = (x[2] - x[1]) * (py - y[1]) - (y[2] - y[1]) * (px - x[1]) + bias[0];
+        w1 = (x[0] - x[2]) * (py - y[2]) - (y[0] - y[2]) * (px - x[2]) + bias[1];
+        w2 = (x[1] - x[0]) * (py - y[0]) - (y[1] - y[0]) * (px - x[0]) + bias[2];
+
+        if (w0 < 0 || w1 < 0 || w2 < 0)
+          continue;
+
+        depth = (w0 * points[0][2] + w1 * points[1][2] + w2 * points[2][2]) / ((float) area);
+
+        if (depth < depth_buffer[j * OVERDRAW_RESOLUTION + i])
+          {
+            depth_buffer[j * OVERDRAW_RESOLUTION + i] = depth;
+            fragment_counts[j * OVERDRAW_RESOLUTION + i]++;
+          }
+      }
+}
+
+//----------------------------------------------------------------------
+
+unsigned int pack_normal(point_3d normal)
+  /**<
+   Packs a normal to signed normalized 10-10-10-2 integer (the format
+   of GL_INT_2_10_10_10_REV, x in the lowest bits).
+   */
+
+{
+  int x = (int) floor(clamp(normal.x,-1.0,1.0) * 511.0 + 0.5);
+  int y = (int) floor(clamp(normal.y,-1.0,1.0) * 511.0 + 0.5);
+  int z = (int) floor(clamp(normal.z,-1.0,1.0) * 511.0 + 0.5);
+
+  return (((unsigned int) x) & 0x3ff) | ((((unsigned int) y) & 0x3ff) << 10) | ((((unsigned int) z) & 0x3ff) << 20);
+}
+
+//----------------------------------------------------------------------
+
+void push_job(job *what)
+  /**<
+   Puts a job that is ready to run to the current thread's queue and
+   wakes up an idle worker.
+   */
+
+{
+  unsigned int index = global_thread_index < global_number_of_threads ? global_thread_index : 0;
+
+  {
+    lock_guard<mutex> lock(global_job_queues[index].lock);
+    global_job_queues[index].jobs.push_back(what);
+  }
+
+  global_queued_jobs++;
+
+  {
+    lock_guard<mutex> lock(global_job_sleep_mutex);  // so that the notification can't get lost
+  }
+
+  global_job_wakeup.notify_one();
+}
+
+//----------------------------------------------------------------------
+
+job *pop_job(unsigned int thread_index)
+  /**<
+   Takes a job from the given thread's queue (newest first) or, if it is
+   empty, steals one from another thread's queue (oldest first).
+
+   @return job to be run or NULL if there are no jobs
+   */
+
+{
+  unsigned int i,victim;
+  job *result = NULL;
+
+  {
+    lock_guard<mutex> lock(global_job_queues[thread_index].lock);
+
+    if (!global_job_queues[thread_index].jobs.empty())
+      {
+        result = global_job_queues[thread_index].jobs.back();
+        global_job_queues[thread_index].jobs.pop_back();
+      }
+  }
+
+  for (i = 1; result == NULL && i < global_number_of_threads; i++)
+    {
+      victim = (thread_index + i) % global_number_of_threads;
+
+      lock_guard<mutex> lock(global_job_queues[victim].lock);
+
+      if (!global_job_queues[victim].jobs.empty())
+        {
+          result = global_job_queues[victim].jobs.front();
+          global_job_queues[victim].jobs.pop_front();
+        }
+    }
+
+  if (result != NULL)
+    global_queued_jobs--;
+
+  return result;
+}
+
+//----------------------------------------------------------------------
+
+void run_job(job *what)
+  /**<
+   Runs the job and releases the jobs that depend on it.
+   */
+
+{
+  unsigned int i;
+  vector<job *> continuations;
+
+  if (what->work)
+    what->work();
+
+  {
+    lock_guard<mutex> lock(what->continuations_mutex);
+    what->completed = true;
+    continuations.swap(what->continuations);
+  }
+
+  for (i = 0; i < continuations.size(); i++)
+    if (--continuations[i]->unfinished_dependencies == 0)
+      push_job(continuations[i]);
+
+  what->finished = true;    // must be the last access, the job can be deleted right after this
+}
+
+//----------------------------------------------------------------------
+
+void worker_function(unsigned int thread_index)
+  /**<
+   Main function of a job system worker thread.
+   */
+
+{
+  job *job_to_run;
+
+  global_thread_index = thread_index;
+
+  while (global_job_system_running)
+    {
+      job_to_run = pop_job(thread_index);
+
+      if (job_to_run != NULL)
+        run_job(job_to_run);
+      else
+        {
+          unique_lock<mutex> lock(global_job_sleep_mutex);
+          global_job_wakeup.wait_for(lock,chrono::milliseconds(2),[]{ return global_queued_jobs > 0 || !global_job_system_running; });
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+
+void print_matrix(float matrix[4][4])
+  /**<
+    For debugging purposes, prints given matrix.
+
+    @matrix matrix to be printed
+  */
+
+{
+  unsigned int i,j;
+
+  for (j = 0; j < 4; j++)
+    {
+      for (i = 0; i < 4; i++)
+        cout << matrix[i][j] << " ";
+
+      cout << endl;
+    }
+
+  cout << endl;
+}
+
+//----------------------------------------------------------------------
+
+unsigned int texture_2d::xy_to_linear(int x, int y)
+
+{
+  return (y * this->width + x) * 3;
+}
+
+//----------------------------------------------------------------------
+
+int convert_glut_key(int glut_key)
+  /**<
+   Converts the GLUT key code to the library key code.
+   */
+
+{
+  switch (glut_key)
+    {
+      case GLUT_KEY_UP: return SPECIAL_KEY_UP; break;
+      case GLUT_KEY_RIGHT: return SPECIAL_KEY_RIGHT; break;
+      case GLUT_KEY_DOWN: return SPECIAL_KEY_DOWN; break;
+      case GLUT_KEY_LEFT: return SPECIAL_KEY_LEFT; break;
+    }
+
+  return 0;
+}
+
+//----------------------------------------------------------------------
+
+void parse_obj_line(string line,float data[4][3])
+  /**<
+    Parses the data contained in one line of obj file format
+    (e.g. "v 1.5 3 4.2" or "f 1/2 3/5 4/6 1/20").
+
+    @param data in this variable the parsed data will be returned, the
+           first index represents the element number (i.e. x, y, z for
+           a vertex or one of the triangle indices) and the second index
+           represents one of up to 3 shashed values (if the values are
+           in format a/b/3), if any of the values is not present, -1.0
+           is inserted.
+   */
+
+{
+  line = line.substr(line.find_first_of(' '));  // get rid of the first characters
+
+  unsigned int i,j;
+  size_t position;
+  bool do_break;
+
+  for (i = 0; i < 4; i++)
+    for (j = 0; j < 3; j++)
+      data[i][j] = -1.0;
+
+  for (i = 0; i < 4; i++)
+    {
+      for (j = 0; j < 3; j++)
+        {
+          do_break = false;
+
+          try
+            {
+              if (line.length() >= 1)
+                data[i][j] = stof(line,&position);
+
+              if (line[position] != '/')
+                do_break = true;
+
+              if (position + 1 <= line.length())
+                line = line.substr(position + 1);
+              else
+                return;
+
+              if (do_break)
+                break;
+            }
+          catch (exception& e)
+            {
+            }
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+
+float angle_to_0_360(float angle)
+  /**<
+   Converts a value in angles so that it is in range <0,360>.
+
+   @param angle angle to be converted
+   @return corresponding angle in <0,360> range
+   */
+
+{
+  if (angle < 0)
+    {
+      angle = -1 * angle;
+      angle = fmod(angle,360.0);
+      angle = 360.0 - angle;
+    }
+
+  if (angle != 0)
+    angle = fmod(angle,360.0);
+  
+  return angle;
+}
+
+//----------------------------------------------------------------------
+
+#ifdef OPENGLSE_SSE
+
+__m128 cross_product_sse(__m128 vector_a, __m128 vector_b)
+
+  /**<
+    Cross product of the first three components of two SSE vectors, the
+    fourth component of the result is 0.
+  */
+
+{
+  return _mm_sub_ps(
+    _mm_mul_ps(_mm_shuffle_ps(vector_a,vector_a,_MM_SHUFFLE(3,0,2,1)),_mm_shuffle_ps(vector_b,vector_b,_MM_SHUFFLE(3,1,0,2))),
+    _mm_mul_ps(_mm_shuffle_ps(vector_a,vector_a,_MM_SHUFFLE(3,1,0,2)),_mm_shuffle_ps(vector_b,vector_b,_MM_SHUFFLE(3,0,2,1))));
+}
+
+//----------------------------------------------------------------------
+
+#endif
+
+void multiply_matrices_simd(const float *matrix_a, const float *matrix_b, float *matrix_result)
+
+  /**<
+    Multiplies two row-major 4x4 matrices (result = a * b). The data
+    don't have to be aligned and the result can overlap the input.
+  */
+
+{
+#if defined(OPENGLSE_AVX)
+  __m128 row;
+  __m256 b0,b1,b2,b3,a01,a23,r01,r23;
+
+  row = _mm_loadu_ps(matrix_b);      // each row of b is duplicated in both halves
+  b0 = _mm256_insertf128_ps(_mm256_castps128_ps256(row),row,1);
+  row = _mm_loadu_ps(matrix_b + 4);
+  b1 = _mm256_insertf128_ps(_mm256_castps128_ps256(row),row,1);
+  row = _mm_loadu_ps(matrix_b + 8);
+  b2 = _mm256_insertf128_ps(_mm256_castps128_ps256(row),row,1);
+  row = _mm_loadu_ps(matrix_b + 12);
+  b3 = _mm256_insertf128_ps(_mm256_castps128_ps256(row),row,1);
+
+  a01 = _mm256_loadu_ps(matrix_a);   // two rows of a at once
+  a23 = _mm256_loadu_ps(matrix_a + 8);
+
+  r01 = _mm256_add_ps(
+    _mm256_add_ps(_mm256_mul_ps(_mm256_shuffle_ps(a01,a01,0x00),b0),_mm256_mul_ps(_mm256_shuffle_ps(a01,a01,0x55),b1)),
+    _mm256_add_ps(_mm256_mul_ps(_mm256_shuffle_ps(a01,a01,0xaa),b2),_mm256_mul_ps(_mm256_shuffle_ps(a01,a01,0xff),b3)));
+
+  r23 = _mm256_add_ps(
+    _mm256_add_ps(_mm256_mul_ps(_mm256_shuffle_ps(a23,a23,0x00),b0),_mm256_mul_ps(_mm256_shuffle_ps(a23,a23,0x55),b1)),
+    _mm256_add_ps(_mm256_mul_ps(_mm256_shuffle_ps(a23,a23,0xaa),b2),_mm256_mul_ps(_mm256_shuffle_ps(a23,a23,0xff),b3)));
+
+  _mm256_storeu_ps(matrix_result,r01);
+  _mm256_storeu_ps(matrix_result + 8,r23);
+#elif defined(OPENGLSE_SSE)
+  unsigned int i;
+  __m128 b0,b1,b2,b3,rows[4];
+
+  b0 = _mm_loadu_ps(matrix_b);
+  b1 = _mm_loadu_ps(matrix_b + 4);
+  b2 = _mm_loadu_ps(matrix_b + 8);
+  b3 = _mm_loadu_ps(matrix_b + 12);
+
+  for (i = 0; i < 4; i++)            // row i of the result = sum of rows of b weighted by row i of a
+    rows[i] = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(matrix_a[i * 4]),b0),_mm_mul_ps(_mm_set1_ps(matrix_a[i * 4 + 1]),b1)),
+      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(matrix_a[i * 4 + 2]),b2),_mm_mul_ps(_mm_set1_ps(matrix_a[i * 4 + 3]),b3)));
+
+  for (i = 0; i < 4; i++)
+    _mm_storeu_ps(matrix_result + i * 4,rows[i]);
+#elif defined(OPENGLSE_NEON)
+  unsigned int i;
+  float32x4_t b0,b1,b2,b3,rows[4];
+
+  b0 = vld1q_f32(matrix_b);
+  b1 = vld1q_f32(matrix_b + 4);
+  b2 = vld1q_f32(matrix_b + 8);
+  b3 = vld1q_f32(matrix_b + 12);
+
+  for (i = 0; i < 4; i++)
+    {
+      rows[i] = vmulq_n_f32(b0,matrix_a[i * 4]);
+      rows[i] = vmlaq_n_f32(rows[i],b1,matrix_a[i * 4 + 1]);
+      rows[i] = vmlaq_n_f32(rows[i],b2,matrix_a[i * 4 + 2]);
+      rows[i] = vmlaq_n_f32(rows[i],b3,matrix_a[i * 4 + 3]);
+    }
+
+  for (i = 0; i < 4; i++)
+    vst1q_f32(matrix_result + i * 4,rows[i]);
+#else
+  unsigned int i,j;
+  float helper_matrix[16];
+
+  for (i = 0; i < 4; i++)
+    for (j = 0; j < 4; j++)
+      helper_matrix[i * 4 + j] =
+        matrix_a[i * 4] * matrix_b[j] +
+        matrix_a[i * 4 + 1] * matrix_b[4 + j] +
+        matrix_a[i * 4 + 2] * matrix_b[8 + j] +
+        matrix_a[i * 4 + 3] * matrix_b[12 + j];
+
+  memcpy(matrix_result,helper_matrix,sizeof(helper_matrix));
+#endif
+}
+
+//----------------------------------------------------------------------
+
+void multiply_matrices_affine_simd(const float *matrix_a, const float *matrix_b, float *matrix_result)
+
+  /**<
+    Same as multiply_matrices_simd but expects both matrices to have
+    the last row 0 0 0 1, so only three rows are computed and the last
+    row of b doesn't have to be multiplied.
+  */
+
+{
+#if defined(OPENGLSE_SSE)
+  unsigned int i;
+  __m128 b0,b1,b2,rows[3];
+
+  b0 = _mm_loadu_ps(matrix_b);
+  b1 = _mm_loadu_ps(matrix_b + 4);
+  b2 = _mm_loadu_ps(matrix_b + 8);
+
+  for (i = 0; i < 3; i++)
+    rows[i] = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(matrix_a[i * 4]),b0),_mm_mul_ps(_mm_set1_ps(matrix_a[i * 4 + 1]),b1)),
+      _mm_add_ps(_mm_mul_ps(_mm_set1_ps(matrix_a[i * 4 + 2]),b2),_mm_set_ps(matrix_a[i * 4 + 3],0,0,0)));
+
+  for (i = 0; i < 3; i++)
+    _mm_storeu_ps(matrix_result + i * 4,rows[i]);
+
+  _mm_storeu_ps(matrix_result + 12,_mm_set_ps(1,0,0,0));
+#elif defined(OPENGLSE_NEON)
+  unsigned int i;
+  float32x4_t b0,b1,b2,rows[3];
+
+  b0 = vld1q_f32(matrix_b);
+  b1 = vld1q_f32(matrix_b + 4);
+  b2 = vld1q_f32(matrix_b + 8);
+
+  for (i = 0; i < 3; i++)
+    {
+      rows[i] = vmulq_n_f32(b0,matrix_a[i * 4]);
+      rows[i] = vmlaq_n_f32(rows[i],b1,matrix_a[i * 4 + 1]);
+      rows[i] = vmlaq_n_f32(rows[i],b2,matrix_a[i * 4 + 2]);
+      rows[i] = vsetq_lane_f32(vgetq_lane_f32(rows[i],3) + matrix_a[i * 4 + 3],rows[i],3);
+    }
+
+  for (i = 0; i < 3; i++)
+    vst1q_f32(matrix_result + i * 4,rows[i]);
+
+  matrix_result[12] = 0;
+  matrix_result[13] = 0;
+  matrix_result[14] = 0;
+  matrix_result[15] = 1;
+#else
+  unsigned int i,j;
+  float helper_matrix[12];
+
+  for (i = 0; i < 3; i++)
+    for (j = 0; j < 4; j++)
+      helper_matrix[i * 4 + j] =
+        matrix_a[i * 4] * matrix_b[j] +
+        matrix_a[i * 4 + 1] * matrix_b[4 + j] +
+        matrix_a[i * 4 + 2] * matrix_b[8 + j] +
+        (j == 3 ? matrix_a[i * 4 + 3] : 0);
+
+  memcpy(matrix_result,helper_matrix,sizeof(helper_matrix));
+  matrix_result[12] = 0;
+  matrix_result[13] = 0;
+  matrix_result[14] = 0;
+  matrix_result[15] = 1;
+#endif
+}
+
+//----------------------------------------------------------------------
+
+bool invert_matrix_affine_simd(const float *matrix, float *matrix_result)
+
+  /**<
+    Inverts a row-major affine 4x4 matrix: the 3x3 part is inverted and
+    the translation becomes -inverse * translation.
+
+    @return false if the matrix is singular (the result isn't changed
+            then)
+  */
+
+{
+#if defined(OPENGLSE_SSE)
+  __m128 c0,c1,c2,translation,x0,x1,x2,zero,helper;
+  float determinant;
+
+  c0 = _mm_loadu_ps(matrix);
+  c1 = _mm_loadu_ps(matrix + 4);
+  c2 = _mm_loadu_ps(matrix + 8);
+  translation = _mm_set_ps(1,0,0,0);
+
+  _MM_TRANSPOSE4_PS(c0,c1,c2,translation);  // now columns, the last one being the translation
+
+  x0 = cross_product_sse(c1,c2);            // rows of the adjugate
+  x1 = cross_product_sse(c2,c0);
+  x2 = cross_product_sse(c0,c1);
+
+  helper = _mm_mul_ps(c0,x0);
+  helper = _mm_add_ps(helper,_mm_movehl_ps(helper,helper));
+  helper = _mm_add_ss(helper,_mm_shuffle_ps(helper,helper,1));
+  determinant = _mm_cvtss_f32(helper);
+
+  if (determinant == 0)
+    return false;
+
+  helper = _mm_set1_ps(1.0f / determinant);
+  x0 = _mm_mul_ps(x0,helper);
+  x1 = _mm_mul_ps(x1,helper);
+  x2 = _mm_mul_ps(x2,helper);
+  zero = _mm_setzero_ps();
+
+  _MM_TRANSPOSE4_PS(x0,x1,x2,zero);         // columns of the inverse
+
+  helper = _mm_add_ps(
+    _mm_add_ps(_mm_mul_ps(x0,_mm_shuffle_ps(translation,translation,0x00)),_mm_mul_ps(x1,_mm_shuffle_ps(translation,translation,0x55))),
+    _mm_mul_ps(x2,_mm_shuffle_ps(translation,translation,0xaa)));
+  helper = _mm_sub_ps(_mm_set_ps(1,0,0,0),helper);
+
+  _MM_TRANSPOSE4_PS(x0,x1,x2,helper);       // back to rows
+
+  _mm_storeu_ps(matrix_result,x0);
+  _mm_storeu_ps(matrix_result + 4,x1);
+  _mm_storeu_ps(matrix_result + 8,x2);
+  _mm_storeu_ps(matrix_result + 12,helper);
+
+  return true;
+#else
+  unsigned int i;
+  float helper_matrix[16];
+  float determinant;
+
+  helper_matrix[0] = matrix[5] * matrix[10] - matrix[6] * matrix[9];  // adjugate of the 3x3 part
+  helper_matrix[1] = matrix[2] * matrix[9] - matrix[1] * matrix[10];
+  helper_matrix[2] = matrix[1] * matrix[6] - matrix[2] * matrix[5];
+  helper_matrix[4] = matrix[6] * matrix[8] - matrix[4] * matrix[10];
+  helper_matrix[5] = matrix[0] * matrix[10] - matrix[2] * matrix[8];
+  helper_matrix[6] = matrix[2] * matrix[4] - matrix[0] * matrix[6];
+  helper_matrix[8] = matrix[4] * matrix[9] - matrix[5] * matrix[8];
+  helper_matrix[9] = matrix[1] * matrix[8] - matrix[0] * matrix[9];
+  helper_matrix[10] = matrix[0] * matrix[5] - matrix[1] * matrix[4];
+
+  determinant = matrix[0] * helper_matrix[0] + matrix[1] * helper_matrix[4] + matrix[2] * helper_matrix[8];
+
+  if (determinant == 0)
+    return false;
+
+  determinant = 1.0f / determinant;
+
+  for (i = 0; i < 3; i++)
+    {
+      helper_matrix[i * 4] *= determinant;
+      helper_matrix[i * 4 + 1] *= determinant;
+      helper_matrix[i * 4 + 2] *= determinant;
+      helper_matrix[i * 4 + 3] = -1 * (helper_matrix[i * 4] * matrix[3] + helper_matrix[i * 4 + 1] * matrix[7] + helper_matrix[i * 4 + 2] * matrix[11]);
+    }
+
+  helper_matrix[12] = 0;
+  helper_matrix[13] = 0;
+  helper_matrix[14] = 0;
+  helper_matrix[15] = 1;
+
+  memcpy(matrix_result,helper_matrix,sizeof(helper_matrix));
+
+  return true;
+#endif
+}
+
+//----------------------------------------------------------------------
+
+void multiply_vector_matrix_simd(const float *vector, const float *matrix, float *vector_result)
+
+  /**<
+    Multiplies a column vector by a row-major 4x4 matrix (result =
+    matrix * vector), the result can overlap the input.
+  */
+
+{
+#if defined(OPENGLSE_SSE)
+  __m128 vector_sse,p0,p1,p2,p3;
+
+  vector_sse = _mm_loadu_ps(vector);
+  p0 = _mm_mul_ps(_mm_loadu_ps(matrix),vector_sse);
+  p1 = _mm_mul_ps(_mm_loadu_ps(matrix + 4),vector_sse);
+  p2 = _mm_mul_ps(_mm_loadu_ps(matrix + 8),vector_sse);
+  p3 = _mm_mul_ps(_mm_loadu_ps(matrix + 12),vector_sse);
+
+  _MM_TRANSPOSE4_PS(p0,p1,p2,p3);           // sum the products of each row vertically
+
+  _mm_storeu_ps(vector_result,_mm_add_ps(_mm_add_ps(p0,p1),_mm_add_ps(p2,p3)));
+#elif defined(OPENGLSE_NEON)
+  float32x4x4_t columns = vld4q_f32(matrix);  // deinterleaving load gives the columns
+  float32x4_t result;
+
+  result = vmulq_n_f32(columns.val[0],vector[0]);
+  result = vmlaq_n_f32(result,columns.val[1],vector[1]);
+  result = vmlaq_n_f32(result,columns.val[2],vector[2]);
+  result = vmlaq_n_f32(result,columns.val[3],vector[3]);
+
+  vst1q_f32(vector_result,result);
+#else
+  unsigned int i;
+  float helper_vector[4];
+
+  for (i = 0; i < 4; i++)
+    helper_vector[i] = vector[0] * matrix[i * 4] + vector[1] * matrix[i * 4 + 1] +
+                       vector[2] * matrix[i * 4 + 2] + vector[3] * matrix[i * 4 + 3];
+
+  memcpy(vector_result,helper_vector,sizeof(helper_vector));
+#endif
+}
+
+//----------------------------------------------------------------------
+
+void transform_points_simd(const float *matrix, float *points, unsigned int count, unsigned int stride, float w)
+
+  /**<
+    Transforms strided 3D points in place by a row-major 4x4 matrix, see
+    transform_points.
+  */
+
+{
+  unsigned int i;
+  float *point;
+
+#if defined(OPENGLSE_SSE)
+  __m128 c0,c1,c2,c3,result;
+
+  c0 = _mm_loadu_ps(matrix);
+  c1 = _mm_loadu_ps(matrix + 4);
+  c2 = _mm_loadu_ps(matrix + 8);
+  c3 = _mm_loadu_ps(matrix + 12);
+
+  _MM_TRANSPOSE4_PS(c0,c1,c2,c3);           // matrix columns
+  c3 = _mm_mul_ps(c3,_mm_set1_ps(w));
+
+  for (i = 0; i < count; i++)
+    {
+      point = (float *) (((char *) points) + i * stride);
+
+      result = _mm_add_ps(
+        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(point[0]),c0),_mm_mul_ps(_mm_set1_ps(point[1]),c1)),
+        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(point[2]),c2),c3));
+
+      _mm_storel_pi((__m64 *) point,result); // only write x, y and z
+      _mm_store_ss(point + 2,_mm_movehl_ps(result,result));
+    }
+#elif defined(OPENGLSE_NEON)
+  float32x4x4_t columns = vld4q_f32(matrix);
+  float32x4_t result,translation;
+
+  translation = vmulq_n_f32(columns.val[3],w);
+
+  for (i = 0; i < count; i++)
+    {
+      point = (float *) (((char *) points) + i * stride);
+
+      result = vmlaq_n_f32(translation,columns.val[0],point[0]);
+      result = vmlaq_n_f32(result,columns.val[1],point[1]);
+      result = vmlaq_n_f32(result,columns.val[2],point[2]);
+
+      vst1_f32(point,vget_low_f32(result));
+      point[2] = vgetq_lane_f32(result,2);
+    }
+#else
+  float x,y,z;
+
+  for (i = 0; i < count; i++)
+    {
+      point = (float *) (((char *) points) + i * stride);
+
+      x = point[0];
+      y = point[1];
+      z = point[2];
+
+      point[0] = matrix[0] * x + matrix[1] * y + matrix[2] * z + matrix[3] * w;
+      point[1] = matrix[4] * x + matrix[5] * y + matrix[6] * z + matrix[7] * w;
+      point[2] = matrix[8] * x + matrix[9] * y + matrix[10] * z + matrix[11] * w;
+    }
+#endif
+}
+
+//----------------------------------------------------------------------
+
+void transform_points_soa_simd(const float *matrix, float *x, float *y, float *z, unsigned int count, float w)
+
+  /**<
+    Transforms 3D points stored as structure of arrays (separate x, y
+    and z arrays) in place by a row-major 4x4 matrix, several points are
+    processed at once.
+  */
+
+{
+  unsigned int i = 0;
+  float helper_x,helper_y,helper_z;
+
+#if defined(OPENGLSE_AVX)
+  __m256 m[12],x8,y8,z8;
+
+  for (i = 0; i < 12; i++)
+    m[i] = _mm256_set1_ps(i % 4 == 3 ? matrix[i] * w : matrix[i]);
+
+  for (i = 0; i + 8 <= count; i += 8)
+    {
+      x8 = _mm256_loadu_ps(x + i);
+      y8 = _mm256_loadu_ps(y + i);
+      z8 = _mm256_loadu_ps(z + i);
+
+      _mm256_storeu_ps(x + i,_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x8,m[0]),_mm256_mul_ps(y8,m[1])),_mm256_add_ps(_mm256_mul_ps(z8,m[2]),m[3])));
+      _mm256_storeu_ps(y + i,_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x8,m[4]),_mm256_mul_ps(y8,m[5])),_mm256_add_ps(_mm256_mul_ps(z8,m[6]),m[7])));
+      _mm256_storeu_ps(z + i,_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x8,m[8]),_mm256_mul_ps(y8,m[9])),_mm256_add_ps(_mm256_mul_ps(z8,m[10]),m[11])));
+    }
+#elif defined(OPENGLSE_SSE)
+  __m128 m[12],x4,y4,z4;
+
+  for (i = 0; i < 12; i++)
+    m[i] = _mm_set1_ps(i % 4 == 3 ? matrix[i] * w : matrix[i]);
+
+  for (i = 0; i + 4 <= count; i += 4)
+    {
+      x4 = _mm_loadu_ps(x + i);
+      y4 = _mm_loadu_ps(y + i);
+      z4 = _mm_loadu_ps(z + i);
+
+      _mm_storeu_ps(x + i,_mm_add_ps(_mm_add_ps(_mm_mul_ps(x4,m[0]),_mm_mul_ps(y4,m[1])),_mm_add_ps(_mm_mul_ps(z4,m[2]),m[3])));
+      _mm_storeu_ps(y + i,_mm_add_ps(_mm_add_ps(_mm_mul_ps(x4,m[4]),_mm_mul_ps(y4,m[5])),_mm_add_ps(_mm_mul_ps(z4,m[6]),m[7])));
+      _mm_storeu_ps(z + i,_mm_add_ps(_mm_add_ps(_mm_mul_ps(x4,m[8]),_mm_mul_ps(y4,m[9])),_mm_add_ps(_mm_mul_ps(z4,m[10]),m[11])));
+    }
+#elif defined(OPENGLSE_NEON)
+  float32x4_t x4,y4,z4,result;
+
+  for (i = 0; i + 4 <= count; i += 4)
+    {
+      x4 = vld1q_f32(x + i);
+      y4 = vld1q_f32(y + i);
+      z4 = vld1q_f32(z + i);
+
+      result = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(matrix[3] * w),x4,matrix[0]),y4,matrix[1]),z4,matrix[2]);
+      vst1q_f32(x + i,result);
+      result = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(matrix[7] * w),x4,matrix[4]),y4,matrix[5]),z4,matrix[6]);
+      vst1q_f32(y + i,result);
+      result = vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vdupq_n_f32(matrix[11] * w),x4,matrix[8]),y4,matrix[9]),z4,matrix[10]);
+      vst1q_f32(z + i,result);
+    }
+#endif
+
+  for (; i < count; i++)  // the rest (or everything without SIMD)
+    {
+      helper_x = x[i];
+      helper_y = y[i];
+      helper_z = z[i];
+
+      x[i] = matrix[0] * helper_x + matrix[1] * helper_y + matrix[2] * helper_z + matrix[3] * w;
+      y[i] = matrix[4] * helper_x + matrix[5] * helper_y + matrix[6] * helper_z + matrix[7] * w;
+      z[i] = matrix[8] * helper_x + matrix[9] * helper_y + matrix[10] * helper_z + matrix[11] * w;
+    }
+}
+
+//----------------------------------------------------------------------
+
+void normalize_vectors_soa_simd(float *x, float *y, float *z, unsigned int count)
+
+  /**<
+    Normalizes 3D vectors stored as structure of arrays, zero vectors
+    are left as they are.
+  */
+
+{
+  unsigned int i = 0;
+  float length;
+
+#if defined(OPENGLSE_SSE)
+  __m128 x4,y4,z4,length4,mask;
+
+  for (i = 0; i + 4 <= count; i += 4)
+    {
+      x4 = _mm_loadu_ps(x + i);
+      y4 = _mm_loadu_ps(y + i);
+      z4 = _mm_loadu_ps(z + i);
+
+      length4 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x4,x4),_mm_mul_ps(y4,y4)),_mm_mul_ps(z4,z4));
+      mask = _mm_cmpgt_ps(length4,_mm_setzero_ps());
+      length4 = _mm_div_ps(_mm_set1_ps(1.0),_mm_sqrt_ps(length4));
+      length4 = _mm_or_ps(_mm_and_ps(mask,length4),_mm_andnot_ps(mask,_mm_set1_ps(1.0)));  // 1 for zero vectors
+
+      _mm_storeu_ps(x + i,_mm_mul_ps(x4,length4));
+      _mm_storeu_ps(y + i,_mm_mul_ps(y4,length4));
+      _mm_storeu_ps(z + i,_mm_mul_ps(z4,length4));
+    }
+#endif
+
+  for (; i < count; i++)
+    {
+      length = sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+
+      if (length != 0)
+        {
+          x[i] /= length;
+          y[i] /= length;
+          z[i] /= length;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+
+void multiply_matrices(float matrix_a[4][4], float matrix_b[4][4], float matrix_result[4][4])
+
+{
+  multiply_matrices_simd(&matrix_a[0][0],&matrix_b[0][0],&matrix_result[0][0]);
+}
+
+//----------------------------------------------------------------------
+
+void cross_product(point_3d vector_a, point_3d vector_b, point_3d *point_result)
+
+{
+  point_result->x = vector_a.y * vector_b.z - vector_a.z * vector_b.y;
+  point_result->y = vector_a.z * vector_b.x - vector_a.x * vector_b.z;
+  point_result->z = vector_a.x * vector_b.y - vector_a.y * vector_b.x;
+}
+
+//----------------------------------------------------------------------
+
+void multiply_vector_matrix(float vector[4], float matrix[4][4], float vector_result[4])
+
+{
+  multiply_vector_matrix_simd(vector,&matrix[0][0],vector_result);
+}
+
+//----------------------------------------------------------------------
+
+void mouse_move_function(int x, int y)
+
+  /**<
+    This function is internally registered as a mouse move function and
+    updates the global mouse coordinates.
+  */
+
+{
+  global_mouse_position[0] = x;
+  global_mouse_position[1] = y;
+}
+
+//----------------------------------------------------------------------
+
+void mouse_click_function(int button, int state, int x, int y)
+
+{
+  global_mouse_position[0] = x;
+  global_mouse_position[1] = y;
+
+  if (user_mouse_function != NULL)
+    user_mouse_function(button,state);
+}
+
+//----------------------------------------------------------------------
+
+void account_memory(unsigned int category, int objects, unsigned long long cpu_change, unsigned long long gpu_change)
+
+  /**<
+    Adds a change of the memory used by some object to the totals of its
+    category and of all the categories, updates the high-water marks and
+    warns when a budget gets exceeded.
+
+    @param category category of the object
+    @param objects change of the number of objects (-1, 0 or 1)
+    @param cpu_change change of the CPU bytes (negative changes wrap
+           around)
+    @param gpu_change change of the GPU bytes
+  */
+
+{
+  unsigned int i;
+  bool exceeded;
+  memory_usage *usage;
+  unsigned int indices[2] = {category,MEMORY_CATEGORIES};
+
+  for (i = 0; i < 2; i++)
+    {
+      usage = &global_memory_usage[indices[i]];
+
+      usage->objects += objects;
+      usage->cpu_bytes += cpu_change;
+      usage->gpu_bytes += gpu_change;
+      usage->cpu_peak_bytes = max(usage->cpu_peak_bytes,usage->cpu_bytes);
+      usage->gpu_peak_bytes = max(usage->gpu_peak_bytes,usage->gpu_bytes);
+
+      exceeded = (global_cpu_memory_budgets[indices[i]] != 0 && usage->cpu_bytes > global_cpu_memory_budgets[indices[i]]) ||
+        (global_gpu_memory_budgets[indices[i]] != 0 && usage->gpu_bytes > global_gpu_memory_budgets[indices[i]]);
+
+      if (exceeded && !global_memory_budget_exceeded[indices[i]])
+        cerr << "WARNING: memory budget of " << global_memory_category_names[indices[i]] << " exceeded (" <<
+          usage->cpu_bytes / 1024 << " KB CPU, " << usage->gpu_bytes / 1024 << " KB GPU)." << endl;
+
+      global_memory_budget_exceeded[indices[i]] = exceeded;
+    }
+}
+
+//----------------------------------------------------------------------
+
+void remove_memory_usage(const void *object)
+
+  /**<
+    Removes an object from the memory statistics (when it's destroyed).
+
+    @param object the object
+  */
+
+{
+  map<const void *,memory_record>::iterator record = global_memory_records.find(object);
+
+  if (record == global_memory_records.end())
+    return;
+
+  account_memory(record->second.category,-1,0 - record->second.cpu_bytes,0 - record->second.gpu_bytes);
+  global_memory_records.erase(record);
+}
+
+//----------------------------------------------------------------------
+
+void set_memory_usage(const void *object, memory_category category, unsigned long long cpu_bytes, unsigned long long gpu_bytes)
+
+  /**<
+    Records the memory used by an object in the memory statistics,
+    replacing what it has reported before. Every object that allocates
+    buffers or textures reports here after allocating or freeing them.
+
+    @param object the object
+    @param category category of the object
+    @param cpu_bytes memory the object uses on CPU
+    @param gpu_bytes memory the object uses on GPU
+  */
+
+{
+  map<const void *,memory_record>::iterator record;
+
+  if (cpu_bytes == 0 && gpu_bytes == 0)    // only objects that hold some memory are counted
+    {
+      remove_memory_usage(object);
+      return;
+    }
+
+  record = global_memory_records.find(object);
+
+  if (record == global_memory_records.end())
+    {
+      memory_record new_record;
+
+      new_record.category = category;
+      new_record.cpu_bytes = 0;
+      new_record.gpu_bytes = 0;
+      record = global_memory_records.insert(make_pair(object,new_record)).first;
+      account_memory(category,1,0,0);
+    }
+
+  account_memory(category,0,cpu_bytes - record->second.cpu_bytes,gpu_bytes - record->second.gpu_bytes);
+  record->second.cpu_bytes = cpu_bytes;
+  record->second.gpu_bytes = gpu_bytes;
+}
+
+//----------------------------------------------------------------------
+
+void upload_frame_uniforms()
+
+  /**<
+    Uploads the per-frame uniform block if it has changed since the last
+    upload, the buffer is made with the first call.
+  */
+
+{
+  if (global_frame_ubo == 0)
+    {
+      glGenBuffers(1,&global_frame_ubo);
+
+      if (global_frame_ubo == 0)
+        cerr << "ERROR: per-frame uniform buffer couldn't be allocated.";
+
+      glBindBuffer(GL_UNIFORM_BUFFER,global_frame_ubo);
+      glBufferData(GL_UNIFORM_BUFFER,sizeof(frame_uniforms),NULL,GL_DYNAMIC_DRAW);
+      glBindBufferBase(GL_UNIFORM_BUFFER,FRAME_UNIFORMS_BINDING,global_frame_ubo);
+      set_memory_usage(&global_frame_ubo,MEMORY_UNIFORM_BUFFERS,0,sizeof(frame_uniforms));
+      global_frame_uniforms_changed = true;
+    }
+
+  if (!global_frame_uniforms_changed)
+    return;
+
+  glBindBuffer(GL_UNIFORM_BUFFER,global_frame_ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER,0,sizeof(frame_uniforms),&global_frame_uniforms);
+  global_frame_uniforms_changed = false;
+}
+
+//----------------------------------------------------------------------
+
+void upload_bone_matrices(vector<matrix_4x4> &matrices)
+
+  /**<
+    Uploads a bone matrix palette to the bone uniform buffer, the buffer
+    is made with the first call.
+
+    @param matrices bone matrices, at most MAX_BONES
+  */
+
+{
+  if (global_bone_ubo == 0)
+    {
+      glGenBuffers(1,&global_bone_ubo);
+
+      if (global_bone_ubo == 0)
+        cerr << "ERROR: bone uniform buffer couldn't be allocated.";
+
+      glBindBuffer(GL_UNIFORM_BUFFER,global_bone_ubo);
+      glBufferData(GL_UNIFORM_BUFFER,MAX_BONES * sizeof(matrix_4x4),NULL,GL_DYNAMIC_DRAW);
+      glBindBufferBase(GL_UNIFORM_BUFFER,BONE_UNIFORMS_BINDING,global_bone_ubo);
+      set_memory_usage(&global_bone_ubo,MEMORY_UNIFORM_BUFFERS,0,MAX_BONES * sizeof(matrix_4x4));
+    }
+
+  if (matrices.size() == 0)
+    return;
+
+  glBindBuffer(GL_UNIFORM_BUFFER,global_bone_ubo);
+  glBufferSubData(GL_UNIFORM_BUFFER,0,min((unsigned int) matrices.size(),(unsigned int) MAX_BONES) * sizeof(matrix_4x4),&matrices[0]);
+}
+
+//----------------------------------------------------------------------
+
+int acquire_material(material_uniforms &material)
+
+  /**<
+    Finds given material in the material uniform buffer and adds a
+    reference to it. If it's not there, it's put to a free slot or added
+    to the end (the buffer grows twice if it's full). Each acquired
+    material has to be released with release_material.
+
+    @param material material data, the padding must be zeroed
+    @return index of the material in the buffer
+  */
+
+{
+  unsigned int i,index;
+  GLint alignment;
+  string key((const char *) &material,sizeof(material_uniforms));
+  unordered_map<string,int>::iterator found = global_material_indices.find(key);
+
+  if (found != global_material_indices.end())
+    {
+      global_material_references[found->second]++;
+      return found->second;
+    }
+
+  if (global_free_materials.size() != 0)
+    {
+      index = global_free_materials.back();
+      global_free_materials.pop_back();
+      global_materials[index] = material;
+    }
+  else
+    {
+      index = global_materials.size();
+      global_materials.push_back(material);
+      global_material_references.push_back(0);
+    }
+
+  global_material_references[index] = 1;
+  global_material_indices[key] = index;
+
+  if (global_material_stride == 0)
+    {
+      glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT,&alignment);
+      alignment = max(alignment,1);
+      global_material_stride = ((sizeof(material_uniforms) + alignment - 1) / alignment) * alignment;
+    }
+
+  if (global_material_ubo == 0)
+    glGenBuffers(1,&global_material_ubo);
+
+  if (global_material_ubo == 0)
+    cerr << "ERROR: material uniform buffer couldn't be allocated.";
+
+  glBindBuffer(GL_UNIFORM_BUFFER,global_material_ubo);
+
+  if (global_materials.size() > global_material_ubo_capacity)   // reupload everything
+    {
+      global_material_ubo_capacity = max(16u,global_material_ubo_capacity * 2);
+
+      vector<unsigned char> data(global_material_ubo_capacity * global_material_stride,0);
+
+      for (i = 0; i < global_materials.size(); i++)
+        memcpy(&data[i * global_material_stride],&global_materials[i],sizeof(material_uniforms));
+
+      glBufferData(GL_UNIFORM_BUFFER,data.size(),&data[0],GL_STATIC_DRAW);
+      set_memory_usage(&global_material_ubo,MEMORY_UNIFORM_BUFFERS,0,data.size());
+      global_bound_material = -1;
+    }
+  else
+    glBufferSubData(GL_UNIFORM_BUFFER,index * global_material_stride,sizeof(material_uniforms),&material);
+
+  return index;
+}
+
+//----------------------------------------------------------------------
+
+void release_material(int index)
+
+  /**<
+    Removes a reference to a material acquired by acquire_material. When
+    no mesh uses the material any more, its slot is freed for reuse.
+
+    @param index index of the material, negative values are ignored
+  */
+
+{
+  if (index < 0 || global_material_references[index] == 0)
+    return;
+
+  global_material_references[index]--;
+
+  if (global_material_references[index] == 0)
+    {
+      global_material_indices.erase(string((const char *) &global_materials[index],sizeof(material_uniforms)));
+      global_free_materials.push_back(index);
+    }
+}
+
+//----------------------------------------------------------------------
+
+void bind_material(int index)
+
+  /**<
+    Binds the range of the material uniform buffer with given material
+    to MATERIAL_UNIFORMS_BINDING, unless it's already bound.
+
+    @param index index of the material
+  */
+
+{
+  if (index == global_bound_material)
+    return;
+
+  glBindBufferRange(GL_UNIFORM_BUFFER,MATERIAL_UNIFORMS_BINDING,global_material_ubo,index * global_material_stride,sizeof(material_uniforms));
+  global_bound_material = index;
+}
+
+//----------------------------------------------------------------------
+
+void loop_function()
+
+  /**<
+    This function is internally registered as a render function and calls
+    the user render function.
+  */
+
+{
+  unsigned int helper_time = glutGet(GLUT_ELAPSED_TIME);
+  global_frame_time_difference = helper_time - global_previous_frame_time;
+  global_previous_frame_time = helper_time;
+
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+  upload_frame_uniforms();     // camera, light etc. changed since the last frame
+
+  user_render_function();
+
+  global_recompute_lod = false;
+
+  if (global_frame_counter <= 0)      // recompute FPS
+      {
+        global_recompute_lod = true;  // so that the next frame LOD will be recomputed
+
+        float ms_difference = get_time() - global_last_time;
+        float sec_difference = ms_difference / 1000.0;
+
+        global_spf = sec_difference / RECOMPUTE_FRAMES;
+        global_fps = RECOMPUTE_FRAMES / sec_difference;
+
+        global_frame_counter = RECOMPUTE_FRAMES;
+        global_last_time = get_time();
+      }
+    else
+      global_frame_counter--;
+
+  glutSwapBuffers();
+}
+
+//----------------------------------------------------------------------
+
+void make_perspective_matrix(float fov_degrees, float near_plane, float far_plane, float matrix[4][4])
+
+{
+  float aspect_ratio = global_window_width / ((float) global_window_height);
+  float range = near_plane - far_plane;
+  float tan_half_fov = tanf(fov_degrees / 2.0 * PI_DIVIDED_180);
+
+  matrix[0][0] = 1.0f / (tan_half_fov * aspect_ratio) ; matrix[1][0] = 0.0f; matrix[2][0] = 0.0f; matrix[3][0] = 0.0f;
+  matrix[0][1] = 0.0f; matrix[1][1] = 1.0f / tan_half_fov; matrix[2][1] = 0.0f; matrix[3][1] = 0.0f;
+  matrix[0][2] = 0.0f; matrix[1][2] = 0.0f; matrix[2][2] = (-1 * near_plane - far_plane) / (float) range; matrix[3][2] = 1.0;
+  matrix[0][3] = 0.0f; matrix[1][3] = 0.0f; matrix[2][3] = 2.0f * far_plane * near_plane / (float) range; matrix[3][3] = 0.0f;
+}
+
+//----------------------------------------------------------------------
+
+void get_frustum_planes(float planes[6][4])
+  /**<
+   Computes the view frustum planes in world space from the current
+   camera and perspective. A point p is inside if
+   planes[i][0] * p.x + planes[i][1] * p.y + planes[i][2] * p.z +
+   planes[i][3] >= 0 for all the planes.
+
+   @param planes in this variable the left, right, bottom, top, near and
+          far planes will be returned, normalized
+   */
+
+{
+  float perspective[4][4],matrix[4][4];
+  unsigned int i,j;
+  float length;
+
+  make_perspective_matrix(global_fov,global_near,global_far,perspective);
+  multiply_matrices(perspective,camera.transformation_matrix,matrix);
+
+  for (i = 0; i < 3; i++)       // the clip space coordinate i must be within <-w,w>
+    for (j = 0; j < 4; j++)
+      {
+        planes[i * 2][j] = matrix[3][j] + matrix[i][j];
+        planes[i * 2 + 1][j] = matrix[3][j] - matrix[i][j];
+      }
+
+  for (i = 0; i < 6; i++)
+    {
+      length = sqrt(planes[i][0] * planes[i][0] + planes[i][1] * planes[i][1] + planes[i][2] * planes[i][2]);
+
+      if (length > 0)
+        for (j = 0; j < 4; j++)
+          planes[i][j] /= length;
+    }
+}
+
+//----------------------------------------------------------------------
+
+void make_rotation_matrix(float degrees_x, float degrees_y, float degrees_z, rotation_matrix_type type, float matrix[4][4])
+
+{
+  degrees_x *= PI_DIVIDED_180;  // convert to radians
+  degrees_y *= PI_DIVIDED_180;
+  degrees_z *= PI_DIVIDED_180;
+
+  float sin_x = sin(degrees_x);
+  float cos_x = cos(degrees_x);
+  float sin_y = sin(degrees_y);
+  float cos_y = cos(degrees_y);
+  float sin_z = sin(degrees_z);
+  float cos_z = cos(degrees_z);
+
+  switch (type)
+    {
+      case ROTATION_XYZ:
+
+        matrix[0][0] = cos_z * cos_y;
+        matrix[1][0] = -1 * cos_y * sin_z;
+        matrix[2][0] = sin_y;
+        matrix[3][0] = 0;
+
+        matrix[0][1] = sin_x * sin_y * cos_z + cos_x * sin_z;
+        matrix[1][1] = -1 * sin_x * sin_y * sin_z + cos_x * cos_z;
+        matrix[2][1] = -1 * sin_x * cos_y;
+        matrix[3][1] = 0;
+
+        matrix[0][2] = -1 * cos_x * sin_y * cos_z + sin_x * sin_z;
+        matrix[1][2] = cos_x * sin_y * sin_z + sin_x * cos_z;
+        matrix[2][2] = cos_x * cos_y;
+        matrix[3][2] = 0;
+
+        matrix[0][3] = 0;
+        matrix[1][3] = 0;
+        matrix[2][3] = 0;
+        matrix[3][3] = 1;
+        break;
+
+      case ROTATION_ZYX:
+
+        matrix[0][0] = cos_z * cos_y;
+        matrix[1][0] = cos_z * sin_y * sin_x - sin_z * cos_x;
+        matrix[2][0] = cos_z * sin_y * cos_x + sin_z * sin_x;
+        matrix[3][0] = 0;
+
+        matrix[0][1] = sin_z * cos_y;
+        matrix[1][1] = sin_z * sin_y * sin_x + cos_z * cos_x;
+        matrix[2][1] = sin_z * sin_y * cos_x - cos_z * sin_x;
+        matrix[3][1] = 0;
+
+        matrix[0][2] = -1 * sin_y;
+        matrix[1][2] = cos_y * sin_x;
+        matrix[2][2] = cos_y * cos_x;
+        matrix[3][2] = 0;
+
+        matrix[0][3] = 0;
+        matrix[1][3] = 0;
+        matrix[2][3] = 0;
+        matrix[3][3] = 1;
+        break;
+
+      case ROTATION_ZXY:
+
+        matrix[0][0] = cos_z * cos_y - sin_z * sin_x * sin_y;
+        matrix[1][0] = -1 * sin_z * cos_x;
+        matrix[2][0] = cos_z * sin_y + sin_z * sin_x * cos_y;
+        matrix[3][0] = 0;
+
+        matrix[0][1] = sin_z * cos_y + cos_z * sin_x * sin_y;
+        matrix[1][1] = cos_z * cos_x;
+        matrix[2][1] = sin_z * sin_y - cos_z * sin_x * cos_y;
+        matrix[3][1] = 0;
+
+        matrix[0][2] = -1 * cos_x * sin_y;
+        matrix[1][2] = sin_x;
+        matrix[2][2] = cos_x * cos_y;
+        matrix[3][2] = 0;
+
+        matrix[0][3] = 0;
+        matrix[1][3] = 0;
+        matrix[2][3] = 0;
+        matrix[3][3] = 1;
+        break;
+
+      case ROTATION_YXZ:
+
+        matrix[0][0] = cos_y * cos_z + sin_y * sin_x * sin_z;
+        matrix[1][0] = -1 * cos_y * sin_z + sin_y * sin_x * cos_z;
+        matrix[2][0] = sin_y * cos_x;
+        matrix[3][0] = 0;
+
+        matrix[0][1] = cos_x * sin_z;
+        matrix[1][1] = cos_x * cos_z;
+        matrix[2][1] = -1 * sin_x;
+        matrix[3][1] = 0;
+
+        matrix[0][2] = -1 * sin_y * cos_z + cos_y * sin_x * sin_z;
+        matrix[1][2] = sin_y * sin_z + cos_y * sin_x * cos_z;
+        matrix[2][2] = cos_y * cos_x;
+        matrix[3][2] = 0;
+
+        matrix[0][3] = 0;
+        matrix[1][3] = 0;
+        matrix[2][3] = 0;
+        matrix[3][3] = 1;
+        break;
+    }
+
+  unsigned int i,j;
+
+  for (j = 0; j < 4; j++)        // get rid of negative zeroes, they mess up the shaders
+    for (i = 0; i < 4; i++)
+      if (matrix[i][j] == -0)
+        matrix[i][j] = 0;
+}
+
+//----------------------------------------------------------------------
+
+void make_translation_matrix(float x, float y, float z, float matrix[4][4])
+
+{
+  matrix[0][0] = 1;
+  matrix[1][0] = 0;
+  matrix[2][0] = 0;
+  matrix[3][0] = 0;
+
+  matrix[0][1] = 0;
+  matrix[1][1] = 1;
+  matrix[2][1] = 0;
+  matrix[3][1] = 0;
+
+  matrix[0][2] = 0;
+  matrix[1][2] = 0;
+  matrix[2][2] = 1;
+  matrix[3][2] = 0;
+
+  matrix[0][3] = x;
+  matrix[1][3] = y;
+  matrix[2][3] = z;
+  matrix[3][3] = 1;
+}
+
+//----------------------------------------------------------------------
+
+void make_scale_matrix(float x, float y, float z, float matrix[4][4])
+
+{
+  matrix[0][0] = x;
+  matrix[1][0] = 0;
+  matrix[2][0] = 0;
+  matrix[3][0] = 0;
+
+  matrix[0][1] = 0;
+  matrix[1][1] = y;
+  matrix[2][1] = 0;
+  matrix[3][1] = 0;
+
+  matrix[0][2] = 0;
+  matrix[1][2] = 0;
+  matrix[2][2] = z;
+  matrix[3][2] = 0;
+
+  matrix[0][3] = 0;
+  matrix[1][3] = 0;
+  matrix[2][3] = 0;
+  matrix[3][3] = 1;
+}
+
+//----------------------------------------------------------------------
+
+void make_identity_matrix(float matrix[4][4])
+
+{
+  unsigned int i,j;
+
+  for (j = 0; j < 4; j++)
+    for (i = 0; i < 4; i++)
+      if (i == j)
+        matrix[i][j] = 1;
+      else
+        matrix[i][j] = 0;
+}
+
+//----------------------------------------------------------------------
+
+bool add_shader(GLuint shader_program, const char* shader_text, GLenum shader_type)
+
+{
+  GLuint shader_object = glCreateShader(shader_type);
+
+  const GLchar* p[1];
+  p[0] = shader_text;
+
+  GLint lengths[1];
+  lengths[0]= strlen(shader_text);
+
+  glShaderSource(shader_object,1,p,lengths);
+  glCompileShader(shader_object);
+
+  GLint success;
+
+  glGetShaderiv(shader_object,GL_COMPILE_STATUS,&success);
+
+  if (!success)
+    {
+      GLchar log[1024];
+      glGetShaderInfoLog(shader_object,sizeof(log),NULL,log);
+      cerr << "Shader compile log: " << log << endl;
+      return false;
+    }
+
+  glAttachShader(shader_program,shader_object);
+
+  return true;
+}
+
+//----------------------------------------------------------------------
+
+unsigned int shader_variant_key(render_mode mode, unsigned int textures, unsigned int features)
+
+  /**<
+    Makes the index of a shader variant in global_shader_variants.
+
+    @param mode render mode
+    @param textures number of textures (0, 1 or 2)
+    @param features shader_feature values combined with |
+    @return shader variant key
+  */
+
+{
+  return ((unsigned int) mode) | (textures << 2) | features;
+}
+
+//----------------------------------------------------------------------
+
+string make_shader_source(const char *shader_text, unsigned int key)
+
+  /**<
+    Makes the source of a shader variant by inserting the feature
+    #defines after the #version line.
+
+    @param shader_text shader_vertex or shader_fragment
+    @param key shader variant key
+    @return shader source
+  */
+
+{
+  string result = shader_text;
+  string defines;
+
+  defines += "#define RENDER_MODE " + to_string(key & 3) + "\n";
+  defines += "#define TEXTURES " + to_string((key >> 2) & 3) + "\n";
+  defines += string("#define ANIMATED ") + ((key & SHADER_ANIMATED) ? "1" : "0") + "\n";
+  defines += string("#define DRAW_2D ") + ((key & SHADER_2D) ? "1" : "0") + "\n";
+  defines += string("#define FOG ") + ((key & SHADER_FOG) ? "1" : "0") + "\n";
+  defines += string("#define SHADOWS ") + ((key & SHADER_SHADOWS) ? "1" : "0") + "\n";
+  defines += string("#define TRANSPARENCY ") + ((key & SHADER_TRANSPARENCY) ? "1" : "0") + "\n";
+  defines += string("#define INSTANCED ") + ((key & SHADER_INSTANCED) ? "1" : "0") + "\n";
+  defines += string("#define SKINNED ") + ((key & SHADER_SKINNED) ? "1" : "0") + "\n";
+  defines += string("#define VERTEX_TEXTURE ") + ((key & SHADER_VERTEX_TEXTURE) ? "1" : "0") + "\n";
+  defines += "#define MAX_BONES " + to_string(MAX_BONES) + "\n";
+  defines += "#define MAX_ANIMATION_FRAMES " + to_string(MAX_ANIMATION_FRAMES) + "\n";
+  defines += "#define VERTEX_TEXTURE_WIDTH " + to_string(VERTEX_TEXTURE_WIDTH) + "\n";
+
+  result.insert(result.find('\n') + 1,defines);
+  return result;
+}
+
+//----------------------------------------------------------------------
+
+unsigned long long hash_data(const void *data, unsigned int size)
+
+  /**<
+    Computes 64 bit FNV-1a hash of given data.
+
+    @param data data to be hashed
+    @param size size of the data in bytes
+    @return hash
+  */
+
+{
+  unsigned int i;
+  unsigned long long result = 14695981039346656037ULL;
+
+  for (i = 0; i < size; i++)
+    {
+      result ^= ((const unsigned char *) data)[i];
+      result *= 1099511628211ULL;
+    }
+
+  return result;
+}
+
+//----------------------------------------------------------------------
+
+unsigned long long hash_string(const string &text)
+
+  /**<
+    Computes 64 bit FNV-1a hash of given string.
+
+    @param text string to be hashed
+    @return hash
+  */
+
+{
+  return hash_data(text.data(),text.length());
+}
+
+//----------------------------------------------------------------------
+
+bool program_binaries_are_supported()
+
+  /**<
+    Checks whether shader program binaries can be cached, i.e. the GPU
+    supports glGetProgramBinary and has at least one binary format.
+
+    @return true if program binaries can be cached
+  */
+
+{
+  GLint formats = 0;
+
+  if (global_cache_directory.length() == 0 || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+    return false;
+
+  glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS,&formats);
+  return formats > 0;
+}
+
+//----------------------------------------------------------------------
+
+string program_cache_file_name(const string &source, unsigned long long *hash)
+
+  /**<
+    Makes the program binary cache file name for given shader source. The
+    hash includes the GL vendor, renderer and version, as binaries only
+    work with the driver that made them.
+
+    @param source vertex and fragment shader source
+    @param hash in this variable the hash of the entry will be returned
+    @return path of the cache file
+  */
+
+{
+  char name[64];
+
+  *hash = hash_string(source + "|" +
+    (const char *) glGetString(GL_VENDOR) + "|" +
+    (const char *) glGetString(GL_RENDERER) + "|" +
+    (const char *) glGetString(GL_VERSION));
+
+  sprintf(name,"program_%016llx.bin",*hash);
+
+  return global_cache_directory + "/" + name;
+}
+
+//----------------------------------------------------------------------
+
+bool load_program_binary(GLuint shader_program, const string &source)
+
+  /**<
+    Loads a shader program from the program binary cache.
+
+    @param shader_program program the binary will be loaded to
+    @param source vertex and fragment shader source of the program
+    @return true if the program has been loaded and linked, false if
+            there is no cache entry or the driver rejected it (the
+            program should then be compiled from source)
+  */
+
+{
+  FILE *file_handle;
+  unsigned long long hash,file_hash;
+  GLenum format;
+  GLint length,success;
+  vector<char> binary;
+
+  if (!program_binaries_are_supported())
+    return false;
+
+  file_handle = fopen(program_cache_file_name(source,&hash).c_str(),"rb");
+
+  if (file_handle == NULL)
+    return false;
+
+  success = 0;
+
+  if (fread(&file_hash,sizeof(file_hash),1,file_handle) == 1 &&
+      fread(&format,sizeof(format),1,file_handle) == 1 &&
+      fread(&length,sizeof(length),1,file_handle) == 1 &&
+      file_hash == hash && length > 0)
+    {
+      binary.resize(length);
+
+      if (fread(&binary[0],1,length,file_handle) == (size_t) length)
+        {
+          glProgramBinary(shader_program,format,&binary[0],length);
+          glGetProgramiv(shader_program,GL_LINK_STATUS,&success);
+        }
+    }
+
+  fclose(file_handle);
+
+  return success != 0;
+}
+
+//----------------------------------------------------------------------
+
+void save_program_binary(GLuint shader_program, const string &source)
+
+  /**<
+    Saves a linked shader program to the program binary cache.
+
+    @param shader_program linked program
+    @param source vertex and fragment shader source of the program
+  */
+
+{
+  FILE *file_handle;
+  unsigned long long hash;
+  GLenum format;
+  GLint length = 0;
+  vector<char> binary;
+
+  if (!program_binaries_are_supported())
+    return;
+
+  glGetProgramiv(shader_program,GL_PROGRAM_BINARY_LENGTH,&length);
+
+  if (length <= 0)
+    return;
+
+  binary.resize(length);
+  glGetProgramBinary(shader_program,length,&length,&format,&binary[0]);
+
+  file_handle = fopen(program_cache_file_name(source,&hash).c_str(),"wb");
+
+  if (file_handle == NULL)
+    {
+      cerr << "ERROR: could not write to the cache directory " << global_cache_directory << "." << endl;
+      return;
+    }
+
+  fwrite(&hash,sizeof(hash),1,file_handle);
+  fwrite(&format,sizeof(format),1,file_handle);
+  fwrite(&length,sizeof(length),1,file_handle);
+  fwrite(&binary[0],1,length,file_handle);
+  fclose(file_handle);
+}
+
+//----------------------------------------------------------------------
+
+bool compile_shader_variant(unsigned int key)
+
+  /**<
+    Compiles and links the shader program of given variant and stores it
+    in global_shader_variants.
+
+    @param key shader variant key
+    @return true if the program has been made, false otherwise
+  */
+
+{
+  char log[256];
+  shader_variant *variant = &global_shader_variants[key];
+  string vertex_source = make_shader_source(shader_vertex,key);
+  string fragment_source = make_shader_source(shader_fragment,key);
+  chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+  GLint success = 0;
+
+  GLuint shader_program = glCreateProgram();
+
+  if (shader_program == 0)
+    {
+      cerr << "ERROR: could not create a shader program." << endl;
+      return false;
+    }
+
+  if (load_program_binary(shader_program,vertex_source + fragment_source))
+    global_program_cache_hits++;
+  else
+    {
+      glDeleteProgram(shader_program);      // a rejected binary can leave the program in an unusable state
+      shader_program = glCreateProgram();
+
+      if (!add_shader(shader_program,vertex_source.c_str(),GL_VERTEX_SHADER))
+        {
+          cerr << "ERROR: could not add a vertex shader program." << endl;
+          glDeleteProgram(shader_program);
+          return false;
+        }
+
+      if (!add_shader(shader_program,fragment_source.c_str(),GL_FRAGMENT_SHADER))
+        {
+          cerr << "ERROR: could not add a fragment shader program." << endl;
+          glDeleteProgram(shader_program);
+          return false;
+        }
+
+      if (program_binaries_are_supported())
+        glProgramParameteri(shader_program,GL_PROGRAM_BINARY_RETRIEVABLE_HINT,GL_TRUE);
+
+      glLinkProgram(shader_program);
+
+      glGetProgramiv(shader_program,GL_LINK_STATUS,&success);
+
+      if (success == 0)
+        {
+          glGetProgramInfoLog(shader_program,sizeof(log),NULL,log);
+          cerr << log << endl;
+          cerr << "ERROR: could not link the shader program." << endl;
+          glDeleteProgram(shader_program);
+          return false;
+        }
+
+      save_program_binary(shader_program,vertex_source + fragment_source);
+      global_program_cache_misses++;
+    }
+
+  glValidateProgram(shader_program);
+
+  glGetProgramiv(shader_program,GL_VALIDATE_STATUS,&success);
+
+  if (!success)
+    {
+      cerr << "ERROR: the shader program is invalid." << endl;
+      glDeleteProgram(shader_program);
+      return false;
+    }
+
+  glUseProgram(shader_program);
+  global_current_shader_variant = -1;
+
+  variant->program = shader_program;
+  variant->world_matrix_location = glGetUniformLocation(shader_program,"world_matrix");
+  variant->frame_percentage_location = glGetUniformLocation(shader_program,"frame_percentage");
+  variant->number_of_shadows_location = glGetUniformLocation(shader_program,"number_of_shadows");
+  variant->shadows_location = glGetUniformLocation(shader_program,"shadows");
+  variant->position_offset_location = glGetUniformLocation(shader_program,"position_offset");
+  variant->position_scale_location = glGetUniformLocation(shader_program,"position_scale");
+  variant->animation_time_location = glGetUniformLocation(shader_program,"animation_time");
+  variant->vertex_texture_vertices_location = glGetUniformLocation(shader_program,"vertex_texture_vertices");
+  variant->vertex_texture_frames_location = glGetUniformLocation(shader_program,"vertex_texture_frames");
+  variant->frame_starts_location = glGetUniformLocation(shader_program,"frame_starts");
+
+  glUniform1i(glGetUniformLocation(shader_program,"texture_unit"),0);    // we'll always be using the unit 0 for the first texture layer
+  glUniform1i(glGetUniformLocation(shader_program,"texture_unit2"),1);   // 1 for the second texture layer
+  glUniform1i(glGetUniformLocation(shader_program,"vertex_texture_unit"),VERTEX_TEXTURE_UNIT);
+  glUniformBlockBinding(shader_program,glGetUniformBlockIndex(shader_program,"frame_data"),FRAME_UNIFORMS_BINDING);
+  glUniformBlockBinding(shader_program,glGetUniformBlockIndex(shader_program,"material_data"),MATERIAL_UNIFORMS_BINDING);
+
+  if (glGetUniformBlockIndex(shader_program,"bone_data") != GL_INVALID_INDEX)
+    glUniformBlockBinding(shader_program,glGetUniformBlockIndex(shader_program,"bone_data"),BONE_UNIFORMS_BINDING);
+
+  chrono::duration<double,milli> duration = chrono::high_resolution_clock::now() - start;
+  global_program_time += duration.count();
+
+  return true;
+}
+
+//----------------------------------------------------------------------
+
+bool use_shader_variant(unsigned int key)
+
+  /**<
+    Makes given shader variant the current program, it's compiled if it
+    hasn't been used yet. The variant's uniform locations are copied to
+    the global *_location variables.
+
+    @param key shader variant key
+    @return true if the variant (or the fallback variant without fog,
+            shadows and transparency if it couldn't be compiled) is in
+            use, false otherwise
+  */
+
+{
+  unsigned int fallback;
+
+  if ((int) key == global_current_shader_variant)
+    return true;
+
+  shader_variant *variant = &global_shader_variants[key];
+
+  if (variant->program == 0 && !variant->failed && !compile_shader_variant(key))
+    {
+      variant->failed = true;
+      cerr << "ERROR: shader variant " << key << " couldn't be made, it will be drawn without fog, shadows and transparency." << endl;
+    }
+
+  if (variant->failed)              // fall back to the variant without the optional features
+    {
+      fallback = key & ~(SHADER_FOG | SHADER_SHADOWS | SHADER_TRANSPARENCY);
+      return fallback != key && use_shader_variant(fallback);
+    }
+
+  glUseProgram(variant->program);
+  global_current_shader_variant = key;
+
+  world_matrix_location = variant->world_matrix_location;
+  frame_percentage_location = variant->frame_percentage_location;
+  number_of_shadows_location = variant->number_of_shadows_location;
+  shadows_location = variant->shadows_location;
+  position_offset_location = variant->position_offset_location;
+  position_scale_location = variant->position_scale_location;
+  animation_time_location = variant->animation_time_location;
+  vertex_texture_vertices_location = variant->vertex_texture_vertices_location;
+  vertex_texture_frames_location = variant->vertex_texture_frames_location;
+  frame_starts_location = variant->frame_starts_location;
+
+  return true;
+}
+
+//----------------------------------------------------------------------
+
+bool compile_shaders()
+
+  /**<
+    Compiles the shader variant of the default material and makes it
+    current, the other variants are compiled when they are first used.
+  */
+
+{
+  global_current_shader_variant = -1;
+  return use_shader_variant(shader_variant_key(RENDER_MODE_SHADED_GORAUD,0,SHADER_FOG));
+}
+
+//----------------------------------------------------------------------
+
+void helper_special_function(int key, int x, int y)
+
+{
+  key = convert_glut_key(key);
+
+  if (user_advanced_keyboard_function != NULL)
+    {
+      if (!global_keyboard_state[key])
+        {
+          global_keyboard_state[key] = true;
+          user_advanced_keyboard_function(true,key,x,y);
+        }
+    }
+
+  if (user_keyboard_function != NULL)
+    {
+      user_keyboard_function(key,x,y);
+    }
+}
+
+//----------------------------------------------------------------------
+
+void helper_keyboard_function(unsigned char key, int x, int y)
+
+{
+  if (user_advanced_keyboard_function != NULL)
+    {
+      if (!global_keyboard_state[key])
+        {
+          global_keyboard_state[key] = true;
+          user_advanced_keyboard_function(true,key,x,y);
+        }
+    }
+
+  if (user_keyboard_function != NULL)
+    user_keyboard_function(key,x,y);
+}
+
+//----------------------------------------------------------------------
+
+void helper_advanced_special_keyboard_function(int key, int x, int y)
+
+{
+  key = convert_glut_key(key);
+
+  if (user_advanced_keyboard_function != NULL && global_keyboard_state[key])
+    {
+      global_keyboard_state[key] = false;
+      user_advanced_keyboard_function(false,key,x,y);
+    }
+}
+
+//----------------------------------------------------------------------
+
+void helper_advanced_keyboard_function(unsigned char key, int x, int y)
+
+{
+  if (user_advanced_keyboard_function != NULL && global_keyboard_state[key])
+    {
+      global_keyboard_state[key] = false;
+      user_advanced_keyboard_function(false,key,x,y);
+    }
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::update_transformation_matrix()
+
+{
+  unsigned int i;
+
+  /* T * R * S is just the rotation with scaled columns and the translation
+     in the last column, no full multiplications needed. */
+
+  make_quaternion_matrix(this->orientation,this->transformation_matrix);
+
+  for (i = 0; i < 3; i++)
+    {
+      this->transformation_matrix[i][0] *= this->scale.x;
+      this->transformation_matrix[i][1] *= this->scale.y;
+      this->transformation_matrix[i][2] *= this->scale.z;
+    }
+
+  this->transformation_matrix[0][3] = this->position.x;
+  this->transformation_matrix[1][3] = this->position.y;
+  this->transformation_matrix[2][3] = this->position.z;
+
+  this->transformation_up_to_date = true;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::get_world_matrix(float matrix[4][4])
+
+{
+  if (!this->transformation_up_to_date)
+    this->update_transformation_matrix();
+
+  if (this->parent_node == NULL)
+    memcpy(matrix,this->transformation_matrix,sizeof(this->transformation_matrix));
+  else
+    {
+      if (global_scene_nodes_changed)
+        update_scene_nodes();
+
+      multiply_matrices_affine_simd(this->parent_node->get_world_matrix_pointer(),&this->transformation_matrix[0][0],&matrix[0][0]);
+    }
+}
+
+//----------------------------------------------------------------------
+
+void update_view_matrix()
+
+  /**<
+    Updates the view (camera) matrix in the per-frame uniforms.
+  */
+
+{
+  multiply_matrices_affine_simd(&camera.rotation_matrix[0][0],&camera.translation_matrix[0][0],&camera.transformation_matrix[0][0]);
+  memcpy(global_frame_uniforms.view_matrix,camera.transformation_matrix,sizeof(global_frame_uniforms.view_matrix));
+  global_frame_uniforms_changed = true;
+}
+
+//----------------------------------------------------------------------
+
+unsigned short pack_color_565(const float *color)
+
+  /**<
+    Converts a color to the 16 bit format of block compressed textures.
+
+    @param color red, green and blue from 0 to 255
+    @return color as 5 bits of red, 6 bits of green and 5 bits of blue
+  */
+
+{
+  unsigned int red,green,blue;
+
+  red = (unsigned int) (min(max(color[0],0.0f),255.0f) * 31.0 / 255.0 + 0.5);
+  green = (unsigned int) (min(max(color[1],0.0f),255.0f) * 63.0 / 255.0 + 0.5);
+  blue = (unsigned int) (min(max(color[2],0.0f),255.0f) * 31.0 / 255.0 + 0.5);
+
+  return (red << 11) | (green << 5) | blue;
+}
+
+//----------------------------------------------------------------------
+
+void unpack_color_565(unsigned short color, float *result)
+
+  /**<
+    Converts a 16 bit color to the color the GPU decodes it to.
+
+    @param color color made by pack_color_565
+    @param result in this array red, green and blue from 0 to 255 will be
+           returned
+  */
+
+{
+  unsigned int red,green,blue;
+
+  red = (color >> 11) & 31;
+  green = (color >> 5) & 63;
+  blue = color & 31;
+
+  result[0] = (red << 3) | (red >> 2);
+  result[1] = (green << 2) | (green >> 4);
+  result[2] = (blue << 3) | (blue >> 2);
+}
+
+//----------------------------------------------------------------------
+
+void find_palette_indices(const float *red, const float *green, const float *blue, float palette[4][3], unsigned int palette_size, unsigned char *indices)
+
+  /**<
+    Finds the closest palette color of each pixel of a 4x4 block, using
+    SIMD instructions to process 4 pixels at once.
+
+    @param red red components of the 16 pixels, aligned to 16 bytes
+    @param green green components of the 16 pixels, aligned to 16 bytes
+    @param blue blue components of the 16 pixels, aligned to 16 bytes
+    @param palette colors of the palette
+    @param palette_size number of colors in the palette (3 or 4)
+    @param indices in this array the palette index of each pixel will be
+           returned
+  */
+
+{
+  unsigned int i,j;
+
+#if defined(OPENGLSE_SSE)
+  alignas(16) float result[4];
+  __m128 r,g,b,dr,dg,db,distance,closer,best_distance,best_index;
+
+  for (i = 0; i < 16; i += 4)
+    {
+      r = _mm_load_ps(red + i);
+      g = _mm_load_ps(green + i);
+      b = _mm_load_ps(blue + i);
+      best_distance = _mm_set1_ps(numeric_limits<float>::max());
+      best_index = _mm_setzero_ps();
+
+      for (j = 0; j < palette_size; j++)
+        {
+          dr = _mm_sub_ps(r,_mm_set1_ps(palette[j][0]));
+          dg = _mm_sub_ps(g,_mm_set1_ps(palette[j][1]));
+          db = _mm_sub_ps(b,_mm_set1_ps(palette[j][2]));
+          distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr,dr),_mm_mul_ps(dg,dg)),_mm_mul_ps(db,db));
+          closer = _mm_cmplt_ps(distance,best_distance);
+          best_distance = _mm_min_ps(distance,best_distance);
+          best_index = _mm_or_ps(_mm_and_ps(closer,_mm_set1_ps((float) j)),_mm_andnot_ps(closer,best_index));
+        }
+
+      _mm_store_ps(result,best_index);
+
+      for (j = 0; j < 4; j++)
+        indices[i + j] = (unsigned char) result[j];
+    }
+#elif defined(OPENGLSE_NEON)
+  alignas(16) float result[4];
+  float32x4_t r,g,b,dr,dg,db,distance,best_distance,best_index;
+
+  for (i = 0; i < 16; i += 4)
+    {
+      r = vld1q_f32(red + i);
+      g = vld1q_f32(green + i);
+      b = vld1q_f32(blue + i);
+      best_distance = vdupq_n_f32(numeric_limits<float>::max());
+      best_index = vdupq_n_f32(0.0f);
+
+      for (j = 0; j < palette_size; j++)
+        {
+          dr = vsubq_f32(r,vdupq_n_f32(palette[j][0]));
+          dg = vsubq_f32(g,vdupq_n_f32(palette[j][1]));
+          db = vsubq_f32(b,vdupq_n_f32(palette[j][2]));
+          distance = vmlaq_f32(vmlaq_f32(vmulq_f32(dr,dr),dg,dg),db,db);
+          best_index = vbslq_f32(vcltq_f32(distance,best_distance),vdupq_n_f32((float) j),best_index);
+          best_distance = vminq_f32(distance,best_distance);
+        }
+
+      vst1q_f32(result,best_index);
+
+      for (j = 0; j < 4; j++)
+        indices[i + j] = (unsigned char) result[j];
+    }
+#else
+  float distance,best_distance;
+
+  for (i = 0; i < 16; i++)
+    {
+      best_distance = numeric_limits<float>::max();
+      indices[i] = 0;
+
+      for (j = 0; j < palette_size; j++)
+        {
+          distance = (red[i] - palette[j][0]) * (red[i] - palette[j][0]) +
+            (green[i] - palette[j][1]) * (green[i] - palette[j][1]) +
+            (blue[i] - palette[j][2]) * (blue[i] - palette[j][2]);
+
+          if (distance < best_distance)
+            {
+              best_distance = distance;
+              indices[i] = j;
+            }
+        }
+    }
+#endif
+}
+
+//----------------------------------------------------------------------
+
+void make_block_palette(float endpoints[2][3], bool three_colors, float palette[4][3])
+
+  /**<
+    Makes the palette of a BC1 color block from its endpoints.
+
+    @param endpoints the two endpoint colors
+    @param three_colors if true, the palette of the 3 color mode (with
+           transparency) is made, otherwise the 4 color one
+    @param palette in this array the palette will be returned
+  */
+
+{
+  unsigned int i;
+
+  for (i = 0; i < 3; i++)
+    {
+      palette[0][i] = endpoints[0][i];
+      palette[1][i] = endpoints[1][i];
+
+      if (three_colors)
+        {
+          palette[2][i] = (endpoints[0][i] + endpoints[1][i]) / 2.0;
+          palette[3][i] = 0.0;
+        }
+      else
+        {
+          palette[2][i] = (2.0 * endpoints[0][i] + endpoints[1][i]) / 3.0;
+          palette[3][i] = (endpoints[0][i] + 2.0 * endpoints[1][i]) / 3.0;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+
+void encode_color_block(const float *red, const float *green, const float *blue, const bool *opaque, bool punch_through, unsigned char *block)
+
+  /**<
+    Encodes 4x4 pixels as a BC1 color block (8 bytes): two 16 bit
+    endpoint colors along the principal axis of the pixel colors,
+    refined by least squares, and 2 bit palette indices.
+
+    @param red red components of the 16 pixels (0 to 255), aligned to 16
+           bytes
+    @param green green components of the 16 pixels, aligned to 16 bytes
+    @param blue blue components of the 16 pixels, aligned to 16 bytes
+    @param opaque says which pixels aren't transparent, only these are
+           used to find the endpoints
+    @param punch_through if true, the transparent pixels are encoded as
+           transparent (3 color mode), otherwise the block is always in
+           the 4 color mode (BC3 color blocks)
+    @param block address the 8 bytes of the block will be written to
+  */
+
+{
+  unsigned int i,j,count,iteration,index_bits;
+  float mean[3],covariance[6],axis[3],new_axis[3],difference[3];
+  float projection,minimum,maximum,length,weight,determinant;
+  float a2,b2,ab,ap[3],bp[3];
+  float endpoints[2][3],palette[4][3];
+  const float four_color_weights[4] = {1.0, 0.0, 2.0 / 3.0, 1.0 / 3.0};
+  const float three_color_weights[4] = {1.0, 0.0, 0.5, 0.0};
+  const float *weights;
+  unsigned char indices[16];
+  unsigned short colors[2],helper;
+  bool three_colors;
+
+  count = 0;
+  mean[0] = 0.0;
+  mean[1] = 0.0;
+  mean[2] = 0.0;
+
+  for (i = 0; i < 16; i++)
+    if (opaque[i])
+      {
+        mean[0] += red[i];
+        mean[1] += green[i];
+        mean[2] += blue[i];
+        count++;
+      }
+
+  if (count == 0)                  // black endpoints (3 color mode) and all pixels transparent
+    {
+      memset(block,0,8);
+
+      if (punch_through)
+        memset(block + 4,0xff,4);
+
+      return;
+    }
+
+  three_colors = punch_through && count < 16;
+  weights = three_colors ? three_color_weights : four_color_weights;
+
+  for (i = 0; i < 3; i++)
+    mean[i] /= count;
+
+  memset(covariance,0,sizeof(covariance));
+
+  for (i = 0; i < 16; i++)
+    if (opaque[i])
+      {
+        difference[0] = red[i] - mean[0];
+        difference[1] = green[i] - mean[1];
+        difference[2] = blue[i] - mean[2];
+
+        covariance[0] += difference[0] * difference[0];
+        covariance[1] += difference[0] * difference[1];
+        covariance[2] += difference[0] * difference[2];
+        covariance[3] += difference[1] * difference[1];
+        covariance[4] += difference[1] * difference[2];
+        covariance[5] += difference[2] * difference[2];
+      }
+
+  axis[0] = 1.0;
+  axis[1] = 1.0;
+  axis[2] = 1.0;
+
+  for (iteration = 0; iteration < 8; iteration++)    // power iteration converges to the principal axis
+    {
+      new_axis[0] = covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2];
+      new_axis[1] = covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2];
+      new_axis[2] = covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2];
+
+      length = max(max(fabs(new_axis[0]),fabs(new_axis[1])),fabs(new_axis[2]));
+
+      if (length < 0.0001)         // all the pixels have about the same color
+        break;
+
+      for (i = 0; i < 3; i++)
+        axis[i] = new_axis[i] / length;
+    }
+
+  length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+  for (i = 0; i < 3; i++)
+    axis[i] /= length;
+
+  minimum = numeric_limits<float>::max();
+  maximum = -1 * numeric_limits<float>::max();
+
+  for (i = 0; i < 16; i++)
+    if (opaque[i])
+      {
+        projection = (red[i] - mean[0]) * axis[0] + (green[i] - mean[1]) * axis[1] + (blue[i] - mean[2]) * axis[2];
+        minimum = min(minimum,projection);
+        maximum = max(maximum,projection);
+      }
+
+  for (i = 0; i < 3; i++)
+    {
+      endpoints[0][i] = mean[i] + axis[i] * maximum;
+      endpoints[1][i] = mean[i] + axis[i] * minimum;
+    }
+
+  make_block_palette(endpoints,three_colors,palette);      // refine the endpoints for the pixels' palette indices
+  find_palette_indices(red,green,blue,palette,three_colors ? 3 : 4,indices);
+
+  a2 = 0.0;
+  b2 = 0.0;
+  ab = 0.0;
+
+  for (i = 0; i < 3; i++)
+    {
+      ap[i] = 0.0;
+      bp[i] = 0.0;
+    }
+
+  for (i = 0; i < 16; i++)
+    if (opaque[i])
+      {
+        weight = weights[indices[i]];
+        a2 += weight * weight;
+        b2 += (1.0 - weight) * (1.0 - weight);
+        ab += weight * (1.0 - weight);
+
+        ap[0] += weight * red[i];
+        ap[1] += weight * green[i];
+        ap[2] += weight * blue[i];
+        bp[0] += (1.0 - weight) * red[i];
+        bp[1] += (1.0 - weight) * green[i];
+        bp[2] += (1.0 - weight) * blue[i];
+      }
+
+  determinant = a2 * b2 - ab * ab;
+
+  if (fabs(determinant) > 0.0001)
+    for (i = 0; i < 3; i++)
+      {
+        endpoints[0][i] = (ap[i] * b2 - bp[i] * ab) / determinant;
+        endpoints[1][i] = (bp[i] * a2 - ap[i] * ab) / determinant;
+      }
+
+  colors[0] = pack_color_565(endpoints[0]);
+  colors[1] = pack_color_565(endpoints[1]);
+
+  if (three_colors ? colors[0] > colors[1] : colors[0] < colors[1])   // the order of the endpoints selects the mode
+    {
+      helper = colors[0];
+      colors[0] = colors[1];
+      colors[1] = helper;
+    }
+
+  unpack_color_565(colors[0],endpoints[0]);
+  unpack_color_565(colors[1],endpoints[1]);
+  make_block_palette(endpoints,three_colors,palette);
+  find_palette_indices(red,green,blue,palette,three_colors ? 3 : 4,indices);
+
+  index_bits = 0;
+
+  for (i = 0; i < 16; i++)
+    {
+      if (three_colors && !opaque[i])
+        j = 3;
+      else if (!three_colors && colors[0] == colors[1])  // this would be the 3 color mode, only the first endpoint is safe
+        j = 0;
+      else
+        j = indices[i];
+
+      index_bits |= j << (2 * i);
+    }
+
+  block[0] = colors[0] & 0xff;
+  block[1] = colors[0] >> 8;
+  block[2] = colors[1] & 0xff;
+  block[3] = colors[1] >> 8;
+  block[4] = index_bits & 0xff;
+  block[5] = (index_bits >> 8) & 0xff;
+  block[6] = (index_bits >> 16) & 0xff;
+  block[7] = (index_bits >> 24) & 0xff;
+}
+
+//----------------------------------------------------------------------
+
+void encode_alpha_block(const bool *opaque, unsigned char *block)
+
+  /**<
+    Encodes the alpha of 4x4 pixels as a BC3 alpha block (8 bytes), the
+    alpha is 255 for the opaque pixels and 0 for the others.
+
+    @param opaque says which pixels aren't transparent
+    @param block address the 8 bytes of the block will be written to
+  */
+
+{
+  unsigned int i;
+  unsigned long long index_bits = 0;
+
+  block[0] = 255;                  // index 0
+  block[1] = 0;                    // index 1
+
+  for (i = 0; i < 16; i++)
+    if (!opaque[i])
+      index_bits |= 1ULL << (3 * i);
+
+  for (i = 0; i < 6; i++)
+    block[2 + i] = (index_bits >> (8 * i)) & 0xff;
+}
+
+//----------------------------------------------------------------------
+
+string cache_file_name(const char *kind, unsigned long long hash)
+
+  /**<
+    Makes the name of a data file in the cache directory.
+
+    @param kind what the file contains, used as the file name prefix
+    @param hash hash of the data
+    @return path of the cache file
+  */
+
+{
+  char name[64];
+
+  sprintf(name,"%s_%016llx.bin",kind,hash);
+
+  return global_cache_directory + "/" + name;
+}
+
+//----------------------------------------------------------------------
+
+void reference_residency_file(string file_name, int change)
+
+  /**<
+    Changes the number of objects whose released data (see
+    residency_policy) are in given cache file. The file is removed when
+    no object uses it any more, so that the cache directory doesn't fill
+    up with old versions of the data.
+
+    @param file_name path of the file
+    @param change 1 when an object starts using the file, -1 when it
+           stops
+  */
+
+{
+  map<string,unsigned int>::iterator file = global_residency_files.insert(make_pair(file_name,0u)).first;
+
+  if (change < 0 && file->second == 0)
+    {
+      global_residency_files.erase(file);
+      return;
+    }
+
+  file->second += change;
+
+  if (file->second == 0)
+    {
+      remove(file_name.c_str());
+      global_residency_files.erase(file);
+    }
+}
+
+//----------------------------------------------------------------------
+
+bool read_cache_file(string file_name, unsigned long long hash, void *data, unsigned int size, void *data2 = NULL, unsigned int size2 = 0)
+
+  /**<
+    Reads data written by write_cache_file.
+
+    @param file_name path of the file
+    @param hash hash of the data, the file is only accepted if it matches
+    @param data address the data will be read to
+    @param size expected size of the data in bytes
+    @param data2 address the second part of the data will be read to
+    @param size2 expected size of the second part of the data
+    @return true if the data have been read, false if there is no valid
+            file
+  */
+
+{
+  FILE *file_handle;
+  unsigned long long file_hash;
+  unsigned int file_size,file_size2;
+  bool success = false;
+
+  if (global_cache_directory.length() == 0)
+    return false;
+
+  file_handle = fopen(file_name.c_str(),"rb");
+
+  if (file_handle == NULL)
+    return false;
+
+  if (fread(&file_hash,sizeof(file_hash),1,file_handle) == 1 &&
+      fread(&file_size,sizeof(file_size),1,file_handle) == 1 &&
+      fread(&file_size2,sizeof(file_size2),1,file_handle) == 1 &&
+      file_hash == hash && file_size == size && file_size2 == size2)
+    success = fread(data,1,size,file_handle) == size &&
+      (size2 == 0 || fread(data2,1,size2,file_handle) == size2);
+
+  fclose(file_handle);
+
+  return success;
+}
+
+//----------------------------------------------------------------------
+
+bool write_cache_file(string file_name, unsigned long long hash, const void *data, unsigned int size, const void *data2 = NULL, unsigned int size2 = 0)
+
+  /**<
+    Writes data to a file in the cache directory, prefixed with their
+    hash and size.
+
+    @param file_name path of the file
+    @param hash hash of the data
+    @param data data to be written
+    @param size size of the data in bytes
+    @param data2 second part of the data (can be NULL)
+    @param size2 size of the second part of the data
+    @return true if the file has been written, false otherwise
+  */
+
+{
+  FILE *file_handle;
+  bool success;
+
+  if (global_cache_directory.length() == 0)
+    return false;
+
+  file_handle = fopen(file_name.c_str(),"wb");
+
+  if (file_handle == NULL)
+    {
+      cerr << "ERROR: could not write to the cache directory " << global_cache_directory << "." << endl;
+      return false;
+    }
+
+  success = fwrite(&hash,sizeof(hash),1,file_handle) == 1 &&
+    fwrite(&size,sizeof(size),1,file_handle) == 1 &&
+    fwrite(&size2,sizeof(size2),1,file_handle) == 1 &&
+    fwrite(data,1,size,file_handle) == size &&
+    (size2 == 0 || fwrite(data2,1,size2,file_handle) == size2);
+
+  fclose(file_handle);
+
+  if (!success)
+    cerr << "ERROR: could not write to the cache directory " << global_cache_directory << "." << endl;
+
+  return success;
+}
+
+//----------------------------------------------------------------------
+
+unsigned long long texture_2d::get_data_hash()
+
+{
+  char parameters[64];
+
+  sprintf(parameters,"|%u|%u|%d|%d|%d|%d|%d",this->width,this->height,(int) this->compression,(int) this->transparency_enabled,
+    this->transparent_color[0],this->transparent_color[1],this->transparent_color[2]);
+
+  return hash_data(this->data,this->width * this->height * 3) ^ hash_string(parameters);
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::encode_blocks(vector<unsigned char> &blocks)
+
+{
+  unsigned int blocks_x = (this->width + 3) / 4;
+  unsigned int blocks_y = (this->height + 3) / 4;
+  unsigned int block_size = this->compression == TEXTURE_COMPRESSION_BC3 ? 16 : 8;
+
+  blocks.resize(blocks_x * blocks_y * block_size);
+
+  parallel_for(blocks_y,[this,blocks_x,block_size,&blocks](unsigned int from, unsigned int to)
+    {
+      unsigned int i,j,k,x,y;
+      alignas(16) float red[16];
+      alignas(16) float green[16];
+      alignas(16) float blue[16];
+      bool opaque[16];
+      unsigned char *pixel,*block;
+
+      for (i = from; i < to; i++)
+        for (j = 0; j < blocks_x; j++)
+          {
+            for (k = 0; k < 16; k++)
+              {
+                x = min(j * 4 + k % 4,this->width - 1);      // textures smaller than a block repeat their edge
+                y = min(i * 4 + k / 4,this->height - 1);
+                pixel = this->data + this->xy_to_linear(x,y);
+
+                red[k] = pixel[0];
+                green[k] = pixel[1];
+                blue[k] = pixel[2];
+
+                opaque[k] = !this->transparency_enabled ||        // same tolerance as the shader
+                  abs(pixel[0] - this->transparent_color[0]) >= 26 ||
+                  abs(pixel[1] - this->transparent_color[1]) >= 26 ||
+                  abs(pixel[2] - this->transparent_color[2]) >= 26;
+              }
+
+            block = &blocks[(i * blocks_x + j) * block_size];
+
+            if (this->compression == TEXTURE_COMPRESSION_BC3)
+              {
+                encode_alpha_block(opaque,block);
+                block += 8;
+              }
+
+            encode_color_block(red,green,blue,opaque,this->compression == TEXTURE_COMPRESSION_BC1,block);
+          }
+    },8);
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::upload_texture_data()
+
+{
+  vector<unsigned char> blocks;
+  unsigned long long hash;
+  unsigned int size;
+  GLenum format;
+
+  if (!this->make_resident())       // discarded data can't be uploaded again, the texture stays as it is
+    return;
+
+  if (this->to == 0)
+    glGenTextures(1,&this->to);
+
+  bind_texture(0,this->to);
+
+  if (this->compression != TEXTURE_COMPRESSION_NONE && this->data != NULL && texture_compression_is_supported())
+    {
+      size = ((this->width + 3) / 4) * ((this->height + 3) / 4) * (this->compression == TEXTURE_COMPRESSION_BC3 ? 16 : 8);
+      hash = this->get_data_hash();
+
+      blocks.resize(size);
+
+      if (read_cache_file(cache_file_name("texture",hash),hash,&blocks[0],size))
+        global_texture_cache_hits++;
+      else
+        {
+          this->encode_blocks(blocks);
+          write_cache_file(cache_file_name("texture",hash),hash,&blocks[0],size);
+          global_texture_cache_misses++;
+        }
+
+      if (this->compression == TEXTURE_COMPRESSION_BC3)
+        format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+      else
+        format = this->transparency_enabled ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+      glCompressedTexImage2D(GL_TEXTURE_2D,0,format,this->width,this->height,0,blocks.size(),&blocks[0]);
+      this->gpu_compression = this->compression;
+    }
+  else
+    {
+      glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,this->width,this->height,0,GL_RGB,GL_UNSIGNED_BYTE,this->data);
+      this->gpu_compression = TEXTURE_COMPRESSION_NONE;
+    }
+
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+
+  this->release_data();
+  this->update_memory_usage();
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::release_data()
+
+{
+  unsigned long long hash;
+
+  if (this->residency == RESIDENCY_KEEP || this->data == NULL)
+    return;
+
+  if (this->residency == RESIDENCY_RELOAD)
+    {
+      hash = this->get_data_hash();
+
+      if (hash != this->residency_hash)          // unchanged data are already in the cache
+        {
+          if (!write_cache_file(cache_file_name("pixels",hash),hash,this->data,this->width * this->height * 3))
+            return;                   // the data stay in memory if they can't be cached
+
+          if (this->residency_hash != 0)         // the previous version isn't needed any more
+            reference_residency_file(cache_file_name("pixels",this->residency_hash),-1);
+
+          reference_residency_file(cache_file_name("pixels",hash),1);
+          this->residency_hash = hash;
+        }
+    }
+  else if (this->residency_hash != 0)            // the cached copy would be out of date
+    {
+      reference_residency_file(cache_file_name("pixels",this->residency_hash),-1);
+      this->residency_hash = 0;
+    }
+
+  free(this->data);
+  this->data = NULL;
+  this->data_discarded = true;
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::update_memory_usage()
+
+{
+  set_memory_usage(this,MEMORY_TEXTURES,this->get_cpu_memory_size(),this->to != 0 ? this->get_gpu_memory_size() : 0);
+}
+
+//----------------------------------------------------------------------
+
+void reshape_function(int width, int height)
+
+{
+  global_window_height = height;
+  global_window_width = width;
+  global_window_center[0] = width / 2;
+  global_window_center[1] = height / 2;
+  glViewport(0,0,width,height);
+  set_perspective(global_fov,global_near,global_far);
+}
+
+float catmull_rom_slope(float x_previous, float y_previous, float x_next, float y_next)
+
+  /**<
+    Computes the slope of a Catmull-Rom spline at a keyframe (the slope
+    of the line connecting the neighbouring keyframes).
+
+    @param x_previous x of the previous keyframe
+    @param y_previous y of the previous keyframe
+    @param x_next x of the next keyframe
+    @param y_next y of the next keyframe
+    @return slope dy/dx
+  */
+
+{
+  return x_next > x_previous ? (y_next - y_previous) / (x_next - x_previous) : 0.0;
+}
+
+//----------------------------------------------------------------------
+
+void make_spline_segment(interpolation_method method, float x0, float y0, float x1, float y1, float slope0, float slope1, float control0, float control1, spline_segment *segment)
+
+  /**<
+    Computes the polynomial of one keyframe segment, so that evaluating
+    it takes only three multiply-adds.
+
+    @param method interpolation method of the first keyframe
+    @param x0 x of the first keyframe
+    @param y0 y of the first keyframe
+    @param x1 x of the second keyframe
+    @param y1 y of the second keyframe
+    @param slope0 slope (dy/dx) at the first keyframe (spline methods)
+    @param slope1 slope at the second keyframe
+    @param control0 Bezier control value after the first keyframe
+    @param control1 Bezier control value before the second keyframe
+    @param segment in this variable the segment will be returned
+  */
+
+{
+  float width = x1 - x0;
+  float tangent0 = slope0 * width;  // Hermite tangents are in units of t
+  float tangent1 = slope1 * width;
+
+  segment->start = x0;
+  segment->inverse_width = width > 0.0 ? 1.0 / width : 0.0;
+  segment->sine = method == INTERPOLATION_SINE;
+
+  switch (method)
+    {
+      case INTERPOLATION_CONSTANT:
+        segment->coefficients[0] = 0.0;
+        segment->coefficients[1] = 0.0;
+        segment->coefficients[2] = 0.0;
+        break;
+
+      case INTERPOLATION_CATMULL_ROM:
+      case INTERPOLATION_HERMITE:
+        segment->coefficients[0] = 2 * y0 - 2 * y1 + tangent0 + tangent1;
+        segment->coefficients[1] = -3 * y0 + 3 * y1 - 2 * tangent0 - tangent1;
+        segment->coefficients[2] = tangent0;
+        break;
+
+      case INTERPOLATION_BEZIER:
+        segment->coefficients[0] = -y0 + 3 * control0 - 3 * control1 + y1;
+        segment->coefficients[1] = 3 * y0 - 6 * control0 + 3 * control1;
+        segment->coefficients[2] = -3 * y0 + 3 * control0;
+        break;
+
+      default:                        // linear, sine eases t and then interpolates linearly
+        segment->coefficients[0] = 0.0;
+        segment->coefficients[1] = 0.0;
+        segment->coefficients[2] = y1 - y0;
+        break;
+    }
+
+  segment->coefficients[3] = y0;
+}
+
+//----------------------------------------------------------------------
+
+float segment_parameter(spline_segment &segment, float x)
+
+  /**<
+    Computes the polynomial parameter of a segment for given x.
+
+    @param segment segment
+    @param x value of the independent variable inside the segment
+    @return t in range <0,1>
+  */
+
+{
+  float t = (x - segment.start) * segment.inverse_width;
+
+  if (segment.sine)
+    t = 0.5 - cos(t * PI) * 0.5;
+
+  return t;
+}
+
+//======================================================================
+// public function definitions:
+//======================================================================
+
+void set_global_light(point_3d direction, unsigned char red, unsigned char green, unsigned char blue)
+
+{
+  global_light_direction.x = direction.x;
+  global_light_direction.y = direction.y;
+  global_light_direction.z = direction.z;
+
+  normalize_vector(&global_light_direction);
+
+  global_light_color[0] = red;
+  global_light_color[1] = green;
+  global_light_color[2] = blue;
+
+  global_frame_uniforms.light_color[0] = red / 255.0;
+  global_frame_uniforms.light_color[1] = green / 255.0;
+  global_frame_uniforms.light_color[2] = blue / 255.0;
+
+  global_frame_uniforms.light_direction[0] = global_light_direction.x;
+  global_frame_uniforms.light_direction[1] = global_light_direction.y;
+  global_frame_uniforms.light_direction[2] = global_light_direction.z;
+
+  global_frame_uniforms_changed = true;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::init_rendering(unsigned int features)
+
+{
+  material_uniforms material;
+
+  memset(&material,0,sizeof(material));     // the padding is compared too
+
+  if (this->texture != NULL)
+    this->texture->get_transparent_color_float(material.transparent_color,material.transparent_color + 1,material.transparent_color + 2);
+
+  material.textures = this->texture == NULL ? 0 : (this->texture2 == NULL ? 1 : 2);
+  material.render_mode = (GLuint) this->mesh_render_mode;
+  material.use_fog = this->use_fog ? 1 : 0;
+  material.transparency_enabled = this->texture != NULL && this->texture->transparency_is_enabled() ? 1 : 0;
+  memcpy(material.mesh_color,this->color_float,sizeof(material.mesh_color));
+  material.ambient_factor = this->material_ambient_intensity;
+  material.diffuse_factor = this->material_diffuse_intensity;
+  material.specular_factor = this->material_specular_intensity;
+  material.specular_exponent = this->material_specular_exponent;
+
+  if (this->material_index < 0 || memcmp(&material,&this->material,sizeof(material)) != 0)
+    {                                       // the material changed, find it in the buffer
+      int index = acquire_material(material);
+
+      release_material(this->material_index);
+      this->material = material;
+      this->material_index = index;
+    }
+
+  features |= global_shader_features;
+
+  if (this->use_fog)
+    features |= SHADER_FOG;
+
+  if (this->shadows.size() != 0)
+    features |= SHADER_SHADOWS;
+
+  if (material.transparency_enabled)
+    features |= SHADER_TRANSPARENCY;
+
+  use_shader_variant(shader_variant_key(this->mesh_render_mode,material.textures,features));
+
+  upload_frame_uniforms();                  // only if something changed during the frame
+  bind_material(this->material_index);
+
+  if (this->texture != NULL)
+    {
+      bind_texture(0,this->texture->get_texture_object());
+
+      if (this->texture2 != NULL)
+        bind_texture(1,this->texture2->get_texture_object());
+    }
+
+  switch (this->mesh_render_mode)
+    {
+      case RENDER_MODE_SHADED_GORAUD:
+        glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
+        break;
+
+      case RENDER_MODE_WIREFRAME:
+        glPolygonMode(GL_FRONT_AND_BACK,GL_LINE);
+        break;
+
+      default:
+        glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
+        break;
+    }
+
+  float world_matrix[4][4];
+  this->get_world_matrix(world_matrix);
+  glUniformMatrix4fv(world_matrix_location,1,GL_TRUE,(const GLfloat *) world_matrix); // load this model's transformation matrix
+
+  if (this->shadows.size() != 0)
+    {
+      glUniform1ui(number_of_shadows_location,(GLuint) (this->shadows.size() > MAX_SHADOWS ? MAX_SHADOWS : this->shadows.size()));
+      glUniform1fv(shadows_location,min((unsigned int) this->shadows.size(),(unsigned int) MAX_SHADOWS) * 4,(GLfloat *) &this->shadows[0]);
+    }
+
+  glUniform3f(position_offset_location,0.0,0.0,0.0);         // float positions, compact meshes set their own
+  glUniform3f(position_scale_location,1.0,1.0,1.0);
+}
+
+//----------------------------------------------------------------------
+
+void camera_struct::go(axis_direction direction, float distance)
+
+{
+  switch (direction)
+    {
+      case DIRECTION_FORWARD:
+        this->move(camera.direction_forward_vector.x * distance,
+                   camera.direction_forward_vector.y * distance,
+                   camera.direction_forward_vector.z * distance);
+        break;
+
+      case DIRECTION_BACKWARD:
+        this->go(DIRECTION_FORWARD,-1 * distance);
+        break;
+
+      case DIRECTION_LEFT:
+        this->move(camera.direction_left_vector.x * distance,
+                   camera.direction_left_vector.y * distance,
+                   camera.direction_left_vector.z * distance);
+        break;
+
+      case DIRECTION_RIGHT:
+        this->go(DIRECTION_LEFT,-1 * distance);
+        break;
+
+
+      case DIRECTION_UP:
+        this->move(camera.direction_up_vector.x * distance,
+                   camera.direction_up_vector.y * distance,
+                   camera.direction_up_vector.z * distance);
+        break;
+
+      case DIRECTION_DOWN:
+        this->go(DIRECTION_UP,-1 * distance);
+        break;
+
+      default:
+        break;
+    }
+}
+
+//----------------------------------------------------------------------
+
+render_mode mesh_3d::get_render_mode()
+
+{
+  return this->mesh_render_mode;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::set_lighting_properties(float ambient, float diffuse, float specular, float specular_exponent)
+
+{
+  if (ambient > 1.0)
+    ambient = 1.0;
+  else if (ambient < 0.0)
+    ambient = 0.0;
+
+  if (diffuse > 1.0)
+    diffuse = 1.0;
+  else if (diffuse < 0.0)
+    diffuse = 0.0;
+
+  if (specular > 1.0)
+    specular = 1.0;
+  else if (specular < 0.0)
+    specular = 0.0;
+
+  this->material_ambient_intensity = ambient;
+  this->material_diffuse_intensity = diffuse;
+  this->material_specular_intensity = specular;
+  this->material_specular_exponent = specular_exponent;
+}
+
+//----------------------------------------------------------------------
+
+bool texture_2d::transparency_is_enabled()
+
+{
+  return this->transparency_enabled;
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::get_transparent_color(unsigned char *red, unsigned char *green, unsigned char *blue)
+
+{
+  *red = this->transparent_color[0];
+  *green = this->transparent_color[1];
+  *blue = this->transparent_color[2];
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::get_transparent_color_float(float *red, float *green, float *blue)
+
+{
+  *red = this->transparent_color_float[0];
+  *green = this->transparent_color_float[1];
+  *blue = this->transparent_color_float[2];
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d_static *make_cuboid(float side_x, float side_y, float side_z)
+
+{
+  mesh_3d_static *result = new mesh_3d_static;
+
+  double half_x, half_y, half_z;
+
+  half_x = side_x / 2.0;
+  half_y = side_y / 2.0;
+  half_z = side_z / 2.0;
+
+              //     x           y           z             u    v      normal   #
+  result->add_vertex(-1 * half_x,-1 * half_y,half_z,       0,   0,  -1,-1,-1);  // 0
+  result->add_vertex(half_x,     -1 * half_y,half_z,       1,   0,   1,-1,-1);  // 1
+  result->add_vertex(-1 * half_x,half_y,     half_z,       0,   1,  -1, 1,-1);  // 2
+  result->add_vertex(half_x,     half_y,     half_z,       1,   1,   1, 1,-1);  // 3
+
+  result->add_vertex(-1 * half_x,-1 * half_y,-1 * half_z,  1,   1,  -1,-1, 1);  // 4
+  result->add_vertex(half_x,     -1 * half_y,-1 * half_z,  0,   1,   1,-1, 1);  // 5
+  result->add_vertex(-1 * half_x,half_y,     -1 * half_z,  1,   0,  -1, 1, 1);  // 6
+  result->add_vertex(half_x,     half_y,     -1 * half_z,  0,   0,   1, 1, 1);  // 7
+
+  result->add_triangle(0,1,2);
+  result->add_triangle(1,3,2);
+  result->add_triangle(3,5,7);
+  result->add_triangle(3,1,5);
+  result->add_triangle(5,4,6);
+  result->add_triangle(6,7,5);
+  result->add_triangle(6,4,2);
+  result->add_triangle(4,0,2);
+  result->add_triangle(6,2,3);
+  result->add_triangle(6,3,7);
+  result->add_triangle(1,0,4);
+  result->add_triangle(5,1,4);
+
+  result->update();
+
+  return result;
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d_static *make_sharp_cuboid(float side_x, float side_y, float side_z)
+
+{
+  mesh_3d_static *result = new mesh_3d_static;
+
+  double half_x, half_y, half_z;
+
+  half_x = side_x / 2.0;
+  half_y = side_y / 2.0;
+  half_z = side_z / 2.0;
+
+              //     x           y           z             u    v      normal   #
+  // back:
+  result->add_vertex(-1 * half_x,-1 * half_y,half_z,       0.75, 0.5,0,  0,-1);  // 0
+  result->add_vertex(half_x,     -1 * half_y,half_z,       0.5,0.5,  0,  0,-1);  // 1
+  result->add_vertex(-1 * half_x,half_y,     half_z,       0.75, 0,  0,  0,-1);  // 2
+  result->add_vertex(half_x,     half_y,     half_z,       0.5,0,    0,  0,-1);  // 3
+
+  result->add_triangle(0,1,2);
+  result->add_triangle(1,3,2);
+
+  // front:
+  result->add_vertex(-1 * half_x,-1 * half_y,-1 * half_z,  0,   0.5, 0, 0, 1);  // 4
+  result->add_vertex(half_x,     -1 * half_y,-1 * half_z,  0.25,0.5, 0, 0, 1);  // 5
+  result->add_vertex(-1 * half_x,half_y,     -1 * half_z,  0,   0,   0, 0, 1);  // 6
+  result->add_vertex(half_x,     half_y,     -1 * half_z,  0.25,0,   0, 0, 1);  // 7
+
+  result->add_triangle(5,4,6);
+  result->add_triangle(6,7,5);
+
+  // left:
+  result->add_vertex(-1 * half_x,-1 * half_y,-1 * half_z,  1,   0.5,-1, 0, 0);  // 8
+  result->add_vertex(-1 * half_x,-1 * half_y,half_z,       0.75,0.5,-1, 0, 0);  // 9
+  result->add_vertex(-1 * half_x,half_y,     -1 * half_z,  1,   0  ,-1, 0, 0);  // 10
+  result->add_vertex(-1 * half_x,half_y,          half_z,  0.75,0,  -1, 0, 0);  // 11
+
+  result->add_triangle(8,9,10);
+  result->add_triangle(11,10,9);
+
+  // right:
+  result->add_vertex(half_x,    -1 * half_y,-1 * half_z,   0.25,0.5, 1, 0, 0);  // 12
+  result->add_vertex(half_x,    -1 * half_y,half_z,        0.5, 0.5, 1, 0, 0);  // 13
+  result->add_vertex(half_x,     half_y,     -1 * half_z,  0.25,0,   1, 0, 0);  // 14
+  result->add_vertex(half_x,     half_y,          half_z,  0.5, 0,   1, 0, 0);  // 15
+
+  result->add_triangle(12,14,13);
+  result->add_triangle(15,13,14);
+
+  // top:
+  result->add_vertex(-1 * half_x,half_y,    -1 * half_z,   0,   1,   0, 1, 0);  // 16
+  result->add_vertex(half_x,     half_y,    -1 * half_z,   0.25,1,   0, 1, 0);  // 17
+  result->add_vertex(-1 * half_x,half_y,         half_z,   0,   0.5, 0, 1, 0);  // 18
+  result->add_vertex(half_x,     half_y,         half_z,   0.25,0.5, 0, 1, 0);  // 19
+
+  result->add_triangle(18,17,16);
+  result->add_triangle(18,19,17);
+
+  // bottom:
+  result->add_vertex(-1 * half_x,-1 * half_y,-1 * half_z,  0.25,0.5, 0,-1, 0);  // 20
+  result->add_vertex(half_x,     -1 * half_y,-1 * half_z,  0.5, 0.5, 0,-1, 0);  // 21
+  result->add_vertex(-1 * half_x,-1 * half_y,     half_z,  0.25,1,   0,-1, 0);  // 22
+  result->add_vertex(half_x,     -1 * half_y,     half_z,  0.5, 1,   0,-1, 0);  // 23
+
+  result->add_triangle(22,20,21);
+  result->add_triangle(23,22,21);
+
+  result->update();
+
+  return result;
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d_static *make_plane(float width, float height, unsigned int resolution_x, unsigned int resolution_y)
+
+{
+  mesh_3d_static *result = new mesh_3d_static;
+
+  unsigned int i,j;
+  float step_x,step_y,half_width,half_height;
+
+  half_width = width / 2.0;
+  half_height = height / 2.0;
+
+  step_x = width / (float) resolution_x;
+  step_y = height / (float) resolution_y;
+
+  for (j = 0; j < resolution_y + 1; j++)
+    for (i = 0; i < resolution_x + 1; i++)
+      {
+        result->add_vertex(step_x * i - half_width,step_y * j - half_height,0,i / (float) resolution_x,j / (float) resolution_y,0,0,-1);
+      }
+
+  for (i = 0; i < result->vertices.size() - resolution_x - 2; i++)
+    {
+      if (i % (resolution_x + 1) != 0 && (i - i / (resolution_x + 1)) % resolution_x == 0)
+        continue;
+
+      result->add_triangle(i,i + resolution_x + 1,i + 1);
+      result->add_triangle(i + resolution_x + 2,i + 1,i + resolution_x + 1);
+    }
+
+  result->update();
+
+  return result;
+}
+
+//----------------------------------------------------------------------
+
+unsigned int texture_2d::get_width()
+
+{
+  return this->width;
+}
+
+//----------------------------------------------------------------------
+
+unsigned int texture_2d::get_height()
+
+{
+  return this->height;
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d_static *make_terrain(float size_x, float size_y, float height, unsigned int resolution_x, unsigned int resolution_y, texture_2d *heightmap, float crop_x, float crop_y, float crop_width, float crop_height)
+
+{
+  mesh_3d_static *result;
+  float matrix[4][4];
+  unsigned int index;
+  int indexes[4];
+  unsigned int crop_x_pixels,crop_y_pixels,crop_width_pixels,crop_height_pixels;
+
+  crop_x = clamp(crop_x,0,1);
+  crop_y = clamp(crop_y,0,1);
+  crop_width = clamp(crop_width,0,1);
+  crop_height = clamp(crop_height,0,1);
+
+  if (heightmap != NULL)
+    {
+      crop_x_pixels = (heightmap->get_width() - 1) * crop_x;
+      crop_y_pixels = (heightmap->get_height() - 1) * crop_y;
+      crop_width_pixels = (heightmap->get_width() - 1) * crop_width;
+      crop_height_pixels = (heightmap->get_height() - 1) * crop_height;
+    }
+  else
+    {
+      crop_x_pixels = 0;
+      crop_y_pixels = 0;
+      crop_width_pixels = 1;
+      crop_height_pixels = 1;
+    }
+
+  result = make_plane(size_x,size_y,resolution_x,resolution_y);
+
+  make_rotation_matrix(-90,0,0,ROTATION_XYZ,matrix);
+  result->apply_matrix(matrix);
+
+  index = 0;
+  int countdown = -1;
+
+  // change the topology of the plane to look better:
+
+  for (index = 0; index < result->triangles.size(); index += 4)
+    {
+      indexes[0] = result->triangles[index].index1;
+      indexes[1] = result->triangles[index].index2;
+      indexes[2] = result->triangles[index].index3;
+      indexes[3] = result->triangles[index + 1].index1;
+
+      result->triangles[index].index2 = indexes[3];
+      result->triangles[index + 1].index2 = indexes[0];
+
+      if (resolution_x % 2 == 0)
+        {
+          if (countdown < 0)
+            {
+              countdown = resolution_x * 2;
+              index += 2;
+            }
+
+          countdown -= 4;
+        }
+    }
+
+  // set the height for each vertex:
+
+  if (heightmap != NULL && heightmap->make_resident())   // reload released pixels here, not lazily in the workers
+    parallel_for(result->vertices.size(),[=](unsigned int from, unsigned int to)
+      {
+        unsigned int i;
+        unsigned char r,g,b;
+        int x,y;
+
+        for (i = from; i < to; i++)
+          {
+            x = ((result->vertices[i].position.x + size_x / 2.0) / size_x) * crop_width_pixels + crop_x_pixels;
+            y = ((result->vertices[i].position.z + size_y / 2.0) / size_y) * crop_height_pixels + crop_y_pixels;
+            heightmap->get_pixel(x,y,&r,&g,&b);
+
+            result->vertices[i].position.y += r / 255.0 * height;
+          }
+      });
+
+  result->texture_map_plane(DIRECTION_DOWN,1.0,1.0);
+  result->smooth_normals();
+
+  result->update();
+
+  return result;
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d_static *make_cone(float radius, float height, unsigned int sides)
+
+{
+  mesh_3d_static *result = new mesh_3d_static;
+
+  result->add_vertex(0,0,0,0,0,0,-1,0);         // bottom
+  result->add_vertex(0,height,0,0.5,1,0,1,0);   // top
+
+  result->add_vertex(radius,0,0,0,0,1,0,0);   // first circle vertex
+
+  unsigned int i;
+  float helper_x,helper_z;
+  float texture_step = 1.0 / (float) sides;
+  float angle = 0;
+  float angle_step = 2 * PI / (float) sides;
+
+  for (i = 0; i < sides; i++)
+    {
+      angle += angle_step;
+      helper_x = cos(angle) * radius;
+      helper_z = sin(angle) * radius;
+
+      if (i < sides - 1)
+        {
+          result->add_vertex(helper_x,0,helper_z,(i + 1) * texture_step,0,helper_x,0,helper_z);
+          result->add_triangle(0,i + 2,i + 3);
+          result->add_triangle(1,i + 3,i + 2);
+        }
+      else
+        {
+          result->add_triangle(0,i + 2,2);
+          result->add_triangle(1,2,i + 2);
+        }
+    }
+
+  result->update();
+
+  return result;
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d_static *make_sphere(float radius, unsigned int height_segments, unsigned int sides)
+
+{
+  mesh_3d_static *result = new mesh_3d_static;
+
+  result->add_vertex(0,-1 * radius,0,0.5,0.5,0,-1,0);  // bottom vertex
+  result->add_vertex(0,radius,0,0.5,0.5,0,1,0);        // top vertex
+
+  unsigned int i,j,first_row_index;
+  float angle_step;
+  float scale_factor;
+  float x_coordinate,y_coordinate,z_coordinate;
+
+  angle_step = 360.0 / (float) sides * PI_DIVIDED_180;
+
+  for (j = 1; j < height_segments; j++)
+    {
+      y_coordinate = -1 * cos(j / (float) height_segments * PI) * radius;
+      scale_factor = sin(j / (float) height_segments * PI);
+
+      for (i = 0; i < sides; i++)
+        {
+          x_coordinate = sin(i * angle_step) * scale_factor;
+          z_coordinate = cos(i * angle_step) * scale_factor;
+
+          result->add_vertex(x_coordinate * radius,y_coordinate,z_coordinate * radius,x_coordinate,z_coordinate,x_coordinate,y_coordinate,z_coordinate);
+
+          first_row_index = (j - 1) * sides + 2;
+
+          if (j == 1)  // bottom of the sphere
+            {
+              if (i < sides - 1)
+                result->add_triangle(0,i + 3,i + 2);
+              else
+                result->add_triangle(0,2,i + 2);
+            }
+          else if (j == height_segments - 1)  // top of the sphere
+            {
+              if (i < sides - 1)
+                result->add_triangle(1,first_row_index + i,first_row_index + i + 1);
+              else
+                result->add_triangle(1,first_row_index + i,first_row_index);
+            }
+
+          if (j < height_segments - 1)
+            {
+              if (i < sides - 1)
+                {
+                  result->add_triangle(first_row_index + i,first_row_index + i + 1,first_row_index + i + 1 + sides);
+                  result->add_triangle(first_row_index + i,first_row_index + i + 1 + sides,first_row_index + i + sides);
+                }
+              else
+                {
+                  result->add_triangle(first_row_index + i,first_row_index,first_row_index + sides);
+                  result->add_triangle(first_row_index + i,first_row_index + sides,first_row_index + i + sides);
+                }
+            }
+        }
+    }
+
+  result->update();
+
+  return result;
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d_static *make_cylinder(float radius, float height, unsigned int sides)
+
+{
+  mesh_3d_static *result = new mesh_3d_static;
+
+  result->add_vertex(0,0,0,0,0,0,-1,0);
+  result->add_vertex(0,height,0,0,0,0,1,0);
+
+  result->add_vertex(radius,0,0,0,0,1,0,0);
+  result->add_vertex(radius,height,0,0,1,1,0,0);
+
+  unsigned int i;
+  float helper_x,helper_z;
+  float angle = 0;
+  float texture_step = 1 / (float) sides;
+  float angle_step = 2 * PI / (float) sides;
+
+  for (i = 0; i < sides; i++)
+    {
+      angle += angle_step;
+      helper_x = cos(angle) * radius;
+      helper_z = sin(angle) * radius;
+
+      if (i < sides - 1)
+        {
+          result->add_vertex(helper_x,0,helper_z,(i + 1) * texture_step,0,helper_x,0,helper_z);
+          result->add_vertex(helper_x,height,helper_z,(i + 1) * texture_step,1,helper_x,0,helper_z);
+
+          result->add_triangle(0,2 * i + 2,2 * i + 4);
+          result->add_triangle(1,2 * i + 5,2 * i + 3);
+
+          result->add_triangle(2 * (i + 1),2 * (i + 1) + 1,2 * (i + 1) + 2);
+          result->add_triangle(2 * (i + 1) + 1,2 * (i + 1) + 3,2 * (i + 1) + 2);
+        }
+      else
+        {
+          result->add_triangle(0,2 * i + 2,2);
+          result->add_triangle(1,3,2 * i + 3);
+
+          result->add_triangle(2 * (i + 1),2 * (i + 1) + 1,2);
+          result->add_triangle(2 * (i + 1) + 1,3,2);
+        }
+    }
+
+  result->update();
+
+  return result;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::apply_matrix(float matrix[4][4])
+
+{
+  if (!this->make_resident())
+    return;
+
+  this->transform_vertices(matrix,0,this->vertices.size());
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::transform_vertices(float matrix[4][4], unsigned int first, unsigned int number_of_vertices)
+
+{
+  float normal_matrix[4][4];
+  float helper;
+  unsigned int i,j;
+
+  if (!this->make_resident())
+    return;
+
+  if (number_of_vertices == 0 || first + number_of_vertices > this->vertices.size())
+    return;
+
+  if (invert_matrix_affine_simd(&matrix[0][0],&normal_matrix[0][0]))
+    {
+      for (j = 0; j < 4; j++)      // transpose the inverse
+        for (i = j + 1; i < 4; i++)
+          {
+            helper = normal_matrix[i][j];
+            normal_matrix[i][j] = normal_matrix[j][i];
+            normal_matrix[j][i] = helper;
+          }
+    }
+  else                             // singular matrix, the inverse transpose doesn't exist
+    memcpy(normal_matrix,matrix,sizeof(normal_matrix));
+
+  parallel_for(number_of_vertices,[this,matrix,&normal_matrix,first](unsigned int from, unsigned int to)
+    {
+      alignas(32) float x[SOA_BLOCK_SIZE];
+      alignas(32) float y[SOA_BLOCK_SIZE];
+      alignas(32) float z[SOA_BLOCK_SIZE];
+      unsigned int i,block,count;
+      vertex_3d *vertex;
+
+      for (block = from; block < to; block += SOA_BLOCK_SIZE)
+        {
+          count = min(to - block,(unsigned int) SOA_BLOCK_SIZE);
+          vertex = &this->vertices[first + block];
+
+          for (i = 0; i < count; i++)   // positions
+            {
+              x[i] = vertex[i].position.x;
+              y[i] = vertex[i].position.y;
+              z[i] = vertex[i].position.z;
+            }
+
+          transform_points_soa_simd(&matrix[0][0],x,y,z,count,1.0);
+
+          for (i = 0; i < count; i++)
+            {
+              vertex[i].position.x = x[i];
+              vertex[i].position.y = y[i];
+              vertex[i].position.z = z[i];
+            }
+
+          for (i = 0; i < count; i++)   // normals
+            {
+              x[i] = vertex[i].normal.x;
+              y[i] = vertex[i].normal.y;
+              z[i] = vertex[i].normal.z;
+            }
+
+          transform_points_soa_simd(&normal_matrix[0][0],x,y,z,count,0.0);
+          normalize_vectors_soa_simd(x,y,z,count);
+
+          for (i = 0; i < count; i++)
+            {
+              vertex[i].normal.x = x[i];
+              vertex[i].normal.y = y[i];
+              vertex[i].normal.z = z[i];
+            }
+        }
+    });
+}
+
+//----------------------------------------------------------------------
+
+texture_2d::texture_2d()
+
+{
+  this->width = 0;
+  this->height = 0;
+  this->data = NULL;
+  this->transparency_enabled = false;
+  this->compression = TEXTURE_COMPRESSION_NONE;
+  this->gpu_compression = TEXTURE_COMPRESSION_NONE;
+  this->residency = RESIDENCY_KEEP;
+  this->data_discarded = false;
+  this->residency_hash = 0;
+  this->set_transparent_color(0,0,0);
+  glGenTextures(1,&this->to);
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::set_transparent_color(unsigned char red, unsigned char green, unsigned char blue)
+
+{
+  this->transparent_color[0] = red;
+  this->transparent_color[1] = green;
+  this->transparent_color[2] = blue;
+
+  this->transparent_color_float[0] = red / 255.0;
+  this->transparent_color_float[1] = green / 255.0;
+  this->transparent_color_float[2] = blue / 255.0;
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::set_transparency(bool enabled)
+
+{
+  this->transparency_enabled = enabled;
+}
+
+//----------------------------------------------------------------------
+
+GLuint texture_2d::get_texture_object()
+
+{
+  return this->to;
+}
+
+//----------------------------------------------------------------------
+
+bool texture_2d::load_ppm(string filename)
+
+{
+  char buffer[16];
+  FILE *file_handle;
+  int character, rgb_component;
+
+  file_handle = fopen(filename.c_str(),"rb");
+
+  if (!file_handle)
+    return false;
+
+  if (!fgets(buffer,sizeof(buffer),file_handle))   // file format
+    return false;
+
+  character = getc(file_handle);                   // skip comments
+
+  while (character == '#')
+    {
+      while (getc(file_handle) != '\n');
+      character = getc(file_handle);
+    }
+
+  ungetc(character,file_handle);
+
+  // image size:
+
+  if (fscanf(file_handle,"%d %d",(int *) &this->width,(int *) &this->height) != 2)
+    {
+      fclose(file_handle);
+      return false;
+    }
+
+  // rgb component:
+
+  if (fscanf(file_handle,"%d",&rgb_component) != 1)
+    {
+      fclose(file_handle);
+      return false;
+    }
+
+  if (rgb_component != 255)  // check the depth
+    {
+      fclose(file_handle);
+      return false;
+    }
+
+  while (fgetc(file_handle) != '\n');
+
+  if (this->data != NULL)
+    free(this->data);
+
+  this->data = (unsigned char *) malloc(this->width * this->height * sizeof(unsigned char) * 3);
+  this->data_discarded = false;
+
+  if (!this->data)
+    {
+      fclose(file_handle);
+      return false;
+    }
+
+  //read pixel data:
+
+  if (fread(this->data,3 * this->width,this->height,file_handle) != this->height)
+    {
+      fclose(file_handle);
+      return false;
+    }
+
+  fclose(file_handle);
+
+  this->flip_vertical();        // this must be done because of OpenGL texture handling
+  // upload the data to GPU:
+
+  this->upload_texture_data();
+
+  return true;
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::initialise(unsigned int width, unsigned int height)
+
+{
+  unsigned int i,j;
+
+  if (this->data != NULL)
+    free(this->data);
+
+  this->width = width;
+  this->height = height;
+  this->data = (unsigned char *) malloc(this->width * this->height * sizeof(unsigned char) * 3);
+  this->data_discarded = false;
+
+  for (j = 0; j < height; j++)
+    for (i = 0; i < width; i++)
+      this->set_pixel(i,j,255,255,255);
+
+  this->upload_texture_data();
+}
+
+//----------------------------------------------------------------------
+
+bool texture_2d::save_ppm(string filename)
+
+{
+  unsigned int i,j;
+  unsigned char r,g,b;
+
+  FILE *file_handle;
+
+  if (!this->make_resident())
+    return false;
+
+  file_handle = fopen(filename.c_str(),"wb");
+
+  if (!file_handle)
+    return false;
+
+  fprintf(file_handle,"P6 %d %d 255 ",this->width,this->height);
+
+  for (j = 0; j < this->height; j++)
+    for (i = 0; i < this->width; i++)
+      {
+        this->get_pixel(i,j,&r,&g,&b);
+        fprintf(file_handle,"%c%c%c",r,g,b);
+      }
+
+  fclose(file_handle);
+  return true;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::smooth_normals()
+
+{
+  if (!this->make_resident())
+    return;
+
+  vector<point_3d> triangle_normals(this->triangles.size());  // normals for each triangle
+  vector<point_3d> normal_sums(this->vertices.size());
+  vector<unsigned int> triangle_counts(this->vertices.size(),0);
+
+  unsigned int i;
+
+  parallel_for(this->triangles.size(),[this,&triangle_normals](unsigned int from, unsigned int to)
+    {
+      unsigned int i,helper_index;
+      point_3d vector0,vector1,vector2;
+
+      for (i = from; i < to; i++)
+        {
+          vector0 = this->vertices[this->triangles[i].index1].position;
+          vector1 = vector0;
+
+          helper_index = this->triangles[i].index2;
+
+          vector0.x -= this->vertices[helper_index].position.x;
+          vector0.y -= this->vertices[helper_index].position.y;
+          vector0.z -= this->vertices[helper_index].position.z;
+
+          helper_index = this->triangles[i].index3;
+
+          vector1.x -= this->vertices[helper_index].position.x;
+          vector1.y -= this->vertices[helper_index].position.y;
+          vector1.z -= this->vertices[helper_index].position.z;
+
+          cross_product(vector0,vector1,&vector2);
+
+          normalize_vector(&vector2);
+
+          triangle_normals[i] = vector2;
+        }
+    });
+
+  for (i = 0; i < this->vertices.size(); i++)
+    {
+      normal_sums[i].x = 0;
+      normal_sums[i].y = 0;
+      normal_sums[i].z = 0;
+    }
+
+  for (i = 0; i < this->triangles.size(); i++)  // add each triangle normal to all of its (distinct) vertices
+    {
+      unsigned int indices[3] = {this->triangles[i].index1,this->triangles[i].index2,this->triangles[i].index3};
+      unsigned int j;
+
+      for (j = 0; j < 3; j++)
+        {
+          if ((j >= 1 && indices[j] == indices[0]) || (j == 2 && indices[j] == indices[1]))
+            continue;
+
+          normal_sums[indices[j]].x += triangle_normals[i].x;
+          normal_sums[indices[j]].y += triangle_normals[i].y;
+          normal_sums[indices[j]].z += triangle_normals[i].z;
+          triangle_counts[indices[j]]++;
+        }
+    }
+
+  parallel_for(this->vertices.size(),[this,&normal_sums,&triangle_counts](unsigned int from, unsigned int to)
+    {
+      unsigned int j;
+      point_3d normal_sum;
+
+      for (j = from; j < to; j++)  // make an average normal of all coresponding triangles for each vertex
+        {
+          normal_sum = normal_sums[j];
+
+          if (triangle_counts[j] != 0)
+            {
+              normal_sum.x = normal_sum.x / (float) triangle_counts[j];
+              normal_sum.y = normal_sum.y / (float) triangle_counts[j];
+              normal_sum.z = normal_sum.z / (float) triangle_counts[j];
+            }
+          else
+            normal_sum.x = 1.0;
+
+          this->vertices[j].normal = normal_sum;
+        }
+    });
+
+  this->update();
+}
+
+//----------------------------------------------------------------------
+
+bool mesh_3d_static::load_obj(string filename)
+
+{
+  ifstream obj_file(filename.c_str());
+  string line;
+  float obj_line_data[4][3];
+  point_3d helper_point;
+
+  vector<point_3d> normals;
+  vector<point_3d> texture_vertices;
+
+  if (!obj_file.is_open())
+    return false;
+
+  this->clear();
+
+  while (getline(obj_file,line))
+    {
+      switch (line[0])
+        {
+          case 'v':
+            if (line[1] == 'n')        // normal vertex
+              {
+                parse_obj_line(line,obj_line_data);
+
+                helper_point.x = obj_line_data[0][0];
+                helper_point.y = obj_line_data[1][0];
+                helper_point.z = obj_line_data[2][0];
+
+                normals.push_back(helper_point);
+                break;
+              }
+            else if (line[1] == 't')   // texture vertex
+              {
+                parse_obj_line(line,obj_line_data);
+
+                helper_point.x = obj_line_data[0][0];
+                helper_point.y = obj_line_data[1][0];
+                helper_point.z = 0;
+
+                texture_vertices.push_back(helper_point);
+                break;
+              }
+            else                       // position vertex
+              {
+                parse_obj_line(line,obj_line_data);
+                this->add_vertex(obj_line_data[0][0],obj_line_data[1][0],obj_line_data[2][0],0,0,1,0,0);
+                break;
+              }
+
+          case 'f':
+            unsigned int indices[4],i,faces;
+
+            parse_obj_line(line,obj_line_data);
+
+            for (i = 0; i < 4; i++)     // triangle indices
+              indices[i] = floor(obj_line_data[i][0]) - 1;
+
+            if (obj_line_data[3][0] < 0.0)
+              {
+                this->add_triangle(indices[0],indices[1],indices[2]);
+                faces = 3;     // 3 vertex face
+              }
+            else
+              {
+                this->add_triangle(indices[0],indices[1],indices[2]);
+                this->add_triangle(indices[0],indices[2],indices[3]);
+                faces = 4;     // 4 vertex face
+              }
+
+            unsigned int vt_index, vn_index;
+
+            for (i = 0; i < faces; i++)    // texture coordinates and normals
+              {
+                vt_index = floor(obj_line_data[i][1]) - 1;
+                vn_index = floor(obj_line_data[i][2]) - 1;
+
+                if (indices[i] >= this->vertices.size() || vt_index >= texture_vertices.size() ||
+                  vn_index >= normals.size())
+                  continue;
+
+                this->vertices[indices[i]].texture_coordinate[0] = texture_vertices[vt_index].x;
+                this->vertices[indices[i]].texture_coordinate[1] = texture_vertices[vt_index].y;
+
+                this->vertices[indices[i]].normal.x = normals[vn_index].x;
+                this->vertices[indices[i]].normal.y = normals[vn_index].y;
+                this->vertices[indices[i]].normal.z = normals[vn_index].z;
+              }
+
+            break;
+
+          default:
+            break;
+        }
+    }
+
+  obj_file.close();
+
+  this->optimize_vertex_cache();   // updates the mesh
+
+  return true;
+}
+
+//----------------------------------------------------------------------
+
+bool mesh_3d_static::save_obj(string filename)
+
+{
+  unsigned int i;
+
+  FILE *file_handle;
+  file_handle = fopen(filename.c_str(),"wb");
+
+  if (!file_handle)
+    return false;
+
+  for (i = 0; i < this->vertices.size(); i++)
+    {
+      fprintf(file_handle,"v %f %f %f\n",this->vertices[i].position.x,
+        this->vertices[i].position.y,this->vertices[i].position.z);
+    }
+
+  fprintf(file_handle,"\n");
+
+  for (i = 0; i < this->vertices.size(); i++)
+    {
+      fprintf(file_handle,"vt %f %f\n",this->vertices[i].texture_coordinate[0],
+        this->vertices[i].texture_coordinate[1]);
+    }
+
+  fprintf(file_handle,"\n");
+
+  for (i = 0; i < this->vertices.size(); i++)
+    {
+      fprintf(file_handle,"vn %f %f %f\n",this->vertices[i].normal.x,
+        this->vertices[i].normal.y,this->vertices[i].normal.z);
+    }
+
+  fprintf(file_handle,"\n");
+
+  for (i = 0; i < this->triangles.size(); i++)
+    {
+      fprintf(file_handle,"f %d/%d/%d %d/%d/%d %d/%d/%d\n",
+        this->triangles[i].index1 + 1,  // in OBJ indexes begin with 1
+        this->triangles[i].index1 + 1,
+        this->triangles[i].index1 + 1,
+        this->triangles[i].index2 + 1,
+        this->triangles[i].index2 + 1,
+        this->triangles[i].index2 + 1,
+        this->triangles[i].index3 + 1,
+        this->triangles[i].index3 + 1,
+        this->triangles[i].index3 + 1);
+    }
+
+  fclose(file_handle);
+  return true;
+  return true;
+}
+
+//----------------------------------------------------------------------
+
+void camera_struct::set_position(float x, float y, float z)
+
+{
+  if (this->skybox != NULL)
+    skybox->set_position(x,y,z);
+
+  this->position.x = x;
+  this->position.y = y;
+  this->position.z = z;
+
+  make_translation_matrix(-1 * x,-1 * y,-1 * z,camera.translation_matrix);
+
+  global_frame_uniforms.camera_position[0] = x;  // update the camera position in the shader
+  global_frame_uniforms.camera_position[1] = y;
+  global_frame_uniforms.camera_position[2] = z;
+
+  update_view_matrix();
+}
+
+//----------------------------------------------------------------------
+
+void camera_struct::move(float dx, float dy, float dz)
+
+{
+  point_3d current_position;
+
+  this->get_position(&current_position);
+  this->set_position(current_position.x + dx,current_position.y + dy,current_position.z + dz);
+}
+
+//----------------------------------------------------------------------
+
+void camera_struct::rotate(float dx_angles, float dy_angles, float dz_angles)
+
+{
+  point_3d current_rotation;
+
+  this->get_rotation(&current_rotation);
+  this->set_rotation(current_rotation.x + dx_angles,current_rotation.y + dy_angles,current_rotation.z + dz_angles);
+}
+
+//----------------------------------------------------------------------
+
+void camera_struct::get_direction(point_3d *direction)
+
+{
+  direction->x = this->direction_forward_vector.x;
+  direction->y = this->direction_forward_vector.y;
+  direction->z = this->direction_forward_vector.z;
+}
+
+//----------------------------------------------------------------------
+
+void camera_struct::set_rotation(float x, float y, float z)
+
+{
+  this->rotation.x = angle_to_0_360(x);
+  this->rotation.y = angle_to_0_360(y);
+  this->rotation.z = angle_to_0_360(z);
+
+  make_quaternion(this->rotation.x,this->rotation.y,this->rotation.z,ROTATION_YXZ,&this->orientation);
+  this->update_rotation();
+}
+
+//----------------------------------------------------------------------
+
+void camera_struct::set_orientation(quaternion orientation)
+
+{
+  this->orientation = orientation;
+  quaternion_to_euler(orientation,ROTATION_YXZ,&this->rotation);
+  this->update_rotation();
+}
+
+//----------------------------------------------------------------------
+
+void camera_struct::update_rotation()
+
+{
+  make_quaternion_matrix(this->orientation,this->rotation_matrix);
+  update_view_matrix();
+
+  /* The camera vectors are rotated by the inverse rotation, which is the
+     transposed matrix, so they're simply its rows. */
+
+  this->direction_forward_vector.x = this->rotation_matrix[2][0];
+  this->direction_forward_vector.y = this->rotation_matrix[2][1];
+  this->direction_forward_vector.z = this->rotation_matrix[2][2];
+
+  normalize_vector(&this->direction_forward_vector);
+
+  this->direction_left_vector.x = -1 * this->rotation_matrix[0][0];
+  this->direction_left_vector.y = -1 * this->rotation_matrix[0][1];
+  this->direction_left_vector.z = -1 * this->rotation_matrix[0][2];
+
+  this->direction_up_vector.x = this->rotation_matrix[1][0];
+  this->direction_up_vector.y = this->rotation_matrix[1][1];
+  this->direction_up_vector.z = this->rotation_matrix[1][2];
+}
+
+//----------------------------------------------------------------------
+
+void camera_struct::get_position(point_3d *position)
+
+{
+  position->x = this->position.x;
+  position->y = this->position.y;
+  position->z = this->position.z;
+}
+
+//----------------------------------------------------------------------
+
+void camera_struct::get_rotation(point_3d *rotation)
+
+{
+  rotation->x = this->rotation.x;
+  rotation->y = this->rotation.y;
+  rotation->z = this->rotation.z;
+}
+
+//----------------------------------------------------------------------
+
+int get_time()
+
+{
+  return glutGet(GLUT_ELAPSED_TIME);
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::texture_map_plane(axis_direction direction, float plane_width, float plane_height)
+
+{
+  float width,height,depth;
+  float x0,y0,z0,x1,y1,z1;
+
+  if (!this->make_resident())
+    return;
+
+  this->get_bounding_box(&x0,&y0,&z0,&x1,&y1,&z1);
+  width = x0 - x1;
+  width = width < 0 ? -1 * width : width;
+  height = y0 - y1;
+  height = height < 0 ? -1 * height : height;
+  depth = z0 - z1;
+  depth = depth < 0 ? -1 * depth : depth;
+
+  parallel_for(this->vertices.size(),[=](unsigned int from, unsigned int to)
+    {
+      unsigned int i;
+      float u_coordinate,v_coordinate;
+
+      for (i = from; i < to; i++)
+        {
+          switch (direction)
+            {
+              case DIRECTION_LEFT:
+                u_coordinate = ((this->vertices[i].position.z - z0) / depth) * plane_width;
+                v_coordinate = ((this->vertices[i].position.y - y0) / height) * plane_height;
+                break;
+
+              case DIRECTION_RIGHT:
+                u_coordinate = (1.0 - (this->vertices[i].position.z - z0) / depth) * plane_width;
+                v_coordinate = (1.0 - (this->vertices[i].position.y - y0) / height) * plane_height;
+                break;
+
+              case DIRECTION_FORWARD:
+                u_coordinate = ((this->vertices[i].position.x - x0) / width) * plane_width;
+                v_coordinate = ((this->vertices[i].position.y - y0) / height) * plane_height;
+                break;
+
+              case DIRECTION_BACKWARD:
+                u_coordinate = (1.0 - (this->vertices[i].position.x - x0) / width) * plane_width;
+                v_coordinate = (1.0 - (this->vertices[i].position.y - y0) / height) * plane_height;
+                break;
+
+              case DIRECTION_UP:
+                u_coordinate = ((this->vertices[i].position.x - x0) / width) * plane_width;
+                v_coordinate = ((this->vertices[i].position.z - z0) / depth) * plane_height;
+                break;
+
+              case DIRECTION_DOWN:
+              default:
+                u_coordinate = (1.0 - (this->vertices[i].position.x - x0) / width) * plane_width;
+                v_coordinate = (1.0 - (this->vertices[i].position.z - z0) / depth) * plane_height;
+                break;
+            }
+
+          this->vertices[i].texture_coordinate[0] = u_coordinate;
+          this->vertices[i].texture_coordinate[1] = v_coordinate;
+        }
+    });
+
+  this->update();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::texture_map_layer_mask(texture_2d *mask)
+
+{
+  float width,depth;
+  float x0,y0,z0,x1,y1,z1;
+
+  if (!this->make_resident() || !mask->make_resident())   // reload released data here, not lazily in the workers
+    return;
+
+  this->get_bounding_box(&x0,&y0,&z0,&x1,&y1,&z1);
+  width = x0 - x1;
+  width = width < 0 ? -1 * width : width;
+  depth = z0 - z1;
+  depth = depth < 0 ? -1 * depth : depth;
+
+  parallel_for(this->vertices.size(),[=](unsigned int from, unsigned int to)
+    {
+      unsigned int i;
+      unsigned int x,y;
+      unsigned char r,g,b;
+
+      for (i = from; i < to; i++)
+        {
+          x = (1.0 - (this->vertices[i].position.x - x0) / width) * (mask->get_width() - 1);
+          y = (1.0 - (this->vertices[i].position.z - z0) / depth) * (mask->get_height() - 1);
+
+          mask->get_pixel(x,y,&r,&g,&b);
+
+          this->vertices[i].texture_blend_ratio = r / 255.0;
+        }
+    });
+
+  this->update();
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::flip_vertical()
+
+{
+  unsigned int i,j;
+  unsigned char r1,g1,b1,r2,g2,b2;
+
+  if (!this->make_resident())
+    return;
+
+  for (j = 0; j < this->height / 2; j++)
+    for (i = 0; i < this->width; i++)
+      {
+        this->get_pixel(i,j,&r1,&g1,&b1);
+        this->get_pixel(i,this->height - j - 1,&r2,&g2,&b2);
+        this->set_pixel(i,j,r2,g2,b2);
+        this->set_pixel(i,this->height - j - 1,r1,g1,b1);
+      }
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::get_position(point_3d *point)
+
+{
+  point->x = this->position.x;
+  point->y = this->position.y;
+  point->z = this->position.z;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::get_rotation(point_3d *point)
+
+{
+  if (!this->rotation_up_to_date)
+    {
+      quaternion_to_euler(this->orientation,ROTATION_ZXY,&this->rotation);
+      this->rotation_up_to_date = true;
+    }
+
+  point->x = this->rotation.x;
+  point->y = this->rotation.y;
+  point->z = this->rotation.z;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::set_position(float x, float y, float z)
+
+{
+  this->position.x = x;
+  this->position.y = y;
+  this->position.z = z;
+
+  this->transformation_up_to_date = false;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::set_parent_node(scene_node *node)
+
+{
+  this->parent_node = node;
+}
+
+//----------------------------------------------------------------------
+
+scene_node *mesh_3d::get_parent_node()
+
+{
+  return this->parent_node;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::clear()
+
+{
+  this->unload();
+  this->vertices.clear();
+  this->triangles.clear();
+  this->data_discarded = false;
+  this->discarded_vertex_count = 0;
+  this->discarded_triangle_count = 0;
+  this->update_memory_usage();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::make_instance_of(mesh_3d_static *what)
+
+{
+  GLuint what_vbo,what_ibo,what_vao;
+  this->clear();
+  what->get_vbo_ibo_vao(&what_vbo,&what_ibo,&what_vao);
+  this->vbo = what_vbo;
+  this->ibo = what_ibo;
+  this->instance_parent = what;
+  this->update();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::set_rotation(float x, float y, float z)
+
+{
+  this->rotation.x = angle_to_0_360(x);
+  this->rotation.y = angle_to_0_360(y);
+  this->rotation.z = angle_to_0_360(z);
+
+  make_quaternion(this->rotation.x,this->rotation.y,this->rotation.z,ROTATION_ZXY,&this->orientation);
+
+  this->rotation_up_to_date = true;
+  this->transformation_up_to_date = false;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::set_orientation(quaternion orientation)
+
+{
+  this->orientation = orientation;
+  this->rotation_up_to_date = false;
+  this->transformation_up_to_date = false;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::get_orientation(quaternion *orientation)
+
+{
+  *orientation = this->orientation;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::rotate(quaternion rotation)
+
+{
+  multiply_quaternions(rotation,this->orientation,&this->orientation);
+  normalize_quaternion(&this->orientation);     // keep the rounding errors from accumulating
+  this->rotation_up_to_date = false;
+  this->transformation_up_to_date = false;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::get_transformation_matrix(float matrix[4][4])
+
+{
+  if (!this->transformation_up_to_date)
+    this->update_transformation_matrix();
+
+  memcpy(matrix,this->transformation_matrix,sizeof(this->transformation_matrix));
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::set_scale(float x, float y, float z)
+
+{
+  this->scale.x = x;
+  this->scale.y = y;
+  this->scale.z = z;
+
+  this->transformation_up_to_date = false;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::scale_to_size(float size,bool apply_matrix)
+
+{
+  float width,height,depth,scale,maximum_size;
+  float scale_matrix[4][4];
+
+  if (!this->make_resident())
+    return;
+
+  this->get_size(&width,&height,&depth);
+
+  maximum_size = width > height ? (width > depth ? width : depth) : (height > depth ? height : depth);
+  scale = size / maximum_size;
+
+  if (apply_matrix)
+    {
+      make_scale_matrix(scale,scale,scale,scale_matrix);
+      this->apply_matrix(scale_matrix);
+    }
+  else
+    this->set_scale(scale);
+}
+
+//----------------------------------------------------------------------
+
+void register_keyboard_function(void (*function)(int key, int x, int y))
+
+{
+  user_keyboard_function = function;
+}
+
+//----------------------------------------------------------------------
+
+void register_advanced_keyboard_function(void (*function)(bool key_up, int key, int x, int y))
+
+{
+  user_advanced_keyboard_function = function;
+}
+
+//----------------------------------------------------------------------
+
+void set_mouse_position(unsigned int x, unsigned int y)
+
+{
+  glutWarpPointer(x,y);
+}
+
+//----------------------------------------------------------------------
+
+void set_perspective(float fov_degrees, float near_plane, float far_plane)
+
+{
+  float matrix[4][4];
+
+  global_fov = fov_degrees;
+  global_near = near_plane;
+  global_far = far_plane;
+
+  make_perspective_matrix(fov_degrees,near_plane,far_plane,matrix);
+  memcpy(global_frame_uniforms.perspective_matrix,matrix,sizeof(global_frame_uniforms.perspective_matrix));
+  global_frame_uniforms.far_plane = far_plane;
+
+  set_fog(global_fog_distance);        // fog uniform must be also updated
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::make_compact_vertices(vector<vertex_3d_compact> &compact_vertices)
+
+{
+  float x0,y0,z0,x1,y1,z1;
+  unsigned int i;
+
+  compact_vertices.resize(this->vertices.size());
+
+  if (this->vertices.size() == 0)
+    return;
+
+  this->get_bounding_box(&x0,&y0,&z0,&x1,&y1,&z1);
+
+  this->position_offset.x = x0;
+  this->position_offset.y = y0;
+  this->position_offset.z = z0;
+  this->position_scale.x = x1 - x0 > 0 ? x1 - x0 : 1.0;    // flat meshes
+  this->position_scale.y = y1 - y0 > 0 ? y1 - y0 : 1.0;
+  this->position_scale.z = z1 - z0 > 0 ? z1 - z0 : 1.0;
+
+  this->compact_uv_half = false;
+
+  for (i = 0; i < this->vertices.size(); i++)   // unsigned normalized texture coordinates are more precise but only cover <0,1>
+    if (this->vertices[i].texture_coordinate[0] < 0 || this->vertices[i].texture_coordinate[0] > 1 ||
+        this->vertices[i].texture_coordinate[1] < 0 || this->vertices[i].texture_coordinate[1] > 1)
+      {
+        this->compact_uv_half = true;
+        break;
+      }
+
+  parallel_for(this->vertices.size(),[this,&compact_vertices](unsigned int from, unsigned int to)
+    {
+      unsigned int i;
+      vertex_3d *vertex;
+      vertex_3d_compact *compact_vertex;
+
+      for (i = from; i < to; i++)
+        {
+          vertex = &this->vertices[i];
+          compact_vertex = &compact_vertices[i];
+
+          compact_vertex->position[0] = quantize_unorm16((vertex->position.x - this->position_offset.x) / this->position_scale.x);
+          compact_vertex->position[1] = quantize_unorm16((vertex->position.y - this->position_offset.y) / this->position_scale.y);
+          compact_vertex->position[2] = quantize_unorm16((vertex->position.z - this->position_offset.z) / this->position_scale.z);
+          compact_vertex->texture_blend_ratio = (unsigned char) (clamp(vertex->texture_blend_ratio,0.0,1.0) * 255.0 + 0.5);
+          compact_vertex->padding = 0;
+
+          if (this->compact_uv_half)
+            {
+              compact_vertex->texture_coordinate[0] = float_to_half(vertex->texture_coordinate[0]);
+              compact_vertex->texture_coordinate[1] = float_to_half(vertex->texture_coordinate[1]);
+            }
+          else
+            {
+              compact_vertex->texture_coordinate[0] = quantize_unorm16(vertex->texture_coordinate[0]);
+              compact_vertex->texture_coordinate[1] = quantize_unorm16(vertex->texture_coordinate[1]);
+            }
+
+          compact_vertex->normal = pack_normal(vertex->normal);
+        }
+    });
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::set_vertex_format(vertex_format format)
+
+{
+  this->format = format;
+}
+
+//----------------------------------------------------------------------
+
+GLenum mesh_3d_static::get_index_type()
+
+{
+  return this->index_type;
+}
+
+//----------------------------------------------------------------------
+
+vertex_format mesh_3d_static::get_vertex_format()
+
+{
+  return this->format;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::get_position_dequantization(point_3d *offset, point_3d *scale)
+
+{
+  *offset = this->position_offset;
+  *scale = this->position_scale;
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d_static *mesh_3d_static::get_instance_parent()
+
+{
+  return this->instance_parent;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::get_vbo_ibo_vao(GLuint *vbo, GLuint *ibo, GLuint *vao)
+
+{
+  *vbo = this->vbo;
+  *ibo = this->ibo;
+  *vao = this->vao;
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d::mesh_3d()
+
+{
+  this->texture = NULL;
+  this->texture2 = NULL;
+  this->visible = true;
+
+  this->set_color(255,255,255);
+
+  this->set_lighting_properties(0.2,0.5,0.8,100);
+
+  this->set_position(0,0,0);
+  this->set_rotation(0,0,0);
+  this->set_scale(1,1,1);
+  this->set_render_mode(RENDER_MODE_SHADED_GORAUD);
+  this->use_fog = true;
+  this->parent_node = NULL;
+  this->material_index = -1;
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d_static::mesh_3d_static(): mesh_3d()
+
+{
+  this->vbo = 0;
+  this->ibo = 0;
+  this->vao = 0;
+  this->instance_parent = NULL;
+  this->residency = RESIDENCY_KEEP;
+  this->data_discarded = false;
+  this->discarded_vertex_count = 0;
+  this->discarded_triangle_count = 0;
+  this->residency_hash = 0;
+  this->index_type = GL_UNSIGNED_INT;
+  this->meshlet_triangle_count = 0;
+  this->culled_triangles = 0;
+  this->arena = NULL;
+  this->arena_handle = -1;
+  this->format = VERTEX_FORMAT_FLOAT;
+  this->compact_uv_half = false;
+  this->position_offset.x = 0;
+  this->position_offset.y = 0;
+  this->position_offset.z = 0;
+  this->position_scale.x = 1;
+  this->position_scale.y = 1;
+  this->position_scale.z = 1;
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d_static::mesh_3d_static(mesh_3d_static *copy_from): mesh_3d()
+
+{
+  unsigned int i;
+
+  this->vbo = 0;
+  this->ibo = 0;
+  this->vao = 0;
+  this->instance_parent = NULL;
+  this->residency = RESIDENCY_KEEP;
+  this->data_discarded = false;
+  this->discarded_vertex_count = 0;
+  this->discarded_triangle_count = 0;
+  this->residency_hash = 0;
+  this->index_type = GL_UNSIGNED_INT;
+  this->meshlet_triangle_count = 0;
+  this->culled_triangles = 0;
+  this->arena = NULL;
+  this->arena_handle = -1;
+  this->format = VERTEX_FORMAT_FLOAT;
+  this->compact_uv_half = false;
+  this->position_offset.x = 0;
+  this->position_offset.y = 0;
+  this->position_offset.z = 0;
+  this->position_scale.x = 1;
+  this->position_scale.y = 1;
+  this->position_scale.z = 1;
+
+  this->texture = copy_from->get_texture();
+  this->set_render_mode(copy_from->get_render_mode());
+
+  if (!copy_from->make_resident())      // the copy stays empty
+    return;
+
+  for (i = 0; i < copy_from->vertex_count(); i++)
+    this->add_vertex(
+      copy_from->vertices[i].position.x,
+      copy_from->vertices[i].position.y,
+      copy_from->vertices[i].position.z,
+      copy_from->vertices[i].texture_coordinate[0],
+      copy_from->vertices[i].texture_coordinate[1],
+      copy_from->vertices[i].normal.x,
+      copy_from->vertices[i].normal.y,
+      copy_from->vertices[i].normal.z);
+
+  for (i = 0; i < copy_from->triangle_count(); i++)
+    this->add_triangle(
+      copy_from->triangles[i].index1,
+      copy_from->triangles[i].index2,
+      copy_from->triangles[i].index3);
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::get_scale(point_3d *scale)
+
+{
+  scale->x = this->scale.x;
+  scale->y = this->scale.y;
+  scale->z = this->scale.z;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::set_texture(texture_2d *texture)
+
+{
+  this->texture = texture;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::add_shadow(float x, float y, float radius, float brightness)
+
+{
+  shadow new_shadow;
+
+  new_shadow.position[0] = x;
+  new_shadow.position[1] = y;
+  new_shadow.radius = radius;
+  new_shadow.brightness = brightness;
+
+  this->shadows.push_back(new_shadow);
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::set_texture2(texture_2d *texture)
+
+{
+  this->texture2 = texture;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::update()
+
+{
+  if (!this->make_resident())       // discarded data can't be uploaded again, the GPU buffers are kept
+    return;
+
+  this->upload_buffers();
+  this->release_data();
+  this->update_memory_usage();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::release_data()
+
+{
+  unsigned long long hash;
+
+  if (this->residency == RESIDENCY_KEEP || this->instance_parent != NULL || this->data_discarded || this->vertices.size() == 0)
+    return;
+
+  if (this->residency == RESIDENCY_RELOAD)
+    {
+      hash = hash_data(&this->vertices[0],this->vertices.size() * sizeof(vertex_3d)) ^
+        hash_data(this->triangles.data(),this->triangles.size() * sizeof(triangle_3d));
+
+      if (hash != this->residency_hash)          // unchanged data are already in the cache
+        {
+          if (!write_cache_file(cache_file_name("mesh",hash),hash,
+            &this->vertices[0],this->vertices.size() * sizeof(vertex_3d),this->triangles.data(),this->triangles.size() * sizeof(triangle_3d)))
+            return;                   // the data stay in memory if they can't be cached
+
+          if (this->residency_hash != 0)         // the previous version isn't needed any more
+            reference_residency_file(cache_file_name("mesh",this->residency_hash),-1);
+
+          reference_residency_file(cache_file_name("mesh",hash),1);
+          this->residency_hash = hash;
+        }
+    }
+  else if (this->residency_hash != 0)            // the cached copy would be out of date
+    {
+      reference_residency_file(cache_file_name("mesh",this->residency_hash),-1);
+      this->residency_hash = 0;
+    }
+
+  this->discarded_vertex_count = this->vertices.size();
+  this->discarded_triangle_count = this->triangles.size();
+  vector<vertex_3d>().swap(this->vertices);      // clear() would keep the capacity
+  vector<triangle_3d>().swap(this->triangles);
+  this->data_discarded = true;
+}
+
+//----------------------------------------------------------------------
+
+bool mesh_3d_static::make_resident()
+
+{
+  if (!this->data_discarded)
+    return true;
+
+  if (this->residency_hash != 0)       // released with RESIDENCY_RELOAD, even if the policy has been changed since
+    {
+      this->vertices.resize(this->discarded_vertex_count);
+      this->triangles.resize(this->discarded_triangle_count);
+
+      if (read_cache_file(cache_file_name("mesh",this->residency_hash),this->residency_hash,
+        &this->vertices[0],this->vertices.size() * sizeof(vertex_3d),this->triangles.data(),this->triangles.size() * sizeof(triangle_3d)))
+        {
+          this->data_discarded = false;
+          this->update_memory_usage();
+          return true;
+        }
+
+      vector<vertex_3d>().swap(this->vertices);
+      vector<triangle_3d>().swap(this->triangles);
+    }
+
+  cerr << "ERROR: the mesh data have been discarded after upload." << endl;
+  return false;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::set_residency(residency_policy policy)
+
+{
+  this->residency = policy;
+}
+
+//----------------------------------------------------------------------
+
+residency_policy mesh_3d_static::get_residency()
+
+{
+  return this->residency;
+}
+
+//----------------------------------------------------------------------
+
+unsigned int mesh_3d_static::get_cpu_memory_size()
+
+{
+  return this->vertices.capacity() * sizeof(vertex_3d) + this->triangles.capacity() * sizeof(triangle_3d);
+}
+
+//----------------------------------------------------------------------
+
+unsigned int mesh_3d_static::get_gpu_memory_size()
+
+{
+  if (this->instance_parent != NULL)
+    return 0;
+
+  if (this->arena_handle >= 0)
+    return this->vertex_count() * sizeof(vertex_3d) + this->triangle_count() * 3 * sizeof(unsigned short);
+
+  if (this->vbo == 0)
+    return 0;
+
+  return this->vertex_count() * (this->format == VERTEX_FORMAT_COMPACT ? sizeof(vertex_3d_compact) : sizeof(vertex_3d)) +
+    this->triangle_count() * 3 * (this->index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int));
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::update_memory_usage()
+
+{
+  set_memory_usage(this,MEMORY_MESHES,this->get_cpu_memory_size(),
+    this->arena_handle >= 0 ? 0 : this->get_gpu_memory_size());   // the arena reports its buffers
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::upload_buffers()
+
+{
+  if (this->arena != NULL && this->instance_parent == NULL &&
+      this->format == VERTEX_FORMAT_FLOAT && this->vertices.size() <= 65536)
+    {
+      if (this->vao != 0)               // the mesh had its own buffers before
+        {
+          delete_vertex_array(this->vao);
+          glDeleteBuffers(1,&this->vbo);
+          glDeleteBuffers(1,&this->ibo);
+          this->vao = 0;
+          this->vbo = 0;
+          this->ibo = 0;
+        }
+
+      if (this->arena_handle >= 0)  // reuse the allocation if it has the right size
+        {
+          arena_allocation allocation = this->arena->get_allocation(this->arena_handle);
+
+          if (allocation.vertices.size != this->vertices.size() || allocation.indices.size != this->triangles.size() * 3)
+            this->release_arena_allocation();
+        }
+
+      if (this->arena_handle < 0)
+        this->arena_handle = this->arena->allocate(this->vertices.size(),this->triangles.size() * 3);
+
+      this->arena->upload(this->arena_handle,this->vertices,this->triangles);
+
+      this->index_type = GL_UNSIGNED_SHORT;
+      this->position_offset.x = 0;
+      this->position_offset.y = 0;
+      this->position_offset.z = 0;
+      this->position_scale.x = 1;
+      this->position_scale.y = 1;
+      this->position_scale.z = 1;
+      return;
+    }
+
+  this->release_arena_allocation();
+
+  if (this->instance_parent != NULL && this->instance_parent->arena_handle >= 0)
+    {                                   // drawn from the parent's arena, no own VAO needed
+      this->format = this->instance_parent->format;
+      this->index_type = this->instance_parent->index_type;
+      this->position_offset = this->instance_parent->position_offset;
+      this->position_scale = this->instance_parent->position_scale;
+      return;
+    }
+
+  if (this->vao == 0)
+    glGenVertexArrays(1,&this->vao);
+
+  if (this->vao == 0)
+    cerr << "ERROR: VAO couldn't be allocated for the mesh.";
+
+  bind_vertex_array(this->vao);
+
+  if (this->vbo == 0)
+    glGenBuffers(1,&this->vbo);
+
+  if (this->vbo == 0)
+    cerr << "ERROR: VBO couldn't be allocated for the mesh.";
+
+  glBindBuffer(GL_ARRAY_BUFFER,this->vbo);
+
+  if (this->instance_parent == NULL)
+    {
+      if (this->format == VERTEX_FORMAT_COMPACT)
+        {
+          vector<vertex_3d_compact> compact_vertices;
+          this->make_compact_vertices(compact_vertices);
+          glBufferData(GL_ARRAY_BUFFER,compact_vertices.size() * sizeof(vertex_3d_compact),&compact_vertices[0],GL_STATIC_DRAW);
+        }
+      else
+        {
+          this->position_offset.x = 0;
+          this->position_offset.y = 0;
+          this->position_offset.z = 0;
+          this->position_scale.x = 1;
+          this->position_scale.y = 1;
+          this->position_scale.z = 1;
+          glBufferData(GL_ARRAY_BUFFER,this->vertices.size() * sizeof(vertex_3d),&this->vertices[0],GL_STATIC_DRAW);
+        }
+    }
+  else     // the instance shares the parent's data
+    {
+      this->format = this->instance_parent->format;
+      this->compact_uv_half = this->instance_parent->compact_uv_half;
+      this->position_offset = this->instance_parent->position_offset;
+      this->position_scale = this->instance_parent->position_scale;
+    }
+
+  if (this->ibo == 0)
+    glGenBuffers(1,&this->ibo);
+
+  if (this->ibo == 0)
+    cerr << "ERROR: IBO couldn't be allocated for the mesh.";
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,this->ibo);
+
+  if (this->instance_parent == NULL)
+    this->index_type = upload_indices(this->triangles,this->vertices.size());
+  else
+    this->index_type = this->instance_parent->index_type;
+
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  glEnableVertexAttribArray(3);
+
+  if (this->format == VERTEX_FORMAT_COMPACT)
+    {
+      glVertexAttribPointer(0,3,GL_UNSIGNED_SHORT,GL_TRUE,sizeof(vertex_3d_compact),0);                 // position
+      glVertexAttribPointer(1,2,this->compact_uv_half ? GL_HALF_FLOAT : GL_UNSIGNED_SHORT,this->compact_uv_half ? GL_FALSE : GL_TRUE,sizeof(vertex_3d_compact),(const GLvoid*) 8);  // texture coordinate
+      glVertexAttribPointer(2,4,GL_INT_2_10_10_10_REV,GL_TRUE,sizeof(vertex_3d_compact),(const GLvoid*) 12); // normal
+      glVertexAttribPointer(3,1,GL_UNSIGNED_BYTE,GL_TRUE,sizeof(vertex_3d_compact),(const GLvoid*) 6);  // texture blend ratio
+    }
+  else
+    {
+      glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),0);                   // position
+      glVertexAttribPointer(1,2,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 12);  // texture coordinate
+      glVertexAttribPointer(2,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 20);  // normal
+      glVertexAttribPointer(3,1,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 32);  // texture blend ratio
+    }
+
+  bind_vertex_array(0);   // unbind the meshe's VAO
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::unload()
+
+{
+  if (this->instance_parent == NULL)
+    {
+      if (this->vao != 0)
+        delete_vertex_array(this->vao);
+
+      if (this->vbo != 0)
+        glDeleteBuffers(1,&this->vbo);
+
+      if (this->ibo != 0)
+        glDeleteBuffers(1,&this->ibo);
+
+      this->release_arena_allocation();
+    }
+  else if (this->vao != 0)                 // the instance's own VAO
+    delete_vertex_array(this->vao);
+
+  this->vao = 0;
+  this->vbo = 0;
+  this->ibo = 0;
+  this->update_memory_usage();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_animated::unload()
+
+{
+  if (this->instance_parent == NULL)
+    {
+      if (this->vbo != 0)
+        glDeleteBuffers(1,&this->vbo);
+
+      if (this->ibo != 0)
+        glDeleteBuffers(1,&this->ibo);
+    }
+
+  this->vbo = 0;
+  this->ibo = 0;
+  this->frame_vertex_count = 0;
+  this->uploaded_frame_count = 0;
+  this->frame_triangle_count = 0;
+  this->frames_changed = true;
+  this->update_memory_usage();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::set_color(unsigned char red, unsigned char green, unsigned char blue)
+
+{
+  this->color[0] = red;
+  this->color[1] = green;
+  this->color[2] = blue;
+
+  this->color_float[0] = this->color[0] / 255.0f;
+  this->color_float[1] = this->color[1] / 255.0f;
+  this->color_float[2] = this->color[2] / 255.0f;
+}
+
+//----------------------------------------------------------------------
+
+void camera_struct::handle_fps()
+
+{
+  float distance_to_go, angle_to_rotate;
+  int time_difference;
+
+  if (user_advanced_keyboard_function == NULL)    // this function must be registered
+    return;
+
+  time_difference = get_frame_time_difference();
+
+  distance_to_go = time_difference * camera.movement_speed;
+  angle_to_rotate = time_difference * camera.rotation_speed;
+
+  if (global_keyboard_state[camera.key_go_forward])
+    this->go(DIRECTION_FORWARD,distance_to_go);
+  else if (global_keyboard_state[camera.key_go_backward])
+    this->go(DIRECTION_BACKWARD,distance_to_go);
+
+  if (global_keyboard_state[camera.key_go_left])
+    this->go(DIRECTION_LEFT,distance_to_go);
+  else if (global_keyboard_state[camera.key_go_right])
+    this->go(DIRECTION_RIGHT,distance_to_go);
+
+  if (global_keyboard_state[camera.key_go_up])
+    this->go(DIRECTION_UP,distance_to_go);
+  else if (global_keyboard_state[camera.key_go_down])
+    this->go(DIRECTION_DOWN,distance_to_go);
+
+  if (use_mouse_for_rotation)
+    {
+      int mouse_dx = global_window_center[0] - global_mouse_position[0];
+      int mouse_dy = global_window_center[1] - global_mouse_position[1];
+
+      if (global_ignore_mouse_position)  // in first call the mouse position is ignored
+        {
+          mouse_dx = 0;
+          mouse_dy = 0;
+          global_ignore_mouse_position = false;
+        }
+
+      set_mouse_position(global_window_center[0],global_window_center[1]);
+
+      this->rotate(-1 * angle_to_rotate * mouse_dy,-1 * angle_to_rotate * mouse_dx,0);
+    }
+  else
+    {
+      if (global_keyboard_state[camera.key_rotate_x_cw])
+        this->rotate(-1 *angle_to_rotate,0,0);
+      else if (global_keyboard_state[camera.key_rotate_x_ccw])
+        this->rotate(angle_to_rotate,0,0);
+
+      if (global_keyboard_state[camera.key_rotate_y_cw])
+        this->rotate(0,angle_to_rotate,0);
+      else if (global_keyboard_state[camera.key_rotate_y_ccw])
+        this->rotate(0,-1 * angle_to_rotate,0);
+
+      if (global_keyboard_state[camera.key_rotate_z_cw])
+        this->rotate(0,0,angle_to_rotate);
+      else if (global_keyboard_state[camera.key_rotate_z_ccw])
+        this->rotate(0,0,-1 * angle_to_rotate);
+    }
+
+  if (this->limit_x_rotation)
+    {
+      point_3d camera_rotation;
+      this->get_rotation(&camera_rotation);
+
+      if (camera_rotation.x < 270.0 && camera_rotation.x > 180.0)
+        this->set_rotation(270.0,camera_rotation.y,camera_rotation.z);
+      else if (camera_rotation.x > 90 && camera_rotation.x < 270.0)
+        this->set_rotation(90.0,camera_rotation.y,camera_rotation.z);
+    }
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::draw()
+
+{
+  if (!this->visible)
+    return;
+
+  this->init_rendering();
+  this->upload_position_dequantization();
+
+  if (this->get_meshlet_count() != 0)
+    {
+      this->cull_meshlets();
+      this->draw_index_ranges(this->visible_counts,this->visible_offsets);
+      return;
+    }
+
+  this->draw_geometry();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::draw_geometry()
+
+{
+  mesh_3d_static *source = this->instance_parent != NULL ? this->instance_parent : this;
+
+  if (source->arena_handle >= 0)
+    {
+      arena_allocation allocation = source->arena->get_allocation(source->arena_handle);
+
+      bind_vertex_array(source->arena->get_vao());  // stays bound, so consecutive arena meshes don't switch VAOs
+      glDrawElementsBaseVertex(GL_TRIANGLES,this->triangle_count() * 3,GL_UNSIGNED_SHORT,
+        (const GLvoid *) (((const char *) 0) + allocation.indices.offset * sizeof(unsigned short)),allocation.vertices.offset);
+      return;
+    }
+
+  bind_vertex_array(this->vao);
+  glDrawElements(GL_TRIANGLES,this->triangle_count() * 3,this->index_type,0);
+  bind_vertex_array(0);
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::set_buffer_arena(buffer_arena *arena)
+
+{
+  if (arena != this->arena)
+    this->release_arena_allocation();
+
+  this->arena = arena;
+}
+
+//----------------------------------------------------------------------
+
+buffer_arena *mesh_3d_static::get_buffer_arena()
+
+{
+  return this->arena;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::release_arena_allocation()
+
+{
+  if (this->arena_handle >= 0 && this->instance_parent == NULL)
+    this->arena->free(this->arena_handle);
+
+  this->arena_handle = -1;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::set_use_fog(bool enable)
+
+{
+  this->use_fog = enable;
+}
+
+//----------------------------------------------------------------------
+
+bool mesh_3d::has_same_material(mesh_3d *mesh)
+
+{
+  return
+    this->texture == mesh->texture &&
+    this->texture2 == mesh->texture2 &&
+    this->mesh_render_mode == mesh->mesh_render_mode &&
+    this->use_fog == mesh->use_fog &&
+    this->color[0] == mesh->color[0] &&
+    this->color[1] == mesh->color[1] &&
+    this->color[2] == mesh->color[2] &&
+    this->material_ambient_intensity == mesh->material_ambient_intensity &&
+    this->material_diffuse_intensity == mesh->material_diffuse_intensity &&
+    this->material_specular_intensity == mesh->material_specular_intensity &&
+    this->material_specular_exponent == mesh->material_specular_exponent;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::copy_material(mesh_3d *mesh)
+
+{
+  this->texture = mesh->texture;
+  this->texture2 = mesh->texture2;
+  this->mesh_render_mode = mesh->mesh_render_mode;
+  this->use_fog = mesh->use_fog;
+  this->set_color(mesh->color[0],mesh->color[1],mesh->color[2]);
+  this->material_ambient_intensity = mesh->material_ambient_intensity;
+  this->material_diffuse_intensity = mesh->material_diffuse_intensity;
+  this->material_specular_intensity = mesh->material_specular_intensity;
+  this->material_specular_exponent = mesh->material_specular_exponent;
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::set_pixel(int x, int y, unsigned char red, unsigned char green, unsigned char blue)
+
+{
+  unsigned int index;
+
+  if (x < 0 || x >= (int) this->width || y < 0 || y >= (int) this->height)
+    return;
+
+  if (this->data == NULL && !this->make_resident())
+    return;
+
+  index = this->xy_to_linear(x,y);
+
+  this->data[index] = red;
+  this->data[index + 1] = green;
+  this->data[index + 2] = blue;
+}
+
+//----------------------------------------------------------------------
+
+void set_fog(float distance)
+
+{
+  float fog_distance_for_shader;   // distance from the viewer and normalized
+  global_fog_distance = distance;
+  fog_distance_for_shader = (global_far - distance) / global_far;
+
+  if (distance <= 0.0)
+    fog_distance_for_shader = -1.0;   // disables the fog
+
+  global_frame_uniforms.fog_distance = fog_distance_for_shader;
+  global_frame_uniforms_changed = true;
+}
+
+//----------------------------------------------------------------------
+
+unsigned int mesh_3d_static::vertex_count()
+
+{
+  if (this->instance_parent != NULL)
+    return this->instance_parent->vertex_count();
+
+  return this->data_discarded ? this->discarded_vertex_count : this->vertices.size();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::remove_useless_triangles()
+
+{
+  unsigned int i;
+
+  if (!this->make_resident())
+    return;
+
+  for (i = 0; i < this->triangles.size(); i++)
+    if (this->triangles[i].index1 == this->triangles[i].index2 ||
+        this->triangles[i].index1 == this->triangles[i].index3 ||
+        this->triangles[i].index2 == this->triangles[i].index3)
+      {
+        this->triangles.erase(this->triangles.begin() + i);
+        i--;
+      }
+}
+
+//----------------------------------------------------------------------
+
+unsigned int mesh_3d_static::triangle_count()
+
+{
+  if (this->instance_parent != NULL)
+    return this->instance_parent->triangle_count();
+
+  return this->data_discarded ? this->discarded_triangle_count : this->triangles.size();
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::get_pixel(int x, int y, unsigned char *red, unsigned char *green, unsigned char *blue)
+
+{
+  unsigned int index;
+
+  if (x < 0 || x >= (int) this->width || y < 0 || y >= (int) this->height ||
+      (this->data == NULL && !this->make_resident()))
+    {
+      *red = 0;
+      *green = 0;
+      *blue = 0;
+      return;
+    }
+
+  index = this->xy_to_linear(x,y);
+
+  *red = this->data[index];
+  *green = this->data[index + 1];
+  *blue = this->data[index + 2];
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::flip_triangles()
+
+{
+  unsigned int i, helper_index;
+
+  if (!this->make_resident())
+    return;
+
+  for (i = 0; i < this->vertices.size(); i++)
+    {
+      this->vertices[i].normal.x *= -1;
+      this->vertices[i].normal.y *= -1;
+      this->vertices[i].normal.z *= -1;
+    }
+
+  for (i = 0; i < this->triangles.size(); i++)   // change the clockwiseness of each triangle
+    {
+      helper_index = this->triangles[i].index1;
+      this->triangles[i].index1 = this->triangles[i].index2;
+      this->triangles[i].index2 = helper_index;
+    }
+
+  this->update();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::optimize_vertex_cache()
+
+{
+  if (!this->make_resident())
+    return;
+
+  unsigned int i,j,k;
+  unsigned int number_of_vertices = this->vertices.size();
+  unsigned int number_of_triangles = this->triangles.size();
+
+  if (number_of_triangles == 0)
+    return;
+
+  vector<unsigned int> indices(number_of_triangles * 3);
+
+  for (i = 0; i < number_of_triangles; i++)
+    {
+      indices[i * 3] = this->triangles[i].index1;
+      indices[i * 3 + 1] = this->triangles[i].index2;
+      indices[i * 3 + 2] = this->triangles[i].index3;
+    }
+
+  for (i = 0; i < indices.size(); i++)
+    if (indices[i] >= number_of_vertices)
+      {
+        cerr << "ERROR: triangle index out of range, vertex cache optimisation skipped." << endl;
+        return;
+      }
+
+  // vertex -> triangles adjacency:
+
+  vector<unsigned int> adjacency_offsets(number_of_vertices + 1,0);
+  vector<unsigned int> adjacency(indices.size());
+  vector<unsigned int> live_triangles(number_of_vertices,0);  // not yet emitted triangles using the vertex
+
+  for (i = 0; i < indices.size(); i++)
+    live_triangles[indices[i]]++;
+
+  for (i = 0; i < number_of_vertices; i++)
+    adjacency_offsets[i + 1] = adjacency_offsets[i] + live_triangles[i];
+
+  vector<unsigned int> fill(adjacency_offsets.begin(),adjacency_offsets.end() - 1);
+
+  for (i = 0; i < indices.size(); i++)
+    adjacency[fill[indices[i]]++] = i / 3;
+
+  // scores (see Tom Forsyth: Linear-Speed Vertex Cache Optimisation):
+
+  float cache_scores[VERTEX_CACHE_SIZE];
+  float valence_scores[64];
+
+  for (i = 0; i < VERTEX_CACHE_SIZE; i++)
+    cache_scores[i] = i < 3 ? 0.75 :   // the last triangle's vertices, fixed score so that strips aren't preferred
+      pow(1.0 - (i - 3) / ((float) (VERTEX_CACHE_SIZE - 3)),1.5);
+
+  for (i = 0; i < 64; i++)
+    valence_scores[i] = i == 0 ? 0.0 : 2.0 / sqrt((float) i);  // boost vertices with few triangles left
+
+  vector<int> cache_positions(number_of_vertices,-1);
+  vector<float> vertex_scores(number_of_vertices);
+  vector<float> triangle_scores(number_of_triangles,0.0);
+  vector<bool> emitted(number_of_triangles,false);
+
+  auto vertex_score = [&](unsigned int vertex)
+    {
+      float result;
+
+      if (live_triangles[vertex] == 0)
+        return -1.0f;
+
+      result = cache_positions[vertex] < 0 ? 0.0f : cache_scores[cache_positions[vertex]];
+      return result + (live_triangles[vertex] < 64 ? valence_scores[live_triangles[vertex]] : 2.0f / sqrt((float) live_triangles[vertex]));
+    };
+
+  for (i = 0; i < number_of_vertices; i++)
+    vertex_scores[i] = vertex_score(i);
+
+  for (i = 0; i < number_of_triangles; i++)
+    triangle_scores[i] = vertex_scores[indices[i * 3]] + vertex_scores[indices[i * 3 + 1]] + vertex_scores[indices[i * 3 + 2]];
+
+  vector<unsigned int> new_indices;
+  unsigned int cache[VERTEX_CACHE_SIZE + 3];
+  unsigned int new_cache[VERTEX_CACHE_SIZE + 3];
+  unsigned int cache_used = 0;
+  unsigned int new_cache_used;
+  unsigned int scan_position = 0;   // all triangles before this one are emitted
+  int best_triangle = 0;
+  float best_score;
+
+  new_indices.reserve(indices.size());
+
+  while (best_triangle >= 0)
+    {
+      unsigned int *triangle_indices = &indices[best_triangle * 3];
+
+      emitted[best_triangle] = true;
+
+      // put the triangle's vertices to the front of the LRU cache:
+
+      new_cache_used = 0;
+
+      for (j = 0; j < 3; j++)
+        {
+          new_indices.push_back(triangle_indices[j]);
+          new_cache[new_cache_used++] = triangle_indices[j];
+
+          // remove the triangle from the vertex's live triangles:
+
+          unsigned int vertex = triangle_indices[j];
+          unsigned int *vertex_triangles = &adjacency[adjacency_offsets[vertex]];
+
+          for (k = 0; k < live_triangles[vertex]; k++)
+            if (vertex_triangles[k] == (unsigned int) best_triangle)
+              {
+                vertex_triangles[k] = vertex_triangles[live_triangles[vertex] - 1];
+                break;
+              }
+
+          live_triangles[vertex]--;
+        }
+
+      for (j = 0; j < cache_used; j++)
+        if (cache[j] != triangle_indices[0] && cache[j] != triangle_indices[1] && cache[j] != triangle_indices[2])
+          new_cache[new_cache_used++] = cache[j];
+
+      for (j = 0; j < cache_used; j++)   // vertices pushed out of the cache
+        cache_positions[cache[j]] = -1;
+
+      // rescore the vertices in the cache and their triangles:
+
+      best_triangle = -1;
+      best_score = -1.0;
+
+      for (j = 0; j < new_cache_used; j++)
+        {
+          unsigned int vertex = new_cache[j];
+
+          cache_positions[vertex] = j < VERTEX_CACHE_SIZE ? (int) j : -1;
+
+          float score_difference = vertex_score(vertex) - vertex_scores[vertex];
+          vertex_scores[vertex] += score_difference;
+
+          for (k = 0; k < live_triangles[vertex]; k++)
+            {
+              unsigned int triangle = adjacency[adjacency_offsets[vertex] + k];
+
+              triangle_scores[triangle] += score_difference;
+
+              if (triangle_scores[triangle] > best_score)
+                {
+                  best_score = triangle_scores[triangle];
+                  best_triangle = triangle;
+                }
+            }
+        }
+
+      cache_used = new_cache_used < VERTEX_CACHE_SIZE ? new_cache_used : VERTEX_CACHE_SIZE;
+      memcpy(cache,new_cache,cache_used * sizeof(unsigned int));
+
+      if (best_triangle < 0)     // no triangle touches the cache, take the next one that hasn't been emitted
+        {
+          while (scan_position < number_of_triangles && emitted[scan_position])
+            scan_position++;
+
+          if (scan_position < number_of_triangles)
+            best_triangle = scan_position;
+        }
+    }
+
+  // renumber the vertices in the order of first use:
+
+  vector<int> remap(number_of_vertices,-1);
+  vector<vertex_3d> new_vertices;
+  unsigned int next_index = 0;
+
+  new_vertices.reserve(number_of_vertices);
+
+  for (i = 0; i < new_indices.size(); i++)
+    {
+      if (remap[new_indices[i]] < 0)
+        {
+          remap[new_indices[i]] = next_index++;
+          new_vertices.push_back(this->vertices[new_indices[i]]);
+        }
+
+      new_indices[i] = remap[new_indices[i]];
+    }
+
+  for (i = 0; i < number_of_vertices; i++)   // keep the unused vertices at the end
+    if (remap[i] < 0)
+      new_vertices.push_back(this->vertices[i]);
+
+  this->vertices.swap(new_vertices);
+
+  for (i = 0; i < number_of_triangles; i++)
+    {
+      this->triangles[i].index1 = new_indices[i * 3];
+      this->triangles[i].index2 = new_indices[i * 3 + 1];
+      this->triangles[i].index3 = new_indices[i * 3 + 2];
+    }
+
+  this->update();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::get_vertex_cache_statistics(unsigned int cache_size, float *acmr, float *atvr)
+
+{
+  unsigned int i,misses,used_vertices,index;
+  vector<unsigned int> cache_timestamps(this->vertices.size(),0);  // time the vertex entered the FIFO + 1, 0 = never
+
+  misses = 0;
+  used_vertices = 0;
+
+  for (i = 0; i < this->triangles.size() * 3; i++)
+    {
+      index = i % 3 == 0 ? this->triangles[i / 3].index1 : (i % 3 == 1 ? this->triangles[i / 3].index2 : this->triangles[i / 3].index3);
+
+      if (index >= this->vertices.size())
+        continue;
+
+      if (cache_timestamps[index] == 0)
+        used_vertices++;
+
+      if (cache_timestamps[index] == 0 || misses - (cache_timestamps[index] - 1) >= cache_size)   // not in the FIFO
+        {
+          cache_timestamps[index] = misses + 1;
+          misses++;
+        }
+    }
+
+  *acmr = this->triangles.size() == 0 ? 0 : misses / ((float) this->triangles.size());
+  *atvr = used_vertices == 0 ? 0 : misses / ((float) used_vertices);
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::optimize_overdraw(float threshold)
+
+{
+  if (!this->make_resident())
+    return;
+
+  unsigned int i,j,k,index;
+  unsigned int number_of_triangles = this->triangles.size();
+  vector<unsigned int> cache_timestamps(this->vertices.size(),0);
+  vector<unsigned int> hard_boundaries,boundaries;
+  unsigned int misses;
+
+  if (number_of_triangles == 0)
+    return;
+
+  for (i = 0; i < number_of_triangles; i++)
+    if (this->triangles[i].index1 >= this->vertices.size() ||
+        this->triangles[i].index2 >= this->vertices.size() ||
+        this->triangles[i].index3 >= this->vertices.size())
+      {
+        cerr << "ERROR: triangle index out of range, overdraw optimisation skipped." << endl;
+        return;
+      }
+
+  // simulates a FIFO cache of 16 vertices, returns the cache misses of the triangle:
+
+  auto simulate_triangle = [&](unsigned int triangle)
+    {
+      unsigned int result = 0;
+      unsigned int triangle_indices[3] = {this->triangles[triangle].index1,this->triangles[triangle].index2,this->triangles[triangle].index3};
+
+      for (unsigned int l = 0; l < 3; l++)
+        if (cache_timestamps[triangle_indices[l]] == 0 || misses - (cache_timestamps[triangle_indices[l]] - 1) >= 16)
+          {
+            cache_timestamps[triangle_indices[l]] = misses + 1;
+            misses++;
+            result++;
+          }
+
+      return result;
+    };
+
+  auto reset_cache = [&]()
+    {
+      misses += 16;    // everything drops out of the FIFO
+    };
+
+  // hard boundaries - the cache gets flushed (all three vertices miss):
+
+  misses = 0;
+
+  for (i = 0; i < number_of_triangles; i++)
+    if (simulate_triangle(i) == 3)
+      hard_boundaries.push_back(i);
+
+  hard_boundaries.push_back(number_of_triangles);
+
+  // soft boundaries - as soon as the cluster is as efficient as the whole hard cluster times the threshold:
+
+  for (i = 0; i + 1 < hard_boundaries.size(); i++)
+    {
+      unsigned int start = hard_boundaries[i];
+      unsigned int end = hard_boundaries[i + 1];
+      unsigned int cluster_misses = 0;
+      unsigned int running_misses = 0;
+      unsigned int running_triangles = 0;
+      float cluster_threshold;
+
+      reset_cache();
+
+      for (j = start; j < end; j++)
+        cluster_misses += simulate_triangle(j);
+
+      cluster_threshold = threshold * cluster_misses / ((float) (end - start));
+
+      boundaries.push_back(start);
+      reset_cache();
+
+      for (j = start; j < end; j++)
+        {
+          running_misses += simulate_triangle(j);
+          running_triangles++;
+
+          if (running_misses / ((float) running_triangles) <= cluster_threshold && j + 1 < end)
+            {
+              boundaries.push_back(j + 1);
+              running_misses = 0;
+              running_triangles = 0;
+              reset_cache();
+            }
+        }
+    }
+
+  boundaries.push_back(number_of_triangles);
+
+  // sort the clusters by how much they face outwards:
+
+  unsigned int number_of_clusters = boundaries.size() - 1;
+  vector<point_3d> centroids(number_of_clusters);
+  vector<point_3d> normals(number_of_clusters);
+  vector<float> sort_keys(number_of_clusters);
+  vector<unsigned int> order(number_of_clusters);
+  point_3d mesh_centroid;
+  float mesh_area = 0;
+
+  mesh_centroid.x = 0;
+  mesh_centroid.y = 0;
+  mesh_centroid.z = 0;
+
+  for (i = 0; i < number_of_clusters; i++)
+    {
+      float cluster_area = 0;
+
+      centroids[i].x = 0;
+      centroids[i].y = 0;
+      centroids[i].z = 0;
+      normals[i].x = 0;
+      normals[i].y = 0;
+      normals[i].z = 0;
+
+      for (j = boundaries[i]; j < boundaries[i + 1]; j++)
+        {
+          point_3d *a = &this->vertices[this->triangles[j].index1].position;
+          point_3d *b = &this->vertices[this->triangles[j].index2].position;
+          point_3d *c = &this->vertices[this->triangles[j].index3].position;
+          point_3d u,v,normal;
+          float area;
+
+          u.x = b->x - a->x;
+          u.y = b->y - a->y;
+          u.z = b->z - a->z;
+          v.x = c->x - a->x;
+          v.y = c->y - a->y;
+          v.z = c->z - a->z;
+          cross_product(u,v,&normal);         // front faces are clockwise on screen, the normal points out
+
+          area = vector_length(normal);
+
+          centroids[i].x += (a->x + b->x + c->x) / 3.0 * area;
+          centroids[i].y += (a->y + b->y + c->y) / 3.0 * area;
+          centroids[i].z += (a->z + b->z + c->z) / 3.0 * area;
+
+          normals[i].x += normal.x;            // area weighted
+          normals[i].y += normal.y;
+          normals[i].z += normal.z;
+
+          cluster_area += area;
+        }
+
+      mesh_centroid.x += centroids[i].x;
+      mesh_centroid.y += centroids[i].y;
+      mesh_centroid.z += centroids[i].z;
+      mesh_area += cluster_area;
+
+      if (cluster_area > 0)
+        {
+          centroids[i].x /= cluster_area;
+          centroids[i].y /= cluster_area;
+          centroids[i].z /= cluster_area;
+        }
+
+      if (vector_length(normals[i]) > 0)
+        normalize_vector(&normals[i]);
+    }
+
+  if (mesh_area > 0)
+    {
+      mesh_centroid.x /= mesh_area;
+      mesh_centroid.y /= mesh_area;
+      mesh_centroid.z /= mesh_area;
+    }
+
+  for (i = 0; i < number_of_clusters; i++)
+    {
+      sort_keys[i] =
+        (centroids[i].x - mesh_centroid.x) * normals[i].x +
+        (centroids[i].y - mesh_centroid.y) * normals[i].y +
+        (centroids[i].z - mesh_centroid.z) * normals[i].z;
+      order[i] = i;
+    }
+
+  stable_sort(order.begin(),order.end(),[&sort_keys](unsigned int a, unsigned int b)
+    {
+      return sort_keys[a] > sort_keys[b];
+    });
+
+  vector<triangle_3d> new_triangles;
+  new_triangles.reserve(number_of_triangles);
+
+  for (i = 0; i < number_of_clusters; i++)
+    {
+      index = order[i];
+
+      for (k = boundaries[index]; k < boundaries[index + 1]; k++)
+        new_triangles.push_back(this->triangles[k]);
+    }
+
+  this->triangles.swap(new_triangles);
+  this->update();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::build_meshlets()
+
+{
+  if (!this->make_resident())
+    return;
+
+  unsigned int i,j,k,first;
+  vector<unsigned int> meshlet_vertices;
+  vector<int> vertex_marks(this->vertices.size(),-1);   // index of the last meshlet that used the vertex
+  meshlet new_meshlet;
+
+  this->meshlets.clear();
+  this->meshlet_triangle_count = this->triangles.size();
+
+  first = 0;
+
+  for (i = 0; i <= this->triangles.size(); i++)
+    {
+      unsigned int new_vertices = 0;
+
+      if (i < this->triangles.size())
+        {
+          unsigned int triangle_indices[3] = {this->triangles[i].index1,this->triangles[i].index2,this->triangles[i].index3};
+
+          for (j = 0; j < 3; j++)
+            {
+              if (triangle_indices[j] >= this->vertices.size())
+                {
+                  cerr << "ERROR: triangle index out of range, meshlets not built." << endl;
+                  this->meshlets.clear();
+                  return;
+                }
+
+              if (vertex_marks[triangle_indices[j]] != (int) this->meshlets.size())
+                new_vertices++;
+            }
+
+          if (meshlet_vertices.size() + new_vertices <= MESHLET_MAX_VERTICES && i - first < MESHLET_MAX_TRIANGLES)
+            {
+              for (j = 0; j < 3; j++)
+                if (vertex_marks[triangle_indices[j]] != (int) this->meshlets.size())
+                  {
+                    vertex_marks[triangle_indices[j]] = this->meshlets.size();
+                    meshlet_vertices.push_back(triangle_indices[j]);
+                  }
+
+              continue;
+            }
+        }
+
+      if (i == first)
+        break;
+
+      // finish the meshlet [first,i):
+
+      float x0,y0,z0,x1,y1,z1;
+      float min_dot = 1.0;
+
+      x0 = y0 = z0 = numeric_limits<float>::max();
+      x1 = y1 = z1 = -1 * numeric_limits<float>::max();
+
+      for (j = 0; j < meshlet_vertices.size(); j++)
+        {
+          point_3d *position = &this->vertices[meshlet_vertices[j]].position;
+
+          x0 = min(x0,position->x);
+          y0 = min(y0,position->y);
+          z0 = min(z0,position->z);
+          x1 = max(x1,position->x);
+          y1 = max(y1,position->y);
+          z1 = max(z1,position->z);
+        }
+
+      new_meshlet.first_triangle = first;
+      new_meshlet.triangle_count = i - first;
+      new_meshlet.center.x = (x0 + x1) / 2.0;
+      new_meshlet.center.y = (y0 + y1) / 2.0;
+      new_meshlet.center.z = (z0 + z1) / 2.0;
+      new_meshlet.radius = 0;
+
+      for (j = 0; j < meshlet_vertices.size(); j++)
+        {
+          point_3d *position = &this->vertices[meshlet_vertices[j]].position;
+          point_3d difference;
+
+          difference.x = position->x - new_meshlet.center.x;
+          difference.y = position->y - new_meshlet.center.y;
+          difference.z = position->z - new_meshlet.center.z;
+
+          new_meshlet.radius = max(new_meshlet.radius,vector_length(difference));
+        }
+
+      vector<point_3d> normals(i - first);
+
+      new_meshlet.cone_axis.x = 0;
+      new_meshlet.cone_axis.y = 0;
+      new_meshlet.cone_axis.z = 0;
+
+      for (k = first; k < i; k++)
+        {
+          point_3d *a = &this->vertices[this->triangles[k].index1].position;
+          point_3d *b = &this->vertices[this->triangles[k].index2].position;
+          point_3d *c = &this->vertices[this->triangles[k].index3].position;
+          point_3d u,v;
+
+          u.x = b->x - a->x;
+          u.y = b->y - a->y;
+          u.z = b->z - a->z;
+          v.x = c->x - a->x;
+          v.y = c->y - a->y;
+          v.z = c->z - a->z;
+          cross_product(u,v,&normals[k - first]);   // points out of the front face
+
+          if (vector_length(normals[k - first]) == 0)   // degenerate triangles can face anywhere
+            continue;
+
+          normalize_vector(&normals[k - first]);
+
+          new_meshlet.cone_axis.x += normals[k - first].x;
+          new_meshlet.cone_axis.y += normals[k - first].y;
+          new_meshlet.cone_axis.z += normals[k - first].z;
+        }
+
+      if (vector_length(new_meshlet.cone_axis) > 0)
+        {
+          normalize_vector(&new_meshlet.cone_axis);
+
+          for (k = 0; k < normals.size(); k++)
+            if (vector_length(normals[k]) > 0)
+              min_dot = min(min_dot,
+                normals[k].x * new_meshlet.cone_axis.x + normals[k].y * new_meshlet.cone_axis.y + normals[k].z * new_meshlet.cone_axis.z);
+        }
+      else
+        min_dot = -1;
+
+      /* All the normals are within the angle alpha (cos alpha = min_dot)
+         around the axis, so all the triangles face away from the
+         camera if the view direction is within 90 - alpha degrees
+         around the axis, i.e. dot(view, axis) > sin alpha. */
+
+      new_meshlet.cone_cutoff = min_dot <= 0.05 ? 2.0 : sqrt(1.0 - min_dot * min_dot);
+
+      this->meshlets.push_back(new_meshlet);
+
+      meshlet_vertices.clear();
+      first = i;
+      i--;                      // the triangle goes to the next meshlet
+    }
+}
+
+//----------------------------------------------------------------------
+
+unsigned int mesh_3d_static::get_meshlet_count()
+
+{
+  vector<meshlet> *source = this->instance_parent != NULL ? &this->instance_parent->meshlets : &this->meshlets;
+  unsigned int triangles = this->instance_parent != NULL ? this->instance_parent->triangle_count() : this->triangle_count();
+  unsigned int built_for = this->instance_parent != NULL ? this->instance_parent->meshlet_triangle_count : this->meshlet_triangle_count;
+
+  return built_for == triangles ? source->size() : 0;   // outdated meshlets aren't used
+}
+
+//----------------------------------------------------------------------
+
+unsigned int mesh_3d_static::cull_meshlets()
+
+{
+  unsigned int i,j;
+  vector<meshlet> *source = this->instance_parent != NULL ? &this->instance_parent->meshlets : &this->meshlets;
+  float world_matrix[4][4],inverse_matrix[4][4];
+  float planes[6][4];
+  float scale,total_triangles;
+  point_3d camera_position,world_center,to_meshlet;
+  unsigned int index_size = this->index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+  bool visible;
+
+  this->visible_counts.clear();
+  this->visible_offsets.clear();
+  this->culled_triangles = 0;
+
+  if (this->get_meshlet_count() == 0)
+    return 0;
+
+  this->get_world_matrix(world_matrix);
+  get_frustum_planes(planes);
+
+  /* The back face test is done in model space: which side of a plane a
+     point lies on doesn't change with affine transformations. */
+
+  bool cone_test = invert_matrix_affine_simd(&world_matrix[0][0],&inverse_matrix[0][0]);
+
+  camera_position.x = inverse_matrix[0][0] * camera.position.x + inverse_matrix[0][1] * camera.position.y + inverse_matrix[0][2] * camera.position.z + inverse_matrix[0][3];
+  camera_position.y = inverse_matrix[1][0] * camera.position.x + inverse_matrix[1][1] * camera.position.y + inverse_matrix[1][2] * camera.position.z + inverse_matrix[1][3];
+  camera_position.z = inverse_matrix[2][0] * camera.position.x + inverse_matrix[2][1] * camera.position.y + inverse_matrix[2][2] * camera.position.z + inverse_matrix[2][3];
+
+  if (cone_test && world_matrix[0][0] * (world_matrix[1][1] * world_matrix[2][2] - world_matrix[1][2] * world_matrix[2][1]) -
+      world_matrix[0][1] * (world_matrix[1][0] * world_matrix[2][2] - world_matrix[1][2] * world_matrix[2][0]) +
+      world_matrix[0][2] * (world_matrix[1][0] * world_matrix[2][1] - world_matrix[1][1] * world_matrix[2][0]) < 0)
+    cone_test = false;          // mirroring swaps the front and back faces
+
+  scale = 0;                    // the longest axis scales the bounding spheres
+
+  for (i = 0; i < 3; i++)
+    scale = max(scale,(float) sqrt(world_matrix[0][i] * world_matrix[0][i] + world_matrix[1][i] * world_matrix[1][i] + world_matrix[2][i] * world_matrix[2][i]));
+
+  total_triangles = 0;
+
+  for (i = 0; i < source->size(); i++)
+    {
+      meshlet *current = &(*source)[i];
+
+      total_triangles += current->triangle_count;
+      visible = true;
+
+      if (cone_test && current->cone_cutoff <= 1.0)
+        {
+          to_meshlet.x = current->center.x - camera_position.x;
+          to_meshlet.y = current->center.y - camera_position.y;
+          to_meshlet.z = current->center.z - camera_position.z;
+
+          if (to_meshlet.x * current->cone_axis.x + to_meshlet.y * current->cone_axis.y + to_meshlet.z * current->cone_axis.z >=
+              current->cone_cutoff * vector_length(to_meshlet) + current->radius)
+            visible = false;
+        }
+
+      if (visible)
+        {
+          world_center.x = world_matrix[0][0] * current->center.x + world_matrix[0][1] * current->center.y + world_matrix[0][2] * current->center.z + world_matrix[0][3];
+          world_center.y = world_matrix[1][0] * current->center.x + world_matrix[1][1] * current->center.y + world_matrix[1][2] * current->center.z + world_matrix[1][3];
+          world_center.z = world_matrix[2][0] * current->center.x + world_matrix[2][1] * current->center.y + world_matrix[2][2] * current->center.z + world_matrix[2][3];
+
+          for (j = 0; j < 6; j++)
+            if (planes[j][0] * world_center.x + planes[j][1] * world_center.y + planes[j][2] * world_center.z + planes[j][3] < -1 * current->radius * scale)
+              {
+                visible = false;
+                break;
+              }
+        }
+
+      if (!visible)
+        {
+          this->culled_triangles += current->triangle_count;
+          continue;
+        }
+
+      if (this->visible_counts.size() != 0 &&   // continues the previous range, merge them
+          (const char *) this->visible_offsets.back() + this->visible_counts.back() * index_size == (const char *) 0 + current->first_triangle * 3 * index_size)
+        this->visible_counts.back() += current->triangle_count * 3;
+      else
+        {
+          this->visible_counts.push_back(current->triangle_count * 3);
+          this->visible_offsets.push_back((const GLvoid *) (((const char *) 0) + current->first_triangle * 3 * index_size));
+        }
+    }
+
+  return this->culled_triangles;
+}
+
+//----------------------------------------------------------------------
+
+unsigned int mesh_3d_static::get_culled_triangles()
+
+{
+  return this->culled_triangles;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::upload_position_dequantization()
+
+{
+  if (this->format == VERTEX_FORMAT_COMPACT)
+    {
+      glUniform3fv(position_offset_location,1,(const GLfloat *) &this->position_offset);
+      glUniform3fv(position_scale_location,1,(const GLfloat *) &this->position_scale);
+    }
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::draw_index_ranges(vector<GLsizei> &counts, vector<const GLvoid *> &offsets)
+
+{
+  if (counts.size() == 0)
+    return;
+
+  mesh_3d_static *source = this->instance_parent != NULL ? this->instance_parent : this;
+
+  if (source->arena_handle >= 0)      // the offsets are relative to the allocation
+    {
+      unsigned int i;
+      arena_allocation allocation = source->arena->get_allocation(source->arena_handle);
+      vector<const GLvoid *> arena_offsets(offsets.size());
+      vector<GLint> base_vertices(offsets.size(),allocation.vertices.offset);
+
+      for (i = 0; i < offsets.size(); i++)
+        arena_offsets[i] = (const GLvoid *) (((const char *) offsets[i]) + allocation.indices.offset * sizeof(unsigned short));
+
+      bind_vertex_array(source->arena->get_vao());
+
+      if (counts.size() == 1)
+        glDrawElementsBaseVertex(GL_TRIANGLES,counts[0],GL_UNSIGNED_SHORT,arena_offsets[0],base_vertices[0]);
+      else
+        glMultiDrawElementsBaseVertex(GL_TRIANGLES,&counts[0],GL_UNSIGNED_SHORT,(const GLvoid **) &arena_offsets[0],counts.size(),&base_vertices[0]);
+
+      return;
+    }
+
+  bind_vertex_array(this->vao);
+
+  if (counts.size() == 1)
+    glDrawElements(GL_TRIANGLES,counts[0],this->index_type,offsets[0]);
+  else
+    glMultiDrawElements(GL_TRIANGLES,&counts[0],this->index_type,(const GLvoid **) &offsets[0],counts.size());
+
+  bind_vertex_array(0);
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::get_overdraw_statistics(unsigned int viewpoints, float *overdraw)
+
+{
+  unsigned int i,j,view;
+  float x0,y0,z0,x1,y1,z1;
+  point_3d center;
+  float size;
+  unsigned long long fragments = 0;
+  unsigned long long covered_pixels = 0;
+
+  *overdraw = 0;
+
+  if (this->triangles.size() == 0 || viewpoints == 0)
+    return;
+
+  this->get_bounding_box(&x0,&y0,&z0,&x1,&y1,&z1);
+
+  center.x = (x0 + x1) / 2.0;
+  center.y = (y0 + y1) / 2.0;
+  center.z = (z0 + z1) / 2.0;
+  size = sqrt((x1 - x0) * (x1 - x0) + (y1 - y0) * (y1 - y0) + (z1 - z0) * (z1 - z0));
+
+  if (size <= 0)
+    return;
+
+  vector<float> depth_buffer(OVERDRAW_RESOLUTION * OVERDRAW_RESOLUTION);
+  vector<unsigned int> fragment_counts(OVERDRAW_RESOLUTION * OVERDRAW_RESOLUTION);
+  vector<float> projected(this->vertices.size() * 3);
+
+  for (view = 0; view < viewpoints; view++)
+    {
+      point_3d direction,right,up,helper;
+      float pixel_scale = (OVERDRAW_RESOLUTION - 1) / size;
+
+      // directions on a golden ratio spiral are evenly distributed on a sphere:
+
+      direction.y = 1.0 - (view + 0.5) * 2.0 / viewpoints;
+      direction.x = sqrt(1.0 - direction.y * direction.y) * cos(view * 2.39996323);
+      direction.z = sqrt(1.0 - direction.y * direction.y) * sin(view * 2.39996323);
+
+      helper.x = fabs(direction.y) < 0.9 ? 0.0 : 1.0;
+      helper.y = fabs(direction.y) < 0.9 ? 1.0 : 0.0;
+      helper.z = 0.0;
+
+      cross_product(helper,direction,&right);
+      normalize_vector(&right);
+      cross_product(direction,right,&up);
+
+      for (i = 0; i < this->vertices.size(); i++)   // orthographic projection
+        {
+          point_3d relative;
+
+          relative.x = this->vertices[i].position.x - center.x;
+          relative.y = this->vertices[i].position.y - center.y;
+          relative.z = this->vertices[i].position.z - center.z;
+
+          projected[i * 3] = (relative.x * right.x + relative.y * right.y + relative.z * right.z) * pixel_scale + OVERDRAW_RESOLUTION / 2.0;
+          projected[i * 3 + 1] = (relative.x * up.x + relative.y * up.y + relative.z * up.z) * pixel_scale + OVERDRAW_RESOLUTION / 2.0;
+          projected[i * 3 + 2] = relative.x * direction.x + relative.y * direction.y + relative.z * direction.z;
+        }
+
+      fill(depth_buffer.begin(),depth_buffer.end(),numeric_limits<float>::max());
+      fill(fragment_counts.begin(),fragment_counts.end(),0);
+
+      for (i = 0; i < this->triangles.size(); i++)
+        {
+          unsigned int triangle_indices[3] = {this->triangles[i].index1,this->triangles[i].index2,this->triangles[i].index3};
+          point_3d *a,*b,*c;
+          point_3d u,v,normal;
+          float points[3][3];
+
+          if (triangle_indices[0] >= this->vertices.size() || triangle_indices[1] >= this->vertices.size() ||
+              triangle_indices[2] >= this->vertices.size())
+            continue;
+
+          a = &this->vertices[triangle_indices[0]].position;
+          b = &this->vertices[triangle_indices[1]].position;
+          c = &this->vertices[triangle_indices[2]].position;
+
+          u.x = b->x - a->x;
+          u.y = b->y - a->y;
+          u.z = b->z - a->z;
+          v.x = c->x - a->x;
+          v.y = c->y - a->y;
+          v.z = c->z - a->z;
+          cross_product(u,v,&normal);
+
+          if (normal.x * direction.x + normal.y * direction.y + normal.z * direction.z >= 0)   // back face culling
+            continue;
+
+          for (j = 0; j < 3; j++)
+            {
+              points[j][0] = projected[triangle_indices[j] * 3];
+              points[j][1] = projected[triangle_indices[j] * 3 + 1];
+              points[j][2] = projected[triangle_indices[j] * 3 + 2];
+            }
+
+          rasterize_triangle_overdraw(points,&depth_buffer[0],&fragment_counts[0]);
+        }
+
+      for (i = 0; i < fragment_counts.size(); i++)
+        if (fragment_counts[i] != 0)
+          {
+            fragments += fragment_counts[i];
+            covered_pixels++;
+          }
+    }
+
+  *overdraw = covered_pixels == 0 ? 0 : fragments / ((double) covered_pixels);
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::simplify(unsigned int iterations)
+
+{
+  unsigned int i,j,k,vertex1,vertex2;
+  float distance,min_distance;
+
+  if (!this->make_resident())
+    return;
+
+  for (i = 0; i < iterations; i++)
+    {
+      // find the 2 nearest vertices and merge them:
+
+      vertex1 = 0;
+      vertex2 = 1;
+      min_distance = numeric_limits<float>::max();
+
+      for (j = 0; j < this->vertices.size(); j++)
+        for (k = j + 1; k < this->vertices.size(); k++)
+          {
+            distance = get_distance(this->vertices[j].position,this->vertices[k].position);
+
+            if (distance < min_distance)
+              {
+                min_distance = distance;
+                vertex1 = j;
+                vertex2 = k;
+              }
+          }
+
+      this->merge_vertices(vertex1,vertex2,true);
+    }
+
+  this->remove_useless_triangles();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::simplify(float ratio)
+
+{
+  if (ratio > 1.0 || ratio < 0.0)
+    return;
+
+  this->simplify((unsigned int) (this->vertex_count() * (1.0 - ratio)));
+}
+
+//----------------------------------------------------------------------
+
+void camera_struct::set_skybox(mesh_3d *what)
+
+{
+  this->skybox = what;
+
+  this->set_position(this->position.x,this->position.y,this->position.z);   // aligns the skybox with the camera
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::get_bounding_box(float *x0, float *y0, float *z0, float *x1, float *y1, float *z1)
+
+{
+  mutex result_mutex;
+
+  if (!this->make_resident())
+    {
+      *x0 = 0;
+      *y0 = 0;
+      *z0 = 0;
+      *x1 = 0;
+      *y1 = 0;
+      *z1 = 0;
+      return;
+    }
+
+  *x0 = numeric_limits<float>::max();
+  *y0 = numeric_limits<float>::max();
+  *z0 = numeric_limits<float>::max();
+  *x1 = -1 * numeric_limits<float>::max();
+  *y1 = -1 * numeric_limits<float>::max();
+  *z1 = -1 * numeric_limits<float>::max();
+
+  parallel_for(this->vertices.size(),[&](unsigned int from, unsigned int to)
+    {
+      unsigned int i;
+      float minimum[3],maximum[3];
+
+      minimum[0] = this->vertices[from].position.x;
+      minimum[1] = this->vertices[from].position.y;
+      minimum[2] = this->vertices[from].position.z;
+      maximum[0] = minimum[0];
+      maximum[1] = minimum[1];
+      maximum[2] = minimum[2];
+
+      for (i = from + 1; i < to; i++)
+        {
+          if (this->vertices[i].position.x < minimum[0])
+            minimum[0] = this->vertices[i].position.x;
+
+          if (this->vertices[i].position.y < minimum[1])
+            minimum[1] = this->vertices[i].position.y;
+
+          if (this->vertices[i].position.z < minimum[2])
+            minimum[2] = this->vertices[i].position.z;
+
+          if (this->vertices[i].position.x > maximum[0])
+            maximum[0] = this->vertices[i].position.x;
+
+          if (this->vertices[i].position.y > maximum[1])
+            maximum[1] = this->vertices[i].position.y;
+
+          if (this->vertices[i].position.z > maximum[2])
+            maximum[2] = this->vertices[i].position.z;
+        }
+
+      lock_guard<mutex> lock(result_mutex);   // merge this batch's box with the result
+
+      *x0 = minimum[0] < *x0 ? minimum[0] : *x0;
+      *y0 = minimum[1] < *y0 ? minimum[1] : *y0;
+      *z0 = minimum[2] < *z0 ? minimum[2] : *z0;
+      *x1 = maximum[0] > *x1 ? maximum[0] : *x1;
+      *y1 = maximum[1] > *y1 ? maximum[1] : *y1;
+      *z1 = maximum[2] > *z1 ? maximum[2] : *z1;
+    });
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::get_bounding_box(point_3d *first_point, point_3d *second_point)
+
+{
+  this->get_bounding_box(&first_point->x,&first_point->y,&first_point->z,
+                         &second_point->x,&second_point->y,&second_point->z);
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::get_size(float *width, float *height, float *depth)
+
+{
+  point_3d point_a,point_b;
+
+  this->get_bounding_box(&point_a,&point_b);
+
+  *width = point_b.x - point_a.x;
+  *height = point_b.y - point_a.y;
+  *depth = point_b.z - point_a.z;
+}
+
+//----------------------------------------------------------------------
+
+int get_frame_time_difference()
+
+{
+  return global_frame_time_difference;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::set_scale(float scale)
+
+{
+  this->set_scale(scale,scale,scale);
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::print_data()
+
+{
+  unsigned int i;
+
+  cout << "vertices (index: position; uv; normal):" << endl;
+
+  for (i = 0; i < this->vertices.size(); i++)
+    cout << i << ": " << this->vertices[i].position.x << ", " <<
+                         this->vertices[i].position.y << ", " <<
+                         this->vertices[i].position.z << "; " <<
+                         this->vertices[i].texture_coordinate[0] << ", " <<
+                         this->vertices[i].texture_coordinate[1] << "; " <<
+                         this->vertices[i].normal.x << "; " <<
+                         this->vertices[i].normal.y << "; " <<
+                         this->vertices[i].normal.z << endl;
+
+  cout << endl;
+  cout << "triangles (index: indices):" << endl;
+
+  for (i = 0; i < this->triangles.size(); i++)
+    cout << i << ": " << this->triangles[i].index1 << ", " <<
+                         this->triangles[i].index2 << ", " <<
+                         this->triangles[i].index3 << endl;
+
+  cout << endl;
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d_static* picture_2d::get_picture_mesh()
+
+{
+  return &this->picture_mesh;
+}
+
+//----------------------------------------------------------------------
+
+void set_background_color(unsigned char red, unsigned char green, unsigned char blue)
+
+{
+  float helper_array[3];
+
+  global_background_color[0] = red;
+  global_background_color[1] = green;
+  global_background_color[2] = blue;
+
+  helper_array[0] = red / 255.0;
+  helper_array[1] = green / 255.0;
+  helper_array[2] = blue / 255.0;
+
+  memcpy(global_frame_uniforms.background_color,helper_array,sizeof(helper_array));
+  global_frame_uniforms_changed = true;
+
+  glClearColor(helper_array[0],helper_array[1],helper_array[2],1.0);
+}
+
+//----------------------------------------------------------------------
+
+float get_fps()
+
+{
+  return global_fps;
+}
+
+//----------------------------------------------------------------------
+
+float get_spf()
+
+{
+  return global_spf;
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::merge_vertices(unsigned int index1, unsigned int index2, bool average_position)
+
+{
+  unsigned int i;
+
+  if (index1 == index2 || index1 >= this->vertices.size() || index2 >= this->vertices.size())
+    return;
+
+  if (average_position)
+    {
+      this->vertices[index1].position.x = (this->vertices[index1].position.x + this->vertices[index2].position.x) / 2.0;
+      this->vertices[index1].position.y = (this->vertices[index1].position.y + this->vertices[index2].position.y) / 2.0;
+      this->vertices[index1].position.z = (this->vertices[index1].position.z + this->vertices[index2].position.z) / 2.0;
+
+      this->vertices[index1].normal.x = (this->vertices[index1].position.x + this->vertices[index2].normal.x) / 2.0;
+      this->vertices[index1].normal.y = (this->vertices[index1].position.y + this->vertices[index2].normal.y) / 2.0;
+      this->vertices[index1].normal.z = (this->vertices[index1].position.z + this->vertices[index2].normal.z) / 2.0;
+
+      normalize_vector(&this->vertices[index1].normal);
+    }
+
+  this->vertices.erase(this->vertices.begin() + index2);
+
+  for (i = 0; i < this->triangles.size(); i++)
+    {
+      if (this->triangles[i].index1 == index2)
+        this->triangles[i].index1 = index1;
+      else if (this->triangles[i].index1 > index2)
+        this->triangles[i].index1 -= 1;
+
+      if (this->triangles[i].index2 == index2)
+        this->triangles[i].index2 = index1;
+      else if (this->triangles[i].index2 > index2)
+        this->triangles[i].index2 -= 1;
+
+      if (this->triangles[i].index3 == index2)
+        this->triangles[i].index3 = index1;
+      else if (this->triangles[i].index3 > index2)
+        this->triangles[i].index3 -= 1;
+    }
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::add_vertex(float x, float y, float z)
+
+{
+  this->add_vertex(x,y,z,0,0,0,0,1);
+}
+
+//----------------------------------------------------------------------
+
+void stop_rendering()
+
+{
+  glutLeaveMainLoop();
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_static::add_vertex(float x, float y, float z, float texture_u, float texture_v, float normal_x, float normal_y, float normal_z)
+
+{
+  vertex_3d vertex;
+
+  if (!this->make_resident())          // the new vertex would be lost by the next reload
+    return;
+
+  vertex.texture_blend_ratio = 1.0;
+
+  vertex.position.x = x;
+  vertex.position.y = y;
+  vertex.position.z = z;
+
+  vertex.texture_coordinate[0] = texture_u;
+  vertex.texture_coordinate[1] = texture_v;
+
+  vertex.normal.x = normal_x;
+  vertex.normal.y = normal_y;
+  vertex.normal.z = normal_z;
+
+  normalize_vector(&vertex.normal);
+
+  this->vertices.push_back(vertex);
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d::set_render_mode(render_mode mode)
+
+{
+  this->mesh_render_mode = mode;
+}
+
+//----------------------------------------------------------------------
 
-//------------------------------------
+void mesh_3d_static::add_triangle(unsigned int index1, unsigned int index2, unsigned int index3)
 
-void render_loop();
-  /**<
-   Starts the rendering loop that will continue rendering the scene
-   using function specified with init_opengl function. The loop can
-   be stopped by calling stop_rendering function. The loop also ends
-   when the window is closed by the user.
-   */
+{
+  triangle_3d triangle;
 
-void stop_rendering();
-  /**<
-   Stops the main rendering loop.
-   */
+  if (!this->make_resident())
+    return;
 
-void draw_pixel(unsigned int x, unsigned int y, unsigned char r, unsigned char g, unsigned char b, unsigned char a);
-  /**<
-   Draws a pixel at given position in frame buffer.
+  triangle.index1 = index1;
+  triangle.index2 = index2;
+  triangle.index3 = index3;
 
-   @param x x position in pixels
-   @param y y position in pixels
-   @param r amount of red
-   @param g amount of green
-   @param b amount of blue
-   @param a amount of alpha
-  */
+  this->triangles.push_back(triangle);
+}
 
-void init_opengl(int *argc_pointer, char** argv, unsigned int window_width, unsigned int window_height, void (*draw_function)(void), const char *window_title);
-  /**<
-   Initialises OpenGL, should be before any other function call from
-   this library.
+//----------------------------------------------------------------------
 
-   @param argc_pointer pointer to program argc
-   @param argv program argv
-   @param window_width rendering window width in pixels
-   @param window_height rendering window height in pixels
-   @param draw_function pointer to a function that will be called
-          to render each frame, this function shouldn't call
-          glutSwapBuffers or glClear, they will be called
-          automatically
-   @param window_title window title
-  */
+void draw_pixel(unsigned int x, unsigned int y, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
 
-float interpolate(float ratio, float value1, float value2, interpolation_method method);
-  /**<
-   Interpolates between two values using specified method.
+{
+  unsigned char bytes[4];
 
-   @param ratio value in range <0,1> where 0 will return the first
-          point value, 1 the second one and the values between will be
-          interpolated
-   @param value1 first value to be interpolated between
-   @param value2 second value to be interpolated between
-   @param method method to use
-   @return value interpolated between value1 and value2 in given ratio
-   */
+  bytes[0] = r;
+  bytes[1] = g;
+  bytes[2] = b;
+  bytes[3] = a;
 
-void set_perspective(float fov_degrees, float near, float far);
-  /**<
-   Sets the perspective for the rendering.
+  glRasterPos2d(x / (double) global_window_width,y / (double) global_window_height);
 
-   @param fov field of view in degrees
-   @param near near distance
-   @param far far distance
-  */
+  glDrawPixels(1,1,GL_RGBA,GL_UNSIGNED_BYTE,bytes);
+}
 
-void register_keyboard_function(void (*function)(int key, int x, int y));
-  /**<
-   Registers given function to be called when key press (character or special)
-   one occurs.
+//----------------------------------------------------------------------
 
-   @param function function to be registered (key is either the ASCII key code
-          or a special_keys code, x and y are the mouse coordinates at the
-          time when the key press occured)
-  */
+mesh_3d::~mesh_3d()
 
-void register_advanced_keyboard_function(void (*function)(bool key_up, int key, int x, int y));
-  /**<
-   Registers given function to be called when key down or key up event
-   occurs.
+{
+  release_material(this->material_index);
+}
 
-   @param function function to be registered (key is either the ASCII key code
-          or a special_keys code, x and y are the mouse coordinates at the
-          time when the key press occured, key_up indicates if the event was
-          key press or key release)
-   */
+//----------------------------------------------------------------------
 
-void register_mouse_function(void (*function)(int button, int state));
-  /**<
-   Registers given function to be called when mouse button press occurs.
-   To regularly check mouse coordinates get_mouse_position function
-   can be used in the main rendering loop.
+mesh_3d_static::~mesh_3d_static()
 
-   @param function function to be registered
-  */
+{
+  this->clear();
 
-int get_time();
-  /**<
-   Gets the current time count.
+  if (this->residency_hash != 0)
+    reference_residency_file(cache_file_name("mesh",this->residency_hash),-1);
 
-   @return number of millisecends since the init function has been called
-   */
+  remove_memory_usage(this);
+}
 
-void normalize_vector(point_3d *vector);
-  /**<
-   Normalizes given vector (so that it's size is equal to 1).
+//----------------------------------------------------------------------
 
-   @param vector vector to be normalized
-   */
+void texture_2d::set_compression(texture_compression compression)
 
-int get_frame_time_difference();
-  /**<
-   Gets the time difference of this frame and the previous one.
+{
+  this->compression = compression;
+}
 
-   @return time difference in milliseconds since the last frame
-   */
+//----------------------------------------------------------------------
 
-float vector_length(point_3d vector);
-  /**<
-   Calculates a vector length.
+texture_compression texture_2d::get_compression()
 
-   @param vector vector whose length will be returned
-   @return vector length
-   */
+{
+  return this->compression;
+}
 
-mesh_3d_static *make_cuboid(float side_x, float side_y, float side_z);
-  /**<
-   Makes a cuboid (box) mesh.
+//----------------------------------------------------------------------
 
-   @param side_x length of the x side
-   @param side_y length of the y side
-   @param side_z length of the z side
-   @return instance of the cuboid mesh
-   */
+texture_compression texture_2d::get_gpu_compression()
 
-mesh_3d_static *make_sharp_cuboid(float side_x, float side_y, float side_z);
-  /**<
-   Makes sharp-edged cuboid (box) mesh. It consists of 6 faces that don't
-   share vertices, so that the edges can be sharp and can have independent
-   texture mapping, which is especially good for skyboxes etc.
+{
+  return this->gpu_compression;
+}
 
-   @param side_x length of the x side
-   @param side_y length of the y side
-   @param side_z length of the z side
-   @return instance of the cuboid mesh
-   */
+//----------------------------------------------------------------------
+
+unsigned int texture_2d::get_gpu_memory_size()
+
+{
+  unsigned int blocks = ((this->width + 3) / 4) * ((this->height + 3) / 4);
+
+  switch (this->gpu_compression)
+    {
+      case TEXTURE_COMPRESSION_BC1: return blocks * 8; break;
+      case TEXTURE_COMPRESSION_BC3: return blocks * 16; break;
+      default: return this->width * this->height * 4; break;
+    }
+}
+
+//----------------------------------------------------------------------
+
+unsigned int texture_2d::get_cpu_memory_size()
+
+{
+  return this->data != NULL ? this->width * this->height * 3 : 0;
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::set_residency(residency_policy policy)
+
+{
+  this->residency = policy;
+}
+
+//----------------------------------------------------------------------
+
+residency_policy texture_2d::get_residency()
+
+{
+  return this->residency;
+}
+
+//----------------------------------------------------------------------
+
+bool texture_2d::make_resident()
+
+{
+  if (!this->data_discarded)
+    return true;
+
+  if (this->residency_hash != 0)       // released with RESIDENCY_RELOAD, even if the policy has been changed since
+    {
+      this->data = (unsigned char *) malloc(this->width * this->height * 3);
+
+      if (this->data != NULL &&
+        read_cache_file(cache_file_name("pixels",this->residency_hash),this->residency_hash,this->data,this->width * this->height * 3))
+        {
+          this->data_discarded = false;
+          this->update_memory_usage();
+          return true;
+        }
+
+      free(this->data);
+      this->data = NULL;
+    }
+
+  cerr << "ERROR: the texture data have been discarded after upload." << endl;
+  return false;
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::update()
+
+{
+  this->upload_texture_data();
+}
+
+//----------------------------------------------------------------------
+
+void texture_2d::unload()
+
+{
+  if (this->to > 0)
+    delete_texture(this->to);
+
+  this->to = 0;
+  this->update_memory_usage();
+}
+
+//----------------------------------------------------------------------
+
+texture_2d::~texture_2d()
+
+{
+  this->unload();
+
+  if (this->data != NULL)
+    free(this->data);
+
+  if (this->residency_hash != 0)
+    reference_residency_file(cache_file_name("pixels",this->residency_hash),-1);
+
+  remove_memory_usage(this);
+}
+
+//----------------------------------------------------------------------
+
+void normalize_vector(point_3d *vector)
+
+{
+  if (vector->x == 0 && vector->y == 0 && vector->z == 0)
+    {
+      vector->x = 1.0;
+      vector->y = 0.0;
+      vector->z = 0.0;
+      return;
+    }
+
+  float length = vector_length(*vector);
+
+  vector->x = vector->x / length;
+  vector->y = vector->y / length;
+  vector->z = vector->z / length;
+}
+
+//----------------------------------------------------------------------
+
+float vector_length(point_3d vector)
+
+{
+  return sqrt(vector.x * vector.x + vector.y * vector.y + vector.z * vector.z);
+}
+
+//----------------------------------------------------------------------
+
+mesh_3d_animated::mesh_3d_animated(): mesh_3d()
 
-mesh_3d_static *make_plane(float width, float height, unsigned int resolution_x, unsigned int resolution_y);
-  /**<
-   Makes a plane mesh.
+{
+  this->playing = false;
+  this->loop = true;
+  this->interpolating = true;
+  this->play_speed = 1.0;
+  this->current_frame = 0;
+  this->instance_parent = NULL;
+  this->frame_percentage = 0.0;
+  this->vbo = 0;
+  this->ibo = 0;
+  this->index_type = GL_UNSIGNED_INT;
+  this->frame_vertex_count = 0;
+  this->uploaded_frame_count = 0;
+  this->frame_triangle_count = 0;
+  this->frames_changed = true;
+}
 
-   @param width plane width
-   @param height plane height
-   @param resolution_x number of squares in x direction
-   @param resolution_y number of squares in y direction
-   @return instance of the plane mesh
-   */
+//----------------------------------------------------------------------
 
-mesh_3d_static *make_cone(float radius, float height, unsigned int sides);
-  /**<
-   Makes a cone mesh.
+void mesh_3d_animated::make_instance_of(mesh_3d_animated *what)
 
-   @param radius cone base radius
-   @param height cone height
-   @param sides number of sides
-   @return instance of the cone mesh
-   */
+{
+  this->clear();
+  this->instance_parent = what;   // the buffers are always taken from the parent in draw()
+}
 
-mesh_3d_static *make_cylinder(float radius, float height, unsigned int sides);
-  /**<
-   Makes a cylinder mesh.
+//----------------------------------------------------------------------
 
-   @param radius cylinder base radius
-   @param height cylinder height
-   @param sides number of sides
-   @return instance of the cylinder mesh
-   */
+void mesh_3d_animated::mark_frames_changed()
 
-mesh_3d_static *make_sphere(float radius, unsigned int height_segments, unsigned int sides);
-  /**<
-   Makes a sphere mesh.
+{
+  this->frames_changed = true;
+}
 
-   @param radius sphere radius
-   @param height_segments vertical resolution
-   @param sides number of sides of the sphere
-   @return instance of the sphere mesh
-   */
+//----------------------------------------------------------------------
 
-mesh_3d_static *make_terrain(float size_x, float size_y, float height, unsigned int resolution_x, unsigned int resolution_y, texture_2d *heightmap, float crop_x = 0.0, float crop_y = 0.0, float crop_width = 1.0, float crop_height = 1.0);
-  /**<
-   Makes a terrain mesh based on heightmap stored as image in texture.
+unsigned int mesh_3d_animated::get_gpu_memory_size()
 
-   @param size_x x size of the mesh
-   @param size_y y size of the mesh
-   @param height terrain amplitude
-   @param resolution_x x resolution of the terrain
-   @param resolution_y y resolution of the terrain
-   @param heightmap heightmap image where lighter means higher, only red component
-          is taken into account, if NULL, the terrain will be flat
-   @param crop_x x coordinate in the range <0,1> of the starting cropping point
-   @param crop_y y coordinate in the range <0,1> of the starting cropping point
-   @param crop_width width of the cropping rectangle (in the range <0,1>)
-   @param crop_height height of the cropping rectangle (in the range <0,1>)
-   @return generated terrain mesh
-   */
+{
+  if (this->instance_parent != NULL || this->vbo == 0)
+    return 0;
 
-picture_2d *make_text(string text, texture_2d *font = NULL, float size = 0.05, float spacing = 0.03);
-  /**<
-   Makes a picture of given ASCII text.
+  return this->uploaded_frame_count * this->frame_vertex_count * sizeof(vertex_3d) +
+    this->frame_triangle_count * 3 * (this->index_type == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint));
+}
 
-   @param text text to be displayed
-   @param font font to be used, if NULL, the default font will be used,
-          the texture should contain exactly 256 characters one next to
-          another from left to right in ASCII order, the size doesn't
-          matter
-   @param size font size
-   @param spacing spacing of the characters
-   @return picture representing given text
-   */
+//----------------------------------------------------------------------
 
-void go_fullscreen();
-  /**<
-   Makes the window fullscreen.
-   */
+buffer_arena::buffer_arena(unsigned int vertex_capacity, unsigned int index_capacity)
 
-string get_gpu_info_string();
-  /**<
-   Gets the string with GPU info.
+{
+  this->vbo = 0;
+  this->ibo = 0;
+  this->vao = 0;
+  this->vertex_capacity = max(vertex_capacity,1u);
+  this->index_capacity = max(index_capacity,1u);
+}
 
-   @return string in format "vendor version"
-   */
+//----------------------------------------------------------------------
 
-float get_fps();
-  /**<
-   Returns current FPS. FPS is being recomputed after every RECOMPUTE_FRAMES
-   frames.
+buffer_arena::~buffer_arena()
 
-   @return current number of frames per second
-   */
+{
+  if (this->vao != 0)
+    delete_vertex_array(this->vao);
 
-float get_spf();
-  /**<
-   Returns current SPF (seconds per frame). SPF is being recomputed after
-   every RECOMPUTE_FRAMES frames.
+  if (this->vbo != 0)
+    glDeleteBuffers(1,&this->vbo);
 
-   @return current number of seconds per frame
-   */
+  if (this->ibo != 0)
+    glDeleteBuffers(1,&this->ibo);
 
-void set_global_light(point_3d direction, unsigned char red, unsigned char green, unsigned char blue);
-  /**<
-   Sets the global directional light parameters that will be used in
-   shading process.
+  remove_memory_usage(this);
+}
 
-   @param direction light direction
-   @param red amount of red in the light intensity
-   @param green amount of green in the light intensity
-   @param blue amount of blue in the light intensity
-   */
+//----------------------------------------------------------------------
 
-void set_background_color(unsigned char red, unsigned char green, unsigned char blue);
-  /**<
-   Sets the background (and fog) color for the viewport.
+void buffer_arena::make_vao()
 
-   @param red amount of red
-   @param green amount of green
-   @param blue amount of blue
-   */
+{
+  if (this->vao == 0)
+    glGenVertexArrays(1,&this->vao);
 
-void set_mouse_position(unsigned int x, unsigned int y);
-  /**<
-   Sets the mouse position relatively to the window top left corner.
+  if (this->vao == 0)
+    cerr << "ERROR: VAO couldn't be allocated for the buffer arena.";
 
-   @param x x position of the mouse cursor
-   @param y y position of the mouse cursor
-   */
+  bind_vertex_array(this->vao);
 
-void set_mouse_visibility(bool visible);
-  /**<
-   Makes the mouse cursor visible or invisible.
+  glBindBuffer(GL_ARRAY_BUFFER,this->vbo);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,this->ibo);
 
-   @param visible if true, the cursor will be visible, invisible
-          otherwise
-   */
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  glEnableVertexAttribArray(3);
 
-void get_mouse_position(int *x, int *y);
-  /**<
-   Gets the current mouse position relative to upper left corner of the
-   window.
+  glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),0);                   // position
+  glVertexAttribPointer(1,2,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 12);  // texture coordinate
+  glVertexAttribPointer(2,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 20);  // normal
+  glVertexAttribPointer(3,1,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 32);  // texture blend ratio
 
-   @param x in this variable the x coordinate in pixels will be returned
-   @param y in this variable the y coordinate in pixels will be returned
-   */
+  bind_vertex_array(0);
+}
 
-void set_fog(float distance);
-  /**<
-   Sets the fog distance. The fog color is determined by the background
-   color.
+//----------------------------------------------------------------------
 
-   @param distance distance of the fog measured from the far plane,
-          negative value or zero turns the fog off
-   */
+void buffer_arena::grow(unsigned int minimum_vertices, unsigned int minimum_indices)
 
-// global variables:
+{
+  unsigned int new_capacity;
+  arena_range range;
 
-unsigned int global_window_width, global_window_height;
-unsigned int global_window_center[2];
-void (*user_render_function)(void) = NULL;                         /// pointer to user specified loop render function
-void (*user_keyboard_function)(int key, int x, int y) = NULL;      /// pointer to user specified keypress function
-void (*user_advanced_keyboard_function)(bool key_up, int key, int x, int y) = NULL;
-void (*user_mouse_function)(int button, int state) = NULL;
-float global_fov, global_near, global_far;                         /// perspective parameters
-float global_fog_distance;                                         /// at what distance from the far plane in view space the fog begins
-bool global_recompute_lod = false;                                 /// flag that tells the mesh_3d_lod objects to recompute their LODs
-int global_mouse_position[2];
-bool global_ignore_mouse_position = true;                          /// this is used by camera.handle_fps() to prevent mouse rotation in first call
+  if (this->vbo == 0)                   // first allocation, the buffers are made with the initial capacity
+    {
+      this->vbo = resize_gpu_buffer(0,0,this->vertex_capacity * sizeof(vertex_3d));
+      this->ibo = resize_gpu_buffer(0,0,this->index_capacity * sizeof(unsigned short));
 
-int global_frame_counter = 0;                                      /// for FPS
-int global_last_time = 0;                                          /// for FPS
-float global_fps = 0;
-float global_spf = 0;
+      range.offset = 0;
+      range.size = this->vertex_capacity;
+      free_arena_range(this->free_vertices,range);
 
-unsigned char global_background_color[3];                          /// background color of the viewport
-bool global_keyboard_state[512];                                   /// keeps the keyboard state (each ASCII character + special keys) for the advanced keyboard function
-int global_previous_frame_time = 0;                                /// keep the time of the previous frame
-int global_frame_time_difference = 0;
+      range.size = this->index_capacity;
+      free_arena_range(this->free_indices,range);
+    }
 
-point_3d global_light_direction;                                   /// global directional light direction vector
-unsigned char global_light_color[3];                               /// global directional light RGB intensity
+  if (minimum_vertices != 0)
+    {
+      new_capacity = max(this->vertex_capacity * 2,this->vertex_capacity + minimum_vertices);
+      this->vbo = resize_gpu_buffer(this->vbo,this->vertex_capacity * sizeof(vertex_3d),new_capacity * sizeof(vertex_3d));
 
-texture_2d global_default_font;                                    /// default font texture
+      range.offset = this->vertex_capacity;   // merged with the free range at the end if there is one
+      range.size = new_capacity - this->vertex_capacity;
+      free_arena_range(this->free_vertices,range);
 
-GLuint perspective_matrix_location;                                /// perspective matrix location
-GLuint world_matrix_location;                                      /// world matrix location
-GLuint view_matrix_location;                                       /// view matrix location
-GLuint texture_unit_location;                                      /// texture matrix location
-GLuint texture2_unit_location;
-GLuint textures_location;
-GLuint mesh_color_location;
-GLuint camera_position_location;
-GLuint light_direction_location;
-GLuint light_color_location;
-GLuint ambient_factor_location;
-GLuint diffuse_factor_location;
-GLuint specular_factor_location;
-GLuint specular_exponent_location;
-GLuint transparent_color_location;
-GLuint transparency_enabled_location;
-GLuint render_mode_location;
-GLuint fog_distance_location;
-GLuint use_fog_location;
-GLuint far_plane_location;
-GLuint background_color_location;
-GLuint frame_percentage_location;
-GLuint number_of_shadows_location;
-GLuint shadows_location;
-GLuint draw_2d_location;
+      this->vertex_capacity = new_capacity;
+    }
 
-struct camera_struct                   /// represents a camera
-{
-  point_3d position;                   /// camera position
-  point_3d rotation;                   /// camera rotation (around x, y and z axis in degrees)
-  point_3d direction_forward_vector;   /// camera direction (forward) vector
-  point_3d direction_left_vector;
-  point_3d direction_up_vector;
-  mesh_3d *skybox = NULL;              /// skybox, follows the camera movement (but not its rotation)
+  if (minimum_indices != 0)
+    {
+      new_capacity = max(this->index_capacity * 2,this->index_capacity + minimum_indices);
+      this->ibo = resize_gpu_buffer(this->ibo,this->index_capacity * sizeof(unsigned short),new_capacity * sizeof(unsigned short));
 
-  float translation_matrix[4][4];
-  float rotation_matrix[4][4];
-  float transformation_matrix[4][4];   /// translation + rotation
+      range.offset = this->index_capacity;
+      range.size = new_capacity - this->index_capacity;
+      free_arena_range(this->free_indices,range);
 
-  float movement_speed = 0.01;         /// camera movement speed (distance per millisecond) used by camera handling function
-  float rotation_speed = 0.1;          /// camera rotation speed (angles per millisecond)
-  bool limit_x_rotation = true;        /// this disallows camera handling function to rotate around x more than allowed (classic FPS behaviour)
-  bool use_mouse_for_rotation = true;  /// if true, the mouse movement rotates the camera, otherwise keys are used and mouse can be moved freely
+      this->index_capacity = new_capacity;
+    }
 
-  int key_go_forward = SPECIAL_KEY_UP;
-  int key_go_backward = SPECIAL_KEY_DOWN;
-  int key_go_left = SPECIAL_KEY_LEFT;
-  int key_go_right = SPECIAL_KEY_RIGHT;
-  int key_go_up = 'q';
-  int key_go_down = 'e';
-  int key_rotate_y_cw = 'd';
-  int key_rotate_y_ccw = 'a';
-  int key_rotate_x_cw = 'w';
-  int key_rotate_x_ccw = 's';
-  int key_rotate_z_cw = 'y';
-  int key_rotate_z_ccw = 'x';
+  this->make_vao();
+  set_memory_usage(this,MEMORY_BUFFER_ARENAS,0,this->vertex_capacity * sizeof(vertex_3d) + this->index_capacity * sizeof(unsigned short));
+}
 
-  void set_position(float x, float y, float z);
-    /**<
-     Sets the camera position to given point.
+//----------------------------------------------------------------------
 
-     @param x new camera x
-     @param y new camera y
-     @param z new camera z
-    */
+int buffer_arena::allocate(unsigned int number_of_vertices, unsigned int number_of_indices)
 
-  void get_direction(point_3d *direction);
-    /**<
-     Gets the camera direction vector;
+{
+  arena_allocation allocation;
+  int handle;
 
-     @param direction in this variable the unit camera direction vector
-            will be returned
-     */
+  if (this->vbo == 0)
+    this->grow(0,0);
 
-  void set_skybox(mesh_3d *what);
-    /**<
-     Sets a skybox, which will follow the camera movement (but not its
-     rotation).
+  while (!allocate_arena_range(this->free_vertices,number_of_vertices,&allocation.vertices.offset))
+    this->grow(number_of_vertices,0);
+
+  while (!allocate_arena_range(this->free_indices,number_of_indices,&allocation.indices.offset))
+    this->grow(0,number_of_indices);
 
-     @param what skybox to be set
-     */
+  allocation.vertices.size = number_of_vertices;
+  allocation.indices.size = number_of_indices;
+  allocation.used = true;
 
-  void handle_fps();
-    /**<
-     Handles the camera depending on the current keyboard state and camera
-     settings (speed, key mapping etc.). This is intended to be called inside
-     the render function and only if advanced keyboard function is registered.
-     The camera behaves the same way as in FPS.
-     */
+  if (this->free_handles.size() != 0)
+    {
+      handle = this->free_handles.back();
+      this->free_handles.pop_back();
+      this->allocations[handle] = allocation;
+    }
+  else
+    {
+      handle = this->allocations.size();
+      this->allocations.push_back(allocation);
+    }
 
-  void move(float dx, float dy, float dz);
-    /**<
-     Moves the camera relatively to its current position.
+  return handle;
+}
 
-     @param dx by how much to move the camera in x
-     @param dy by how much to move the camera in y
-     @param dz by how much to move the camera in z
-     */
+//----------------------------------------------------------------------
 
-  void rotate(float dx_angles, float dy_angles, float dz_angles);
-    /**<
-     Rotates the camera relatively to its current rotation.
+void buffer_arena::free(int allocation)
 
-     @param dx_angles by how many angles to rotate the camera around x
-     @param dy_angles by how many angles to rotate the camera around y
-     @param dz_angles by how many angles to rotate the camera around z
-     */
+{
+  if (allocation < 0 || allocation >= (int) this->allocations.size() || !this->allocations[allocation].used)
+    return;
 
-  void set_rotation(float x, float y, float z);
-    /**<
-     Sets the camera rotation to given point.
+  free_arena_range(this->free_vertices,this->allocations[allocation].vertices);
+  free_arena_range(this->free_indices,this->allocations[allocation].indices);
+  this->allocations[allocation].used = false;
+  this->free_handles.push_back(allocation);
+}
 
-     @param x new camera rotation around x
-     @param y new camera rotation around y
-     @param z new camera rotation around z
-    */
+//----------------------------------------------------------------------
 
-  void get_position(point_3d *position);
-    /**<
-     Gets the current camera position.
+void buffer_arena::upload(int allocation, vector<vertex_3d> &vertices, vector<triangle_3d> &triangles)
 
-     @param position in this variable the camera position will be returned
-    */
+{
+  unsigned int i;
+  arena_range vertex_range = this->allocations[allocation].vertices;
+  arena_range index_range = this->allocations[allocation].indices;
 
-  void get_rotation(point_3d *rotation);
-    /**<
-     Gets the current camera rotation.
+  if (vertices.size() > vertex_range.size || triangles.size() * 3 > index_range.size)
+    {
+      cerr << "ERROR: data don't fit the buffer arena allocation.";
+      return;
+    }
 
-     @param rotation in this variable the camera rotation in degrees will
-          be returned
-    */
+  vector<unsigned short> indices(triangles.size() * 3);
 
-  void go(axis_direction direction, float distance);
-    /**<
-     Moves the camera in direction depending on its rotation.
+  for (i = 0; i < triangles.size(); i++)
+    {
+      indices[i * 3] = (unsigned short) triangles[i].index1;
+      indices[i * 3 + 1] = (unsigned short) triangles[i].index2;
+      indices[i * 3 + 2] = (unsigned short) triangles[i].index3;
+    }
 
-     @param direction direction in which the camera will move from its
-            perspective
-     @param distance how far the camera should go
-     */
+  if (vertices.size() != 0)
+    {
+      glBindBuffer(GL_COPY_WRITE_BUFFER,this->vbo);
+      glBufferSubData(GL_COPY_WRITE_BUFFER,vertex_range.offset * sizeof(vertex_3d),vertices.size() * sizeof(vertex_3d),&vertices[0]);
+    }
 
-} camera;
+  if (indices.size() != 0)
+    {
+      glBindBuffer(GL_COPY_WRITE_BUFFER,this->ibo);
+      glBufferSubData(GL_COPY_WRITE_BUFFER,index_range.offset * sizeof(unsigned short),indices.size() * sizeof(unsigned short),&indices[0]);
+    }
+}
 
-//======================================================================
-// private function definitions:
-//======================================================================
+//----------------------------------------------------------------------
 
-float get_distance(point_3d point1, point_3d point2)
+arena_allocation buffer_arena::get_allocation(int allocation)
 
 {
-  float dx,dy,dz;
+  return this->allocations[allocation];
+}
 
-  dx = point1.x - point2.x;
-  dy = point1.y - point2.y;
-  dz = point1.z - point2.z;
+//----------------------------------------------------------------------
 
-  return sqrt(dx * dx + dy * dy + dz * dz);
+GLuint buffer_arena::get_vao()
+
+{
+  return this->vao;
 }
 
 //----------------------------------------------------------------------
 
-void load_default_font()
-  /**<
-   Loads the default global font texture (global_default_font).
-   */
+void buffer_arena::defragment()
 
 {
-  unsigned int i,j,index,x_position;
+  unsigned int i,vertex_end,index_end;
+  GLuint new_vbo,new_ibo;
+  vector<unsigned int> order;
+  arena_range range;
 
-  global_default_font.initialise(1280 + 256,8);  // 1280 = 256 (number of characters) * 5 (character width), + 256 = space perofe each character
-  global_default_font.set_transparent_color(255,255,255);
-  global_default_font.set_transparency(true);
+  if (this->vbo == 0)
+    return;
 
-  index = 0;
+  for (i = 0; i < this->allocations.size(); i++)
+    if (this->allocations[i].used)
+      order.push_back(i);
 
-  for (j = 0; j < 7; j++)
+  sort(order.begin(),order.end(),[this](unsigned int a, unsigned int b)
     {
-      x_position = 198;
+      return this->allocations[a].vertices.offset < this->allocations[b].vertices.offset;
+    });
 
-      for (i = 0; i < 470; i++)              // 470 = width of default font pixel data
-        {
-          if (i % 5 == 0)
-            x_position++;
+  glGenBuffers(1,&new_vbo);
+  glGenBuffers(1,&new_ibo);
 
-          if (default_font_data[index] != 0)
-            global_default_font.set_pixel(x_position,j,0,0,0); // 166 = offset
+  glBindBuffer(GL_COPY_READ_BUFFER,this->vbo);
+  glBindBuffer(GL_COPY_WRITE_BUFFER,new_vbo);
+  glBufferData(GL_COPY_WRITE_BUFFER,this->vertex_capacity * sizeof(vertex_3d),NULL,GL_STATIC_DRAW);
 
-          x_position++;
-          index++;
-        }
+  vertex_end = 0;
+
+  for (i = 0; i < order.size(); i++)  // vertices are moved in their order, indices are relative so they stay the same
+    {
+      arena_range &vertex_range = this->allocations[order[i]].vertices;
+
+      if (vertex_range.size != 0)
+        glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,vertex_range.offset * sizeof(vertex_3d),vertex_end * sizeof(vertex_3d),vertex_range.size * sizeof(vertex_3d));
+
+      vertex_range.offset = vertex_end;
+      vertex_end += vertex_range.size;
     }
 
-  global_default_font.update();
+  sort(order.begin(),order.end(),[this](unsigned int a, unsigned int b)
+    {
+      return this->allocations[a].indices.offset < this->allocations[b].indices.offset;
+    });
+
+  glBindBuffer(GL_COPY_READ_BUFFER,this->ibo);
+  glBindBuffer(GL_COPY_WRITE_BUFFER,new_ibo);
+  glBufferData(GL_COPY_WRITE_BUFFER,this->index_capacity * sizeof(unsigned short),NULL,GL_STATIC_DRAW);
+
+  index_end = 0;
+
+  for (i = 0; i < order.size(); i++)
+    {
+      arena_range &index_range = this->allocations[order[i]].indices;
+
+      if (index_range.size != 0)
+        glCopyBufferSubData(GL_COPY_READ_BUFFER,GL_COPY_WRITE_BUFFER,index_range.offset * sizeof(unsigned short),index_end * sizeof(unsigned short),index_range.size * sizeof(unsigned short));
+
+      index_range.offset = index_end;
+      index_end += index_range.size;
+    }
+
+  glDeleteBuffers(1,&this->vbo);
+  glDeleteBuffers(1,&this->ibo);
+  this->vbo = new_vbo;
+  this->ibo = new_ibo;
+
+  this->free_vertices.clear();
+  this->free_indices.clear();
+
+  range.offset = vertex_end;
+  range.size = this->vertex_capacity - vertex_end;
+  free_arena_range(this->free_vertices,range);
+
+  range.offset = index_end;
+  range.size = this->index_capacity - index_end;
+  free_arena_range(this->free_indices,range);
+
+  this->make_vao();
 }
 
 //----------------------------------------------------------------------
 
-float clamp(float what, float minimum, float maximum)
+unsigned int buffer_arena::get_allocation_count()
 
 {
-  if (what > maximum)
-    return maximum;
-  else if (what < minimum)
-    return minimum;
-  else
-    return what;
+  return this->allocations.size() - this->free_handles.size();
 }
 
 //----------------------------------------------------------------------
 
-void print_matrix(float matrix[4][4])
-  /**<
-    For debugging purposes, prints given matrix.
-
-    @matrix matrix to be printed
-  */
+void buffer_arena::get_occupancy(float *vertex_occupancy, float *index_occupancy)
 
 {
-  unsigned int i,j;
+  unsigned int i,free_vertices,free_indices;
 
-  for (j = 0; j < 4; j++)
-    {
-      for (i = 0; i < 4; i++)
-        cout << matrix[i][j] << " ";
+  free_vertices = 0;
+  free_indices = 0;
 
-      cout << endl;
-    }
+  for (i = 0; i < this->free_vertices.size(); i++)
+    free_vertices += this->free_vertices[i].size;
 
-  cout << endl;
+  for (i = 0; i < this->free_indices.size(); i++)
+    free_indices += this->free_indices[i].size;
+
+  *vertex_occupancy = this->vbo == 0 ? 0.0 : 1.0 - free_vertices / ((float) this->vertex_capacity);
+  *index_occupancy = this->ibo == 0 ? 0.0 : 1.0 - free_indices / ((float) this->index_capacity);
 }
 
 //----------------------------------------------------------------------
 
-unsigned int texture_2d::xy_to_linear(int x, int y)
+void buffer_arena::get_fragmentation(float *vertex_fragmentation, float *index_fragmentation)
 
 {
-  return (y * this->width + x) * 3;
+  *vertex_fragmentation = arena_fragmentation(this->free_vertices);
+  *index_fragmentation = arena_fragmentation(this->free_indices);
 }
 
 //----------------------------------------------------------------------
 
-int convert_glut_key(int glut_key)
-  /**<
-   Converts the GLUT key code to the library key code.
-   */
+void buffer_arena::print_report()
 
 {
-  switch (glut_key)
-    {
-      case GLUT_KEY_UP: return SPECIAL_KEY_UP; break;
-      case GLUT_KEY_RIGHT: return SPECIAL_KEY_RIGHT; break;
-      case GLUT_KEY_DOWN: return SPECIAL_KEY_DOWN; break;
-      case GLUT_KEY_LEFT: return SPECIAL_KEY_LEFT; break;
-    }
+  float vertex_occupancy,index_occupancy,vertex_fragmentation,index_fragmentation;
 
-  return 0;
+  this->get_occupancy(&vertex_occupancy,&index_occupancy);
+  this->get_fragmentation(&vertex_fragmentation,&index_fragmentation);
+
+  cout << "buffer arena: " << this->get_allocation_count() << " allocations" << endl;
+  cout << "  VBO: " << this->vertex_capacity << " vertices (" << (this->vertex_capacity * sizeof(vertex_3d)) / 1024 << " KB), " <<
+    vertex_occupancy * 100 << " % used, " << this->free_vertices.size() << " free ranges, fragmentation " << vertex_fragmentation << endl;
+  cout << "  IBO: " << this->index_capacity << " indices (" << (this->index_capacity * sizeof(unsigned short)) / 1024 << " KB), " <<
+    index_occupancy * 100 << " % used, " << this->free_indices.size() << " free ranges, fragmentation " << index_fragmentation << endl;
 }
 
 //----------------------------------------------------------------------
 
-void parse_obj_line(string line,float data[4][3])
-  /**<
-    Parses the data contained in one line of obj file format
-    (e.g. "v 1.5 3 4.2" or "f 1/2 3/5 4/6 1/20").
-
-    @param data in this variable the parsed data will be returned, the
-           first index represents the element number (i.e. x, y, z for
-           a vertex or one of the triangle indices) and the second index
-           represents one of up to 3 shashed values (if the values are
-           in format a/b/3), if any of the values is not present, -1.0
-           is inserted.
-   */
+picture_2d::picture_2d()
 
 {
-  line = line.substr(line.find_first_of(' '));  // get rid of the first characters
+  this->picture_mesh.set_render_mode(RENDER_MODE_NO_LIGHT);
+  this->picture_mesh.add_vertex(0,0,0,0,0,0,0,1);  // z coordinate doesn't matter
+  this->picture_mesh.add_vertex(1,0,0,1,0,0,0,1);
+  this->picture_mesh.add_vertex(0,1,0,0,1,0,0,1);
+  this->picture_mesh.add_vertex(1,1,0,1,1,0,0,1);
 
-  unsigned int i,j;
-  size_t position;
-  bool do_break;
+  this->set_position(0,0);
+  this->set_rotation(0);
+  this->set_size(0.5,0.5);
 
-  for (i = 0; i < 4; i++)
-    for (j = 0; j < 3; j++)
-      data[i][j] = -1.0;
+  this->picture_mesh.add_triangle(0,2,1);
+  this->picture_mesh.add_triangle(1,2,3);
+}
 
-  for (i = 0; i < 4; i++)
-    {
-      for (j = 0; j < 3; j++)
-        {
-          do_break = false;
+//----------------------------------------------------------------------
 
-          try
-            {
-              if (line.length() >= 1)
-                data[i][j] = stof(line,&position);
+picture_2d::~picture_2d()
 
-              if (line[position] != '/')
-                do_break = true;
+{
+}
 
-              if (position + 1 <= line.length())
-                line = line.substr(position + 1);
-              else
-                return;
+//----------------------------------------------------------------------
 
-              if (do_break)
-                break;
-            }
-          catch (exception& e)
-            {
-            }
-        }
-    }
+void picture_2d::set_picture(texture_2d *picture)
+
+{
+  this->picture_mesh.set_texture(picture);
+  this->update();
 }
 
 //----------------------------------------------------------------------
 
-float angle_to_0_360(float angle)
-  /**<
-   Converts a value in angles so that it is in range <0,360>.
-
-   @param angle angle to be converted
-   @return corresponding angle in <0,360> range
-   */
+void picture_2d::set_position(float x, float y)
 
 {
-  if (angle < 0)
-    {
-      angle = -1 * angle;
-      angle = fmod(angle,360.0);
-      angle = 360.0 - angle;
-    }
+  x = clamp(x,0.0,0.1) * 2 - 1.0;
+  y = clamp(y,0.0,0.1) * 2 - 1.0;
 
-  if (angle != 0)
-    angle = fmod(angle,360.0);
-  
-  return angle;
+  this->picture_mesh.set_position(x,y,0);
+}
+
+//----------------------------------------------------------------------
+
+void picture_2d::set_rotation(float degrees)
+
+{
+  this->picture_mesh.set_rotation(0,0,degrees);
 }
 
 //----------------------------------------------------------------------
 
-void multiply_matrices(float matrix_a[4][4], float matrix_b[4][4], float matrix_result[4][4])
+void picture_2d::draw()
 
 {
-  unsigned int i,j;
+  global_shader_features |= SHADER_2D;
+  this->picture_mesh.draw();
+  global_shader_features &= ~SHADER_2D;
+}
 
-  for (j = 0; j < 4; j++)
-    for (i = 0; i < 4; i++)
-      matrix_result[i][j] =
-        matrix_b[0][j] * matrix_a[i][0] +
-        matrix_b[1][j] * matrix_a[i][1] +
-        matrix_b[2][j] * matrix_a[i][2] +
-        matrix_b[3][j] * matrix_a[i][3];
+//----------------------------------------------------------------------
+
+void picture_2d::update()
+
+{
+  this->picture_mesh.update();
 }
 
 //----------------------------------------------------------------------
 
-void cross_product(point_3d vector_a, point_3d vector_b, point_3d *point_result)
+void picture_2d::unload()
 
 {
-  point_result->x = vector_a.y * vector_b.z - vector_a.z * vector_b.y;
-  point_result->y = vector_a.z * vector_b.x - vector_a.x * vector_b.z;
-  point_result->z = vector_a.x * vector_b.y - vector_a.y * vector_b.x;
+  this->picture_mesh.unload();
 }
 
 //----------------------------------------------------------------------
 
-void multiply_vector_matrix(float vector[4], float matrix[4][4], float vector_result[4])
+void picture_2d::set_size(float width, float height)
 
 {
-  unsigned int i;
+  width = clamp(width,0.0,1.0) * 2;
+  height = clamp(height,0.0,1.0) * 2;
 
-  for (i = 0; i < 4; i++)
-    vector_result[i] = vector[0] * matrix[i][0] + vector[1] * matrix[i][1] +
-                       vector[2] * matrix[i][2] + vector[3] * matrix[i][3];
+  this->picture_mesh.set_scale(width,height,1.0);
 }
 
 //----------------------------------------------------------------------
 
-void mouse_move_function(int x, int y)
-
-  /**<
-    This function is internally registered as a mouse move function and
-    updates the global mouse coordinates.
-  */
+void mesh_3d_animated::use_interpolation(bool interpolate)
 
 {
-  global_mouse_position[0] = x;
-  global_mouse_position[1] = y;
+  this->interpolating = interpolate;
 }
 
 //----------------------------------------------------------------------
 
-void mouse_click_function(int button, int state, int x, int y)
+mesh_3d_animated::~mesh_3d_animated()
 
 {
-  global_mouse_position[0] = x;
-  global_mouse_position[1] = y;
-
-  if (user_mouse_function != NULL)
-    user_mouse_function(button,state);
+  this->clear();
 }
 
 //----------------------------------------------------------------------
 
-void loop_function()
-
-  /**<
-    This function is internally registered as a render function and calls
-    the user render function.
-  */
+unsigned int mesh_3d_animated::get_number_of_frames()
 
 {
-  unsigned int helper_time = glutGet(GLUT_ELAPSED_TIME);
-  global_frame_time_difference = helper_time - global_previous_frame_time;
-  global_previous_frame_time = helper_time;
+  return this->frames.size();
+}
 
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+//----------------------------------------------------------------------
 
-  user_render_function();
+void mesh_3d_animated::add_frame(mesh_3d_static *mesh, unsigned int length)
 
-  global_recompute_lod = false;
+{
+  animation_frame frame;
+  vertex_3d vertex;
+  triangle_3d triangle;
+  unsigned int i;
 
-  if (global_frame_counter <= 0)      // recompute FPS
-      {
-        global_recompute_lod = true;  // so that the next frame LOD will be recomputed
+  if (!mesh->make_resident())
+    return;
 
-        float ms_difference = get_time() - global_last_time;
-        float sec_difference = ms_difference / 1000.0;
+  frame.length_ms = length;
 
-        global_spf = sec_difference / RECOMPUTE_FRAMES;
-        global_fps = RECOMPUTE_FRAMES / sec_difference;
+  for (i = 0; i < mesh->vertices.size(); i++)
+    {
+      vertex.position.x = mesh->vertices[i].position.x;
+      vertex.position.y = mesh->vertices[i].position.y;
+      vertex.position.z = mesh->vertices[i].position.z;
+      vertex.normal.x = mesh->vertices[i].normal.x;
+      vertex.normal.y = mesh->vertices[i].normal.y;
+      vertex.normal.z = mesh->vertices[i].normal.z;
+      vertex.texture_coordinate[0] = mesh->vertices[i].texture_coordinate[0];
+      vertex.texture_coordinate[1] = mesh->vertices[i].texture_coordinate[1];
 
-        global_frame_counter = RECOMPUTE_FRAMES;
-        global_last_time = get_time();
-      }
-    else
-      global_frame_counter--;
+      frame.vertices.push_back(vertex);
+    }
 
-  glutSwapBuffers();
+  for (i = 0; i < mesh->triangles.size(); i++)
+    {
+      triangle.index1 = mesh->triangles[i].index1;
+      triangle.index2 = mesh->triangles[i].index2;
+      triangle.index3 = mesh->triangles[i].index3;
+
+      frame.triangles.push_back(triangle);
+    }
+
+  this->frames.push_back(frame);
+  this->frames_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-void make_perspective_matrix(float fov_degrees, float near_plane, float far_plane, float matrix[4][4])
+void mesh_3d_animated::set_playing(bool play)
 
 {
-  float aspect_ratio = global_window_width / ((float) global_window_height);
-  float range = near_plane - far_plane;
-  float tan_half_fov = tanf(fov_degrees / 2.0 * PI_DIVIDED_180);
+  this->playing = play;
+}
 
-  matrix[0][0] = 1.0f / (tan_half_fov * aspect_ratio) ; matrix[1][0] = 0.0f; matrix[2][0] = 0.0f; matrix[3][0] = 0.0f;
-  matrix[0][1] = 0.0f; matrix[1][1] = 1.0f / tan_half_fov; matrix[2][1] = 0.0f; matrix[3][1] = 0.0f;
-  matrix[0][2] = 0.0f; matrix[1][2] = 0.0f; matrix[2][2] = (-1 * near_plane - far_plane) / (float) range; matrix[3][2] = 1.0;
-  matrix[0][3] = 0.0f; matrix[1][3] = 0.0f; matrix[2][3] = 2.0f * far_plane * near_plane / (float) range; matrix[3][3] = 0.0f;
+//----------------------------------------------------------------------
+
+keyframe_interpolator::keyframe_interpolator()
+
+{
+  this->cursor = 0;
+  this->segments_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-void make_rotation_matrix(float degrees_x, float degrees_y, float degrees_z, rotation_matrix_type type, float matrix[4][4])
+void keyframe_interpolator::sort()
 
 {
-  degrees_x *= PI_DIVIDED_180;  // convert to radians
-  degrees_y *= PI_DIVIDED_180;
-  degrees_z *= PI_DIVIDED_180;
+  stable_sort(this->keyframes.begin(),this->keyframes.end(),
+    [](const keyframe &keyframe1, const keyframe &keyframe2) { return keyframe1.x < keyframe2.x; });
 
-  float sin_x = sin(degrees_x);
-  float cos_x = cos(degrees_x);
-  float sin_y = sin(degrees_y);
-  float cos_y = cos(degrees_y);
-  float sin_z = sin(degrees_z);
-  float cos_z = cos(degrees_z);
+  this->cursor = 0;
+  this->segments_changed = true;
+}
 
-  switch (type)
-    {
-      case ROTATION_XYZ:
+//----------------------------------------------------------------------
 
-        matrix[0][0] = cos_z * cos_y;
-        matrix[1][0] = -1 * cos_y * sin_z;
-        matrix[2][0] = sin_y;
-        matrix[3][0] = 0;
+void keyframe_interpolator::add_hermite_keyframe(float x, float y, float tangent)
 
-        matrix[0][1] = sin_x * sin_y * cos_z + cos_x * sin_z;
-        matrix[1][1] = -1 * sin_x * sin_y * sin_z + cos_x * cos_z;
-        matrix[2][1] = -1 * sin_x * cos_y;
-        matrix[3][1] = 0;
+{
+  this->add_keyframe(x,y,INTERPOLATION_HERMITE);
+  this->keyframes[this->find_segment(x) - 1].tangent = tangent;   // the new keyframe is the last one with this x
+}
 
-        matrix[0][2] = -1 * cos_x * sin_y * cos_z + sin_x * sin_z;
-        matrix[1][2] = cos_x * sin_y * sin_z + sin_x * cos_z;
-        matrix[2][2] = cos_x * cos_y;
-        matrix[3][2] = 0;
+//----------------------------------------------------------------------
 
-        matrix[0][3] = 0;
-        matrix[1][3] = 0;
-        matrix[2][3] = 0;
-        matrix[3][3] = 1;
-        break;
+void keyframe_interpolator::add_bezier_keyframe(float x, float y, float control_in, float control_out)
 
-      case ROTATION_ZYX:
+{
+  this->add_keyframe(x,y,INTERPOLATION_BEZIER);
 
-        matrix[0][0] = cos_z * cos_y;
-        matrix[1][0] = cos_z * sin_y * sin_x - sin_z * cos_x;
-        matrix[2][0] = cos_z * sin_y * cos_x + sin_z * sin_x;
-        matrix[3][0] = 0;
+  keyframe &added = this->keyframes[this->find_segment(x) - 1];
+  added.control_in = control_in;
+  added.control_out = control_out;
+}
 
-        matrix[0][1] = sin_z * cos_y;
-        matrix[1][1] = sin_z * sin_y * sin_x + cos_z * cos_x;
-        matrix[2][1] = sin_z * sin_y * cos_x - cos_z * sin_x;
-        matrix[3][1] = 0;
+//----------------------------------------------------------------------
 
-        matrix[0][2] = -1 * sin_y;
-        matrix[1][2] = cos_y * sin_x;
-        matrix[2][2] = cos_y * cos_x;
-        matrix[3][2] = 0;
+void keyframe_interpolator::update_segments()
 
-        matrix[0][3] = 0;
-        matrix[1][3] = 0;
-        matrix[2][3] = 0;
-        matrix[3][3] = 1;
-        break;
+{
+  unsigned int i,previous,next;
+  float slope0,slope1;
 
-      case ROTATION_ZXY:
+  this->segments.resize(this->keyframes.size() > 1 ? this->keyframes.size() - 1 : 0);
 
-        matrix[0][0] = cos_z * cos_y - sin_z * sin_x * sin_y;
-        matrix[1][0] = -1 * sin_z * cos_x;
-        matrix[2][0] = cos_z * sin_y + sin_z * sin_x * cos_y;
-        matrix[3][0] = 0;
+  for (i = 0; i < this->segments.size(); i++)
+    {
+      keyframe &key0 = this->keyframes[i];
+      keyframe &key1 = this->keyframes[i + 1];
 
-        matrix[0][1] = sin_z * cos_y + cos_z * sin_x * sin_y;
-        matrix[1][1] = cos_z * cos_x;
-        matrix[2][1] = sin_z * sin_y - cos_z * sin_x * cos_y;
-        matrix[3][1] = 0;
+      if (key0.interpolation == INTERPOLATION_CATMULL_ROM)
+        {
+          previous = i == 0 ? 0 : i - 1;         // one-sided slopes at the ends
+          next = min(i + 2,(unsigned int) this->keyframes.size() - 1);
+          slope0 = catmull_rom_slope(this->keyframes[previous].x,this->keyframes[previous].y,key1.x,key1.y);
+          slope1 = catmull_rom_slope(key0.x,key0.y,this->keyframes[next].x,this->keyframes[next].y);
+        }
+      else
+        {
+          slope0 = key0.tangent;
+          slope1 = key1.tangent;
+        }
 
-        matrix[0][2] = -1 * cos_x * sin_y;
-        matrix[1][2] = sin_x;
-        matrix[2][2] = cos_x * cos_y;
-        matrix[3][2] = 0;
+      make_spline_segment(key0.interpolation,key0.x,key0.y,key1.x,key1.y,slope0,slope1,key0.control_out,key1.control_in,&this->segments[i]);
+    }
 
-        matrix[0][3] = 0;
-        matrix[1][3] = 0;
-        matrix[2][3] = 0;
-        matrix[3][3] = 1;
-        break;
+  this->segments_changed = false;
+}
 
-      case ROTATION_YXZ:
+//----------------------------------------------------------------------
 
-        matrix[0][0] = cos_y * cos_z + sin_y * sin_x * sin_z;
-        matrix[1][0] = -1 * cos_y * sin_z + sin_y * sin_x * cos_z;
-        matrix[2][0] = sin_y * cos_x;
-        matrix[3][0] = 0;
+void keyframe_interpolator::add_keyframes(const vector<keyframe> &new_keyframes)
 
-        matrix[0][1] = cos_x * sin_z;
-        matrix[1][1] = cos_x * cos_z;
-        matrix[2][1] = -1 * sin_x;
-        matrix[3][1] = 0;
+{
+  this->keyframes.insert(this->keyframes.end(),new_keyframes.begin(),new_keyframes.end());
+  this->sort();
+}
 
-        matrix[0][2] = -1 * sin_y * cos_z + cos_y * sin_x * sin_z;
-        matrix[1][2] = sin_y * sin_z + cos_y * sin_x * cos_z;
-        matrix[2][2] = cos_y * cos_x;
-        matrix[3][2] = 0;
+//----------------------------------------------------------------------
 
-        matrix[0][3] = 0;
-        matrix[1][3] = 0;
-        matrix[2][3] = 0;
-        matrix[3][3] = 1;
-        break;
-    }
+unsigned int keyframe_interpolator::get_keyframe_count()
 
-  unsigned int i,j;
+{
+  return this->keyframes.size();
+}
 
-  for (j = 0; j < 4; j++)        // get rid of negative zeroes, they mess up the shaders
-    for (i = 0; i < 4; i++)
-      if (matrix[i][j] == -0)
-        matrix[i][j] = 0;
+//----------------------------------------------------------------------
+
+keyframe keyframe_interpolator::get_keyframe(unsigned int index)
+
+{
+  if (index >= this->keyframes.size())
+    return keyframe();
+
+  return this->keyframes[index];
 }
 
 //----------------------------------------------------------------------
 
-void make_translation_matrix(float x, float y, float z, float matrix[4][4])
+void keyframe_interpolator::set_keyframe(unsigned int index, keyframe new_keyframe)
 
 {
-  matrix[0][0] = 1;
-  matrix[1][0] = 0;
-  matrix[2][0] = 0;
-  matrix[3][0] = 0;
+  bool moved;
 
-  matrix[0][1] = 0;
-  matrix[1][1] = 1;
-  matrix[2][1] = 0;
-  matrix[3][1] = 0;
+  if (index >= this->keyframes.size())
+    return;
 
-  matrix[0][2] = 0;
-  matrix[1][2] = 0;
-  matrix[2][2] = 1;
-  matrix[3][2] = 0;
+  moved = this->keyframes[index].x != new_keyframe.x;
+  this->keyframes[index] = new_keyframe;
 
-  matrix[0][3] = x;
-  matrix[1][3] = y;
-  matrix[2][3] = z;
-  matrix[3][3] = 1;
+  if (moved)
+    this->sort();
+  else
+    this->segments_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-void make_scale_matrix(float x, float y, float z, float matrix[4][4])
+void keyframe_interpolator::remove_keyframe(unsigned int index)
 
 {
-  matrix[0][0] = x;
-  matrix[1][0] = 0;
-  matrix[2][0] = 0;
-  matrix[3][0] = 0;
+  if (index >= this->keyframes.size())
+    return;
 
-  matrix[0][1] = 0;
-  matrix[1][1] = y;
-  matrix[2][1] = 0;
-  matrix[3][1] = 0;
+  this->keyframes.erase(this->keyframes.begin() + index);
+  this->cursor = 0;
+  this->segments_changed = true;
+}
 
-  matrix[0][2] = 0;
-  matrix[1][2] = 0;
-  matrix[2][2] = z;
-  matrix[3][2] = 0;
+//----------------------------------------------------------------------
 
-  matrix[0][3] = 0;
-  matrix[1][3] = 0;
-  matrix[2][3] = 0;
-  matrix[3][3] = 1;
+void keyframe_interpolator::clear()
+
+{
+  this->keyframes.clear();
+  this->segments.clear();
+  this->cursor = 0;
+  this->segments_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-void make_identity_matrix(float matrix[4][4])
+unsigned int keyframe_interpolator::find_segment(float x)
 
 {
-  unsigned int i,j;
+  unsigned int number_of_keyframes = this->keyframes.size();
+  unsigned int i = min(this->cursor,number_of_keyframes);
 
-  for (j = 0; j < 4; j++)
-    for (i = 0; i < 4; i++)
-      if (i == j)
-        matrix[i][j] = 1;
-      else
-        matrix[i][j] = 0;
+  if ((i == 0 || this->keyframes[i - 1].x <= x) && (i == number_of_keyframes || this->keyframes[i].x > x))
+    return i;                         // the same segment as last time
+
+  if (i < number_of_keyframes && this->keyframes[i].x <= x && (i + 1 == number_of_keyframes || this->keyframes[i + 1].x > x))
+    i++;                              // the next segment
+  else
+    i = upper_bound(this->keyframes.begin(),this->keyframes.end(),x,
+      [](float value, const keyframe &key) { return value < key.x; }) - this->keyframes.begin();
+
+  this->cursor = i;
+  return i;
 }
 
 //----------------------------------------------------------------------
 
-bool add_shader(GLuint shader_program, const char* shader_text, GLenum shader_type)
+string get_gpu_info_string()
 
 {
-  GLuint shader_object = glCreateShader(shader_type);
+  string result;
 
-  const GLchar* p[1];
-  p[0] = shader_text;
+  result = ((const char *) glGetString(GL_VENDOR));
+  result += " ";
+  result += ((const char *) glGetString(GL_VERSION));
 
-  GLint lengths[1];
-  lengths[0]= strlen(shader_text);
+  return result;
+}
 
-  glShaderSource(shader_object,1,p,lengths);
-  glCompileShader(shader_object);
+//----------------------------------------------------------------------
 
-  GLint success;
+void keyframe_interpolator::add_keyframe(float x, float y, interpolation_method interpolation)
 
-  glGetShaderiv(shader_object,GL_COMPILE_STATUS,&success);
+{
+  keyframe helper_keyframe;
 
-  if (!success)
-    {
-      GLchar log[1024];
-      glGetShaderInfoLog(shader_object,sizeof(log),NULL,log);
-      cerr << "Shader compile log: " << log << endl;
-      return false;
-    }
+  helper_keyframe.x = x;
+  helper_keyframe.y = y;
+  helper_keyframe.interpolation = interpolation;
+  helper_keyframe.tangent = 0.0;
+  helper_keyframe.control_in = y;
+  helper_keyframe.control_out = y;
 
-  glAttachShader(shader_program,shader_object);
+  this->keyframes.insert(upper_bound(this->keyframes.begin(),this->keyframes.end(),x,  // after the keyframes with the same x
+    [](float value, const keyframe &key) { return value < key.x; }),helper_keyframe);
 
-  return true;
+  this->cursor = 0;
+  this->segments_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-bool compile_shaders()
+float keyframe_interpolator::get_value(float x)
 
 {
-  char log[256];
+  if (this->keyframes.size() <= 1)
+    return 0.0;
 
-  GLuint shader_program = glCreateProgram();
+  spline_segment *segment = this->get_segment(x);
 
-  if (shader_program == 0)
-    {
-      cerr << "ERROR: could not create a shader program." << endl;
-      return false;
-    }
+  if (segment == NULL)
+    return 0;
 
-  if (!add_shader(shader_program,shader_vertex,GL_VERTEX_SHADER))
-    {
-      cerr << "ERROR: could not add a vertex shader program." << endl;
-      return false;
-    }
+  float t = segment_parameter(*segment,x);
 
-  if (!add_shader(shader_program,shader_fragment,GL_FRAGMENT_SHADER))
-    {
-      cerr << "ERROR: could not add a fragment shader program." << endl;
-      return false;
-    }
+  return ((segment->coefficients[0] * t + segment->coefficients[1]) * t + segment->coefficients[2]) * t + segment->coefficients[3];
+}
 
-  GLint success = 0;
+//----------------------------------------------------------------------
 
-  glLinkProgram(shader_program);
+spline_segment *keyframe_interpolator::get_segment(float x)
 
-  glGetProgramiv(shader_program,GL_LINK_STATUS,&success);
+{
+  if (this->keyframes.size() <= 1)
+    return NULL;
 
-  if (success == 0)
-    {
-      glGetProgramInfoLog(shader_program,sizeof(log),NULL,log);
-      cerr << log << endl;
-      cerr << "ERROR: could not link the shader program." << endl;
-      return false;
-    }
+  if (this->segments_changed || this->segments.size() + 1 != this->keyframes.size())
+    this->update_segments();
 
-  glValidateProgram(shader_program);
+  unsigned int i = this->find_segment(x);
 
-  glGetProgramiv(shader_program,GL_VALIDATE_STATUS,&success);
+  if (i == 0 || i >= this->keyframes.size())
+    return NULL;
 
-  if (!success)
-    {
-      cerr << "ERROR: the shader program is invalid." << endl;
-      return false;
-    }
+  return &this->segments[i - 1];
+}
 
-  glUseProgram(shader_program);
+//----------------------------------------------------------------------
 
-  perspective_matrix_location = glGetUniformLocation(shader_program,"perspective_matrix");
-  world_matrix_location = glGetUniformLocation(shader_program,"world_matrix");
-  view_matrix_location = glGetUniformLocation(shader_program,"view_matrix");
-  texture_unit_location = glGetUniformLocation(shader_program,"texture_unit");
-  texture2_unit_location = glGetUniformLocation(shader_program,"texture_unit2");
-  textures_location = glGetUniformLocation(shader_program,"textures");
-  mesh_color_location = glGetUniformLocation(shader_program,"mesh_color");
-  light_direction_location = glGetUniformLocation(shader_program,"light_direction");
-  light_color_location = glGetUniformLocation(shader_program,"light_color");
-  ambient_factor_location = glGetUniformLocation(shader_program,"ambient_factor");
-  diffuse_factor_location = glGetUniformLocation(shader_program,"diffuse_factor");
-  specular_factor_location = glGetUniformLocation(shader_program,"specular_factor");
-  camera_position_location = glGetUniformLocation(shader_program,"camera_position");
-  specular_exponent_location = glGetUniformLocation(shader_program,"specular_exponent");
-  transparent_color_location = glGetUniformLocation(shader_program,"transparent_color");
-  transparency_enabled_location = glGetUniformLocation(shader_program,"transparency_enabled");
-  render_mode_location = glGetUniformLocation(shader_program,"render_mode");
-  fog_distance_location = glGetUniformLocation(shader_program,"fog_distance");
-  far_plane_location = glGetUniformLocation(shader_program,"far_plane");
-  background_color_location = glGetUniformLocation(shader_program,"background_color");
-  use_fog_location = glGetUniformLocation(shader_program,"use_fog");
-  frame_percentage_location = glGetUniformLocation(shader_program,"frame_percentage");
-  number_of_shadows_location = glGetUniformLocation(shader_program,"number_of_shadows");
-  shadows_location = glGetUniformLocation(shader_program,"shadows");
-  draw_2d_location = glGetUniformLocation(shader_program,"draw_2d");
+multichannel_interpolator::multichannel_interpolator(unsigned int channels)
 
-  return true;
+{
+  this->channels = max(channels,1u);
+  this->cursor = 0;
+  this->segments_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-void helper_special_function(int key, int x, int y)
+void multichannel_interpolator::add_keyframe(float x, const float *values, interpolation_method interpolation, const float *tangents)
 
 {
-  key = convert_glut_key(key);
+  unsigned int i,index;
+  keyframe value = keyframe();
 
-  if (user_advanced_keyboard_function != NULL)
+  index = upper_bound(this->positions.begin(),this->positions.end(),x) - this->positions.begin();
+
+  this->positions.insert(this->positions.begin() + index,x);
+  this->methods.insert(this->methods.begin() + index,interpolation);
+  this->values.insert(this->values.begin() + index * this->channels,this->channels,value);
+
+  for (i = 0; i < this->channels; i++)
     {
-      if (!global_keyboard_state[key])
-        {
-          global_keyboard_state[key] = true;
-          user_advanced_keyboard_function(true,key,x,y);
-        }
+      value.x = x;
+      value.y = values[i];
+      value.interpolation = interpolation;
+      value.tangent = tangents == NULL ? 0.0 : tangents[i];
+      value.control_in = values[i];
+      value.control_out = values[i];
+      this->values[index * this->channels + i] = value;
     }
 
-  if (user_keyboard_function != NULL)
+  this->cursor = 0;
+  this->segments_changed = true;
+}
+
+//----------------------------------------------------------------------
+
+void multichannel_interpolator::add_bezier_keyframe(float x, const float *values, const float *controls_in, const float *controls_out)
+
+{
+  unsigned int i,index;
+
+  this->add_keyframe(x,values,INTERPOLATION_BEZIER);
+
+  index = upper_bound(this->positions.begin(),this->positions.end(),x) - this->positions.begin() - 1;
+
+  for (i = 0; i < this->channels; i++)
     {
-      user_keyboard_function(key,x,y);
+      this->values[index * this->channels + i].control_in = controls_in[i];
+      this->values[index * this->channels + i].control_out = controls_out[i];
     }
 }
 
 //----------------------------------------------------------------------
 
-void helper_keyboard_function(unsigned char key, int x, int y)
+void multichannel_interpolator::update_segments()
 
 {
-  if (user_advanced_keyboard_function != NULL)
+  unsigned int i,j,previous,next,number_of_keyframes;
+  float slope0,slope1;
+
+  number_of_keyframes = this->positions.size();
+  this->segments.resize(number_of_keyframes > 1 ? (number_of_keyframes - 1) * this->channels : 0);
+
+  for (i = 0; i + 1 < number_of_keyframes; i++)
     {
-      if (!global_keyboard_state[key])
+      previous = i == 0 ? 0 : i - 1;
+      next = min(i + 2,number_of_keyframes - 1);
+
+      for (j = 0; j < this->channels; j++)
         {
-          global_keyboard_state[key] = true;
-          user_advanced_keyboard_function(true,key,x,y);
+          keyframe &key0 = this->values[i * this->channels + j];
+          keyframe &key1 = this->values[(i + 1) * this->channels + j];
+
+          if (this->methods[i] == INTERPOLATION_CATMULL_ROM)
+            {
+              slope0 = catmull_rom_slope(this->positions[previous],this->values[previous * this->channels + j].y,this->positions[i + 1],key1.y);
+              slope1 = catmull_rom_slope(this->positions[i],key0.y,this->positions[next],this->values[next * this->channels + j].y);
+            }
+          else
+            {
+              slope0 = key0.tangent;
+              slope1 = key1.tangent;
+            }
+
+          make_spline_segment(this->methods[i],this->positions[i],key0.y,this->positions[i + 1],key1.y,
+            slope0,slope1,key0.control_out,key1.control_in,&this->segments[i * this->channels + j]);
         }
     }
 
-  if (user_keyboard_function != NULL)
-    user_keyboard_function(key,x,y);
+  this->segments_changed = false;
 }
 
 //----------------------------------------------------------------------
 
-void helper_advanced_special_keyboard_function(int key, int x, int y)
+void multichannel_interpolator::get_values(float x, float *result)
 
 {
-  key = convert_glut_key(key);
+  unsigned int i,number_of_keyframes;
+  float t;
 
-  if (user_advanced_keyboard_function != NULL && global_keyboard_state[key])
+  number_of_keyframes = this->positions.size();
+
+  if (number_of_keyframes == 0)
     {
-      global_keyboard_state[key] = false;
-      user_advanced_keyboard_function(false,key,x,y);
+      for (i = 0; i < this->channels; i++)
+        result[i] = 0.0;
+
+      return;
     }
-}
 
-//----------------------------------------------------------------------
+  if (this->segments_changed)
+    this->update_segments();
 
-void helper_advanced_keyboard_function(unsigned char key, int x, int y)
+  i = min(this->cursor,number_of_keyframes);   // the same search as keyframe_interpolator::find_segment
 
-{
-  if (user_advanced_keyboard_function != NULL && global_keyboard_state[key])
+  if (!((i == 0 || this->positions[i - 1] <= x) && (i == number_of_keyframes || this->positions[i] > x)))
     {
-      global_keyboard_state[key] = false;
-      user_advanced_keyboard_function(false,key,x,y);
+      if (i < number_of_keyframes && this->positions[i] <= x && (i + 1 == number_of_keyframes || this->positions[i + 1] > x))
+        i++;
+      else
+        i = upper_bound(this->positions.begin(),this->positions.end(),x) - this->positions.begin();
+
+      this->cursor = i;
     }
-}
 
-//----------------------------------------------------------------------
+  if (i == 0 || i >= number_of_keyframes)     // outside, hold the first or the last value
+    {
+      keyframe *key = &this->values[(i == 0 ? 0 : number_of_keyframes - 1) * this->channels];
 
-void mesh_3d::update_transformation_matrix()
+      for (i = 0; i < this->channels; i++)
+        result[i] = key[i].y;
 
-{
-  float helper_matrix[4][4];
+      return;
+    }
 
-  multiply_matrices(this->translation_matrix,this->rotation_matrix,helper_matrix);
-  multiply_matrices(helper_matrix,this->scale_matrix,this->transformation_matrix);
+  spline_segment *segment = &this->segments[(i - 1) * this->channels];
+  t = segment_parameter(segment[0],x);        // the same for all the channels
+
+  for (i = 0; i < this->channels; i++)
+    result[i] = ((segment[i].coefficients[0] * t + segment[i].coefficients[1]) * t + segment[i].coefficients[2]) * t + segment[i].coefficients[3];
 }
 
 //----------------------------------------------------------------------
 
-void update_view_matrix()
-
-  /**<
-    Updates the view (camera) matrix in the shader.
-  */
+unsigned int multichannel_interpolator::get_channel_count()
 
 {
-  multiply_matrices(camera.rotation_matrix,camera.translation_matrix,camera.transformation_matrix);
-  glUniformMatrix4fv(view_matrix_location,1,GL_TRUE,(const GLfloat *)camera.transformation_matrix);
+  return this->channels;
 }
 
 //----------------------------------------------------------------------
 
-void texture_2d::upload_texture_data()
+unsigned int multichannel_interpolator::get_keyframe_count()
 
 {
-  if (this->to == 0)
-    glGenTextures(1,&this->to);
-
-  glBindTexture(GL_TEXTURE_2D,this->to);
-  glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA,this->width,this->height,0,GL_RGB,GL_UNSIGNED_BYTE,this->data);
-
-  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+  return this->positions.size();
 }
 
 //----------------------------------------------------------------------
 
-void reshape_function(int width, int height)
+void multichannel_interpolator::clear()
 
 {
-  global_window_height = height;
-  global_window_width = width;
-  global_window_center[0] = width / 2;
-  global_window_center[1] = height / 2;
-  glViewport(0,0,width,height);
-  set_perspective(global_fov,global_near,global_far);
+  this->positions.clear();
+  this->methods.clear();
+  this->values.clear();
+  this->segments.clear();
+  this->cursor = 0;
+  this->segments_changed = true;
 }
 
-//======================================================================
-// public function definitions:
-//======================================================================
+//----------------------------------------------------------------------
 
-void set_global_light(point_3d direction, unsigned char red, unsigned char green, unsigned char blue)
+void mesh_3d_animated::update()
 
 {
-  float helper_color[3],helper_direction[3];
-
-  global_light_direction.x = direction.x;
-  global_light_direction.y = direction.y;
-  global_light_direction.z = direction.z;
+  unsigned int i;
+  vector<vertex_3d> helper_vertices;
 
-  normalize_vector(&global_light_direction);
+  if (this->instance_parent != NULL || !this->frames_changed || this->frames.size() == 0)
+    return;
 
-  global_light_color[0] = red;
-  global_light_color[1] = green;
-  global_light_color[2] = blue;
+  for (i = 1; i < this->frames.size(); i++)
+    if (this->frames[i].vertices.size() != this->frames[0].vertices.size())
+      {
+        cerr << "ERROR: all frames of the animated mesh must have the same number of vertices." << endl;
+        return;
+      }
 
-  helper_color[0] = red / 255.0;
-  helper_color[1] = green / 255.0;
-  helper_color[2] = blue / 255.0;
+  if (this->vbo == 0)
+    {
+      glGenBuffers(1,&this->vbo);
 
-  helper_direction[0] = global_light_direction.x;
-  helper_direction[1] = global_light_direction.y;
-  helper_direction[2] = global_light_direction.z;
+      if (this->vbo == 0)
+        cerr << "ERROR: VBO couldn't be allocated for the animated mesh.";
+    }
 
-  glUniform3fv(light_color_location,1,(const GLfloat *) helper_color);
-  glUniform3fv(light_direction_location,1,(const GLfloat *) helper_direction);
-}
+  if (this->ibo == 0)
+    {
+      glGenBuffers(1,&this->ibo);
 
-//----------------------------------------------------------------------
+      if (this->ibo == 0)
+        cerr << "ERROR: IBO couldn't be allocated for the animated mesh.";
+    }
 
-void mesh_3d::init_rendering()
+  this->frame_vertex_count = this->frames[0].vertices.size();
+  this->uploaded_frame_count = this->frames.size();
+  this->frame_triangle_count = this->frames[0].triangles.size();
 
-{
-  float transparent_color[3];
+  helper_vertices.reserve(this->frames.size() * this->frame_vertex_count);
 
-  if (this->texture != NULL)
-    this->texture->get_transparent_color_float(transparent_color,transparent_color + 1,transparent_color + 2);
+  for (i = 0; i < this->frames.size(); i++)   // each frame is stored once, draw() picks two of them by attribute offsets
+    helper_vertices.insert(helper_vertices.end(),this->frames[i].vertices.begin(),this->frames[i].vertices.end());
 
-  if (this->texture == NULL)
-    glUniform1ui(textures_location,(GLuint) 0);
-  else if (this->texture2 == NULL)
-    glUniform1ui(textures_location,(GLuint) 1);
-  else
-    glUniform1ui(textures_location,(GLuint) 2);
+  glBindBuffer(GL_ARRAY_BUFFER,this->vbo);
+  glBufferData(GL_ARRAY_BUFFER,helper_vertices.size() * sizeof(vertex_3d),helper_vertices.size() != 0 ? &helper_vertices[0] : NULL,GL_STATIC_DRAW);
 
-  switch (this->mesh_render_mode)
-    {
-      case RENDER_MODE_NO_LIGHT:
-        glUniform1ui(render_mode_location,(GLuint) 0);
-        break;
+  bind_vertex_array(0);    // the IBO binding would otherwise change the bound VAO
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,this->ibo);
+  this->index_type = upload_indices(this->frames[0].triangles,this->frame_vertex_count);
 
-      case RENDER_MODE_SHADED_GORAUD:
-        glUniform1ui(render_mode_location,(GLuint) 1);
-        break;
+  this->frames_changed = false;
+  this->update_memory_usage();
+}
 
-      case RENDER_MODE_SHADED_PHONG:
-        glUniform1ui(render_mode_location,(GLuint) 2);
-        break;
+//----------------------------------------------------------------------
 
-      case RENDER_MODE_WIREFRAME:
-        glUniform1ui(render_mode_location,(GLuint) 3);
-        break;
-    }
+void mesh_3d_animated::update_memory_usage()
 
-  if (this->texture != NULL)
-    {
-      glActiveTexture(GL_TEXTURE0);      // set the active texture unit to 0
-      glBindTexture(GL_TEXTURE_2D,this->texture->get_texture_object());
+{
+  unsigned int i;
+  unsigned long long cpu_bytes = 0;
 
-      if (this->texture2 != NULL)
-        {
-          glActiveTexture(GL_TEXTURE1);
-          glBindTexture(GL_TEXTURE_2D,this->texture2->get_texture_object());
-        }
-    }
+  for (i = 0; i < this->frames.size(); i++)
+    cpu_bytes += this->frames[i].vertices.capacity() * sizeof(vertex_3d) + this->frames[i].triangles.capacity() * sizeof(triangle_3d);
 
-  switch (this->mesh_render_mode)
-    {
-      case RENDER_MODE_SHADED_GORAUD:
-        glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
-        break;
+  set_memory_usage(this,MEMORY_ANIMATED_MESHES,cpu_bytes,this->get_gpu_memory_size());
+}
 
-      case RENDER_MODE_WIREFRAME:
-        glPolygonMode(GL_FRONT_AND_BACK,GL_LINE);
-        break;
+//----------------------------------------------------------------------
 
-      default:
-        glPolygonMode(GL_FRONT_AND_BACK,GL_FILL);
-        break;
-    }
+void mesh_3d::set_visibility(bool visible)
 
-  glUniformMatrix4fv(world_matrix_location,1,GL_TRUE,(const GLfloat *) this->transformation_matrix); // load this model's transformation matrix
-  glUniform1ui(use_fog_location,this->use_fog ? 1 : 0);
-  glUniform1ui(render_mode_location,(GLuint) this->mesh_render_mode);
-  glUniform1ui(number_of_shadows_location,(GLuint) (this->shadows.size() > MAX_SHADOWS ? MAX_SHADOWS : this->shadows.size()));
-  glUniform1fv(shadows_location,this->shadows.size() * 4,(GLfloat *) &this->shadows[0]);     // no animation
-  glUniform1ui(transparency_enabled_location,this->texture != NULL && this->texture->transparency_is_enabled() ? 1 : 0);
-  glUniform3fv(transparent_color_location,1,(const GLfloat *) transparent_color);
-  glUniform3fv(mesh_color_location,1,(const GLfloat *) this->color_float);
-  glUniform1f(frame_percentage_location,(GLfloat) -1.0);     // no animation
-  glUniform1f(ambient_factor_location,(GLfloat) this->material_ambient_intensity);
-  glUniform1f(diffuse_factor_location,(GLfloat) this->material_diffuse_intensity);
-  glUniform1f(specular_factor_location,(GLfloat) this->material_specular_intensity);
-  glUniform1f(specular_exponent_location,(GLfloat) this->material_specular_exponent);
+{
+  this->visible = visible;
 }
 
 //----------------------------------------------------------------------
 
-void camera_struct::go(axis_direction direction, float distance)
+bool mesh_3d::get_visibility()
 
 {
-  switch (direction)
-    {
-      case DIRECTION_FORWARD:
-        this->move(camera.direction_forward_vector.x * distance,
-                   camera.direction_forward_vector.y * distance,
-                   camera.direction_forward_vector.z * distance);
-        break;
-
-      case DIRECTION_BACKWARD:
-        this->go(DIRECTION_FORWARD,-1 * distance);
-        break;
+  return this->visible;
+}
 
-      case DIRECTION_LEFT:
-        this->move(camera.direction_left_vector.x * distance,
-                   camera.direction_left_vector.y * distance,
-                   camera.direction_left_vector.z * distance);
-        break;
+//----------------------------------------------------------------------
 
-      case DIRECTION_RIGHT:
-        this->go(DIRECTION_LEFT,-1 * distance);
-        break;
+mesh_3d_lod::mesh_3d_lod(bool use_this_mesh_properties, bool keep_everything_on_gpu)
 
+{
+  this->active_level = -1;
+  this->use_this_mesh_properties = use_this_mesh_properties;
+  this->keep_everything_on_gpu = keep_everything_on_gpu;
+}
 
-      case DIRECTION_UP:
-        this->move(camera.direction_up_vector.x * distance,
-                   camera.direction_up_vector.y * distance,
-                   camera.direction_up_vector.z * distance);
-        break;
+//----------------------------------------------------------------------
 
-      case DIRECTION_DOWN:
-        this->go(DIRECTION_UP,-1 * distance);
-        break;
+int mesh_3d_lod::get_current_detail_level()
 
-      default:
-        break;
-    }
+{
+  return this->active_level;
 }
 
 //----------------------------------------------------------------------
 
-render_mode mesh_3d::get_render_mode()
+void mesh_3d_lod::add_detail_mesh(mesh_3d_static *mesh, float distance)
 
 {
-  return this->mesh_render_mode;
+  detail_level detail;
+
+  detail.mesh = mesh;
+  detail.distance_to = distance;
+
+  this->lod_meshes.push_back(detail);
+  this->update();
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d::set_lighting_properties(float ambient, float diffuse, float specular, float specular_exponent)
+void mesh_3d_lod::update()
 
 {
-  if (ambient > 1.0)
-    ambient = 1.0;
-  else if (ambient < 0.0)
-    ambient = 0.0;
-
-  if (diffuse > 1.0)
-    diffuse = 1.0;
-  else if (diffuse < 0.0)
-    diffuse = 0.0;
+  // sort the lod_meshes array by distance (index 0 ~ shortest distance):
 
-  if (specular > 1.0)
-    specular = 1.0;
-  else if (specular < 0.0)
-    specular = 0.0;
+  unsigned int i,j;
+  detail_level helper;
 
-  this->material_ambient_intensity = ambient;
-  this->material_diffuse_intensity = diffuse;
-  this->material_specular_intensity = specular;
-  this->material_specular_exponent = specular_exponent;
+  for (i = 0; i < this->lod_meshes.size(); i++)
+    for (j = i; j < this->lod_meshes.size() - 1; j++)
+      {
+        if (this->lod_meshes[j].distance_to > this->lod_meshes[j + 1].distance_to)
+          {
+            helper = lod_meshes[j];
+            lod_meshes[j] = lod_meshes[j + 1];
+            lod_meshes[j + 1] = helper;
+          }
+      }
 }
 
 //----------------------------------------------------------------------
 
-bool texture_2d::transparency_is_enabled()
+void mesh_3d_lod::unload()
 
 {
-  return this->transparency_enabled;
 }
 
 //----------------------------------------------------------------------
 
-void texture_2d::get_transparent_color(unsigned char *red, unsigned char *green, unsigned char *blue)
+void set_mouse_visibility(bool visible)
 
 {
-  *red = this->transparent_color[0];
-  *green = this->transparent_color[1];
-  *blue = this->transparent_color[2];
+  if (visible)
+    glutSetCursor(GLUT_CURSOR_LEFT_ARROW);
+  else
+    glutSetCursor(GLUT_CURSOR_NONE);
 }
 
 //----------------------------------------------------------------------
 
-void texture_2d::get_transparent_color_float(float *red, float *green, float *blue)
+void mesh_3d_lod::clear()
 
 {
-  *red = this->transparent_color_float[0];
-  *green = this->transparent_color_float[1];
-  *blue = this->transparent_color_float[2];
+  this->active_level = -1;
+  this->lod_meshes.clear();
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d_static *make_cuboid(float side_x, float side_y, float side_z)
+void go_fullscreen()
 
 {
-  mesh_3d_static *result = new mesh_3d_static;
-
-  double half_x, half_y, half_z;
+  glutFullScreen();
+}
 
-  half_x = side_x / 2.0;
-  half_y = side_y / 2.0;
-  half_z = side_z / 2.0;
+//----------------------------------------------------------------------
 
-              //     x           y           z             u    v      normal   #
-  result->add_vertex(-1 * half_x,-1 * half_y,half_z,       0,   0,  -1,-1,-1);  // 0
-  result->add_vertex(half_x,     -1 * half_y,half_z,       1,   0,   1,-1,-1);  // 1
-  result->add_vertex(-1 * half_x,half_y,     half_z,       0,   1,  -1, 1,-1);  // 2
-  result->add_vertex(half_x,     half_y,     half_z,       1,   1,   1, 1,-1);  // 3
+void mesh_3d_lod::draw()
 
-  result->add_vertex(-1 * half_x,-1 * half_y,-1 * half_z,  1,   1,  -1,-1, 1);  // 4
-  result->add_vertex(half_x,     -1 * half_y,-1 * half_z,  0,   1,   1,-1, 1);  // 5
-  result->add_vertex(-1 * half_x,half_y,     -1 * half_z,  1,   0,  -1, 1, 1);  // 6
-  result->add_vertex(half_x,     half_y,     -1 * half_z,  0,   0,   1, 1, 1);  // 7
+{
+  if (this->lod_meshes.size() == 0)
+    return;
 
-  result->add_triangle(0,1,2);
-  result->add_triangle(1,3,2);
-  result->add_triangle(3,5,7);
-  result->add_triangle(3,1,5);
-  result->add_triangle(5,4,6);
-  result->add_triangle(6,7,5);
-  result->add_triangle(6,4,2);
-  result->add_triangle(4,0,2);
-  result->add_triangle(6,2,3);
-  result->add_triangle(6,3,7);
-  result->add_triangle(1,0,4);
-  result->add_triangle(5,1,4);
+  if (global_recompute_lod)
+    {
+      double dx,dy,dz,distance;
+      int level_before = this->active_level;
+      float world_matrix[4][4];
 
-  result->update();
+      this->get_world_matrix(world_matrix);
 
-  return result;
-}
+      dx = world_matrix[0][3] - camera.position.x;
+      dy = world_matrix[1][3] - camera.position.y;
+      dz = world_matrix[2][3] - camera.position.z;
+      distance = sqrt(dx * dx + dy * dy + dz * dz);
 
-//----------------------------------------------------------------------
+      this->active_level = this->lod_meshes.size() - 1;
 
-mesh_3d_static *make_sharp_cuboid(float side_x, float side_y, float side_z)
+      while (true)
+        {
+          if (this->active_level < 0)
+            {
+              this->active_level = 0;
+              break;
+            }
 
-{
-  mesh_3d_static *result = new mesh_3d_static;
+          if (distance > this->lod_meshes[this->active_level].distance_to)
+            {
+              this->active_level++;
+              break;
+            }
 
-  double half_x, half_y, half_z;
+          this->active_level--;
+        }
 
-  half_x = side_x / 2.0;
-  half_y = side_y / 2.0;
-  half_z = side_z / 2.0;
+      if (this->active_level == (int) this->lod_meshes.size())
+        {
+          this->active_level = -1;
+          return;
+        }
 
-              //     x           y           z             u    v      normal   #
-  // back:
-  result->add_vertex(-1 * half_x,-1 * half_y,half_z,       0.75, 0.5,0,  0,-1);  // 0
-  result->add_vertex(half_x,     -1 * half_y,half_z,       0.5,0.5,  0,  0,-1);  // 1
-  result->add_vertex(-1 * half_x,half_y,     half_z,       0.75, 0,  0,  0,-1);  // 2
-  result->add_vertex(half_x,     half_y,     half_z,       0.5,0,    0,  0,-1);  // 3
+      if (!this->keep_everything_on_gpu && level_before != this->active_level) // reupload data on GPU
+        {
+          unsigned int i;
 
-  result->add_triangle(0,1,2);
-  result->add_triangle(1,3,2);
+          for (i = 0; i < this->lod_meshes.size(); i++)
+            if (this->lod_meshes[i].mesh != NULL)
+              {
+                if ((int) i == this->active_level)
+                  this->lod_meshes[i].mesh->update();
+                else
+                  this->lod_meshes[i].mesh->unload();
+              }
+        }
+    }
 
-  // front:
-  result->add_vertex(-1 * half_x,-1 * half_y,-1 * half_z,  0,   0.5, 0, 0, 1);  // 4
-  result->add_vertex(half_x,     -1 * half_y,-1 * half_z,  0.25,0.5, 0, 0, 1);  // 5
-  result->add_vertex(-1 * half_x,half_y,     -1 * half_z,  0,   0,   0, 0, 1);  // 6
-  result->add_vertex(half_x,     half_y,     -1 * half_z,  0.25,0,   0, 0, 1);  // 7
+  if (this->active_level < 0)
+    return;
 
-  result->add_triangle(5,4,6);
-  result->add_triangle(6,7,5);
+  mesh_3d_static *mesh_to_draw = this->lod_meshes[this->active_level].mesh;
 
-  // left:
-  result->add_vertex(-1 * half_x,-1 * half_y,-1 * half_z,  1,   0.5,-1, 0, 0);  // 8
-  result->add_vertex(-1 * half_x,-1 * half_y,half_z,       0.75,0.5,-1, 0, 0);  // 9
-  result->add_vertex(-1 * half_x,half_y,     -1 * half_z,  1,   0  ,-1, 0, 0);  // 10
-  result->add_vertex(-1 * half_x,half_y,          half_z,  0.75,0,  -1, 0, 0);  // 11
+  if (mesh_to_draw != NULL)
+    {
+      if (!this->visible)
+        return;
 
-  result->add_triangle(8,9,10);
-  result->add_triangle(11,10,9);
+      if (this->use_this_mesh_properties)
+        {
+          this->texture = mesh_to_draw->get_texture(1);
+          this->texture2 = mesh_to_draw->get_texture(2);
+          this->mesh_render_mode = mesh_to_draw->get_render_mode();
+        }
 
-  // right:
-  result->add_vertex(half_x,    -1 * half_y,-1 * half_z,   0.25,0.5, 1, 0, 0);  // 12
-  result->add_vertex(half_x,    -1 * half_y,half_z,        0.5, 0.5, 1, 0, 0);  // 13
-  result->add_vertex(half_x,     half_y,     -1 * half_z,  0.25,0,   1, 0, 0);  // 14
-  result->add_vertex(half_x,     half_y,          half_z,  0.5, 0,   1, 0, 0);  // 15
+      point_3d offset,scale;
 
-  result->add_triangle(12,14,13);
-  result->add_triangle(15,13,14);
+      mesh_to_draw->get_position_dequantization(&offset,&scale);
+      this->init_rendering();
+      glUniform3fv(position_offset_location,1,(const GLfloat *) &offset);
+      glUniform3fv(position_scale_location,1,(const GLfloat *) &scale);
+      mesh_to_draw->draw_geometry();
+    }
+}
 
-  // top:
-  result->add_vertex(-1 * half_x,half_y,    -1 * half_z,   0,   1,   0, 1, 0);  // 16
-  result->add_vertex(half_x,     half_y,    -1 * half_z,   0.25,1,   0, 1, 0);  // 17
-  result->add_vertex(-1 * half_x,half_y,         half_z,   0,   0.5, 0, 1, 0);  // 18
-  result->add_vertex(half_x,     half_y,         half_z,   0.25,0.5, 0, 1, 0);  // 19
+//----------------------------------------------------------------------
 
-  result->add_triangle(18,17,16);
-  result->add_triangle(18,19,17);
+mesh_3d_batch::mesh_3d_batch(): mesh_3d_static()
 
-  // bottom:
-  result->add_vertex(-1 * half_x,-1 * half_y,-1 * half_z,  0.25,0.5, 0,-1, 0);  // 20
-  result->add_vertex(half_x,     -1 * half_y,-1 * half_z,  0.5, 0.5, 0,-1, 0);  // 21
-  result->add_vertex(-1 * half_x,-1 * half_y,     half_z,  0.25,1,   0,-1, 0);  // 22
-  result->add_vertex(half_x,     -1 * half_y,     half_z,  0.5, 1,   0,-1, 0);  // 23
+{
+  this->hidden_members = 0;
+}
 
-  result->add_triangle(22,20,21);
-  result->add_triangle(23,22,21);
+//----------------------------------------------------------------------
 
-  result->update();
+void mesh_3d_batch::clear()
 
-  return result;
+{
+  mesh_3d_static::clear();
+  this->members.clear();
+  this->hidden_members = 0;
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d_static *make_plane(float width, float height, unsigned int resolution_x, unsigned int resolution_y)
+void mesh_3d_batch::build(vector<mesh_3d_static *> &meshes)
 
 {
-  mesh_3d_static *result = new mesh_3d_static;
+  unsigned int i,j,number_of_vertices,number_of_triangles,first_vertex;
+  mesh_3d_static *geometry;
+  batch_member member;
+  float matrix[4][4];
 
-  unsigned int i,j;
-  float step_x,step_y,half_width,half_height;
+  this->clear();
 
-  half_width = width / 2.0;
-  half_height = height / 2.0;
+  if (meshes.size() == 0)
+    return;
 
-  step_x = width / (float) resolution_x;
-  step_y = height / (float) resolution_y;
+  number_of_vertices = 0;
+  number_of_triangles = 0;
 
-  for (j = 0; j < resolution_y + 1; j++)
-    for (i = 0; i < resolution_x + 1; i++)
-      {
-        result->add_vertex(step_x * i - half_width,step_y * j - half_height,0,i / (float) resolution_x,j / (float) resolution_y,0,0,-1);
-      }
+  for (i = 0; i < meshes.size(); i++)    // allocate everything at once
+    {
+      geometry = meshes[i]->get_instance_parent() != NULL ? meshes[i]->get_instance_parent() : meshes[i];
+      geometry->make_resident();
+      number_of_vertices += geometry->vertices.size();
+      number_of_triangles += geometry->triangles.size();
+    }
 
-  for (i = 0; i < result->vertices.size() - resolution_x - 2; i++)
+  this->vertices.reserve(number_of_vertices);
+  this->triangles.reserve(number_of_triangles);
+
+  for (i = 0; i < meshes.size(); i++)
     {
-      if (i % (resolution_x + 1) != 0 && (i - i / (resolution_x + 1)) % resolution_x == 0)
-        continue;
+      geometry = meshes[i]->get_instance_parent() != NULL ? meshes[i]->get_instance_parent() : meshes[i];
+      first_vertex = this->vertices.size();
 
-      result->add_triangle(i,i + resolution_x + 1,i + 1);
-      result->add_triangle(i + resolution_x + 2,i + 1,i + resolution_x + 1);
-    }
+      member.source = meshes[i];
+      member.first_triangle = this->triangles.size();
+      member.triangle_count = geometry->triangles.size();
+      member.visible = true;
+      this->members.push_back(member);
 
-  result->update();
+      this->vertices.insert(this->vertices.end(),geometry->vertices.begin(),geometry->vertices.end());
 
-  return result;
+      for (j = 0; j < geometry->triangles.size(); j++)
+        {
+          triangle_3d triangle = geometry->triangles[j];
+
+          triangle.index1 += first_vertex;
+          triangle.index2 += first_vertex;
+          triangle.index3 += first_vertex;
+          this->triangles.push_back(triangle);
+        }
+
+      meshes[i]->get_world_matrix(matrix);
+      this->transform_vertices(matrix,first_vertex,geometry->vertices.size());
+    }
+
+  this->copy_material(meshes[0]);
+  this->set_vertex_format(meshes[0]->get_vertex_format());
+  this->update();
 }
 
 //----------------------------------------------------------------------
 
-unsigned int texture_2d::get_width()
+unsigned int mesh_3d_batch::get_member_count()
 
 {
-  return this->width;
+  return this->members.size();
 }
 
 //----------------------------------------------------------------------
 
-unsigned int texture_2d::get_height()
+mesh_3d_static *mesh_3d_batch::get_member(unsigned int index)
 
 {
-  return this->height;
+  return index < this->members.size() ? this->members[index].source : NULL;
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d_static *make_terrain(float size_x, float size_y, float height, unsigned int resolution_x, unsigned int resolution_y, texture_2d *heightmap, float crop_x, float crop_y, float crop_width, float crop_height)
+void mesh_3d_batch::set_member_visibility(unsigned int index, bool visible)
 
 {
-  mesh_3d_static *result;
-  float matrix[4][4];
-  unsigned int i,index;
-  unsigned char r,g,b;
-  int x,y;
-  int indexes[4];
-  unsigned int crop_x_pixels,crop_y_pixels,crop_width_pixels,crop_height_pixels;
+  if (index >= this->members.size() || this->members[index].visible == visible)
+    return;
 
-  crop_x = clamp(crop_x,0,1);
-  crop_y = clamp(crop_y,0,1);
-  crop_width = clamp(crop_width,0,1);
-  crop_height = clamp(crop_height,0,1);
+  this->members[index].visible = visible;
 
-  if (heightmap != NULL)
-    {
-      crop_x_pixels = (heightmap->get_width() - 1) * crop_x;
-      crop_y_pixels = (heightmap->get_height() - 1) * crop_y;
-      crop_width_pixels = (heightmap->get_width() - 1) * crop_width;
-      crop_height_pixels = (heightmap->get_height() - 1) * crop_height;
-    }
+  if (visible)
+    this->hidden_members--;
   else
-    {
-      crop_x_pixels = 0;
-      crop_y_pixels = 0;
-      crop_width_pixels = 1;
-      crop_height_pixels = 1;
-    }
+    this->hidden_members++;
+}
 
-  result = make_plane(size_x,size_y,resolution_x,resolution_y);
+//----------------------------------------------------------------------
 
-  make_rotation_matrix(-90,0,0,ROTATION_XYZ,matrix);
-  result->apply_matrix(matrix);
+bool mesh_3d_batch::get_member_visibility(unsigned int index)
 
-  index = 0;
-  int countdown = -1;
+{
+  return index < this->members.size() ? this->members[index].visible : false;
+}
 
-  // change the topology of the plane to look better:
+//----------------------------------------------------------------------
 
-  for (index = 0; index < result->triangles.size(); index += 4)
+void mesh_3d_batch::draw()
+
+{
+  unsigned int i;
+  unsigned int index_size = this->index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
+
+  if (!this->visible)
+    return;
+
+  if (this->hidden_members == 0)
     {
-      indexes[0] = result->triangles[index].index1;
-      indexes[1] = result->triangles[index].index2;
-      indexes[2] = result->triangles[index].index3;
-      indexes[3] = result->triangles[index + 1].index1;
+      mesh_3d_static::draw();
+      return;
+    }
 
-      result->triangles[index].index2 = indexes[3];
-      result->triangles[index + 1].index2 = indexes[0];
+  if (this->hidden_members == this->members.size())
+    return;
 
-      if (resolution_x % 2 == 0)
-        {
-          if (countdown < 0)
-            {
-              countdown = resolution_x * 2;
-              index += 2;
-            }
+  this->visible_counts.clear();
+  this->visible_offsets.clear();
 
-          countdown -= 4;
+  for (i = 0; i < this->members.size(); i++)
+    {
+      if (!this->members[i].visible || this->members[i].triangle_count == 0)
+        continue;
+
+      if (this->visible_counts.size() != 0 &&     // continues the previous range, merge them
+          (const char *) this->visible_offsets.back() + this->visible_counts.back() * index_size == (const char *) 0 + this->members[i].first_triangle * 3 * index_size)
+        this->visible_counts.back() += this->members[i].triangle_count * 3;
+      else
+        {
+          this->visible_counts.push_back(this->members[i].triangle_count * 3);
+          this->visible_offsets.push_back((const GLvoid *) (((const char *) 0) + this->members[i].first_triangle * 3 * index_size));
         }
     }
 
-  // set the height for each vertex:
+  this->init_rendering();
+  this->upload_position_dequantization();
+  this->draw_index_ranges(this->visible_counts,this->visible_offsets);
+}
 
-  if (heightmap != NULL)
-    for (i = 0; i < result->vertices.size(); i++)
-      {
-        if (heightmap != NULL)
-          {
-            x = ((result->vertices[i].position.x + size_x / 2.0) / size_x) * crop_width_pixels + crop_x_pixels;
-            y = ((result->vertices[i].position.z + size_y / 2.0) / size_y) * crop_height_pixels + crop_y_pixels;
-            heightmap->get_pixel(x,y,&r,&g,&b);
-          }
-        else
-          r = 1;
+//----------------------------------------------------------------------
 
-        result->vertices[i].position.y += r / 255.0 * height;
-      }
+unsigned int get_shader_variant_count()
 
-  result->texture_map_plane(DIRECTION_DOWN,1.0,1.0);
-  result->smooth_normals();
+{
+  unsigned int i,result;
 
-  result->update();
+  result = 0;
+
+  for (i = 0; i < SHADER_VARIANTS; i++)
+    if (global_shader_variants[i].program != 0)
+      result++;
 
   return result;
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d_static *make_cone(float radius, float height, unsigned int sides)
+void precompile_shader_variants()
 
 {
-  mesh_3d_static *result = new mesh_3d_static;
+  unsigned int mode,textures;
+  int current = global_current_shader_variant;
 
-  result->add_vertex(0,0,0,0,0,0,-1,0);         // bottom
-  result->add_vertex(0,height,0,0.5,1,0,1,0);   // top
+  for (mode = RENDER_MODE_NO_LIGHT; mode <= RENDER_MODE_WIREFRAME; mode++)
+    for (textures = 0; textures <= 2; textures++)
+      {
+        use_shader_variant(shader_variant_key((render_mode) mode,textures,0));
+        use_shader_variant(shader_variant_key((render_mode) mode,textures,SHADER_FOG));
+      }
 
-  result->add_vertex(radius,0,0,0,0,1,0,0);   // first circle vertex
+  if (current >= 0)
+    use_shader_variant(current);
+}
 
+//----------------------------------------------------------------------
+
+void clear_shader_variants()
+
+{
   unsigned int i;
-  float helper_x,helper_z;
-  float texture_step = 1.0 / (float) sides;
-  float angle = 0;
-  float angle_step = 2 * PI / (float) sides;
 
-  for (i = 0; i < sides; i++)
-    {
-      angle += angle_step;
-      helper_x = cos(angle) * radius;
-      helper_z = sin(angle) * radius;
+  glUseProgram(0);
 
-      if (i < sides - 1)
-        {
-          result->add_vertex(helper_x,0,helper_z,(i + 1) * texture_step,0,helper_x,0,helper_z);
-          result->add_triangle(0,i + 2,i + 3);
-          result->add_triangle(1,i + 3,i + 2);
-        }
-      else
+  for (i = 0; i < SHADER_VARIANTS; i++)
+    {
+      if (global_shader_variants[i].program != 0)
         {
-          result->add_triangle(0,i + 2,2);
-          result->add_triangle(1,2,i + 2);
+          glDeleteProgram(global_shader_variants[i].program);
+          global_shader_variants[i].program = 0;
         }
-    }
 
-  result->update();
+      global_shader_variants[i].failed = false;
+    }
 
-  return result;
+  global_current_shader_variant = -1;
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d_static *make_sphere(float radius, unsigned int height_segments, unsigned int sides)
+void get_program_cache_statistics(unsigned int *hits, unsigned int *misses, double *milliseconds)
 
 {
-  mesh_3d_static *result = new mesh_3d_static;
-
-  result->add_vertex(0,-1 * radius,0,0.5,0.5,0,-1,0);  // bottom vertex
-  result->add_vertex(0,radius,0,0.5,0.5,0,1,0);        // top vertex
-
-  unsigned int i,j,first_row_index;
-  float angle_step;
-  float scale_factor;
-  float x_coordinate,y_coordinate,z_coordinate;
-
-  angle_step = 360.0 / (float) sides * PI_DIVIDED_180;
+  *hits = global_program_cache_hits;
+  *misses = global_program_cache_misses;
+  *milliseconds = global_program_time;
+}
 
-  for (j = 1; j < height_segments; j++)
-    {
-      y_coordinate = -1 * cos(j / (float) height_segments * PI) * radius;
-      scale_factor = sin(j / (float) height_segments * PI);
+//----------------------------------------------------------------------
 
-      for (i = 0; i < sides; i++)
-        {
-          x_coordinate = sin(i * angle_step) * scale_factor;
-          z_coordinate = cos(i * angle_step) * scale_factor;
+memory_usage get_memory_usage(memory_category category)
 
-          result->add_vertex(x_coordinate * radius,y_coordinate,z_coordinate * radius,x_coordinate,z_coordinate,x_coordinate,y_coordinate,z_coordinate);
+{
+  return global_memory_usage[category];
+}
 
-          first_row_index = (j - 1) * sides + 2;
+//----------------------------------------------------------------------
 
-          if (j == 1)  // bottom of the sphere
-            {
-              if (i < sides - 1)
-                result->add_triangle(0,i + 3,i + 2);
-              else
-                result->add_triangle(0,2,i + 2);
-            }
-          else if (j == height_segments - 1)  // top of the sphere
-            {
-              if (i < sides - 1)
-                result->add_triangle(1,first_row_index + i,first_row_index + i + 1);
-              else
-                result->add_triangle(1,first_row_index + i,first_row_index);
-            }
+bool get_object_memory_usage(const void *object, memory_record *record)
 
-          if (j < height_segments - 1)
-            {
-              if (i < sides - 1)
-                {
-                  result->add_triangle(first_row_index + i,first_row_index + i + 1,first_row_index + i + 1 + sides);
-                  result->add_triangle(first_row_index + i,first_row_index + i + 1 + sides,first_row_index + i + sides);
-                }
-              else
-                {
-                  result->add_triangle(first_row_index + i,first_row_index,first_row_index + sides);
-                  result->add_triangle(first_row_index + i,first_row_index + sides,first_row_index + i + sides);
-                }
-            }
-        }
-    }
+{
+  map<const void *,memory_record>::iterator found = global_memory_records.find(object);
 
-  result->update();
+  if (found == global_memory_records.end())
+    return false;
 
-  return result;
+  *record = found->second;
+  return true;
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d_static *make_cylinder(float radius, float height, unsigned int sides)
+void get_largest_memory_users(unsigned int count, vector<const void *> &objects, vector<memory_record> &records)
 
 {
-  mesh_3d_static *result = new mesh_3d_static;
-
-  result->add_vertex(0,0,0,0,0,0,-1,0);
-  result->add_vertex(0,height,0,0,0,0,1,0);
-
-  result->add_vertex(radius,0,0,0,0,1,0,0);
-  result->add_vertex(radius,height,0,0,1,1,0,0);
-
   unsigned int i;
-  float helper_x,helper_z;
-  float angle = 0;
-  float texture_step = 1 / (float) sides;
-  float angle_step = 2 * PI / (float) sides;
-
-  for (i = 0; i < sides; i++)
-    {
-      angle += angle_step;
-      helper_x = cos(angle) * radius;
-      helper_z = sin(angle) * radius;
+  vector<pair<const void *,memory_record> > all(global_memory_records.begin(),global_memory_records.end());
 
-      if (i < sides - 1)
-        {
-          result->add_vertex(helper_x,0,helper_z,(i + 1) * texture_step,0,helper_x,0,helper_z);
-          result->add_vertex(helper_x,height,helper_z,(i + 1) * texture_step,1,helper_x,0,helper_z);
+  count = min(count,(unsigned int) all.size());
 
-          result->add_triangle(0,2 * i + 2,2 * i + 4);
-          result->add_triangle(1,2 * i + 5,2 * i + 3);
+  partial_sort(all.begin(),all.begin() + count,all.end(),[](const pair<const void *,memory_record> &a, const pair<const void *,memory_record> &b)
+    {
+      return a.second.cpu_bytes + a.second.gpu_bytes > b.second.cpu_bytes + b.second.gpu_bytes;
+    });
 
-          result->add_triangle(2 * (i + 1),2 * (i + 1) + 1,2 * (i + 1) + 2);
-          result->add_triangle(2 * (i + 1) + 1,2 * (i + 1) + 3,2 * (i + 1) + 2);
-        }
-      else
-        {
-          result->add_triangle(0,2 * i + 2,2);
-          result->add_triangle(1,3,2 * i + 3);
+  objects.clear();
+  records.clear();
 
-          result->add_triangle(2 * (i + 1),2 * (i + 1) + 1,2);
-          result->add_triangle(2 * (i + 1) + 1,3,2);
-        }
+  for (i = 0; i < count; i++)
+    {
+      objects.push_back(all[i].first);
+      records.push_back(all[i].second);
     }
+}
 
-  result->update();
+//----------------------------------------------------------------------
 
-  return result;
+void set_memory_budget(memory_category category, unsigned long long cpu_bytes, unsigned long long gpu_bytes)
+
+{
+  global_cpu_memory_budgets[category] = cpu_bytes;
+  global_gpu_memory_budgets[category] = gpu_bytes;
+  global_memory_budget_exceeded[category] = false;
+  account_memory(category,0,0,0);          // warns if the budget is already exceeded
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::apply_matrix(float matrix[4][4])
+void print_memory_report(unsigned int largest_objects)
 
 {
   unsigned int i;
-  float helper_vector[4],result_vector[4];
+  vector<const void *> objects;
+  vector<memory_record> records;
 
-  for (i = 0; i < this->vertices.size(); i++)
-    {
-      helper_vector[0] = this->vertices[i].position.x;
-      helper_vector[1] = this->vertices[i].position.y;
-      helper_vector[2] = this->vertices[i].position.z;
-      helper_vector[3] = 1.0;
-
-      multiply_vector_matrix(helper_vector,matrix,result_vector);
-
-      this->vertices[i].position.x = result_vector[0];
-      this->vertices[i].position.y = result_vector[1];
-      this->vertices[i].position.z = result_vector[2];
+  cout << "memory usage (current / high-water mark):" << endl;
 
-      helper_vector[0] = this->vertices[i].normal.x;
-      helper_vector[1] = this->vertices[i].normal.y;
-      helper_vector[2] = this->vertices[i].normal.z;
-      helper_vector[3] = 0.0;
+  for (i = 0; i <= MEMORY_CATEGORIES; i++)
+    cout << "  " << setw(10) << global_memory_category_names[i] << ": " << setw(6) << global_memory_usage[i].objects << " objects, " <<
+      setw(8) << global_memory_usage[i].cpu_bytes / 1024 << " / " << setw(8) << global_memory_usage[i].cpu_peak_bytes / 1024 << " KB CPU, " <<
+      setw(8) << global_memory_usage[i].gpu_bytes / 1024 << " / " << setw(8) << global_memory_usage[i].gpu_peak_bytes / 1024 << " KB GPU" << endl;
 
-      multiply_vector_matrix(helper_vector,matrix,result_vector);
+  get_largest_memory_users(largest_objects,objects,records);
 
-      this->vertices[i].normal.x = result_vector[0];
-      this->vertices[i].normal.y = result_vector[1];
-      this->vertices[i].normal.z = result_vector[2];
-    }
+  for (i = 0; i < objects.size(); i++)
+    cout << "  " << setw(10) << global_memory_category_names[records[i].category] << " " << objects[i] << ": " <<
+      records[i].cpu_bytes / 1024 << " KB CPU, " << records[i].gpu_bytes / 1024 << " KB GPU" << endl;
 }
 
 //----------------------------------------------------------------------
 
-texture_2d::texture_2d()
+string get_memory_report_line(memory_category category)
 
 {
-  this->width = 0;
-  this->height = 0;
-  this->data = NULL;
-  this->transparency_enabled = false;
-  this->set_transparent_color(0,0,0);
-  glGenTextures(1,&this->to);
+  return string(global_memory_category_names[category]) + ": " + to_string(global_memory_usage[category].objects) + " objects, " +
+    to_string(global_memory_usage[category].cpu_bytes / 1024) + " KB CPU, " + to_string(global_memory_usage[category].gpu_bytes / 1024) + " KB GPU";
 }
 
 //----------------------------------------------------------------------
 
-void texture_2d::set_transparent_color(unsigned char red, unsigned char green, unsigned char blue)
+picture_2d *make_memory_text(memory_category category, texture_2d *font, float size, float spacing)
 
 {
-  this->transparent_color[0] = red;
-  this->transparent_color[1] = green;
-  this->transparent_color[2] = blue;
-
-  this->transparent_color_float[0] = red / 255.0;
-  this->transparent_color_float[1] = green / 255.0;
-  this->transparent_color_float[2] = blue / 255.0;
+  return make_text(get_memory_report_line(category),font,size,spacing);
 }
 
 //----------------------------------------------------------------------
 
-void texture_2d::set_transparency(bool enabled)
+bool texture_compression_is_supported()
 
 {
-  this->transparency_enabled = enabled;
+  return GLEW_EXT_texture_compression_s3tc;
 }
 
 //----------------------------------------------------------------------
 
-GLuint texture_2d::get_texture_object()
+void get_texture_cache_statistics(unsigned int *hits, unsigned int *misses)
 
 {
-  return this->to;
+  *hits = global_texture_cache_hits;
+  *misses = global_texture_cache_misses;
 }
 
 //----------------------------------------------------------------------
 
-bool texture_2d::load_ppm(string filename)
+void set_cache_directory(string directory)
 
 {
-  char buffer[16];
-  FILE *file_handle;
-  int character, rgb_component;
+  while (directory.length() > 1 && (directory[directory.length() - 1] == '/' || directory[directory.length() - 1] == '\\'))
+    directory.erase(directory.length() - 1);
 
-  file_handle = fopen(filename.c_str(),"rb");
-
-  if (!file_handle)
-    return false;
+  global_cache_directory = directory;
+}
 
-  if (!fgets(buffer,sizeof(buffer),file_handle))   // file format
-    return false;
+//----------------------------------------------------------------------
 
-  character = getc(file_handle);                   // skip comments
+string get_cache_directory()
 
-  while (character == '#')
-    {
-      while (getc(file_handle) != '\n');
-      character = getc(file_handle);
-    }
+{
+  return global_cache_directory;
+}
 
-  ungetc(character,file_handle);
+//----------------------------------------------------------------------
 
-  // image size:
+buffer_arena *get_default_buffer_arena()
 
-  if (fscanf(file_handle,"%d %d",(int *) &this->width,(int *) &this->height) != 2)
-    {
-      fclose(file_handle);
-      return false;
-    }
+{
+  return &global_buffer_arena;
+}
 
-  // rgb component:
+//----------------------------------------------------------------------
 
-  if (fscanf(file_handle,"%d",&rgb_component) != 1)
-    {
-      fclose(file_handle);
-      return false;
-    }
+unsigned int get_texture_bind_count()
 
-  if (rgb_component != 255)  // check the depth
-    {
-      fclose(file_handle);
-      return false;
-    }
+{
+  return global_texture_binds;
+}
 
-  while (fgetc(file_handle) != '\n');
+//----------------------------------------------------------------------
 
-  this->data = (unsigned char *) malloc(this->width * this->height * sizeof(unsigned char) * 3);
+bool multi_draw_indirect_is_supported()
 
-  if (!this->data)
-    {
-      fclose(file_handle);
-      return false;
-    }
+{
+  return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance);
+}
 
-  //read pixel data:
+//----------------------------------------------------------------------
 
-  if (fread(this->data,3 * this->width,this->height,file_handle) != this->height)
-    {
-      fclose(file_handle);
-      return false;
-    }
+void set_multi_draw_indirect(bool enable)
 
-  fclose(file_handle);
+{
+  global_multi_draw_indirect = enable && multi_draw_indirect_is_supported();
+}
 
-  this->flip_vertical();        // this must be done because of OpenGL texture handling
-  // upload the data to GPU:
+//----------------------------------------------------------------------
 
-  this->upload_texture_data();
+mesh_3d_group::mesh_3d_group(): mesh_3d()
 
-  return true;
+{
+  this->vbo = 0;
+  this->ibo = 0;
+  this->vao = 0;
+  this->matrix_buffer = 0;
+  this->indirect_buffer = 0;
+  this->index_type = GL_UNSIGNED_INT;
+  this->geometry_buffer_size = 0;
+  this->stream_buffer_size = 0;
 }
 
 //----------------------------------------------------------------------
 
-void texture_2d::initialise(unsigned int width, unsigned int height)
+mesh_3d_group::~mesh_3d_group()
 
 {
-  unsigned int i,j;
+  this->clear();
+}
 
-  this->width = width;
-  this->height = height;
-  this->data = (unsigned char *) malloc(this->width * this->height * sizeof(unsigned char) * 3);
+//----------------------------------------------------------------------
 
-  for (j = 0; j < height; j++)
-    for (i = 0; i < width; i++)
-      this->set_pixel(i,j,255,255,255);
+void mesh_3d_group::clear()
 
-  this->upload_texture_data();
+{
+  this->unload();
+  this->geometries.clear();
+  this->commands.clear();
+  this->matrices.clear();
 }
 
 //----------------------------------------------------------------------
 
-bool texture_2d::save_ppm(string filename)
+void mesh_3d_group::build(vector<mesh_3d_static *> &meshes)
 
 {
   unsigned int i,j;
-  unsigned char r,g,b;
+  mesh_3d_static *geometry;
+  group_geometry new_geometry;
 
-  FILE *file_handle;
-  file_handle = fopen(filename.c_str(),"wb");
+  this->clear();
 
-  if (!file_handle)
-    return false;
+  for (i = 0; i < meshes.size(); i++)
+    {
+      geometry = meshes[i]->get_instance_parent() != NULL ? meshes[i]->get_instance_parent() : meshes[i];
 
-  fprintf(file_handle,"P6 %d %d 255 ",this->width,this->height);
+      for (j = 0; j < this->geometries.size(); j++)
+        if (this->geometries[j].geometry == geometry)
+          break;
 
-  for (j = 0; j < this->height; j++)
-    for (i = 0; i < this->width; i++)
-      {
-        this->get_pixel(i,j,&r,&g,&b);
-        fprintf(file_handle,"%c%c%c",r,g,b);
-      }
+      if (j == this->geometries.size())
+        {
+          new_geometry.geometry = geometry;
+          new_geometry.first_index = 0;
+          new_geometry.index_count = 0;
+          new_geometry.base_vertex = 0;
+          this->geometries.push_back(new_geometry);
+        }
 
-  fclose(file_handle);
-  return true;
+      this->geometries[j].members.push_back(meshes[i]);
+    }
+
+  if (meshes.size() != 0)
+    this->copy_material(meshes[0]);
+
+  this->update();
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::smooth_normals()
+void mesh_3d_group::update()
 
 {
-  vector<point_3d> triangle_normals;  // normals for each triangle
+  unsigned int i,j,number_of_vertices,number_of_indices;
+  vector<vertex_3d> group_vertices;
+  vector<unsigned int> group_indices;
+  mesh_3d_static *geometry;
+
+  if (this->geometries.size() == 0)
+    return;
 
-  unsigned int i,j,helper_index;
-  point_3d vector0,vector1,vector2;
+  number_of_vertices = 0;
+  number_of_indices = 0;
+  this->index_type = GL_UNSIGNED_SHORT;   // indices are relative to the base vertex, so 16 bits are enough for small geometries
 
-  for (i = 0; i < this->triangles.size(); i++)
+  for (i = 0; i < this->geometries.size(); i++)
     {
-      vector0 = this->vertices[this->triangles[i].index1].position;
-      vector1 = vector0;
+      geometry = this->geometries[i].geometry;
+      geometry->make_resident();
 
-      helper_index = this->triangles[i].index2;
+      this->geometries[i].base_vertex = number_of_vertices;
+      this->geometries[i].first_index = number_of_indices;
+      this->geometries[i].index_count = geometry->triangles.size() * 3;
 
-      vector0.x -= this->vertices[helper_index].position.x;
-      vector0.y -= this->vertices[helper_index].position.y;
-      vector0.z -= this->vertices[helper_index].position.z;
+      number_of_vertices += geometry->vertices.size();
+      number_of_indices += geometry->triangles.size() * 3;
 
-      helper_index = this->triangles[i].index3;
-
-      vector1.x -= this->vertices[helper_index].position.x;
-      vector1.y -= this->vertices[helper_index].position.y;
-      vector1.z -= this->vertices[helper_index].position.z;
+      if (geometry->vertices.size() > 65536)
+        this->index_type = GL_UNSIGNED_INT;
+    }
 
-      cross_product(vector0,vector1,&vector2);
+  group_vertices.reserve(number_of_vertices);
+  group_indices.reserve(number_of_indices);
 
-      normalize_vector(&vector2);
+  for (i = 0; i < this->geometries.size(); i++)
+    {
+      geometry = this->geometries[i].geometry;
+      group_vertices.insert(group_vertices.end(),geometry->vertices.begin(),geometry->vertices.end());
 
-      triangle_normals.push_back(vector2);
+      for (j = 0; j < geometry->triangles.size(); j++)
+        {
+          group_indices.push_back(geometry->triangles[j].index1);
+          group_indices.push_back(geometry->triangles[j].index2);
+          group_indices.push_back(geometry->triangles[j].index3);
+        }
     }
 
-  unsigned int number_of_triangles;
-  point_3d normal_sum;
+  if (this->vao == 0)
+    glGenVertexArrays(1,&this->vao);
 
-  for (j = 0; j < this->vertices.size(); j++)  // find all coresponding triangles for each vector and make an average normal of them
-    {
-      normal_sum.x = 0;
-      normal_sum.y = 0;
-      normal_sum.z = 0;
-      number_of_triangles = 0;
+  if (this->vbo == 0)
+    glGenBuffers(1,&this->vbo);
 
-      for (i = 0; i < this->triangles.size(); i++)
-        if (this->triangles[i].index1 == j ||
-            this->triangles[i].index2 == j ||
-            this->triangles[i].index3 == j)
-          {
-            normal_sum.x += triangle_normals[i].x;
-            normal_sum.y += triangle_normals[i].y;
-            normal_sum.z += triangle_normals[i].z;
-            number_of_triangles++;
-          }
+  if (this->ibo == 0)
+    glGenBuffers(1,&this->ibo);
 
-      if (number_of_triangles != 0)
-        {
-          normal_sum.x = normal_sum.x / (float) number_of_triangles;
-          normal_sum.y = normal_sum.y / (float) number_of_triangles;
-          normal_sum.z = normal_sum.z / (float) number_of_triangles;
-        }
-      else
-        normal_sum.x = 1.0;
+  if (this->matrix_buffer == 0)
+    glGenBuffers(1,&this->matrix_buffer);
 
-      this->vertices[j].normal = normal_sum;
-    }
+  if (this->indirect_buffer == 0)
+    glGenBuffers(1,&this->indirect_buffer);
 
-  this->update();
-}
+  if (this->vao == 0 || this->vbo == 0 || this->ibo == 0 || this->matrix_buffer == 0 || this->indirect_buffer == 0)
+    cerr << "ERROR: buffers couldn't be allocated for the mesh group.";
 
-//----------------------------------------------------------------------
+  bind_vertex_array(this->vao);
 
-bool mesh_3d_static::load_obj(string filename)
+  glBindBuffer(GL_ARRAY_BUFFER,this->vbo);
+  glBufferData(GL_ARRAY_BUFFER,group_vertices.size() * sizeof(vertex_3d),group_vertices.size() == 0 ? NULL : &group_vertices[0],GL_STATIC_DRAW);
 
-{
-  ifstream obj_file(filename.c_str());
-  string line;
-  float obj_line_data[4][3];
-  point_3d helper_point;
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,this->ibo);
 
-  vector<point_3d> normals;
-  vector<point_3d> texture_vertices;
+  if (this->index_type == GL_UNSIGNED_SHORT)
+    {
+      vector<unsigned short> short_indices(group_indices.begin(),group_indices.end());
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER,short_indices.size() * sizeof(unsigned short),short_indices.size() == 0 ? NULL : &short_indices[0],GL_STATIC_DRAW);
+    }
+  else
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,group_indices.size() * sizeof(unsigned int),group_indices.size() == 0 ? NULL : &group_indices[0],GL_STATIC_DRAW);
 
-  if (!obj_file.is_open())
-    return false;
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  glEnableVertexAttribArray(3);
 
-  this->clear();
+  glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),0);                   // position
+  glVertexAttribPointer(1,2,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 12);  // texture coordinate
+  glVertexAttribPointer(2,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 20);  // normal
+  glVertexAttribPointer(3,1,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 32);  // texture blend ratio
 
-  while (getline(obj_file,line))
+  glBindBuffer(GL_ARRAY_BUFFER,this->matrix_buffer);
+
+  for (i = 0; i < 4; i++)             // instance matrix, one column per location
     {
-      switch (line[0])
-        {
-          case 'v':
-            if (line[1] == 'n')        // normal vertex
-              {
-                parse_obj_line(line,obj_line_data);
+      glEnableVertexAttribArray(8 + i);
+      glVertexAttribPointer(8 + i,4,GL_FLOAT,GL_FALSE,16 * sizeof(float),(const GLvoid*) (i * 4 * sizeof(float)));
+      glVertexAttribDivisor(8 + i,1);
+    }
 
-                helper_point.x = obj_line_data[0][0];
-                helper_point.y = obj_line_data[1][0];
-                helper_point.z = obj_line_data[2][0];
+  bind_vertex_array(0);
 
-                normals.push_back(helper_point);
-                break;
-              }
-            else if (line[1] == 't')   // texture vertex
-              {
-                parse_obj_line(line,obj_line_data);
+  this->geometry_buffer_size = group_vertices.size() * sizeof(vertex_3d) +
+    group_indices.size() * (this->index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int));
+  this->update_memory_usage();
+}
 
-                helper_point.x = obj_line_data[0][0];
-                helper_point.y = obj_line_data[1][0];
-                helper_point.z = 0;
+//----------------------------------------------------------------------
 
-                texture_vertices.push_back(helper_point);
-                break;
-              }
-            else                       // position vertex
-              {
-                parse_obj_line(line,obj_line_data);
-                this->add_vertex(obj_line_data[0][0],obj_line_data[1][0],obj_line_data[2][0],0,0,1,0,0);
-                break;
-              }
+void mesh_3d_group::update_memory_usage()
 
-          case 'f':
-            unsigned int indices[4],i,faces;
+{
+  set_memory_usage(this,MEMORY_MESHES,
+    this->commands.capacity() * sizeof(draw_elements_indirect_command) + this->matrices.capacity() * sizeof(float),
+    this->vbo != 0 ? this->geometry_buffer_size + this->stream_buffer_size : 0);
+}
 
-            parse_obj_line(line,obj_line_data);
+//----------------------------------------------------------------------
 
-            for (i = 0; i < 4; i++)     // triangle indices
-              indices[i] = floor(obj_line_data[i][0]) - 1;
+void mesh_3d_group::unload()
 
-            if (obj_line_data[3][0] < 0.0)
-              {
-                this->add_triangle(indices[0],indices[1],indices[2]);
-                faces = 3;     // 3 vertex face
-              }
-            else
-              {
-                this->add_triangle(indices[0],indices[1],indices[2]);
-                this->add_triangle(indices[0],indices[2],indices[3]);
-                faces = 4;     // 4 vertex face
-              }
+{
+  if (this->vbo != 0)
+    glDeleteBuffers(1,&this->vbo);
 
-            unsigned int vt_index, vn_index;
+  if (this->ibo != 0)
+    glDeleteBuffers(1,&this->ibo);
 
-            for (i = 0; i < faces; i++)    // texture coordinates and normals
-              {
-                vt_index = floor(obj_line_data[i][1]) - 1;
-                vn_index = floor(obj_line_data[i][2]) - 1;
+  if (this->matrix_buffer != 0)
+    glDeleteBuffers(1,&this->matrix_buffer);
+
+  if (this->indirect_buffer != 0)
+    glDeleteBuffers(1,&this->indirect_buffer);
+
+  if (this->vao != 0)
+    delete_vertex_array(this->vao);
+
+  this->vbo = 0;
+  this->ibo = 0;
+  this->matrix_buffer = 0;
+  this->indirect_buffer = 0;
+  this->vao = 0;
+  this->geometry_buffer_size = 0;
+  this->stream_buffer_size = 0;
+  remove_memory_usage(this);
+}
 
-                if (indices[i] >= this->vertices.size() || vt_index >= texture_vertices.size() ||
-                  vn_index >= normals.size())
-                  continue;
+//----------------------------------------------------------------------
 
-                this->vertices[indices[i]].texture_coordinate[0] = texture_vertices[vt_index].x;
-                this->vertices[indices[i]].texture_coordinate[1] = texture_vertices[vt_index].y;
+unsigned int mesh_3d_group::get_member_count()
 
-                this->vertices[indices[i]].normal.x = normals[vn_index].x;
-                this->vertices[indices[i]].normal.y = normals[vn_index].y;
-                this->vertices[indices[i]].normal.z = normals[vn_index].z;
-              }
+{
+  unsigned int i,result;
 
-            break;
+  result = 0;
 
-          default:
-            break;
-        }
-    }
+  for (i = 0; i < this->geometries.size(); i++)
+    result += this->geometries[i].members.size();
 
-  obj_file.close();
+  return result;
+}
 
-  this->update();
+//----------------------------------------------------------------------
 
-  return true;
+unsigned int mesh_3d_group::get_draw_command_count()
+
+{
+  return this->commands.size();
 }
 
 //----------------------------------------------------------------------
 
-bool mesh_3d_static::save_obj(string filename)
+void mesh_3d_group::draw()
 
 {
-  unsigned int i;
+  unsigned int i,j,k,l;
+  float matrix[4][4];
+  draw_elements_indirect_command command;
+  unsigned int index_size = this->index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int);
 
-  FILE *file_handle;
-  file_handle = fopen(filename.c_str(),"wb");
+  this->commands.clear();
+  this->matrices.clear();
 
-  if (!file_handle)
-    return false;
+  if (!this->visible || this->vao == 0)
+    return;
 
-  for (i = 0; i < this->vertices.size(); i++)
+  for (i = 0; i < this->geometries.size(); i++)   // consecutive instances of each geometry
     {
-      fprintf(file_handle,"v %f %f %f\n",this->vertices[i].position.x,
-        this->vertices[i].position.y,this->vertices[i].position.z);
-    }
+      command.count = this->geometries[i].index_count;
+      command.instance_count = 0;
+      command.first_index = this->geometries[i].first_index;
+      command.base_vertex = this->geometries[i].base_vertex;
+      command.base_instance = this->matrices.size() / 16;
 
-  fprintf(file_handle,"\n");
+      for (j = 0; j < this->geometries[i].members.size(); j++)
+        {
+          if (!this->geometries[i].members[j]->get_visibility())
+            continue;
 
-  for (i = 0; i < this->vertices.size(); i++)
-    {
-      fprintf(file_handle,"vt %f %f\n",this->vertices[i].texture_coordinate[0],
-        this->vertices[i].texture_coordinate[1]);
+          this->geometries[i].members[j]->get_world_matrix(matrix);
+
+          for (k = 0; k < 4; k++)     // transpose to column-major
+            for (l = 0; l < 4; l++)
+              this->matrices.push_back(matrix[l][k]);
+
+          command.instance_count++;
+        }
+
+      if (command.instance_count != 0 && command.count != 0)
+        this->commands.push_back(command);
     }
 
-  fprintf(file_handle,"\n");
+  if (this->commands.size() == 0)
+    return;
 
-  for (i = 0; i < this->vertices.size(); i++)
+  this->init_rendering(global_multi_draw_indirect ? SHADER_INSTANCED : 0);
+  bind_vertex_array(this->vao);
+
+  if (global_multi_draw_indirect)
     {
-      fprintf(file_handle,"vn %f %f %f\n",this->vertices[i].normal.x,
-        this->vertices[i].normal.y,this->vertices[i].normal.z);
-    }
+      glBindBuffer(GL_ARRAY_BUFFER,this->matrix_buffer);
+      glBufferData(GL_ARRAY_BUFFER,this->matrices.size() * sizeof(float),&this->matrices[0],GL_STREAM_DRAW);
 
-  fprintf(file_handle,"\n");
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER,this->indirect_buffer);
+      glBufferData(GL_DRAW_INDIRECT_BUFFER,this->commands.size() * sizeof(draw_elements_indirect_command),&this->commands[0],GL_STREAM_DRAW);
 
-  for (i = 0; i < this->triangles.size(); i++)
+      if (this->stream_buffer_size != this->matrices.size() * sizeof(float) + this->commands.size() * sizeof(draw_elements_indirect_command))
+        {
+          this->stream_buffer_size = this->matrices.size() * sizeof(float) + this->commands.size() * sizeof(draw_elements_indirect_command);
+          this->update_memory_usage();
+        }
+
+      glMultiDrawElementsIndirect(GL_TRIANGLES,this->index_type,0,this->commands.size(),0);
+
+      glBindBuffer(GL_DRAW_INDIRECT_BUFFER,0);
+    }
+  else                                // one draw call per mesh
     {
-      fprintf(file_handle,"f %d/%d/%d %d/%d/%d %d/%d/%d\n",
-        this->triangles[i].index1 + 1,  // in OBJ indexes begin with 1
-        this->triangles[i].index1 + 1,
-        this->triangles[i].index1 + 1,
-        this->triangles[i].index2 + 1,
-        this->triangles[i].index2 + 1,
-        this->triangles[i].index2 + 1,
-        this->triangles[i].index3 + 1,
-        this->triangles[i].index3 + 1,
-        this->triangles[i].index3 + 1);
+      for (i = 0; i < this->commands.size(); i++)
+        for (j = 0; j < this->commands[i].instance_count; j++)
+          {
+            glUniformMatrix4fv(world_matrix_location,1,GL_FALSE,(const GLfloat *) &this->matrices[(this->commands[i].base_instance + j) * 16]);
+            glDrawElementsBaseVertex(GL_TRIANGLES,this->commands[i].count,this->index_type,
+              (const GLvoid *) (((const char *) 0) + this->commands[i].first_index * index_size),this->commands[i].base_vertex);
+          }
     }
 
-  fclose(file_handle);
-  return true;
-  return true;
+  bind_vertex_array(0);
 }
 
 //----------------------------------------------------------------------
 
-void camera_struct::set_position(float x, float y, float z)
+void make_static_batches(vector<mesh_3d_static *> &meshes, vector<mesh_3d_batch *> &batches)
 
 {
-  if (this->skybox != NULL)
-    skybox->set_position(x,y,z);
+  unsigned int i,j;
+  vector<vector<mesh_3d_static *> > groups;
 
-  this->position.x = x;
-  this->position.y = y;
-  this->position.z = z;
+  for (i = 0; i < meshes.size(); i++)
+    {
+      if (meshes[i] == NULL || !meshes[i]->get_visibility())
+        continue;
 
-  make_translation_matrix(-1 * x,-1 * y,-1 * z,camera.translation_matrix);
+      for (j = 0; j < groups.size(); j++)   // there are usually only a few materials
+        if (groups[j][0]->has_same_material(meshes[i]) && groups[j][0]->get_vertex_format() == meshes[i]->get_vertex_format())
+          break;
 
-  glUniform3fv(camera_position_location,1,(const GLfloat *) &camera.position); // update the camera position in the shader
+      if (j == groups.size())
+        groups.push_back(vector<mesh_3d_static *>());
 
-  update_view_matrix();
+      groups[j].push_back(meshes[i]);
+    }
+
+  for (i = 0; i < groups.size(); i++)
+    {
+      mesh_3d_batch *batch = new mesh_3d_batch();
+      batch->build(groups[i]);
+      batches.push_back(batch);
+    }
 }
 
 //----------------------------------------------------------------------
 
-void camera_struct::move(float dx, float dy, float dz)
+void mesh_3d_animated::clear()
 
 {
-  point_3d current_position;
-
-  this->get_position(&current_position);
-  this->set_position(current_position.x + dx,current_position.y + dy,current_position.z + dz);
+  this->unload();
+  this->frames.clear();
+  this->instance_parent = NULL;
+  remove_memory_usage(this);
 }
 
 //----------------------------------------------------------------------
 
-void camera_struct::rotate(float dx_angles, float dy_angles, float dz_angles)
+void register_mouse_function(void (*function)(int button, int state))
 
 {
-  point_3d current_rotation;
-
-  this->get_rotation(&current_rotation);
-  this->set_rotation(current_rotation.x + dx_angles,current_rotation.y + dy_angles,current_rotation.z + dz_angles);
+  user_mouse_function = function;
 }
 
 //----------------------------------------------------------------------
 
-void camera_struct::get_direction(point_3d *direction)
+texture_2d *mesh_3d::get_texture(unsigned int texture_no)
 
 {
-  direction->x = this->direction_forward_vector.x;
-  direction->y = this->direction_forward_vector.y;
-  direction->z = this->direction_forward_vector.z;
+  if (texture_no == 2)
+    return this->texture2;
+  else
+    return this->texture;
 }
 
 //----------------------------------------------------------------------
 
-void camera_struct::set_rotation(float x, float y, float z)
+void mesh_3d_static::merge(mesh_3d_static *mesh)
 
 {
-  this->rotation.x = angle_to_0_360(x);
-  this->rotation.y = angle_to_0_360(y);
-  this->rotation.z = angle_to_0_360(z);
+  unsigned int i,first_vertex;
+  triangle_3d triangle;
 
-  make_rotation_matrix(camera.rotation.x,camera.rotation.y,camera.rotation.z,ROTATION_YXZ,camera.rotation_matrix);
-  update_view_matrix();
+  if (mesh == this || !this->make_resident() || !mesh->make_resident())
+    return;
 
-  float vector_rotation_matrix[4][4];
-  make_rotation_matrix(-1 * camera.rotation.x,-1 * camera.rotation.y,-1 * camera.rotation.z,ROTATION_ZXY,vector_rotation_matrix); // for the camera vector, we have to use reversed order of transformations
+  first_vertex = this->vertices.size();
 
-  float helper_vector[4];
-  float result_vector[4];
+  for (i = 0; i < mesh->triangles.size(); i++)
+    {
+      triangle = mesh->triangles[i];
+      triangle.index1 += first_vertex;
+      triangle.index2 += first_vertex;
+      triangle.index3 += first_vertex;
+
+      this->triangles.push_back(triangle);
+    }
+
+  this->vertices.insert(this->vertices.end(),mesh->vertices.begin(),mesh->vertices.end());
+
+  this->update();
+}
+
+//----------------------------------------------------------------------
 
-  helper_vector[0] = 0;     // initial camera direction
-  helper_vector[1] = 0;
-  helper_vector[2] = 1;
-  helper_vector[3] = 0;
+picture_2d *make_text(string text, texture_2d *font, float size, float spacing)
 
-  multiply_vector_matrix(helper_vector,vector_rotation_matrix,result_vector);
+{
+  picture_2d *result_picture;
+  mesh_3d_static *picture_mesh;
+  unsigned char character;
+  unsigned int i;
+  float dx;
 
-  this->direction_forward_vector.x = result_vector[0];
-  this->direction_forward_vector.y = result_vector[1];
-  this->direction_forward_vector.z = result_vector[2];
+  result_picture = new picture_2d();
+  picture_mesh = result_picture->get_picture_mesh();
+  picture_mesh->set_buffer_arena(&global_buffer_arena);   // texts are many small meshes
 
-  normalize_vector(&camera.direction_forward_vector);
+  if (font == NULL)
+    result_picture->set_picture(&global_default_font);
+  else
+    result_picture->set_picture(font);
 
-  helper_vector[0] = -1;
-  helper_vector[1] = 0;
-  helper_vector[2] = 0;
-  helper_vector[3] = 0;
+  picture_mesh->clear();
 
-  multiply_vector_matrix(helper_vector,vector_rotation_matrix,result_vector);
+  for (i = 0; i < text.length(); i++)
+    {
+      character = text[i];
+      dx = 1 / 256.0;
 
-  this->direction_left_vector.x = result_vector[0];
-  this->direction_left_vector.y = result_vector[1];
-  this->direction_left_vector.z = result_vector[2];
+      picture_mesh->add_vertex(0   + i *  (size + spacing),0,0,      character * dx,1,       0,0,1);  // z coordinate doesn't matter
+      picture_mesh->add_vertex(size + i * (size + spacing),0,0,      character * dx + dx,1,  0,0,1);
+      picture_mesh->add_vertex(0   + i *  (size + spacing),size,0,    character * dx,0,       0,0,1);
+      picture_mesh->add_vertex(size + i * (size + spacing),size,0,    character * dx + dx,0,  0,0,1);
 
-  helper_vector[0] = 0;
-  helper_vector[1] = 1;
-  helper_vector[2] = 0;
-  helper_vector[3] = 0;
+      picture_mesh->add_triangle(0 + i * 4,2 + i * 4,1 + i * 4);
+      picture_mesh->add_triangle(1 + i * 4,2 + i * 4,3 + i * 4);
+    }
 
-  multiply_vector_matrix(helper_vector,vector_rotation_matrix,result_vector);
+  result_picture->update();
 
-  this->direction_up_vector.x = result_vector[0];
-  this->direction_up_vector.y = result_vector[1];
-  this->direction_up_vector.z = result_vector[2];
+  return result_picture;
 }
 
 //----------------------------------------------------------------------
 
-void camera_struct::get_position(point_3d *position)
+void render_loop()
 
 {
-  position->x = this->position.x;
-  position->y = this->position.y;
-  position->z = this->position.z;
+  glutMainLoop();
 }
 
 //----------------------------------------------------------------------
 
-void camera_struct::get_rotation(point_3d *rotation)
+void mesh_3d_animated::set_speed(float speed)
 
 {
-  rotation->x = this->rotation.x;
-  rotation->y = this->rotation.y;
-  rotation->z = this->rotation.z;
+  this->play_speed = speed;
 }
 
 //----------------------------------------------------------------------
 
-int get_time()
+void get_mouse_position(int *x, int *y)
 
 {
-  return glutGet(GLUT_ELAPSED_TIME);
+  *x = global_mouse_position[0];
+  *y = global_mouse_position[1];
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::texture_map_plane(axis_direction direction, float plane_width, float plane_height)
+void get_interpolated_values(keyframe_interpolator **interpolators, unsigned int count, float x, float *result)
 
 {
   unsigned int i;
-  float width,height,depth;
-  float x0,y0,z0,x1,y1,z1;
-  float u_coordinate,v_coordinate;
-
-  this->get_bounding_box(&x0,&y0,&z0,&x1,&y1,&z1);
-  width = x0 - x1;
-  width = width < 0 ? -1 * width : width;
-  height = y0 - y1;
-  height = height < 0 ? -1 * height : height;
-  depth = z0 - z1;
-  depth = depth < 0 ? -1 * depth : depth;
+  float t;
+  spline_segment *segment;
 
-  for (i = 0; i < this->vertices.size(); i++)
+  for (i = 0; i < count; i++)
     {
-      switch (direction)
+      segment = interpolators[i]->get_segment(x);
+
+      if (segment == NULL)         // get_value gives 0 outside the keyframes
         {
-          case DIRECTION_LEFT:
-            u_coordinate = ((this->vertices[i].position.z - z0) / depth) * plane_width;
-            v_coordinate = ((this->vertices[i].position.y - y0) / height) * plane_height;
-            break;
+          result[i] = 0.0;
+          continue;
+        }
 
-          case DIRECTION_RIGHT:
-            u_coordinate = (1.0 - (this->vertices[i].position.z - z0) / depth) * plane_width;
-            v_coordinate = (1.0 - (this->vertices[i].position.y - y0) / height) * plane_height;
-            break;
+      t = segment_parameter(*segment,x);
+      result[i] = ((segment->coefficients[0] * t + segment->coefficients[1]) * t + segment->coefficients[2]) * t + segment->coefficients[3];
+    }
+}
 
-          case DIRECTION_FORWARD:
-            u_coordinate = ((this->vertices[i].position.x - x0) / width) * plane_width;
-            v_coordinate = ((this->vertices[i].position.y - y0) / height) * plane_height;
-            break;
+//----------------------------------------------------------------------
 
-          case DIRECTION_BACKWARD:
-            u_coordinate = (1.0 - (this->vertices[i].position.x - x0) / width) * plane_width;
-            v_coordinate = (1.0 - (this->vertices[i].position.y - y0) / height) * plane_height;
-            break;
+float interpolate(float ratio, float value1, float value2, interpolation_method method)
 
-          case DIRECTION_UP:
-            u_coordinate = ((this->vertices[i].position.x - x0) / width) * plane_width;
-            v_coordinate = ((this->vertices[i].position.z - z0) / depth) * plane_height;
-            break;
+{
+  clamp(ratio,0.0,1.0);
 
-          case DIRECTION_DOWN:
-          default:
-            u_coordinate = (1.0 - (this->vertices[i].position.x - x0) / width) * plane_width;
-            v_coordinate = (1.0 - (this->vertices[i].position.z - z0) / depth) * plane_height;
-            break;
-        }
+  switch (method)
+    {
+      case INTERPOLATION_LINEAR:
+        return ratio * value2 + (1.0 - ratio) * value1;
+        break;
 
-      this->vertices[i].texture_coordinate[0] = u_coordinate;
-      this->vertices[i].texture_coordinate[1] = v_coordinate;
-    }
+      case INTERPOLATION_SINE:
+        ratio = cos(ratio * PI) * 0.5 + 0.5;
 
-  this->update();
+        return ratio * value1 + (1.0 - ratio) * value2;
+        break;
+
+      case INTERPOLATION_CATMULL_ROM:
+      case INTERPOLATION_HERMITE:
+      case INTERPOLATION_BEZIER:
+        ratio = ratio * ratio * (3.0 - 2.0 * ratio);
+
+        return ratio * value2 + (1.0 - ratio) * value1;
+        break;
+
+      default:
+        return value1;
+        break;
+    }
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::texture_map_layer_mask(texture_2d *mask)
+void mesh_3d_animated::draw()
 
 {
-  unsigned int i;
-  float width,depth;
-  float x0,y0,z0,x1,y1,z1;
-  unsigned int x,y;
-  unsigned char r,g,b;
+  unsigned int number_of_frames;
+  unsigned int frame_length;
+  unsigned int next_frame;
+  mesh_3d_animated *source;
+  size_t frame_size,offset,next_offset;
 
-  this->get_bounding_box(&x0,&y0,&z0,&x1,&y1,&z1);
-  width = x0 - x1;
-  width = width < 0 ? -1 * width : width;
-  depth = z0 - z1;
-  depth = depth < 0 ? -1 * depth : depth;
+  if (!this->visible)
+    return;
+
+  source = this->instance_parent == NULL ? this : this->instance_parent;
+  number_of_frames = min(source->uploaded_frame_count,(unsigned int) source->frames.size());   // the offsets must stay inside the VBO
+
+  if (number_of_frames == 0 || source->vbo == 0)
+    return;
+
+  if (this->current_frame >= (int) number_of_frames)
+    this->current_frame = 0;
+
+  frame_length = source->frames[this->current_frame].length_ms;
+
+  this->frame_percentage += this->play_speed * (get_frame_time_difference() / ((float) frame_length));
+
+  while (this->frame_percentage > 1.0)
+    {
+      this->current_frame++;
+      this->frame_percentage -= 1.0;
+
+      if (this->current_frame >= (int) number_of_frames)
+        {
+          this->current_frame = 0;
 
-  for (i = 0; i < this->vertices.size(); i++)
+          if (!this->loop)
+            {
+              this->set_playing(false);
+              this->frame_percentage = 0.0;
+              break;
+            }
+        }
+    }
+
+  while (this->frame_percentage < 0.0)
     {
-      x = (1.0 - (this->vertices[i].position.x - x0) / width) * (mask->get_width() - 1);
-      y = (1.0 - (this->vertices[i].position.z - z0) / depth) * (mask->get_height() - 1);
+      this->current_frame--;
+      this->frame_percentage += 1.0;
 
-      mask->get_pixel(x,y,&r,&g,&b);
+      if (this->current_frame < 0)
+        {
+          this->current_frame = number_of_frames - 1;
 
-      this->vertices[i].texture_blend_ratio = r / 255.0;
+          if (!this->loop)
+            {
+              this->set_playing(false);
+              this->frame_percentage = 0.0;
+              break;
+            }
+        }
     }
 
-  this->update();
-}
+  this->init_rendering(SHADER_ANIMATED);
+  glUniform1f(frame_percentage_location,(GLfloat) (this->interpolating ? this->frame_percentage : 0.0));
 
-//----------------------------------------------------------------------
+  bind_vertex_array(0);                // animated meshes use the default VAO
 
-void texture_2d::flip_vertical()
+  glEnableVertexAttribArray(0);
+  glEnableVertexAttribArray(1);
+  glEnableVertexAttribArray(2);
+  glEnableVertexAttribArray(3);
+  glEnableVertexAttribArray(4);
+  glEnableVertexAttribArray(5);
+  glEnableVertexAttribArray(6);
+  glEnableVertexAttribArray(7);
 
-{
-  unsigned int i,j;
-  unsigned char r1,g1,b1,r2,g2,b2;
+  next_frame = (this->current_frame + 1) % number_of_frames;   // the last frame blends into the first one
+  frame_size = source->frame_vertex_count * sizeof(vertex_3d);
+  offset = this->current_frame * frame_size;
+  next_offset = next_frame * frame_size;
 
-  for (j = 0; j < this->height / 2; j++)
-    for (i = 0; i < this->width; i++)
-      {
-        this->get_pixel(i,j,&r1,&g1,&b1);
-        this->get_pixel(i,this->height - j - 1,&r2,&g2,&b2);
-        this->set_pixel(i,j,r2,g2,b2);
-        this->set_pixel(i,this->height - j - 1,r1,g1,b1);
-      }
-}
+  glBindBuffer(GL_ARRAY_BUFFER,source->vbo);
+  glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) (offset));             // position
+  glVertexAttribPointer(1,2,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) (offset + 12));        // texture coordinate
+  glVertexAttribPointer(2,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) (offset + 20));        // normal
+  glVertexAttribPointer(3,1,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) (offset + 32));        // texture blend ratio
+  glVertexAttribPointer(4,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) (next_offset));        // position2
+  glVertexAttribPointer(5,2,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) (next_offset + 12));   // texture coordinate2
+  glVertexAttribPointer(6,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) (next_offset + 20));   // normal2
+  glVertexAttribPointer(7,1,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) (next_offset + 32));   // texture blend ratio2
 
-//----------------------------------------------------------------------
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,source->ibo);
 
-void mesh_3d::get_position(point_3d *point)
+  if (source->ibo != 0)
+    glDrawElements(GL_TRIANGLES,source->frame_triangle_count * 3,source->index_type,0);
 
-{
-  point->x = this->position.x;
-  point->y = this->position.y;
-  point->z = this->position.z;
+  glDisableVertexAttribArray(0);
+  glDisableVertexAttribArray(1);
+  glDisableVertexAttribArray(2);
+  glDisableVertexAttribArray(3);
+  glDisableVertexAttribArray(4);
+  glDisableVertexAttribArray(5);
+  glDisableVertexAttribArray(6);
+  glDisableVertexAttribArray(7);
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d::get_rotation(point_3d *point)
+skeletal_clip::skeletal_clip()
 
 {
-  point->x = this->rotation.x;
-  point->y = this->rotation.y;
-  point->z = this->rotation.z;
+  this->length_ms = 0;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d::set_position(float x, float y, float z)
+void skeletal_clip::add_key(unsigned int bone, float time_ms, point_3d position, quaternion rotation, point_3d scale)
 
 {
-  this->position.x = x;
-  this->position.y = y;
-  this->position.z = z;
+  bone_key key;
 
-  make_translation_matrix(x,y,z,this->translation_matrix);
+  key.time_ms = time_ms;
+  key.position = position;
+  key.rotation = rotation;
+  key.scale = scale;
 
-  this->update_transformation_matrix();
-}
+  if (bone >= this->bone_tracks.size())
+    this->bone_tracks.resize(bone + 1,-1);
 
-//----------------------------------------------------------------------
+  if (this->bone_tracks[bone] < 0)
+    {
+      bone_track track;
+      track.bone = bone;
+      this->bone_tracks[bone] = this->tracks.size();
+      this->tracks.push_back(track);
+    }
 
-void mesh_3d_static::clear()
+  vector<bone_key> &keys = this->tracks[this->bone_tracks[bone]].keys;
 
-{
-  this->unload();
-  this->vertices.clear();
-  this->triangles.clear();
+  keys.insert(upper_bound(keys.begin(),keys.end(),key,  // keeps the keys sorted, appending in order is O(1)
+    [](const bone_key &key1, const bone_key &key2) { return key1.time_ms < key2.time_ms; }),key);
+
+  this->length_ms = max(this->length_ms,time_ms);
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::make_instance_of(mesh_3d_static *what)
+bool skeletal_clip::sample(unsigned int bone, float time_ms, bone_key *result)
 
 {
-  GLuint what_vbo,what_ibo,what_vao;
-  this->clear();
-  what->get_vbo_ibo_vao(&what_vbo,&what_ibo,&what_vao);
-  this->vbo = what_vbo;
-  this->ibo = what_ibo;
-  this->instance_parent = what;
-  this->update();
-}
-
-//----------------------------------------------------------------------
+  float ratio;
 
-void mesh_3d::set_rotation(float x, float y, float z)
+  if (bone >= this->bone_tracks.size() || this->bone_tracks[bone] < 0)
+    return false;
 
-{
-  this->rotation.x = angle_to_0_360(x);
-  this->rotation.y = angle_to_0_360(y);
-  this->rotation.z = angle_to_0_360(z);
+  vector<bone_key> &keys = this->tracks[this->bone_tracks[bone]].keys;
 
-  make_rotation_matrix(this->rotation.x,this->rotation.y,this->rotation.z,ROTATION_ZXY,this->rotation_matrix);
+  vector<bone_key>::iterator next = upper_bound(keys.begin(),keys.end(),time_ms,
+    [](float time, const bone_key &key) { return time < key.time_ms; });
 
-  this->update_transformation_matrix();
-}
+  if (next == keys.begin())
+    {
+      *result = keys.front();
+      return true;
+    }
 
-//----------------------------------------------------------------------
+  if (next == keys.end())
+    {
+      *result = keys.back();
+      return true;
+    }
 
-void mesh_3d::set_scale(float x, float y, float z)
+  bone_key &previous = *(next - 1);
 
-{
-  this->scale.x = x;
-  this->scale.y = y;
-  this->scale.z = z;
+  ratio = next->time_ms > previous.time_ms ? (time_ms - previous.time_ms) / (next->time_ms - previous.time_ms) : 0.0;
 
-  make_scale_matrix(x,y,z,this->scale_matrix);
+  result->time_ms = time_ms;
+  result->position.x = previous.position.x + (next->position.x - previous.position.x) * ratio;
+  result->position.y = previous.position.y + (next->position.y - previous.position.y) * ratio;
+  result->position.z = previous.position.z + (next->position.z - previous.position.z) * ratio;
+  result->scale.x = previous.scale.x + (next->scale.x - previous.scale.x) * ratio;
+  result->scale.y = previous.scale.y + (next->scale.y - previous.scale.y) * ratio;
+  result->scale.z = previous.scale.z + (next->scale.z - previous.scale.z) * ratio;
+  interpolate_quaternions(ratio,previous.rotation,next->rotation,&result->rotation);
 
-  this->update_transformation_matrix();
+  return true;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::scale_to_size(float size,bool apply_matrix)
+float skeletal_clip::get_length()
 
 {
-  float width,height,depth,scale,maximum_size;
-  float scale_matrix[4][4];
-
-  this->get_size(&width,&height,&depth);
-
-  maximum_size = width > height ? (width > depth ? width : depth) : (height > depth ? height : depth);
-  scale = size / maximum_size;
-
-  if (apply_matrix)
-    {
-      make_scale_matrix(scale,scale,scale,scale_matrix);
-      this->apply_matrix(scale_matrix);
-    }
-  else
-    this->set_scale(scale);
+  return this->length_ms;
 }
 
 //----------------------------------------------------------------------
 
-void register_keyboard_function(void (*function)(int key, int x, int y))
+unsigned int skeletal_clip::get_key_count()
 
 {
-  user_keyboard_function = function;
-}
-
-//----------------------------------------------------------------------
+  unsigned int i,result = 0;
 
-void register_advanced_keyboard_function(void (*function)(bool key_up, int key, int x, int y))
+  for (i = 0; i < this->tracks.size(); i++)
+    result += this->tracks[i].keys.size();
 
-{
-  user_advanced_keyboard_function = function;
+  return result;
 }
 
 //----------------------------------------------------------------------
 
-void set_mouse_position(unsigned int x, unsigned int y)
+unsigned int skeletal_clip::get_memory_size()
 
 {
-  glutWarpPointer(x,y);
+  return this->get_key_count() * sizeof(bone_key) + this->tracks.size() * sizeof(bone_track) + this->bone_tracks.size() * sizeof(int);
 }
 
 //----------------------------------------------------------------------
 
-void set_perspective(float fov_degrees, float near_plane, float far_plane)
+void skeletal_clip::clear()
 
 {
-  float matrix[4][4];
-
-  global_fov = fov_degrees;
-  global_near = near_plane;
-  global_far = far_plane;
-
-  make_perspective_matrix(fov_degrees,near_plane,far_plane,matrix);
-  glUniformMatrix4fv(perspective_matrix_location,1,GL_TRUE,(const GLfloat *)matrix);
-  glUniform1f(far_plane_location,(GLfloat) far_plane);
-
-  set_fog(global_fog_distance);        // fog uniform must be also updated
+  this->tracks.clear();
+  this->bone_tracks.clear();
+  this->length_ms = 0;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::get_vbo_ibo_vao(GLuint *vbo, GLuint *ibo, GLuint *vao)
+mesh_3d_skinned::mesh_3d_skinned(): mesh_3d_static()
 
 {
-  *vbo = this->vbo;
-  *ibo = this->ibo;
-  *vao = this->vao;
+  this->skin_vbo = 0;
+  this->clip = NULL;
+  this->clip_time = 0.0;
+  this->play_speed = 1.0;
+  this->playing = false;
+  this->loop = true;
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d::mesh_3d()
+mesh_3d_skinned::~mesh_3d_skinned()
 
 {
-  this->texture = NULL;
-  this->texture2 = NULL;
-  this->visible = true;
-
-  this->set_color(255,255,255);
-
-  this->set_lighting_properties(0.2,0.5,0.8,100);
-
-  this->set_position(0,0,0);
-  this->set_rotation(0,0,0);
-  this->set_scale(1,1,1);
-  this->set_render_mode(RENDER_MODE_SHADED_GORAUD);
-  this->use_fog = true;
+  this->clear();      // the base destructor wouldn't call this class's clear
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d_static::mesh_3d_static(): mesh_3d()
+void mesh_3d_skinned::make_instance_of(mesh_3d_skinned *what)
 
 {
-  this->vbo = 0;
-  this->ibo = 0;
-  this->vao = 0;
-  this->instance_parent = NULL;
+  mesh_3d_static::make_instance_of(what);
+  this->bones = what->bones;
+  this->bone_matrices.clear();
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d_static::mesh_3d_static(mesh_3d_static *copy_from): mesh_3d()
+int mesh_3d_skinned::add_bone(string name, int parent, point_3d position, quaternion rotation, point_3d scale)
 
 {
+  skeleton_bone bone;
+  matrix_4x4 bind_matrix,local_matrix;
   unsigned int i;
 
-  this->vbo = 0;
-  this->ibo = 0;
-  this->vao = 0;
-  this->instance_parent = NULL;
-
-  this->texture = copy_from->get_texture();
-
-  for (i = 0; i < copy_from->vertex_count(); i++)
-    this->add_vertex(
-      copy_from->vertices[i].position.x,
-      copy_from->vertices[i].position.y,
-      copy_from->vertices[i].position.z,
-      copy_from->vertices[i].texture_coordinate[0],
-      copy_from->vertices[i].texture_coordinate[1],
-      copy_from->vertices[i].normal.x,
-      copy_from->vertices[i].normal.y,
-      copy_from->vertices[i].normal.z);
-
-  for (i = 0; i < copy_from->triangle_count(); i++)
-    this->add_triangle(
-      copy_from->triangles[i].index1,
-      copy_from->triangles[i].index2,
-      copy_from->triangles[i].index3);
+  if (this->bones.size() >= MAX_BONES || parent >= (int) this->bones.size())
+    {
+      cerr << "ERROR: the bone " << name << " couldn't be added to the skinned mesh." << endl;
+      return -1;
+    }
 
-  this->set_render_mode(copy_from->get_render_mode());
-}
+  bone.name = name;
+  bone.parent = parent < 0 ? -1 : parent;
+  bone.position = position;
+  bone.rotation = rotation;
+  bone.scale = scale;
 
-//----------------------------------------------------------------------
+  make_quaternion_matrix(rotation,local_matrix.m);
 
-void mesh_3d::get_scale(point_3d *scale)
+  for (i = 0; i < 3; i++)     // T * R * S, see scene_node::update_world_matrix
+    {
+      local_matrix.m[i][0] *= scale.x;
+      local_matrix.m[i][1] *= scale.y;
+      local_matrix.m[i][2] *= scale.z;
+    }
 
-{
-  scale->x = this->scale.x;
-  scale->y = this->scale.y;
-  scale->z = this->scale.z;
-}
+  local_matrix.m[0][3] = position.x;
+  local_matrix.m[1][3] = position.y;
+  local_matrix.m[2][3] = position.z;
 
-//----------------------------------------------------------------------
+  if (bone.parent < 0)
+    bind_matrix = local_matrix;
+  else
+    {
+      invert_matrix_affine(&this->bones[bone.parent].inverse_bind_matrix,&bind_matrix);   // the parent's bind matrix
+      multiply_matrices_affine(&bind_matrix,&local_matrix,&bind_matrix);
+    }
 
-void mesh_3d::set_texture(texture_2d *texture)
+  if (!invert_matrix_affine(&bind_matrix,&bone.inverse_bind_matrix))
+    make_identity_matrix(bone.inverse_bind_matrix.m);
 
-{
-  this->texture = texture;
+  this->bones.push_back(bone);
+  return this->bones.size() - 1;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d::add_shadow(float x, float y, float radius, float brightness)
+int mesh_3d_skinned::find_bone(string name)
 
 {
-  shadow new_shadow;
+  unsigned int i;
 
-  new_shadow.position[0] = x;
-  new_shadow.position[1] = y;
-  new_shadow.radius = radius;
-  new_shadow.brightness = brightness;
+  for (i = 0; i < this->bones.size(); i++)
+    if (this->bones[i].name == name)
+      return i;
 
-  this->shadows.push_back(new_shadow);
+  return -1;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d::set_texture2(texture_2d *texture)
+unsigned int mesh_3d_skinned::get_bone_count()
 
 {
-  this->texture2 = texture;
+  return this->bones.size();
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::update()
+void mesh_3d_skinned::set_vertex_bones(unsigned int vertex, const unsigned int bones[4], const float weights[4])
 
 {
-  if (this->vao == 0)
-    glGenVertexArrays(1,&this->vao);
+  unsigned int i,largest,sum;
+  float total;
+  vertex_skin helper_skin;
 
-  if (this->vao == 0)
-    cerr << "ERROR: VAO couldn't be allocated for the mesh.";
+  memset(&helper_skin,0,sizeof(helper_skin));
 
-  glBindVertexArray(this->vao);
+  total = 0.0;
+  largest = 0;
 
-  if (this->vbo == 0)
-    glGenBuffers(1,&this->vbo);
+  for (i = 0; i < 4; i++)
+    {
+      total += max(weights[i],0.0f);
 
-  if (this->vbo == 0)
-    cerr << "ERROR: VBO couldn't be allocated for the mesh.";
+      if (weights[i] > weights[largest])
+        largest = i;
+    }
 
-  glBindBuffer(GL_ARRAY_BUFFER,this->vbo);
+  if (total <= 0.0)          // no influence, follow the bone fully
+    {
+      total = 1.0;
+      largest = 0;
+    }
 
-  if (this->instance_parent == NULL)
-    glBufferData(GL_ARRAY_BUFFER,this->vertices.size() * sizeof(vertex_3d),&this->vertices[0],GL_STATIC_DRAW);
+  sum = 0;
 
-  if (this->ibo == 0)
-    glGenBuffers(1,&this->ibo);
+  for (i = 0; i < 4; i++)
+    {
+      helper_skin.bone_weights[i] = (unsigned char) (max(weights[i],0.0f) / total * 255.0);
+      sum += helper_skin.bone_weights[i];
+    }
 
-  if (this->ibo == 0)
-    cerr << "ERROR: IBO couldn't be allocated for the mesh.";
+  helper_skin.bone_weights[largest] += 255 - sum;   // rounding errors go to the strongest bone
 
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,this->ibo);
+  for (i = 0; i < 4; i++)
+    {
+      if (helper_skin.bone_weights[i] == 0)     // unused, any valid index will do
+        continue;
 
-  if (this->instance_parent == NULL)
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,this->triangles.size() * sizeof(triangle_3d),&this->triangles[0],GL_STATIC_DRAW);
+      if (bones[i] >= this->bones.size())       // the palette entry would be left from another mesh
+        {
+          cerr << "ERROR: bone " << bones[i] << " doesn't exist in the skinned mesh." << endl;
+          return;
+        }
 
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-  glEnableVertexAttribArray(2);
-  glEnableVertexAttribArray(3);
+      helper_skin.bone_indices[i] = (unsigned char) bones[i];
+    }
 
-  glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),0);                   // position
-  glVertexAttribPointer(1,2,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 12);  // texture coordinate
-  glVertexAttribPointer(2,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 20);  // normal
-  glVertexAttribPointer(3,1,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 32);  // texture blend ratio
+  if (vertex >= this->skin.size())
+    {
+      vertex_skin default_skin;
+      memset(&default_skin,0,sizeof(default_skin));
+      default_skin.bone_weights[0] = 255;
+      this->skin.resize(vertex + 1,default_skin);
+    }
 
-  glBindVertexArray(0);   // unbind the meshe's VAO
+  this->skin[vertex] = helper_skin;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::unload()
+void mesh_3d_skinned::set_clip(skeletal_clip *clip)
 
 {
-  if (this->instance_parent == NULL)
-    {
-      if (this->vao != 0)
-        glDeleteVertexArrays(1,&this->vao);
+  this->clip = clip;
+  this->clip_time = 0.0;
+}
 
-      if (this->vbo != 0)
-        glDeleteBuffers(1,&this->vbo);
+//----------------------------------------------------------------------
 
-      if (this->ibo != 0)
-        glDeleteBuffers(1,&this->ibo);
-    }
+void mesh_3d_skinned::set_clip_time(float time_ms)
 
-  this->vao = 0;
-  this->vbo = 0;
-  this->ibo = 0;
+{
+  this->clip_time = time_ms;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_animated::unload()
+float mesh_3d_skinned::get_clip_time()
 
 {
-  unsigned int i;
+  return this->clip_time;
+}
 
-  if (this->instance_parent == NULL)
-    for (i = 0; i < this->frames.size(); i++)
-      {
-        if (this->frames[i].vbo != 0)
-          glDeleteBuffers(1,&this->frames[i].vbo);
+//----------------------------------------------------------------------
 
-        if (this->frames[i].ibo != 0)
-          glDeleteBuffers(1,&this->frames[i].ibo);
-      }
+void mesh_3d_skinned::set_playing(bool play)
 
-  for (i = 0; i < this->frames.size(); i++)
-    {
-      this->frames[i].vbo = 0;
-      this->frames[i].ibo = 0;
-    }
+{
+  this->playing = play;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d::set_color(unsigned char red, unsigned char green, unsigned char blue)
+void mesh_3d_skinned::set_loop(bool loop)
 
 {
-  this->color[0] = red;
-  this->color[1] = green;
-  this->color[2] = blue;
-
-  this->color_float[0] = this->color[0] / 255.0f;
-  this->color_float[1] = this->color[1] / 255.0f;
-  this->color_float[2] = this->color[2] / 255.0f;
+  this->loop = loop;
 }
 
 //----------------------------------------------------------------------
 
-void camera_struct::handle_fps()
+void mesh_3d_skinned::set_speed(float speed)
 
 {
-  float distance_to_go, angle_to_rotate;
-  int time_difference;
+  this->play_speed = speed;
+}
 
-  if (user_advanced_keyboard_function == NULL)    // this function must be registered
-    return;
+//----------------------------------------------------------------------
 
-  time_difference = get_frame_time_difference();
+void mesh_3d_skinned::update_pose()
 
-  distance_to_go = time_difference * camera.movement_speed;
-  angle_to_rotate = time_difference * camera.rotation_speed;
+{
+  unsigned int i,j;
+  bone_key pose;
+  matrix_4x4 local_matrix;
 
-  if (global_keyboard_state[camera.key_go_forward])
-    this->go(DIRECTION_FORWARD,distance_to_go);
-  else if (global_keyboard_state[camera.key_go_backward])
-    this->go(DIRECTION_BACKWARD,distance_to_go);
+  this->world_matrices.resize(this->bones.size());
+  this->bone_matrices.resize(this->bones.size());
 
-  if (global_keyboard_state[camera.key_go_left])
-    this->go(DIRECTION_LEFT,distance_to_go);
-  else if (global_keyboard_state[camera.key_go_right])
-    this->go(DIRECTION_RIGHT,distance_to_go);
+  for (i = 0; i < this->bones.size(); i++)
+    {
+      pose.position = this->bones[i].position;
+      pose.rotation = this->bones[i].rotation;
+      pose.scale = this->bones[i].scale;
 
-  if (global_keyboard_state[camera.key_go_up])
-    this->go(DIRECTION_UP,distance_to_go);
-  else if (global_keyboard_state[camera.key_go_down])
-    this->go(DIRECTION_DOWN,distance_to_go);
+      if (this->clip != NULL)
+        this->clip->sample(i,this->clip_time,&pose);
 
-  if (use_mouse_for_rotation)
-    {
-      int mouse_dx = global_window_center[0] - global_mouse_position[0];
-      int mouse_dy = global_window_center[1] - global_mouse_position[1];
+      make_quaternion_matrix(pose.rotation,local_matrix.m);
 
-      if (global_ignore_mouse_position)  // in first call the mouse position is ignored
+      for (j = 0; j < 3; j++)
         {
-          mouse_dx = 0;
-          mouse_dy = 0;
-          global_ignore_mouse_position = false;
+          local_matrix.m[j][0] *= pose.scale.x;
+          local_matrix.m[j][1] *= pose.scale.y;
+          local_matrix.m[j][2] *= pose.scale.z;
         }
 
-      set_mouse_position(global_window_center[0],global_window_center[1]);
+      local_matrix.m[0][3] = pose.position.x;
+      local_matrix.m[1][3] = pose.position.y;
+      local_matrix.m[2][3] = pose.position.z;
 
-      this->rotate(-1 * angle_to_rotate * mouse_dy,-1 * angle_to_rotate * mouse_dx,0);
+      if (this->bones[i].parent < 0)   // parents go first, so their world matrices are ready
+        this->world_matrices[i] = local_matrix;
+      else
+        multiply_matrices_affine(&this->world_matrices[this->bones[i].parent],&local_matrix,&this->world_matrices[i]);
+
+      multiply_matrices_affine(&this->world_matrices[i],&this->bones[i].inverse_bind_matrix,&this->bone_matrices[i]);
     }
-  else
-    {
-      if (global_keyboard_state[camera.key_rotate_x_cw])
-        this->rotate(-1 *angle_to_rotate,0,0);
-      else if (global_keyboard_state[camera.key_rotate_x_ccw])
-        this->rotate(angle_to_rotate,0,0);
+}
 
-      if (global_keyboard_state[camera.key_rotate_y_cw])
-        this->rotate(0,angle_to_rotate,0);
-      else if (global_keyboard_state[camera.key_rotate_y_ccw])
-        this->rotate(0,-1 * angle_to_rotate,0);
+//----------------------------------------------------------------------
 
-      if (global_keyboard_state[camera.key_rotate_z_cw])
-        this->rotate(0,0,angle_to_rotate);
-      else if (global_keyboard_state[camera.key_rotate_z_ccw])
-        this->rotate(0,0,-1 * angle_to_rotate);
-    }
+void mesh_3d_skinned::update()
 
-  if (this->limit_x_rotation)
+{
+  mesh_3d_skinned *source;
+
+  this->set_buffer_arena(NULL);        // the arena's VAO has no skin attributes
+  mesh_3d_static::update();
+
+  source = this->instance_parent != NULL ? (mesh_3d_skinned *) this->instance_parent : this;
+
+  if (this->instance_parent == NULL)
     {
-      point_3d camera_rotation;
-      this->get_rotation(&camera_rotation);
+      vertex_skin default_skin;
 
-      if (camera_rotation.x < 270.0 && camera_rotation.x > 180.0)
-        this->set_rotation(270.0,camera_rotation.y,camera_rotation.z);
-      else if (camera_rotation.x > 90 && camera_rotation.x < 270.0)
-        this->set_rotation(90.0,camera_rotation.y,camera_rotation.z);
+      memset(&default_skin,0,sizeof(default_skin));
+      default_skin.bone_weights[0] = 255;
+      this->skin.resize(this->vertex_count(),default_skin);
+
+      if (this->skin_vbo == 0)
+        glGenBuffers(1,&this->skin_vbo);
+
+      if (this->skin_vbo == 0)
+        cerr << "ERROR: skin VBO couldn't be allocated for the mesh.";
+
+      glBindBuffer(GL_ARRAY_BUFFER,this->skin_vbo);
+      glBufferData(GL_ARRAY_BUFFER,this->skin.size() * sizeof(vertex_skin),this->skin.size() != 0 ? &this->skin[0] : NULL,GL_STATIC_DRAW);
     }
+
+  bind_vertex_array(this->vao);
+  glBindBuffer(GL_ARRAY_BUFFER,source->skin_vbo);
+  glEnableVertexAttribArray(12);
+  glEnableVertexAttribArray(13);
+  glVertexAttribIPointer(12,4,GL_UNSIGNED_BYTE,sizeof(vertex_skin),0);                          // bone indices
+  glVertexAttribPointer(13,4,GL_UNSIGNED_BYTE,GL_TRUE,sizeof(vertex_skin),(const GLvoid*) 4);   // bone weights
+  bind_vertex_array(0);
+
+  this->update_memory_usage();
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::draw()
+void mesh_3d_skinned::update_memory_usage()
 
 {
-  if (!this->visible)
-    return;
+  if (this->instance_parent != NULL)
+    {
+      mesh_3d_static::update_memory_usage();
+      return;
+    }
 
-  this->init_rendering();
-  glBindVertexArray(this->vao);
-  glDrawElements(GL_TRIANGLES,this->triangle_count() * 3,GL_UNSIGNED_INT,0);
-  glBindVertexArray(0);
+  set_memory_usage(this,MEMORY_MESHES,this->get_cpu_memory_size() + this->skin.capacity() * sizeof(vertex_skin),
+    this->get_gpu_memory_size() + (this->skin_vbo != 0 ? this->skin.size() * sizeof(vertex_skin) : 0));
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d::set_use_fog(bool enable)
+void mesh_3d_skinned::unload()
 
 {
-  this->use_fog = enable;
+  if (this->instance_parent == NULL && this->skin_vbo != 0)
+    glDeleteBuffers(1,&this->skin_vbo);
+
+  this->skin_vbo = 0;
+  mesh_3d_static::unload();
 }
 
 //----------------------------------------------------------------------
 
-void texture_2d::set_pixel(int x, int y, unsigned char red, unsigned char green, unsigned char blue)
+void mesh_3d_skinned::clear()
 
 {
-  unsigned int index;
-
-  if (x < 0 || x >= (int) this->width || y < 0 || y >= (int) this->height)
-    return;
-
-  index = this->xy_to_linear(x,y);
-
-  this->data[index] = red;
-  this->data[index + 1] = green;
-  this->data[index + 2] = blue;
+  mesh_3d_static::clear();
+  this->skin.clear();
+  this->bones.clear();
+  this->bone_matrices.clear();
 }
 
 //----------------------------------------------------------------------
 
-void set_fog(float distance)
+void mesh_3d_skinned::draw()
 
 {
-  float fog_distance_for_shader;   // distance from the viewer and normalized
-  global_fog_distance = distance;
-  fog_distance_for_shader = (global_far - distance) / global_far;
+  float length;
 
-  if (distance <= 0.0)
-    fog_distance_for_shader = -1.0;   // disables the fog
+  if (!this->visible || this->bones.size() == 0)
+    return;
 
-  glUniform1f(fog_distance_location,(GLfloat) fog_distance_for_shader);
-}
+  if (this->playing && this->clip != NULL)
+    {
+      length = this->clip->get_length();
+      this->clip_time += this->play_speed * get_frame_time_difference();
 
-//----------------------------------------------------------------------
+      if (length <= 0.0)
+        this->clip_time = 0.0;
+      else if (this->clip_time > length || this->clip_time < 0.0)
+        {
+          if (this->loop)
+            {
+              this->clip_time = fmod(this->clip_time,length);
 
-unsigned int mesh_3d_static::vertex_count()
+              if (this->clip_time < 0.0)
+                this->clip_time += length;
+            }
+          else
+            {
+              this->clip_time = this->clip_time < 0.0 ? 0.0 : length;
+              this->set_playing(false);
+            }
+        }
+    }
 
-{
-  return this->instance_parent == NULL ? this->vertices.size() : this->instance_parent->vertex_count();
-}
+  this->update_pose();
+
+  this->init_rendering(SHADER_SKINNED);
+  this->upload_position_dequantization();
+  upload_bone_matrices(this->bone_matrices);
+
+  if (this->get_meshlet_count() != 0)    // the bounds are those of the bind pose
+    {
+      this->cull_meshlets();
+      this->draw_index_ranges(this->visible_counts,this->visible_offsets);
+      return;
+    }
 
+  this->draw_geometry();
+}
 //----------------------------------------------------------------------
 
-void mesh_3d_static::remove_useless_triangles()
+mesh_3d_crowd::mesh_3d_crowd(): mesh_3d()
 
 {
-  unsigned int i;
-
-  for (i = 0; i < this->triangles.size(); i++)
-    if (this->triangles[i].index1 == this->triangles[i].index2 ||
-        this->triangles[i].index1 == this->triangles[i].index3 ||
-        this->triangles[i].index2 == this->triangles[i].index3)
-      {
-        this->triangles.erase(this->triangles.begin() + i);
-        i--;
-      }
+  this->vbo = 0;
+  this->ibo = 0;
+  this->vao = 0;
+  this->instance_buffer = 0;
+  this->instance_buffer_size = 0;
+  this->vertex_texture = 0;
+  this->index_type = GL_UNSIGNED_INT;
+  this->texture_height = 0;
+  this->animation_time = 0.0;
+  this->play_speed = 1.0;
+  this->playing = true;
 }
 
 //----------------------------------------------------------------------
 
-unsigned int mesh_3d_static::triangle_count()
+mesh_3d_crowd::~mesh_3d_crowd()
 
 {
-  return this->instance_parent == NULL ? this->triangles.size() : this->instance_parent->triangle_count();
+  this->clear();
 }
 
 //----------------------------------------------------------------------
 
-void texture_2d::get_pixel(int x, int y, unsigned char *red, unsigned char *green, unsigned char *blue)
+void mesh_3d_crowd::build(mesh_3d_animated *animation)
 
 {
-  unsigned int index;
+  unsigned int i,j,number_of_frames,number_of_vertices;
+  float *texel;
 
-  if (x < 0 || x >= (int) this->width || y < 0 || y >= (int) this->height)
+  number_of_frames = min((unsigned int) animation->frames.size(),(unsigned int) MAX_ANIMATION_FRAMES);
+
+  if (number_of_frames == 0)           // validate first, a failed build keeps the crowd as it was
     {
-      *red = 0;
-      *green = 0;
-      *blue = 0;
+      cerr << "ERROR: the animated mesh has no frames to be baked." << endl;
       return;
     }
 
-  index = this->xy_to_linear(x,y);
+  number_of_vertices = animation->frames[0].vertices.size();
 
-  *red = this->data[index];
-  *green = this->data[index + 1];
-  *blue = this->data[index + 2];
-}
+  for (i = 1; i < number_of_frames; i++)
+    if (animation->frames[i].vertices.size() != number_of_vertices)
+      {
+        cerr << "ERROR: all frames of the animated mesh must have the same number of vertices." << endl;
+        return;
+      }
 
-//----------------------------------------------------------------------
+  if (animation->frames.size() > MAX_ANIMATION_FRAMES)
+    cerr << "ERROR: only " << MAX_ANIMATION_FRAMES << " frames can be baked to a vertex animation texture." << endl;
 
-void mesh_3d_static::flip_triangles()
+  this->texture_data.clear();
+  this->frame_starts.clear();
 
-{
-  unsigned int i, helper_index;
+  this->base_vertices = animation->frames[0].vertices;
+  this->triangles = animation->frames[0].triangles;
 
-  for (i = 0; i < this->vertices.size(); i++)
-    {
-      this->vertices[i].normal.x *= -1;
-      this->vertices[i].normal.y *= -1;
-      this->vertices[i].normal.z *= -1;
-    }
+  this->texture_height = (number_of_frames * number_of_vertices * 2 + VERTEX_TEXTURE_WIDTH - 1) / VERTEX_TEXTURE_WIDTH;
+  this->texture_data.resize(this->texture_height * VERTEX_TEXTURE_WIDTH * 4,0.0);
+  this->frame_starts.push_back(0.0);
 
-  for (i = 0; i < this->triangles.size(); i++)   // change the clockwiseness of each triangle
+  for (i = 0; i < number_of_frames; i++)
     {
-      helper_index = this->triangles[i].index1;
-      this->triangles[i].index1 = this->triangles[i].index2;
-      this->triangles[i].index2 = helper_index;
+      for (j = 0; j < number_of_vertices; j++)
+        {
+          texel = &this->texture_data[((i * number_of_vertices + j) * 2) * 4];
+          texel[0] = animation->frames[i].vertices[j].position.x;
+          texel[1] = animation->frames[i].vertices[j].position.y;
+          texel[2] = animation->frames[i].vertices[j].position.z;
+          texel[4] = animation->frames[i].vertices[j].normal.x;
+          texel[5] = animation->frames[i].vertices[j].normal.y;
+          texel[6] = animation->frames[i].vertices[j].normal.z;
+        }
+
+      this->frame_starts.push_back(this->frame_starts.back() + animation->frames[i].length_ms);
     }
 
-  this->update();
+  this->copy_material(animation);
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::simplify(unsigned int iterations)
+unsigned int mesh_3d_crowd::add_member(mesh_3d *member, float time_offset)
 
 {
-  unsigned int i,j,k,vertex1,vertex2;
-  float distance,min_distance;
+  this->members.push_back(member);
+  this->time_offsets.push_back(time_offset);
+  return this->members.size() - 1;
+}
 
-  for (i = 0; i < iterations; i++)
-    {
-      // find the 2 nearest vertices and merge them:
+//----------------------------------------------------------------------
 
-      vertex1 = 0;
-      vertex2 = 1;
-      min_distance = numeric_limits<float>::max();
+void mesh_3d_crowd::set_time_offset(unsigned int member, float time_offset)
 
-      for (j = 0; j < this->vertices.size(); j++)
-        for (k = j + 1; k < this->vertices.size(); k++)
-          {
-            distance = get_distance(this->vertices[j].position,this->vertices[k].position);
+{
+  if (member < this->time_offsets.size())
+    this->time_offsets[member] = time_offset;
+}
 
-            if (distance < min_distance)
-              {
-                min_distance = distance;
-                vertex1 = j;
-                vertex2 = k;
-              }
-          }
+//----------------------------------------------------------------------
 
-      this->merge_vertices(vertex1,vertex2,true);
-    }
+unsigned int mesh_3d_crowd::get_member_count()
 
-  this->remove_useless_triangles();
+{
+  return this->members.size();
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::simplify(float ratio)
+unsigned int mesh_3d_crowd::get_texture_memory_size()
 
 {
-  if (ratio > 1.0 || ratio < 0.0)
-    return;
+  return this->texture_height * VERTEX_TEXTURE_WIDTH * 4 * sizeof(float);
+}
+
+//----------------------------------------------------------------------
+
+void mesh_3d_crowd::set_playing(bool play)
 
-  this->simplify((unsigned int) (this->vertex_count() * (1.0 - ratio)));
+{
+  this->playing = play;
 }
 
 //----------------------------------------------------------------------
 
-void camera_struct::set_skybox(mesh_3d *what)
+void mesh_3d_crowd::set_speed(float speed)
 
 {
-  this->skybox = what;
-
-  this->set_position(this->position.x,this->position.y,this->position.z);   // aligns the skybox with the camera
+  this->play_speed = speed;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::get_bounding_box(float *x0, float *y0, float *z0, float *x1, float *y1, float *z1)
+void mesh_3d_crowd::update()
 
 {
   unsigned int i;
+  GLint max_size = 0;
 
-  *x0 = numeric_limits<float>::max();
-  *y0 = numeric_limits<float>::max();
-  *z0 = numeric_limits<float>::max();
-  *x1 = numeric_limits<float>::min();
-  *y1 = numeric_limits<float>::min();
-  *z1 = numeric_limits<float>::min();
+  if (this->frame_starts.size() == 0)
+    return;
 
-  for (i = 0; i < this->vertices.size(); i++)
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE,&max_size);
+
+  if (this->texture_height > (unsigned int) max_size)
     {
-      if (this->vertices[i].position.x < *x0)
-        *x0 = this->vertices[i].position.x;
+      cerr << "ERROR: the vertex animation texture of the crowd would be " << this->texture_height <<
+        " texels high, but the maximum is " << max_size << ", use fewer frames or vertices." << endl;
+      this->unload();                 // don't draw the previously uploaded frames with the new mesh
+      return;
+    }
+
+  if (this->vao == 0)
+    glGenVertexArrays(1,&this->vao);
+
+  if (this->vbo == 0)
+    glGenBuffers(1,&this->vbo);
+
+  if (this->ibo == 0)
+    glGenBuffers(1,&this->ibo);
+
+  if (this->instance_buffer == 0)
+    glGenBuffers(1,&this->instance_buffer);
+
+  if (this->vertex_texture == 0)
+    glGenTextures(1,&this->vertex_texture);
 
-      if (this->vertices[i].position.y < *y0)
-        *y0 = this->vertices[i].position.y;
+  if (this->vao == 0 || this->vbo == 0 || this->ibo == 0 || this->instance_buffer == 0 || this->vertex_texture == 0)
+    cerr << "ERROR: buffers couldn't be allocated for the crowd.";
+
+  bind_texture(VERTEX_TEXTURE_UNIT,this->vertex_texture);
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);   // read with texelFetch only
+  glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+  glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA32F,VERTEX_TEXTURE_WIDTH,this->texture_height,0,GL_RGBA,GL_FLOAT,&this->texture_data[0]);
+
+  bind_vertex_array(this->vao);
+
+  glBindBuffer(GL_ARRAY_BUFFER,this->vbo);
+  glBufferData(GL_ARRAY_BUFFER,this->base_vertices.size() * sizeof(vertex_3d),this->base_vertices.size() == 0 ? NULL : &this->base_vertices[0],GL_STATIC_DRAW);
 
-      if (this->vertices[i].position.z < *z0)
-        *z0 = this->vertices[i].position.z;
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,this->ibo);
+  this->index_type = upload_indices(this->triangles,this->base_vertices.size());
 
-      if (this->vertices[i].position.x > *x1)
-        *x1 = this->vertices[i].position.x;
+  glEnableVertexAttribArray(1);       // positions and normals come from the texture
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(1,2,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 12);  // texture coordinate
+  glVertexAttribPointer(3,1,GL_FLOAT,GL_FALSE,sizeof(vertex_3d),(const GLvoid*) 32);  // texture blend ratio
 
-      if (this->vertices[i].position.y > *y1)
-        *y1 = this->vertices[i].position.y;
+  glBindBuffer(GL_ARRAY_BUFFER,this->instance_buffer);
 
-      if (this->vertices[i].position.z > *z1)
-        *z1 = this->vertices[i].position.z;
+  for (i = 0; i < 4; i++)             // instance matrix, one column per location
+    {
+      glEnableVertexAttribArray(8 + i);
+      glVertexAttribPointer(8 + i,4,GL_FLOAT,GL_FALSE,17 * sizeof(float),(const GLvoid*) (i * 4 * sizeof(float)));
+      glVertexAttribDivisor(8 + i,1);
     }
+
+  glEnableVertexAttribArray(14);
+  glVertexAttribPointer(14,1,GL_FLOAT,GL_FALSE,17 * sizeof(float),(const GLvoid*) (16 * sizeof(float)));   // time offset
+  glVertexAttribDivisor(14,1);
+
+  bind_vertex_array(0);
+  this->update_memory_usage();
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::get_bounding_box(point_3d *first_point, point_3d *second_point)
+void mesh_3d_crowd::update_memory_usage()
 
 {
-  this->get_bounding_box(&first_point->x,&first_point->y,&first_point->z,
-                         &second_point->x,&second_point->y,&second_point->z);
+  unsigned long long gpu_bytes = 0;
+
+  if (this->vbo != 0)
+    gpu_bytes = this->get_texture_memory_size() + this->base_vertices.size() * sizeof(vertex_3d) +
+      this->triangles.size() * 3 * (this->index_type == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(unsigned int)) +
+      this->instance_buffer_size;
+
+  set_memory_usage(this,MEMORY_CROWDS,
+    this->texture_data.capacity() * sizeof(float) + this->base_vertices.capacity() * sizeof(vertex_3d) +
+    this->triangles.capacity() * sizeof(triangle_3d) + this->instance_data.capacity() * sizeof(float),gpu_bytes);
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::get_size(float *width, float *height, float *depth)
+void mesh_3d_crowd::unload()
 
 {
-  point_3d point_a,point_b;
+  if (this->vbo != 0)
+    glDeleteBuffers(1,&this->vbo);
 
-  this->get_bounding_box(&point_a,&point_b);
+  if (this->ibo != 0)
+    glDeleteBuffers(1,&this->ibo);
 
-  *width = point_b.x - point_a.x;
-  *height = point_b.y - point_a.y;
-  *depth = point_b.z - point_a.z;
-}
+  if (this->instance_buffer != 0)
+    glDeleteBuffers(1,&this->instance_buffer);
 
-//----------------------------------------------------------------------
+  if (this->vertex_texture != 0)
+    delete_texture(this->vertex_texture);
 
-int get_frame_time_difference()
+  if (this->vao != 0)
+    delete_vertex_array(this->vao);
 
-{
-  return global_frame_time_difference;
+  this->vbo = 0;
+  this->ibo = 0;
+  this->instance_buffer = 0;
+  this->instance_buffer_size = 0;
+  this->vertex_texture = 0;
+  this->vao = 0;
+  this->update_memory_usage();
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d::set_scale(float scale)
+void mesh_3d_crowd::clear()
 
 {
-  this->set_scale(scale,scale,scale);
+  this->unload();
+  this->members.clear();
+  this->time_offsets.clear();
+  this->base_vertices.clear();
+  this->triangles.clear();
+  this->texture_data.clear();
+  this->frame_starts.clear();
+  this->instance_data.clear();
+  remove_memory_usage(this);
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::print_data()
+void mesh_3d_crowd::draw()
 
 {
-  unsigned int i;
+  unsigned int i,j,k,number_of_instances;
+  float matrix[4][4];
 
-  cout << "vertices (index: position; uv; normal):" << endl;
+  this->instance_data.clear();
 
-  for (i = 0; i < this->vertices.size(); i++)
-    cout << i << ": " << this->vertices[i].position.x << ", " <<
-                         this->vertices[i].position.y << ", " <<
-                         this->vertices[i].position.z << "; " <<
-                         this->vertices[i].texture_coordinate[0] << ", " <<
-                         this->vertices[i].texture_coordinate[1] << "; " <<
-                         this->vertices[i].normal.x << "; " <<
-                         this->vertices[i].normal.y << "; " <<
-                         this->vertices[i].normal.z << endl;
+  if (!this->visible || this->vao == 0 || this->frame_starts.empty())
+    return;
 
-  cout << endl;
-  cout << "triangles (index: indices):" << endl;
+  if (this->playing && this->frame_starts.back() > 0.0)
+    this->animation_time = fmod(this->animation_time + this->play_speed * get_frame_time_difference(),this->frame_starts.back());
 
-  for (i = 0; i < this->triangles.size(); i++)
-    cout << i << ": " << this->triangles[i].index1 << ", " <<
-                         this->triangles[i].index2 << ", " <<
-                         this->triangles[i].index3 << endl;
+  for (i = 0; i < this->members.size(); i++)
+    {
+      if (!this->members[i]->get_visibility())
+        continue;
 
-  cout << endl;
-}
+      this->members[i]->get_world_matrix(matrix);
 
-//----------------------------------------------------------------------
+      for (j = 0; j < 4; j++)         // transpose to column-major
+        for (k = 0; k < 4; k++)
+          this->instance_data.push_back(matrix[k][j]);
 
-mesh_3d_static* picture_2d::get_picture_mesh()
+      this->instance_data.push_back(this->time_offsets[i]);
+    }
 
-{
-  return &this->picture_mesh;
-}
+  number_of_instances = this->instance_data.size() / 17;
 
-//----------------------------------------------------------------------
+  if (number_of_instances == 0)
+    return;
 
-void set_background_color(unsigned char red, unsigned char green, unsigned char blue)
+  this->init_rendering(SHADER_VERTEX_TEXTURE | SHADER_INSTANCED);
 
-{
-  float helper_array[3];
+  glUniform1f(animation_time_location,this->animation_time);
+  glUniform1i(vertex_texture_vertices_location,this->base_vertices.size());
+  glUniform1i(vertex_texture_frames_location,this->frame_starts.size() - 1);
+  glUniform1fv(frame_starts_location,this->frame_starts.size(),&this->frame_starts[0]);
 
-  global_background_color[0] = red;
-  global_background_color[1] = green;
-  global_background_color[2] = blue;
+  bind_texture(VERTEX_TEXTURE_UNIT,this->vertex_texture);
 
-  helper_array[0] = red / 255.0;
-  helper_array[1] = green / 255.0;
-  helper_array[2] = blue / 255.0;
+  bind_vertex_array(this->vao);
 
-  glUniform3fv(background_color_location,1,(const GLfloat *) helper_array);
+  glBindBuffer(GL_ARRAY_BUFFER,this->instance_buffer);
+  glBufferData(GL_ARRAY_BUFFER,this->instance_data.size() * sizeof(float),&this->instance_data[0],GL_STREAM_DRAW);
 
-  glClearColor(helper_array[0],helper_array[1],helper_array[2],1.0);
+  if (this->instance_buffer_size != this->instance_data.size() * sizeof(float))
+    {
+      this->instance_buffer_size = this->instance_data.size() * sizeof(float);
+      this->update_memory_usage();
+    }
+
+  glDrawElementsInstanced(GL_TRIANGLES,this->triangles.size() * 3,this->index_type,0,number_of_instances);
+
+  bind_vertex_array(0);
 }
 
 //----------------------------------------------------------------------
 
-float get_fps()
+texture_atlas::texture_atlas(unsigned int page_size, unsigned int padding)
 
 {
-  return global_fps;
+  this->page_size = page_size;
+  this->padding = padding;
 }
 
 //----------------------------------------------------------------------
 
-float get_spf()
+texture_atlas::~texture_atlas()
 
 {
-  return global_spf;
+  this->clear();
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::merge_vertices(unsigned int index1, unsigned int index2, bool average_position)
+int texture_atlas::add_texture(texture_2d *texture)
 
 {
-  unsigned int i;
+  atlas_region region;
+  int handle = this->find_texture(texture);
 
-  if (index1 == index2 || index1 >= this->vertices.size() || index2 >= this->vertices.size())
-    return;
+  if (handle >= 0)
+    return handle;
 
-  if (average_position)
-    {
-      this->vertices[index1].position.x = (this->vertices[index1].position.x + this->vertices[index2].position.x) / 2.0;
-      this->vertices[index1].position.y = (this->vertices[index1].position.y + this->vertices[index2].position.y) / 2.0;
-      this->vertices[index1].position.z = (this->vertices[index1].position.z + this->vertices[index2].position.z) / 2.0;
+  memset(&region,0,sizeof(region));
+  region.page = (unsigned int) -1;
 
-      this->vertices[index1].normal.x = (this->vertices[index1].position.x + this->vertices[index2].normal.x) / 2.0;
-      this->vertices[index1].normal.y = (this->vertices[index1].position.y + this->vertices[index2].normal.y) / 2.0;
-      this->vertices[index1].normal.z = (this->vertices[index1].position.z + this->vertices[index2].normal.z) / 2.0;
+  this->sources.push_back(texture);
+  this->regions.push_back(region);
 
-      normalize_vector(&this->vertices[index1].normal);
-    }
+  return this->sources.size() - 1;
+}
 
-  this->vertices.erase(this->vertices.begin() + index2);
+//----------------------------------------------------------------------
 
-  for (i = 0; i < this->triangles.size(); i++)
-    {
-      if (this->triangles[i].index1 == index2)
-        this->triangles[i].index1 = index1;
-      else if (this->triangles[i].index1 > index2)
-        this->triangles[i].index1 -= 1;
+int texture_atlas::find_texture(texture_2d *texture)
 
-      if (this->triangles[i].index2 == index2)
-        this->triangles[i].index2 = index1;
-      else if (this->triangles[i].index2 > index2)
-        this->triangles[i].index2 -= 1;
+{
+  unsigned int i;
 
-      if (this->triangles[i].index3 == index2)
-        this->triangles[i].index3 = index1;
-      else if (this->triangles[i].index3 > index2)
-        this->triangles[i].index3 -= 1;
-    }
+  for (i = 0; i < this->sources.size(); i++)
+    if (this->sources[i] == texture)
+      return i;
+
+  return -1;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::add_vertex(float x, float y, float z)
+bool texture_atlas::find_position(unsigned int page, unsigned int width, unsigned int height, unsigned int *x, unsigned int *y, unsigned int *segment)
 
 {
-  this->add_vertex(x,y,z,0,0,0,0,1);
-}
+  unsigned int i,j,top,covered,best_top;
+  vector<skyline_segment> &skyline = this->skylines[page];
+  bool found = false;
 
-//----------------------------------------------------------------------
+  best_top = this->page_size + 1;
 
-void stop_rendering()
+  for (i = 0; i < skyline.size(); i++)
+    {
+      if (skyline[i].x + width > this->page_size)
+        break;
 
-{
-  glutLeaveMainLoop();
+      top = 0;                        // the rectangle lies on the highest segment under it
+      covered = 0;
+
+      for (j = i; j < skyline.size() && covered < width; j++)
+        {
+          top = max(top,skyline[j].y);
+          covered += skyline[j].width;
+        }
+
+      if (top + height <= this->page_size && top + height < best_top)
+        {
+          best_top = top + height;
+          *x = skyline[i].x;
+          *y = top;
+          *segment = i;
+          found = true;
+        }
+    }
+
+  return found;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::add_vertex(float x, float y, float z, float texture_u, float texture_v, float normal_x, float normal_y, float normal_z)
+void texture_atlas::place(unsigned int page, unsigned int segment, unsigned int x, unsigned int y, unsigned int width, unsigned int height)
 
 {
-  vertex_3d vertex;
+  unsigned int i,right;
+  skyline_segment new_segment;
+  vector<skyline_segment> &skyline = this->skylines[page];
 
-  vertex.texture_blend_ratio = 1.0;
+  new_segment.x = x;
+  new_segment.y = y + height;
+  new_segment.width = width;
 
-  vertex.position.x = x;
-  vertex.position.y = y;
-  vertex.position.z = z;
+  skyline.insert(skyline.begin() + segment,new_segment);
 
-  vertex.texture_coordinate[0] = texture_u;
-  vertex.texture_coordinate[1] = texture_v;
+  right = x + width;
 
-  vertex.normal.x = normal_x;
-  vertex.normal.y = normal_y;
-  vertex.normal.z = normal_z;
+  i = segment + 1;
 
-  normalize_vector(&vertex.normal);
+  while (i < skyline.size() && skyline[i].x < right)   // cut the segments under the rectangle
+    {
+      if (skyline[i].x + skyline[i].width <= right)
+        skyline.erase(skyline.begin() + i);
+      else
+        {
+          skyline[i].width -= right - skyline[i].x;
+          skyline[i].x = right;
+          break;
+        }
+    }
 
-  this->vertices.push_back(vertex);
+  for (i = 0; i + 1 < skyline.size(); )    // merge the neighbours of the same height
+    if (skyline[i].y == skyline[i + 1].y)
+      {
+        skyline[i].width += skyline[i + 1].width;
+        skyline.erase(skyline.begin() + i + 1);
+      }
+    else
+      i++;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d::set_render_mode(render_mode mode)
+void texture_atlas::build()
 
 {
-  this->mesh_render_mode = mode;
-}
+  unsigned int i,j,k,x,y,segment,width,height,page_index;
+  unsigned int source_x,source_y;
+  unsigned char red,green,blue,color[3],page_color[3];
+  vector<unsigned int> order;
+  vector<bool> page_changed(this->pages.size(),false);
+  int transparent_color;
+  skyline_segment empty_skyline;
 
-//----------------------------------------------------------------------
+  for (i = 0; i < this->sources.size(); i++)   // the packed textures stay where they are
+    if (this->regions[i].page == (unsigned int) -1)
+      order.push_back(i);
 
-void mesh_3d_static::add_triangle(unsigned int index1, unsigned int index2, unsigned int index3)
+  sort(order.begin(),order.end(),[this](unsigned int a, unsigned int b)   // the tallest first packs best
+    {
+      if (this->sources[a]->get_height() != this->sources[b]->get_height())
+        return this->sources[a]->get_height() > this->sources[b]->get_height();
 
-{
-  triangle_3d triangle;
+      return this->sources[a]->get_width() > this->sources[b]->get_width();
+    });
 
-  triangle.index1 = index1;
-  triangle.index2 = index2;
-  triangle.index3 = index3;
+  empty_skyline.x = 0;
+  empty_skyline.y = 0;
+  empty_skyline.width = this->page_size;
 
-  this->triangles.push_back(triangle);
-}
+  for (i = 0; i < order.size(); i++)
+    {
+      texture_2d *source = this->sources[order[i]];
+      atlas_region &region = this->regions[order[i]];
 
-//----------------------------------------------------------------------
+      region.page = (unsigned int) -1;
+      width = source->get_width() + 2 * this->padding;
+      height = source->get_height() + 2 * this->padding;
 
-void draw_pixel(unsigned int x, unsigned int y, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+      source->get_transparent_color(color,color + 1,color + 2);
+      transparent_color = source->transparency_is_enabled() ? (color[0] << 16) | (color[1] << 8) | color[2] : -1;
 
-{
-  unsigned char bytes[4];
+      if (width > this->page_size || height > this->page_size)
+        {
+          cerr << "ERROR: a texture is too big for the atlas page." << endl;
+          continue;
+        }
 
-  bytes[0] = r;
-  bytes[1] = g;
-  bytes[2] = b;
-  bytes[3] = a;
+      for (page_index = 0; page_index < this->pages.size(); page_index++)
+        if (this->page_colors[page_index] == transparent_color && this->find_position(page_index,width,height,&x,&y,&segment))
+          break;
 
-  glRasterPos2d(x / (double) global_window_width,y / (double) global_window_height);
+      if (page_index == this->pages.size())     // new page
+        {
+          texture_2d *page = new texture_2d();
+          page->initialise(this->page_size,this->page_size);
 
-  glDrawPixels(1,1,GL_RGBA,GL_UNSIGNED_BYTE,bytes);
-}
+          if (transparent_color >= 0)
+            {
+              page_color[0] = transparent_color >> 16;
+              page_color[1] = (transparent_color >> 8) & 0xff;
+              page_color[2] = transparent_color & 0xff;
+              page->set_transparent_color(page_color[0],page_color[1],page_color[2]);
+              page->set_transparency(true);
+            }
 
-//----------------------------------------------------------------------
+          this->pages.push_back(page);
+          this->skylines.push_back(vector<skyline_segment>(1,empty_skyline));
+          this->page_colors.push_back(transparent_color);
+          page_changed.push_back(false);
+          this->find_position(page_index,width,height,&x,&y,&segment);
+        }
 
-mesh_3d::~mesh_3d()
+      this->place(page_index,segment,x,y,width,height);
+      page_changed[page_index] = true;
 
-{
+      for (j = 0; j < height; j++)      // copy the pixels, the padding repeats the edge pixels
+        for (k = 0; k < width; k++)
+          {
+            source_x = min((unsigned int) max((int) k - (int) this->padding,0),source->get_width() - 1);
+            source_y = min((unsigned int) max((int) j - (int) this->padding,0),source->get_height() - 1);
+            source->get_pixel(source_x,source_y,&red,&green,&blue);
+            this->pages[page_index]->set_pixel(x + k,y + j,red,green,blue);
+          }
+
+      region.page = page_index;
+      region.x = x + this->padding;
+      region.y = y + this->padding;
+      region.width = source->get_width();
+      region.height = source->get_height();
+      region.u0 = region.x / ((float) this->page_size);
+      region.v0 = region.y / ((float) this->page_size);
+      region.u1 = (region.x + region.width) / ((float) this->page_size);
+      region.v1 = (region.y + region.height) / ((float) this->page_size);
+    }
+
+  for (i = 0; i < this->pages.size(); i++)
+    if (page_changed[i])
+      this->pages[i]->update();
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d_static::~mesh_3d_static()
+atlas_region texture_atlas::get_region(int handle)
 
 {
-  this->clear();
+  return this->regions[handle];
 }
 
 //----------------------------------------------------------------------
 
-void texture_2d::update()
+texture_2d *texture_atlas::get_page(unsigned int index)
 
 {
-  this->upload_texture_data();
+  return this->pages[index];
 }
 
 //----------------------------------------------------------------------
 
-void texture_2d::unload()
+unsigned int texture_atlas::get_page_count()
 
 {
-  if (this->to > 0)
-    glDeleteTextures(1,&this->to);
+  return this->pages.size();
 }
 
 //----------------------------------------------------------------------
 
-texture_2d::~texture_2d()
+bool texture_atlas::remap_mesh(mesh_3d_static *mesh)
 
 {
-  this->unload();
+  unsigned int i;
+  int handle = this->find_texture(mesh->get_texture());
 
-  if (this->data != NULL)
-    free(this->data);
-}
+  if (handle < 0 || this->regions[handle].page >= this->pages.size() || mesh->get_texture(2) != NULL || !mesh->make_resident())
+    return false;
 
-//----------------------------------------------------------------------
+  atlas_region &region = this->regions[handle];
 
-void normalize_vector(point_3d *vector)
+  for (i = 0; i < mesh->vertices.size(); i++)
+    if (mesh->vertices[i].texture_coordinate[0] < 0.0 || mesh->vertices[i].texture_coordinate[0] > 1.0 ||
+        mesh->vertices[i].texture_coordinate[1] < 0.0 || mesh->vertices[i].texture_coordinate[1] > 1.0)
+      return false;
 
-{
-  if (vector->x == 0 && vector->y == 0 && vector->z == 0)
+  for (i = 0; i < mesh->vertices.size(); i++)
     {
-      vector->x = 1.0;
-      vector->y = 0.0;
-      vector->z = 0.0;
-      return;
-    }
-
-  float length = vector_length(*vector);
-
-  vector->x = vector->x / length;
-  vector->y = vector->y / length;
-  vector->z = vector->z / length;
+      mesh->vertices[i].texture_coordinate[0] = region.u0 + mesh->vertices[i].texture_coordinate[0] * (region.u1 - region.u0);
+      mesh->vertices[i].texture_coordinate[1] = region.v0 + mesh->vertices[i].texture_coordinate[1] * (region.v1 - region.v0);
+    }
+
+  mesh->set_texture(this->pages[region.page]);
+  return true;
 }
 
 //----------------------------------------------------------------------
 
-float vector_length(point_3d vector)
+void texture_atlas::clear()
 
 {
-  return sqrt(vector.x * vector.x + vector.y * vector.y + vector.z * vector.z);
+  unsigned int i;
+
+  for (i = 0; i < this->pages.size(); i++)
+    delete this->pages[i];
+
+  this->pages.clear();
+  this->skylines.clear();
+  this->page_colors.clear();
+  this->sources.clear();
+  this->regions.clear();
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d_animated::mesh_3d_animated(): mesh_3d()
+scene_node::scene_node()
 
 {
-  this->playing = false;
-  this->loop = true;
-  this->interpolating = true;
-  this->play_speed = 1.0;
-  this->current_frame = 0;
-  this->instance_parent = NULL;
-  this->frame_percentage = 0.0;
+  this->position.x = 0;
+  this->position.y = 0;
+  this->position.z = 0;
+  this->rotation.x = 0;
+  this->rotation.y = 0;
+  this->rotation.z = 0;
+  this->orientation.x = 0;
+  this->orientation.y = 0;
+  this->orientation.z = 0;
+  this->orientation.w = 1;
+  this->rotation_up_to_date = true;
+  this->scale.x = 1;
+  this->scale.y = 1;
+  this->scale.z = 1;
+  this->parent = NULL;
+  this->dirty = true;
+  this->world_changed = false;
+
+  make_identity_matrix(this->local_matrix);
+  make_identity_matrix(this->world_matrix);
+
+  global_scene_nodes.push_back(this);   // a root node can go anywhere, the order stays valid
+  global_scene_nodes_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_animated::make_instance_of(mesh_3d_animated *what)
+scene_node::~scene_node()
 
 {
   unsigned int i;
-  animation_frame frame;
 
-  this->clear();
+  this->set_parent(NULL);
 
-  for (i = 0; i < what->frames.size(); i++)
+  for (i = 0; i < this->children.size(); i++)
     {
-      frame.length_ms = what->frames[i].length_ms;
-      frame.vbo = what->frames[i].vbo;
-      frame.ibo = what->frames[i].ibo;
+      this->children[i]->parent = NULL;    // the children become roots
+      this->children[i]->dirty = true;
     }
 
-  this->instance_parent = what;
+  for (i = 0; i < global_scene_nodes.size(); i++)
+    if (global_scene_nodes[i] == this)
+      {
+        global_scene_nodes.erase(global_scene_nodes.begin() + i);
+        break;
+      }
+
+  global_scene_nodes_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-picture_2d::picture_2d()
+bool scene_node::set_parent(scene_node *parent)
 
 {
-  this->picture_mesh.set_render_mode(RENDER_MODE_NO_LIGHT);
-  this->picture_mesh.add_vertex(0,0,0,0,0,0,0,1);  // z coordinate doesn't matter
-  this->picture_mesh.add_vertex(1,0,0,1,0,0,0,1);
-  this->picture_mesh.add_vertex(0,1,0,0,1,0,0,1);
-  this->picture_mesh.add_vertex(1,1,0,1,1,0,0,1);
+  scene_node *helper_node;
+  unsigned int i;
 
-  this->set_position(0,0);
-  this->set_rotation(0);
-  this->set_size(0.5,0.5);
+  if (parent == this->parent)
+    return true;
 
-  this->picture_mesh.add_triangle(0,2,1);
-  this->picture_mesh.add_triangle(1,2,3);
-}
+  for (helper_node = parent; helper_node != NULL; helper_node = helper_node->parent)
+    if (helper_node == this)
+      {
+        cerr << "ERROR: scene node can't be attached to its own descendant." << endl;
+        return false;
+      }
 
-//----------------------------------------------------------------------
+  if (this->parent != NULL)
+    for (i = 0; i < this->parent->children.size(); i++)
+      if (this->parent->children[i] == this)
+        {
+          this->parent->children.erase(this->parent->children.begin() + i);
+          break;
+        }
 
-picture_2d::~picture_2d()
+  this->parent = parent;
 
-{
+  if (parent != NULL)
+    parent->children.push_back(this);
+
+  this->dirty = true;
+  global_scene_nodes_sorted = false;
+  global_scene_nodes_changed = true;
+
+  return true;
 }
 
 //----------------------------------------------------------------------
 
-void picture_2d::set_picture(texture_2d *picture)
+scene_node *scene_node::get_parent()
 
 {
-  this->picture_mesh.set_texture(picture);
-  this->update();
+  return this->parent;
 }
 
 //----------------------------------------------------------------------
 
-void picture_2d::set_position(float x, float y)
+void scene_node::set_position(float x, float y, float z)
 
 {
-  x = clamp(x,0.0,0.1) * 2 - 1.0;
-  y = clamp(y,0.0,0.1) * 2 - 1.0;
-
-  this->picture_mesh.set_position(x,y,0);
+  this->position.x = x;
+  this->position.y = y;
+  this->position.z = z;
+  this->dirty = true;
+  global_scene_nodes_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-void picture_2d::set_rotation(float degrees)
+void scene_node::set_rotation(float x, float y, float z)
 
 {
-  this->picture_mesh.set_rotation(0,0,degrees);
+  this->rotation.x = angle_to_0_360(x);
+  this->rotation.y = angle_to_0_360(y);
+  this->rotation.z = angle_to_0_360(z);
+  make_quaternion(this->rotation.x,this->rotation.y,this->rotation.z,ROTATION_ZXY,&this->orientation);
+  this->rotation_up_to_date = true;
+  this->dirty = true;
+  global_scene_nodes_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-void picture_2d::draw()
+void scene_node::set_orientation(quaternion orientation)
 
 {
-  glUniform1ui(draw_2d_location,1);
-  this->picture_mesh.draw();
-  glUniform1ui(draw_2d_location,0);
+  this->orientation = orientation;
+  this->rotation_up_to_date = false;
+  this->dirty = true;
+  global_scene_nodes_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-void picture_2d::update()
+void scene_node::get_orientation(quaternion *orientation)
 
 {
-  this->picture_mesh.update();
+  *orientation = this->orientation;
 }
 
 //----------------------------------------------------------------------
 
-void picture_2d::unload()
+void scene_node::rotate(quaternion rotation)
 
 {
-  this->picture_mesh.unload();
+  multiply_quaternions(rotation,this->orientation,&this->orientation);
+  normalize_quaternion(&this->orientation);
+  this->rotation_up_to_date = false;
+  this->dirty = true;
+  global_scene_nodes_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-void picture_2d::set_size(float width, float height)
+void scene_node::set_scale(float x, float y, float z)
 
 {
-  width = clamp(width,0.0,1.0) * 2;
-  height = clamp(height,0.0,1.0) * 2;
-
-  this->picture_mesh.set_scale(width,height,1.0);
+  this->scale.x = x;
+  this->scale.y = y;
+  this->scale.z = z;
+  this->dirty = true;
+  global_scene_nodes_changed = true;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_animated::use_interpolation(bool interpolate)
+void scene_node::get_position(point_3d *point)
 
 {
-  this->interpolating = interpolate;
+  *point = this->position;
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d_animated::~mesh_3d_animated()
+void scene_node::get_rotation(point_3d *point)
 
 {
-  this->clear();
+  if (!this->rotation_up_to_date)
+    {
+      quaternion_to_euler(this->orientation,ROTATION_ZXY,&this->rotation);
+      this->rotation_up_to_date = true;
+    }
+
+  *point = this->rotation;
 }
 
 //----------------------------------------------------------------------
 
-unsigned int mesh_3d_animated::get_number_of_frames()
+void scene_node::get_scale(point_3d *scale)
 
 {
-  return this->frames.size();
+  *scale = this->scale;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_animated::add_frame(mesh_3d_static *mesh, unsigned int length)
+void scene_node::get_world_matrix(float matrix[4][4])
 
 {
-  animation_frame frame;
-  vertex_3d vertex;
-  triangle_3d triangle;
-  unsigned int i;
-
-  frame.length_ms = length;
-  frame.vbo = 0;
-  frame.ibo = 0;
+  if (global_scene_nodes_changed)
+    update_scene_nodes();
 
-  for (i = 0; i < mesh->vertex_count(); i++)
-    {
-      vertex.position.x = mesh->vertices[i].position.x;
-      vertex.position.y = mesh->vertices[i].position.y;
-      vertex.position.z = mesh->vertices[i].position.z;
-      vertex.normal.x = mesh->vertices[i].normal.x;
-      vertex.normal.y = mesh->vertices[i].normal.y;
-      vertex.normal.z = mesh->vertices[i].normal.z;
-      vertex.texture_coordinate[0] = mesh->vertices[i].texture_coordinate[0];
-      vertex.texture_coordinate[1] = mesh->vertices[i].texture_coordinate[1];
+  memcpy(matrix,this->world_matrix,sizeof(this->world_matrix));
+}
 
-      frame.vertices.push_back(vertex);
-    }
+//----------------------------------------------------------------------
 
-  for (i = 0; i < mesh->triangle_count(); i++)
-    {
-      triangle.index1 = mesh->triangles[i].index1;
-      triangle.index2 = mesh->triangles[i].index2;
-      triangle.index3 = mesh->triangles[i].index3;
+void scene_node::get_world_position(point_3d *point)
 
-      frame.triangles.push_back(triangle);
-    }
+{
+  if (global_scene_nodes_changed)
+    update_scene_nodes();
 
-  this->frames.push_back(frame);
+  point->x = this->world_matrix[0][3];
+  point->y = this->world_matrix[1][3];
+  point->z = this->world_matrix[2][3];
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_animated::set_playing(bool play)
+unsigned int scene_node::get_number_of_children()
 
 {
-  this->playing = play;
+  return this->children.size();
 }
 
 //----------------------------------------------------------------------
 
-void keyframe_interpolator::sort()
+scene_node *scene_node::get_child(unsigned int index)
 
 {
-  unsigned int i,j;
-  keyframe helper_keyframe;
-
-  for (j = 0; j < this->keyframes.size(); j++)   // bubble sort
-    for (i = j; i < this->keyframes.size() - 1; i++)
-      if (this->keyframes[i].x > this->keyframes[i + 1].x)
-        {
-          helper_keyframe = this->keyframes[i];
-          this->keyframes[i] = this->keyframes[i + 1];
-          this->keyframes[i + 1] = helper_keyframe;
-        }
+  return this->children[index];
 }
 
 //----------------------------------------------------------------------
 
-string get_gpu_info_string()
+const float *scene_node::get_world_matrix_pointer()
 
 {
-  string result;
-
-  result = ((const char *) glGetString(GL_VENDOR));
-  result += " ";
-  result += ((const char *) glGetString(GL_VERSION));
-
-  return result;
+  return &this->world_matrix[0][0];
 }
 
 //----------------------------------------------------------------------
 
-void keyframe_interpolator::add_keyframe(float x, float y, interpolation_method interpolation)
+void scene_node::update_world_matrix()
 
 {
-  keyframe helper_keyframe;
+  unsigned int i;
 
-  helper_keyframe.x = x;
-  helper_keyframe.y = y;
-  helper_keyframe.interpolation = interpolation;
+  if (this->dirty)
+    {
+      make_quaternion_matrix(this->orientation,this->local_matrix);
 
-  this->keyframes.push_back(helper_keyframe);
-  this->sort();
+      for (i = 0; i < 3; i++)     // T * R * S, see mesh_3d::update_transformation_matrix
+        {
+          this->local_matrix[i][0] *= this->scale.x;
+          this->local_matrix[i][1] *= this->scale.y;
+          this->local_matrix[i][2] *= this->scale.z;
+        }
+
+      this->local_matrix[0][3] = this->position.x;
+      this->local_matrix[1][3] = this->position.y;
+      this->local_matrix[2][3] = this->position.z;
+    }
+
+  if (this->dirty || (this->parent != NULL && this->parent->world_changed))  // changes propagate down the tree
+    {
+      if (this->parent == NULL)
+        memcpy(this->world_matrix,this->local_matrix,sizeof(this->local_matrix));
+      else
+        multiply_matrices_affine_simd(&this->parent->world_matrix[0][0],&this->local_matrix[0][0],&this->world_matrix[0][0]);
+
+      this->world_changed = true;
+    }
+  else
+    this->world_changed = false;
+
+  this->dirty = false;
 }
 
 //----------------------------------------------------------------------
 
-float keyframe_interpolator::get_value(float x)
+void update_scene_nodes()
 
 {
-  if (this->keyframes.size() <= 1)
-    return 0.0;
+  unsigned int i,j;
 
-  unsigned int i;
+  if (!global_scene_nodes_sorted)   // depth first order: parents go before children, siblings stay close together
+    {
+      vector<scene_node *> sorted_nodes;
+      vector<scene_node *> stack;
+      scene_node *node;
 
-  for (i = 0; i < this->keyframes.size(); i++)
-    if (this->keyframes[i].x > x)
-      break;
+      sorted_nodes.reserve(global_scene_nodes.size());
 
-  if (i == 0 || i >= this->keyframes.size())
-    return 0;
+      for (i = 0; i < global_scene_nodes.size(); i++)
+        if (global_scene_nodes[i]->get_parent() == NULL)
+          {
+            stack.push_back(global_scene_nodes[i]);
+
+            while (stack.size() != 0)
+              {
+                node = stack.back();
+                stack.pop_back();
+                sorted_nodes.push_back(node);
+                for (j = node->get_number_of_children(); j > 0; j--)
+                  stack.push_back(node->get_child(j - 1));
+              }
+          }
+
+      global_scene_nodes.swap(sorted_nodes);
+      global_scene_nodes_sorted = true;
+    }
+
+  for (i = 0; i < global_scene_nodes.size(); i++)
+    global_scene_nodes[i]->update_world_matrix();
 
-  return interpolate((x - this->keyframes[i - 1].x) / (this->keyframes[i].x - this->keyframes[i - 1].x),this->keyframes[i - 1].y,this->keyframes[i].y,this->keyframes[i - 1].interpolation);
+  global_scene_nodes_changed = false;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_animated::update()
+void make_quaternion(float degrees_x, float degrees_y, float degrees_z, rotation_matrix_type type, quaternion *result)
 
 {
-  unsigned int i,j;
+  quaternion quaternion_x,quaternion_y,quaternion_z,helper;
 
-  for (i = 0; i < this->frames.size(); i++)
-    {
-      if (this->frames[i].vbo == 0)
-        {
-          glGenBuffers(1,&this->frames[i].vbo);
+  /* The engine rotates clockwise around the axes (see make_rotation_matrix),
+     so the angles are negated here. */
 
-          if (this->frames[i].vbo == 0)
-            cerr << "ERROR: VBO couldn't be allocated for the animated mesh.";
-        }
+  degrees_x *= -1 * PI_DIVIDED_180 / 2.0;
+  degrees_y *= -1 * PI_DIVIDED_180 / 2.0;
+  degrees_z *= -1 * PI_DIVIDED_180 / 2.0;
 
-      if (this->frames[i].ibo == 0)
-        {
-          glGenBuffers(1,&this->frames[i].ibo);
+  quaternion_x.x = sin(degrees_x);
+  quaternion_x.y = 0;
+  quaternion_x.z = 0;
+  quaternion_x.w = cos(degrees_x);
 
-          if (this->frames[i].ibo == 0)
-            cerr << "ERROR: IBO couldn't be allocated for the animated mesh.";
-        }
+  quaternion_y.x = 0;
+  quaternion_y.y = sin(degrees_y);
+  quaternion_y.z = 0;
+  quaternion_y.w = cos(degrees_y);
 
-      vector<vertex_3d> helper_vertices;
+  quaternion_z.x = 0;
+  quaternion_z.y = 0;
+  quaternion_z.z = sin(degrees_z);
+  quaternion_z.w = cos(degrees_z);
 
-      for (j = 0; j < this->frames[i].vertices.size(); j++)
-        {
-          helper_vertices.push_back(this->frames[i].vertices[j]);
-          helper_vertices.push_back(this->frames[(i + 1) % this->frames.size()].vertices[j]);
-        }
+  switch (type)   // the rotation applied first goes last
+    {
+      case ROTATION_XYZ:
+        multiply_quaternions(quaternion_z,quaternion_y,&helper);
+        multiply_quaternions(helper,quaternion_x,result);
+        break;
+
+      case ROTATION_ZYX:
+        multiply_quaternions(quaternion_x,quaternion_y,&helper);
+        multiply_quaternions(helper,quaternion_z,result);
+        break;
 
-      glBindBuffer(GL_ARRAY_BUFFER,this->frames[i].vbo);
-      glBufferData(GL_ARRAY_BUFFER,helper_vertices.size() * sizeof(vertex_3d),&helper_vertices[0],GL_STATIC_DRAW);
+      case ROTATION_ZXY:
+        multiply_quaternions(quaternion_y,quaternion_x,&helper);
+        multiply_quaternions(helper,quaternion_z,result);
+        break;
 
-      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,this->frames[i].ibo);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER,this->frames[i].triangles.size() * sizeof(triangle_3d),&this->frames[i].triangles[0],GL_STATIC_DRAW);
+      case ROTATION_YXZ:
+        multiply_quaternions(quaternion_z,quaternion_x,&helper);
+        multiply_quaternions(helper,quaternion_y,result);
+        break;
     }
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d::set_visibility(bool visible)
+void make_quaternion_axis_angle(point_3d axis, float degrees, quaternion *result)
 
 {
-  this->visible = visible;
+  float sin_half;
+
+  normalize_vector(&axis);
+
+  degrees *= -1 * PI_DIVIDED_180 / 2.0;
+  sin_half = sin(degrees);
+
+  result->x = axis.x * sin_half;
+  result->y = axis.y * sin_half;
+  result->z = axis.z * sin_half;
+  result->w = cos(degrees);
 }
 
 //----------------------------------------------------------------------
 
-bool mesh_3d::get_visibility()
+void multiply_quaternions(quaternion quaternion1, quaternion quaternion2, quaternion *result)
 
 {
-  return this->visible;
+  result->x = quaternion1.w * quaternion2.x + quaternion1.x * quaternion2.w + quaternion1.y * quaternion2.z - quaternion1.z * quaternion2.y;
+  result->y = quaternion1.w * quaternion2.y - quaternion1.x * quaternion2.z + quaternion1.y * quaternion2.w + quaternion1.z * quaternion2.x;
+  result->z = quaternion1.w * quaternion2.z + quaternion1.x * quaternion2.y - quaternion1.y * quaternion2.x + quaternion1.z * quaternion2.w;
+  result->w = quaternion1.w * quaternion2.w - quaternion1.x * quaternion2.x - quaternion1.y * quaternion2.y - quaternion1.z * quaternion2.z;
 }
 
 //----------------------------------------------------------------------
 
-mesh_3d_lod::mesh_3d_lod(bool use_this_mesh_properties, bool keep_everything_on_gpu)
+void normalize_quaternion(quaternion *what)
 
 {
-  this->active_level = -1;
-  this->use_this_mesh_properties = use_this_mesh_properties;
-  this->keep_everything_on_gpu = keep_everything_on_gpu;
+  float length = sqrt(what->x * what->x + what->y * what->y + what->z * what->z + what->w * what->w);
+
+  if (length == 0)
+    {
+      what->x = 0;
+      what->y = 0;
+      what->z = 0;
+      what->w = 1;
+      return;
+    }
+
+  what->x /= length;
+  what->y /= length;
+  what->z /= length;
+  what->w /= length;
 }
 
 //----------------------------------------------------------------------
 
-int mesh_3d_lod::get_current_detail_level()
+void interpolate_quaternions(float ratio, quaternion quaternion1, quaternion quaternion2, quaternion *result)
 
 {
-  return this->active_level;
+  float cos_angle,angle,sin_angle,ratio1,ratio2;
+
+  cos_angle = quaternion1.x * quaternion2.x + quaternion1.y * quaternion2.y + quaternion1.z * quaternion2.z + quaternion1.w * quaternion2.w;
+
+  if (cos_angle < 0)    // go the shorter way around
+    {
+      cos_angle *= -1;
+      quaternion2.x *= -1;
+      quaternion2.y *= -1;
+      quaternion2.z *= -1;
+      quaternion2.w *= -1;
+    }
+
+  if (cos_angle > 0.9995)     // nearly the same rotations, linear interpolation is precise enough
+    {
+      ratio1 = 1.0 - ratio;
+      ratio2 = ratio;
+    }
+  else
+    {
+      angle = acos(cos_angle);
+      sin_angle = sin(angle);
+      ratio1 = sin((1.0 - ratio) * angle) / sin_angle;
+      ratio2 = sin(ratio * angle) / sin_angle;
+    }
+
+  result->x = ratio1 * quaternion1.x + ratio2 * quaternion2.x;
+  result->y = ratio1 * quaternion1.y + ratio2 * quaternion2.y;
+  result->z = ratio1 * quaternion1.z + ratio2 * quaternion2.z;
+  result->w = ratio1 * quaternion1.w + ratio2 * quaternion2.w;
+
+  normalize_quaternion(result);
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_lod::add_detail_mesh(mesh_3d_static *mesh, float distance)
+void make_quaternion_matrix(quaternion rotation, float matrix[4][4])
 
 {
-  detail_level detail;
+  float xx = rotation.x * rotation.x, yy = rotation.y * rotation.y, zz = rotation.z * rotation.z;
+  float xy = rotation.x * rotation.y, xz = rotation.x * rotation.z, yz = rotation.y * rotation.z;
+  float wx = rotation.w * rotation.x, wy = rotation.w * rotation.y, wz = rotation.w * rotation.z;
 
-  detail.mesh = mesh;
-  detail.distance_to = distance;
+  matrix[0][0] = 1 - 2 * (yy + zz);
+  matrix[0][1] = 2 * (xy - wz);
+  matrix[0][2] = 2 * (xz + wy);
+  matrix[0][3] = 0;
 
-  this->lod_meshes.push_back(detail);
-  this->update();
+  matrix[1][0] = 2 * (xy + wz);
+  matrix[1][1] = 1 - 2 * (xx + zz);
+  matrix[1][2] = 2 * (yz - wx);
+  matrix[1][3] = 0;
+
+  matrix[2][0] = 2 * (xz - wy);
+  matrix[2][1] = 2 * (yz + wx);
+  matrix[2][2] = 1 - 2 * (xx + yy);
+  matrix[2][3] = 0;
+
+  matrix[3][0] = 0;
+  matrix[3][1] = 0;
+  matrix[3][2] = 0;
+  matrix[3][3] = 1;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_lod::update()
+void quaternion_to_euler(quaternion rotation, rotation_matrix_type type, point_3d *degrees)
+
+{
+  float m[4][4];
+  float sin_angle;
+
+  make_quaternion_matrix(rotation,m);
+
+  /* The angles are read from the matrix elements that make_rotation_matrix
+     computes for given order, with the third angle set to 0 in the gimbal
+     lock. */
+
+  switch (type)
+    {
+      case ROTATION_ZXY:
+        sin_angle = clamp(m[1][2],-1.0,1.0);
+        degrees->x = asin(sin_angle);
+
+        if (fabs(sin_angle) < 0.999999)
+          {
+            degrees->y = atan2(-1 * m[0][2],m[2][2]);
+            degrees->z = atan2(-1 * m[1][0],m[1][1]);
+          }
+        else
+          {
+            degrees->y = atan2(m[2][0],m[0][0]);
+            degrees->z = 0;
+          }
+        break;
+
+      case ROTATION_YXZ:
+        sin_angle = clamp(-1 * m[2][1],-1.0,1.0);
+        degrees->x = asin(sin_angle);
+
+        if (fabs(sin_angle) < 0.999999)
+          {
+            degrees->y = atan2(m[2][0],m[2][2]);
+            degrees->z = atan2(m[0][1],m[1][1]);
+          }
+        else
+          {
+            degrees->y = atan2(-1 * m[0][2],m[0][0]);
+            degrees->z = 0;
+          }
+        break;
+
+      case ROTATION_XYZ:
+        sin_angle = clamp(m[2][0],-1.0,1.0);
+        degrees->y = asin(sin_angle);
 
-{
-  // sort the lod_meshes array by distance (index 0 ~ shortest distance):
+        if (fabs(sin_angle) < 0.999999)
+          {
+            degrees->x = atan2(-1 * m[2][1],m[2][2]);
+            degrees->z = atan2(-1 * m[1][0],m[0][0]);
+          }
+        else
+          {
+            degrees->x = atan2(m[0][1] * sin_angle,m[1][1]);
+            degrees->z = 0;
+          }
+        break;
 
-  unsigned int i,j;
-  detail_level helper;
+      case ROTATION_ZYX:
+        sin_angle = clamp(-1 * m[0][2],-1.0,1.0);
+        degrees->y = asin(sin_angle);
 
-  for (i = 0; i < this->lod_meshes.size(); i++)
-    for (j = i; j < this->lod_meshes.size() - 1; j++)
-      {
-        if (this->lod_meshes[j].distance_to > this->lod_meshes[j + 1].distance_to)
+        if (fabs(sin_angle) < 0.999999)
           {
-            helper = lod_meshes[j];
-            lod_meshes[j] = lod_meshes[j + 1];
-            lod_meshes[j + 1] = helper;
+            degrees->x = atan2(m[1][2],m[2][2]);
+            degrees->z = atan2(m[0][1],m[0][0]);
           }
-      }
+        else
+          {
+            degrees->x = atan2(m[1][0] * sin_angle,m[1][1]);
+            degrees->z = 0;
+          }
+        break;
+    }
+
+  degrees->x = angle_to_0_360(degrees->x / PI_DIVIDED_180);
+  degrees->y = angle_to_0_360(degrees->y / PI_DIVIDED_180);
+  degrees->z = angle_to_0_360(degrees->z / PI_DIVIDED_180);
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_lod::unload()
+void multiply_matrices_4x4(const matrix_4x4 *matrix_a, const matrix_4x4 *matrix_b, matrix_4x4 *matrix_result)
 
 {
+  multiply_matrices_simd(&matrix_a->m[0][0],&matrix_b->m[0][0],&matrix_result->m[0][0]);
 }
 
 //----------------------------------------------------------------------
 
-void set_mouse_visibility(bool visible)
+void multiply_matrices_affine(const matrix_4x4 *matrix_a, const matrix_4x4 *matrix_b, matrix_4x4 *matrix_result)
 
 {
-  if (visible)
-    glutSetCursor(GLUT_CURSOR_LEFT_ARROW);
-  else
-    glutSetCursor(GLUT_CURSOR_NONE);
+  multiply_matrices_affine_simd(&matrix_a->m[0][0],&matrix_b->m[0][0],&matrix_result->m[0][0]);
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_lod::clear()
+bool invert_matrix_affine(const matrix_4x4 *matrix, matrix_4x4 *matrix_result)
 
 {
-  this->active_level = -1;
-  this->lod_meshes.clear();
+  return invert_matrix_affine_simd(&matrix->m[0][0],&matrix_result->m[0][0]);
 }
 
 //----------------------------------------------------------------------
 
-void go_fullscreen()
+void multiply_vector_matrix_4x4(const vector_4d *vector, const matrix_4x4 *matrix, vector_4d *vector_result)
 
 {
-  glutFullScreen();
+  multiply_vector_matrix_simd(vector->v,&matrix->m[0][0],vector_result->v);
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_lod::draw()
+void transform_points(const matrix_4x4 *matrix, float *points, unsigned int count, unsigned int stride, float w)
 
 {
-  if (this->lod_meshes.size() == 0)
-    return;
-
-  if (global_recompute_lod)
-    {
-      double dx,dy,dz,distance;
-      int level_before = this->active_level;
-
-      dx = this->position.x - camera.position.x;
-      dy = this->position.y - camera.position.y;
-      dz = this->position.z - camera.position.z;
-      distance = sqrt(dx * dx + dy * dy + dz * dz);
-
-      this->active_level = this->lod_meshes.size() - 1;
-
-      while (true)
-        {
-          if (this->active_level < 0)
-            {
-              this->active_level = 0;
-              break;
-            }
-
-          if (distance > this->lod_meshes[this->active_level].distance_to)
-            {
-              this->active_level++;
-              break;
-            }
-
-          this->active_level--;
-        }
-
-      if (this->active_level == (int) this->lod_meshes.size())
-        {
-          this->active_level = -1;
-          return;
-        }
-
-      if (!this->keep_everything_on_gpu && level_before != this->active_level) // reupload data on GPU
-        {
-          unsigned int i;
-
-          for (i = 0; i < this->lod_meshes.size(); i++)
-            if (this->lod_meshes[i].mesh != NULL)
-              {
-                if ((int) i == this->active_level)
-                  this->lod_meshes[i].mesh->update();
-                else
-                  this->lod_meshes[i].mesh->unload();
-              }
-        }
-    }
-
-  if (this->active_level < 0)
-    return;
-
-  mesh_3d_static *mesh_to_draw = this->lod_meshes[this->active_level].mesh;
-  GLuint mesh_vbo,mesh_ibo,mesh_vao;
-
-  if (mesh_to_draw != NULL)
-    {
-      if (!this->visible)
-        return;
-
-      if (this->use_this_mesh_properties)
-        {
-          this->texture = mesh_to_draw->get_texture(1);
-          this->texture2 = mesh_to_draw->get_texture(2);
-          this->mesh_render_mode = mesh_to_draw->get_render_mode();
-        }
-
-      mesh_to_draw->get_vbo_ibo_vao(&mesh_vbo,&mesh_ibo,&mesh_vao);
-      this->init_rendering();
-      glBindVertexArray(mesh_vao);
-      glDrawElements(GL_TRIANGLES,mesh_to_draw->triangle_count() * 3,GL_UNSIGNED_INT,0);
-      glBindVertexArray(0);
-    }
+  transform_points_simd(&matrix->m[0][0],points,count,stride,w);
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_animated::clear()
+void transform_points_soa(const matrix_4x4 *matrix, float *x, float *y, float *z, unsigned int count, float w)
 
 {
-  this->unload();
-  this->frames.clear();
+  transform_points_soa_simd(&matrix->m[0][0],x,y,z,count,w);
 }
 
 //----------------------------------------------------------------------
 
-void register_mouse_function(void (*function)(int button, int state))
+job::job()
 
 {
-  user_mouse_function = function;
+  this->unfinished_dependencies = 1;
+  this->finished = false;
+  this->completed = false;
 }
 
 //----------------------------------------------------------------------
 
-texture_2d *mesh_3d::get_texture(unsigned int texture_no)
+job::job(function<void()> work): job()
 
 {
-  if (texture_no == 2)
-    return this->texture2;
-  else
-    return this->texture;
+  this->work = work;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_static::merge(mesh_3d_static *mesh)
+void init_job_system(unsigned int threads)
 
 {
   unsigned int i;
-  triangle_3d triangle;
 
-  if (mesh == this)
-    return;
+  shutdown_job_system();
 
-  for (i = 0; i < mesh->triangle_count(); i++)
-    {
-      triangle = mesh->triangles[i];
-      triangle.index1 += this->vertex_count();
-      triangle.index2 += this->vertex_count();
-      triangle.index3 += this->vertex_count();
+  if (threads == 0)
+    threads = thread::hardware_concurrency();
 
-      this->triangles.push_back(triangle);
-    }
+  if (threads < 1)
+    threads = 1;
+  else if (threads > MAX_WORKER_THREADS)
+    threads = MAX_WORKER_THREADS;
 
-  for (i = 0; i < mesh->vertices.size(); i++)
-    this->vertices.push_back(mesh->vertices[i]);
+  global_number_of_threads = threads;
+  global_thread_index = 0;
+  global_job_system_running = true;
 
-  this->update();
+  for (i = 1; i < threads; i++)
+    global_worker_threads.push_back(thread(worker_function,i));
+
+  if (!global_job_system_exit_registered)
+    {
+      atexit(shutdown_job_system);   // the threads have to be joined before the program ends
+      global_job_system_exit_registered = true;
+    }
 }
 
 //----------------------------------------------------------------------
 
-picture_2d *make_text(string text, texture_2d *font, float size, float spacing)
+void shutdown_job_system()
 
 {
-  picture_2d *result_picture;
-  mesh_3d_static *picture_mesh;
-  unsigned char character;
   unsigned int i;
-  float dx;
+  job *job_to_run;
 
-  result_picture = new picture_2d();
-  picture_mesh = result_picture->get_picture_mesh();
+  global_job_system_running = false;
+  global_job_wakeup.notify_all();
 
-  if (font == NULL)
-    result_picture->set_picture(&global_default_font);
-  else
-    result_picture->set_picture(font);
+  for (i = 0; i < global_worker_threads.size(); i++)
+    global_worker_threads[i].join();
 
-  picture_mesh->clear();
+  global_worker_threads.clear();
 
-  for (i = 0; i < text.length(); i++)
+  while (true)   // finish what's left on this thread
     {
-      character = text[i];
-      dx = 1 / 256.0;
+      job_to_run = pop_job(0);
 
-      picture_mesh->add_vertex(0   + i *  (size + spacing),0,0,      character * dx,1,       0,0,1);  // z coordinate doesn't matter
-      picture_mesh->add_vertex(size + i * (size + spacing),0,0,      character * dx + dx,1,  0,0,1);
-      picture_mesh->add_vertex(0   + i *  (size + spacing),size,0,    character * dx,0,       0,0,1);
-      picture_mesh->add_vertex(size + i * (size + spacing),size,0,    character * dx + dx,0,  0,0,1);
+      if (job_to_run == NULL)
+        break;
 
-      picture_mesh->add_triangle(0 + i * 4,2 + i * 4,1 + i * 4);
-      picture_mesh->add_triangle(1 + i * 4,2 + i * 4,3 + i * 4);
+      run_job(job_to_run);
     }
 
-  result_picture->update();
-
-  return result_picture;
+  global_number_of_threads = 1;
 }
 
 //----------------------------------------------------------------------
 
-void render_loop()
+unsigned int get_number_of_threads()
 
 {
-  glutMainLoop();
+  return global_number_of_threads;
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_animated::set_speed(float speed)
+void add_job_dependency(job *what, job *depends_on)
 
 {
-  this->play_speed = speed;
+  lock_guard<mutex> lock(depends_on->continuations_mutex);
+
+  if (depends_on->completed)   // already done, nothing to wait for
+    return;
+
+  what->unfinished_dependencies++;
+  depends_on->continuations.push_back(what);
 }
 
 //----------------------------------------------------------------------
 
-void get_mouse_position(int *x, int *y)
+void submit_job(job *what)
 
 {
-  *x = global_mouse_position[0];
-  *y = global_mouse_position[1];
+  if (--what->unfinished_dependencies == 0)
+    push_job(what);
 }
 
 //----------------------------------------------------------------------
 
-float interpolate(float ratio, float value1, float value2, interpolation_method method)
+void wait_for_job(job *what)
 
 {
-  clamp(ratio,0.0,1.0);
+  job *job_to_run;
 
-  switch (method)
+  while (!what->finished)
     {
-      case INTERPOLATION_LINEAR:
-        return ratio * value2 + (1.0 - ratio) * value1;
-        break;
-
-      case INTERPOLATION_SINE:
-        ratio = cos(ratio * PI) * 0.5 + 0.5;
+      job_to_run = pop_job(global_thread_index < global_number_of_threads ? global_thread_index : 0);
 
-        return ratio * value1 + (1.0 - ratio) * value2;
-        break;
-
-      default:
-        return value1;
-        break;
+      if (job_to_run != NULL)
+        run_job(job_to_run);
+      else
+        this_thread::yield();
     }
 }
 
 //----------------------------------------------------------------------
 
-void mesh_3d_animated::draw()
+void parallel_for(unsigned int count, function<void(unsigned int from, unsigned int to)> body, unsigned int min_batch)
 
 {
-  unsigned int number_of_frames;
-  unsigned int frame_length;
-  unsigned int number_of_triangles;
-  GLuint effective_vbo,effective_ibo;
-
-  if (!this->visible)
-    return;
-
-  if (this->instance_parent == NULL)
-    {
-      number_of_triangles = this->frames[this->current_frame].triangles.size();
-      number_of_frames = this->frames.size();
-      frame_length = this->frames[this->current_frame].length_ms;
-    }
-  else
-    {
-      number_of_triangles = this->instance_parent->frames[this->current_frame].triangles.size();
-      number_of_frames = this->instance_parent->frames.size();
-      frame_length = this->instance_parent->frames[this->current_frame].length_ms;
-    }
+  unsigned int i,batches;
+  job *jobs;
 
-  if (number_of_frames == 0)
+  if (count == 0)
     return;
 
-  this->frame_percentage += this->play_speed * (get_frame_time_difference() / ((float) frame_length));
-
-  while (this->frame_percentage > 1.0)
-    {
-      this->current_frame++;
-      this->frame_percentage -= 1.0;
-
-      if (this->current_frame >= (int) number_of_frames)
-        {
-          this->current_frame = 0;
+  batches = count / (min_batch < 1 ? 1 : min_batch);
 
-          if (!this->loop)
-            {
-              this->set_playing(false);
-              this->frame_percentage = 0.0;
-              break;
-            }
-        }
-    }
+  if (batches > global_number_of_threads * 4)  // a few batches per thread so that stealing can balance the load
+    batches = global_number_of_threads * 4;
 
-  while (this->frame_percentage < 0.0)
+  if (global_number_of_threads <= 1 || batches <= 1)
     {
-      this->current_frame--;
-      this->frame_percentage += 1.0;
-
-      if (this->current_frame < 0)
-        {
-          this->current_frame = number_of_frames - 1;
-
-          if (!this->loop)
-            {
-              this->set_playing(false);
-              this->frame_percentage = 0.0;
-              break;
-            }
-        }
+      body(0,count);
+      return;
     }
 
-  this->init_rendering();
-  glUniform1f(frame_percentage_location,(GLfloat) (this->interpolating ? this->frame_percentage : 0.0));
-
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
-  glEnableVertexAttribArray(2);
-  glEnableVertexAttribArray(3);
-  glEnableVertexAttribArray(4);
-  glEnableVertexAttribArray(5);
-  glEnableVertexAttribArray(6);
-  glEnableVertexAttribArray(7);
+  jobs = new job[batches];
 
-  if (this->instance_parent == NULL)
-    {
-      effective_vbo = this->frames[this->current_frame].vbo;
-      effective_ibo = this->frames[this->current_frame].ibo;
-    }
-  else
+  for (i = 0; i < batches; i++)
     {
-      effective_vbo = this->instance_parent->frames[this->current_frame].vbo;
-      effective_ibo = this->instance_parent->frames[this->current_frame].ibo;
-    }
+      unsigned int from = (unsigned int) (count * (unsigned long long) i / batches);
+      unsigned int to = (unsigned int) (count * (unsigned long long) (i + 1) / batches);
 
-  glBindBuffer(GL_ARRAY_BUFFER,effective_vbo);
-  glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d) * 2,0);                   // position
-  glVertexAttribPointer(1,2,GL_FLOAT,GL_FALSE,sizeof(vertex_3d) * 2,(const GLvoid*) 12);  // texture coordinate
-  glVertexAttribPointer(2,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d) * 2,(const GLvoid*) 20);  // normal
-  glVertexAttribPointer(3,1,GL_FLOAT,GL_FALSE,sizeof(vertex_3d) * 2,(const GLvoid*) 32);  // texture blend ratio
-  glVertexAttribPointer(4,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d) * 2,(const GLvoid*) 36);  // position2
-  glVertexAttribPointer(5,2,GL_FLOAT,GL_FALSE,sizeof(vertex_3d) * 2,(const GLvoid*) 48);  // texture coordinate2
-  glVertexAttribPointer(6,3,GL_FLOAT,GL_FALSE,sizeof(vertex_3d) * 2,(const GLvoid*) 56);  // normal2
-  glVertexAttribPointer(7,1,GL_FLOAT,GL_FALSE,sizeof(vertex_3d) * 2,(const GLvoid*) 68);  // texture blend ratio2
-
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,effective_ibo);
+      jobs[i].work = [&body,from,to]{ body(from,to); };
+      submit_job(&jobs[i]);
+    }
 
-  if (effective_ibo != 0)
-    glDrawElements(GL_TRIANGLES,number_of_triangles * 3,GL_UNSIGNED_INT,0);
+  for (i = 0; i < batches; i++)
+    wait_for_job(&jobs[i]);
 
-  glDisableVertexAttribArray(0);
-  glDisableVertexAttribArray(1);
-  glDisableVertexAttribArray(2);
-  glDisableVertexAttribArray(3);
-  glDisableVertexAttribArray(4);
-  glDisableVertexAttribArray(5);
-  glDisableVertexAttribArray(6);
-  glDisableVertexAttribArray(7);
+  delete[] jobs;
 }
 
 //----------------------------------------------------------------------
@@ -5565,6 +15673,7 @@ void init_opengl(int *argc_pointer, char** argv, unsigned int window_width, unsi
   global_far = 100;
 
   user_render_function = draw_function;
+  init_job_system();
   glutInit(argc_pointer,argv);
   glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
   glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE,GLUT_ACTION_GLUTMAINLOOP_RETURNS);
@@ -5583,6 +15692,7 @@ void init_opengl(int *argc_pointer, char** argv, unsigned int window_width, unsi
   glutSetOption(GLUT_ACTION_ON_WINDOW_CLOSE,GLUT_ACTION_CONTINUE_EXECUTION);
   glClearColor(0.0f,0.0f,0.0f,0.0f);
   glewInit();
+  global_multi_draw_indirect = multi_draw_indirect_is_supported();
   glFrontFace(GL_CW);
   glCullFace(GL_BACK);
   glEnable(GL_CULL_FACE);
@@ -5591,9 +15701,6 @@ void init_opengl(int *argc_pointer, char** argv, unsigned int window_width, unsi
   set_perspective(global_fov,global_near,global_far);
   camera.set_position(0,0,0);
   camera.set_rotation(0,0,0);
-  glUniform1i(texture_unit_location,0);    // we'll always be using the unit 0 for the first texture layer
-  glUniform1i(texture2_unit_location,1);   // 1 for the second texture layer
-  glUniform1ui(draw_2d_location,0);
 
   point_3d light_direction;
 